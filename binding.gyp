@@ -1,12 +1,26 @@
 {
+  "variables": {
+    "rpi_stats%": 1,
+    "rpi_trace%": 1
+  },
   "targets": [
     {
       "target_name": "node_rpi",
       "include_dirs": [ "<!(node -e \"require('nan')\")" ],
       "sources": [
         "src/rpi.c", 
+        "src/stats.c", 
+        "src/trace.c", 
+        "src/rt.c", 
+        "src/ring.c", 
+        "src/poller.c", 
+        "src/sampler.c", 
+        "src/regmap.c", 
+        "src/kdev.c", 
         "src/node_rpi.cc", 
       ],
+      "defines": [ "RPI_STATS=<(rpi_stats)", "RPI_TRACE=<(rpi_trace)" ],
+      "libraries": [ "-lrt", "-lpthread" ],
       "cflags": [ "-Wno-cast-function-type" ],
     }
   ]
@@ -10,7 +10,16 @@
 const rpi = require('./rpi.js');
 const i2c = require('./i2c.js');
 const spi = require('./spi.js');
+const AuxSPI = require('./aux-spi.js');
+const SoftSPI = require('./soft-spi.js');
+const SoftI2C = require('./soft-i2c.js');
+const KernelI2C = require('./kernel-i2c.js');
+const KernelSPI = require('./kernel-spi.js');
 const pwm = require('./pwm.js');
+const Ring = require('./ring.js');
+const Poller = require('./poller.js');
+const Sampler = require('./sampler.js');
+const BufferPool = require('./buffer-pool.js');
 const GpioInput = require('./gpio-input.js');
 const GpioOutput = require('./gpio-output.js');
 
@@ -34,6 +43,28 @@ function endTime(m){
 	}
 }
 
+/* i2c object of startI2C()/createI2C(), options { backend:'kernel', bus } use /dev/i2c-<bus> */
+function newI2C(ps){
+	if(ps !== null && typeof ps === 'object'){
+		if(ps.backend === 'kernel'){
+			return new KernelI2C(ps.bus);
+		}
+		ps = ps.bus;
+	}
+	return new i2c(ps === 0 ? 0 : 1);
+}
+
+/* spi object of startSPI()/createSPI(), options { backend:'kernel', bus, cs } use /dev/spidev<bus>.<cs> */
+function newSPI(bus){
+	if(bus !== null && typeof bus === 'object'){
+		if(bus.backend === 'kernel'){
+			return new KernelSPI(bus.bus, bus.cs);
+		}
+		bus = bus.bus;
+	}
+	return bus === 1 || bus === 2 ? new AuxSPI(bus, 1) : new spi(1);
+}
+
 function findDuplicatePins(arr) {
   	let dup = arr.filter((item, index) => arr.indexOf(item) !== index);
     	if(dup[0]){
@@ -196,6 +227,103 @@ unwatchInput(){
 	}	
 }
 	
+/*********************
+
+   Native counters
+
+ *********************/
+// returns a Float64Array of the native hot-path counters, see statsLayout()
+stats () {
+	return rpi.stats();
+}
+
+// returns the counters as { gpio:{ ops:n, ... }, pwm:{...}, i2c:{...}, spi:{...}, timer:{...} }
+statsObject () {
+	let data = rpi.stats(), layout = rpi.stats_layout(), result = {};
+	let n = layout.counters.length;
+	layout.subsystems.forEach((s, x) => {
+		result[s] = {};
+		layout.counters.forEach((c, y) => {
+			result[s][c] = data[x * n + y];
+		});
+	});
+	return result;
+}
+
+statsLayout () {
+	return rpi.stats_layout();
+}
+
+resetStats () {
+	rpi.stats_reset();
+}
+
+// e.g. r.setBusWait({ adaptive:false }) spins in the i2c/spi transfers instead of sleeping
+setBusWait (options) {
+	let o = options === undefined ? {} : options;
+	rpi.bus_wait(o.adaptive === undefined ? true : o.adaptive, o.minSleep || 0);
+}
+
+// e.g. r.exportStats('/array-gpio-stats'), an external sampler can read /dev/shm/array-gpio-stats
+exportStats (name) {
+	return rpi.stats_export(name === undefined ? '' : name);
+}
+
+/*********************
+
+   Native trace
+
+ *********************/
+// size - no. of trace records kept per native thread (default 16384)
+startTrace (size) {
+	rpi.trace_start(size === undefined ? 0 : size);
+}
+
+stopTrace () {
+	rpi.trace_stop();
+}
+
+clearTrace () {
+	rpi.trace_clear();
+}
+
+// writes a chrome://tracing or ui.perfetto.dev json file, returns the no. of events
+dumpTrace (path) {
+	return rpi.trace_dump(path);
+}
+
+/*********************
+
+   Real-time profile
+
+ *********************/
+/* Configure how the latency-critical native engine threads run
+ *
+ * options = { priority:n, cpu:n|'isolated', mlock:bool, prefault:bytes, spin:bool, self:bool }
+ *
+ * priority - SCHED_FIFO priority 1~99 (0 = default scheduler)
+ * cpu      - cpu affinity, 'isolated' picks the first isolated core (isolcpus=)
+ * mlock    - lock all process memory pages
+ * prefault - stack bytes to pre-fault in each engine thread
+ * spin     - engine threads busy-wait instead of sleeping
+ * self     - apply the profile to the calling thread too
+ *
+ * Settings w/o sufficient privileges are skipped, returns the settings actually applied.
+ */
+setRealtime (options) {
+	let o = options === undefined ? {} : options;
+	let cpu = o.cpu === 'isolated' ? -2 : (o.cpu === undefined ? -1 : o.cpu);
+	rpi.rt_profile(o.priority || 0, cpu, o.mlock ? 1 : 0, o.prefault || 0, o.spin ? 1 : 0);
+	if(o.self){
+		rpi.rt_apply();
+	}
+	return rpi.rt_status();
+}
+
+realtimeStatus () {
+	return rpi.rt_status();
+}
+
 /***********
 
     GPIO
@@ -246,16 +374,18 @@ startPWM(pin, freq, T, pw){
 I2C = i2c;
 
 // w/o new  e.g let i2c = r.I2C(pin_select)
+// pin_select 0 = BSC0 (pin 27/28), 1 = BSC1 (pin 3/5), both buses can be used at the same time
 I2C(pin_select) { 
  	return new i2c(pin_select); 
 }
 
+// e.g let i2c = r.startI2C({ backend:'kernel', bus:1 }) uses the kernel driver (/dev/i2c-1)
 startI2C(pin_select) {
- 	return new i2c(1);
+ 	return newI2C(pin_select);
 }
 	
 createI2C(pinSet) {
- 	return new I2C(1);
+ 	return newI2C(pinSet);
 }
 
 /*********
@@ -277,12 +407,89 @@ setSPI() {
 	return new spi(); 
 }
 	
-startSPI() {
-	return new spi(1); 
+// bus 1 or 2 starts the AUX mini spi SPI1 or SPI2
+// e.g let spi = r.startSPI({ backend:'kernel', bus:0, cs:0 }) uses the kernel driver (/dev/spidev0.0)
+startSPI(bus) {
+	return newSPI(bus);
 }
 
-createSPI() {
-	return new spi(1); 
+createSPI(bus) {
+	return newSPI(bus);
+}
+
+/*********
+
+   Kernel driver I2C and SPI (i2c-dev, spidev)
+
+ *********/
+KernelI2C = KernelI2C;
+KernelSPI = KernelSPI;
+
+/*********
+
+   Software (bit-banged) SPI and I2C
+
+ *********/
+// e.g let spi = r.createSoftSPI({ sclk:29, mosi:31, miso:33, cs:35, freq:1000000 })
+SoftSPI = SoftSPI;
+
+createSoftSPI(options) {
+	return new SoftSPI(options);
+}
+
+// e.g let i2c = r.createSoftI2C({ scl:16, sda:18, speed:400000 })
+SoftI2C = SoftI2C;
+
+createSoftI2C(options) {
+	return new SoftI2C(options);
+}
+
+/*********
+
+   I2C sensor polling
+
+ *********/
+// e.g let poller = r.createPoller({ slots:32, dataSize:32 })
+Poller = Poller;
+
+createPoller(options) {
+	return new Poller(options);
+}
+
+/*********
+
+   SPI adc sampling
+
+ *********/
+// e.g let sampler = r.createSampler({ adc:'mcp3008', channels:[0, 1], rate:50000 })
+Sampler = Sampler;
+
+createSampler(options) {
+	return new Sampler(options);
+}
+
+/*********
+
+   Registered transfer buffers
+
+ *********/
+// e.g let pool = r.createBufferPool(); let id = pool.register(4096)
+BufferPool = BufferPool;
+
+createBufferPool() {
+	return new BufferPool();
+}
+
+/*********
+
+   Bus transaction rings
+
+ *********/
+// e.g let ring = r.createRing('i2c', { entries:64, dataSize:4096, onComplete:(id, status, len, ns) => {} })
+Ring = Ring;
+
+createRing(bus, options) {
+	return new Ring(bus, options);
 }
 
 pinout = rpi.pinout;
@@ -0,0 +1,109 @@
+/*!
+ * array-gpio/aux-spi.js
+ *
+ * Copyright(c) 2017 Ed Alegrid
+ * MIT Licensed
+ */
+
+'use strict';
+
+const rpi = require('./rpi.js');
+
+/* AUX mini SPI controller, bus 1 (SPI1, GPIO 16 ~ 21) or 2 (SPI2, GPIO 40 ~ 45)
+ *
+ * Each controller has its own registers and lock, so transfers on SPI0, SPI1 and SPI2
+ * run in parallel (async transfers of each bus are queued separately).
+ */
+class AuxSPI {
+
+#bus = 1;
+#init = 0;
+#div = 128;
+#mode = 0;
+#cs = 0;
+
+constructor(bus, s){
+	if(bus !== 1 && bus !== 2){
+		throw new Error('Invalid aux spi bus ' + bus + ', use 1 or 2');
+	}
+	this.#bus = bus;
+	if(s === 1){
+		this.begin();
+	}
+}
+
+#apply(){
+	if(this.#init){
+		rpi.aux_spi_set(this.#bus, this.#div, this.#mode, this.#cs);
+	}
+}
+
+get bus(){
+	return this.#bus;
+}
+
+begin(){
+	rpi.aux_spi_start(this.#bus);
+	this.#init = 1;
+	this.#apply();
+}
+
+/* SCLK = core clock / div, div is rounded to an even value (2 ~ 8192) */
+setClockFreq(div){
+	this.#div = div;
+	this.#apply();
+}
+
+/* mode 0 ~ 3, the mini SPI has no clock phase setting (modes 1 and 3 use the opposite clock edges) */
+setDataMode(mode){
+	this.#mode = mode;
+	this.#apply();
+}
+
+/* chip select 0 ~ 2 (CE0 GPIO 18/43, CE1 GPIO 17/44, CE2 GPIO 16/45), active low */
+chipSelect(cs){
+	this.#cs = cs;
+	this.#apply();
+}
+
+/* full-duplex transfer of len bytes, wbuf or rbuf can be null */
+dataTransfer(wbuf, rbuf, len){
+	if(this.#init){
+		return rpi.aux_spi_transfer(this.#bus, wbuf, rbuf, len === undefined ? (wbuf || rbuf).length : len);
+	}
+}
+
+write(wbuf, len){
+	return this.dataTransfer(wbuf, null, len);
+}
+
+read(rbuf, len){
+	return this.dataTransfer(null, rbuf, len);
+}
+
+/* async versions, returns a promise that resolves after the transfer is completed in a worker thread */
+dataTransferAsync(wbuf, rbuf, len){
+	if(this.#init){
+		return rpi.aux_spi_transfer_async(this.#bus, wbuf, rbuf, len);
+	}
+	return Promise.reject(new Error('SPI' + this.#bus + ' is not started'));
+}
+
+writeAsync(wbuf, len){
+	return this.dataTransferAsync(wbuf, null, len);
+}
+
+readAsync(rbuf, len){
+	return this.dataTransferAsync(null, rbuf, len);
+}
+
+end(){
+	if(this.#init){
+		rpi.aux_spi_stop(this.#bus);
+		this.#init = 0;
+	}
+}
+
+}
+
+module.exports = AuxSPI;
@@ -0,0 +1,63 @@
+/*!
+ * array-gpio/buffer-pool.js
+ *
+ * Copyright(c) 2017 Ed Alegrid
+ * MIT Licensed
+ */
+
+'use strict';
+
+const rpi = require('./rpi.js');
+
+/* Buffers registered once with the native side
+ *
+ * The *Buf transfer methods (i2c.readBuf(), spi.transferBuf(), ...) address a registered buffer
+ * by (id, offset, length), so a transfer passes integers only: no Buffer allocation and
+ * no object conversion per call.
+ */
+class BufferPool {
+
+#bufs = new Map();
+
+/* Register an ArrayBuffer, a SharedArrayBuffer or a new ArrayBuffer of size bytes, returns the buffer id */
+register(b){
+	let ab = typeof b === 'number' ? new ArrayBuffer(b) : b;
+
+	if(!(ab instanceof ArrayBuffer) && !(ab instanceof SharedArrayBuffer)){
+		throw new TypeError('ArrayBuffer, SharedArrayBuffer or size required');
+	}
+
+	let id = rpi.buf_register(ab);
+	if(id < 0){
+		throw new Error('Buffer pool is full');
+	}
+	this.#bufs.set(id, Buffer.from(ab));
+
+	return id;
+}
+
+/* Buffer view of a registered buffer */
+buffer(id){
+	let buf = this.#bufs.get(id);
+	if(buf === undefined){
+		throw new Error('Invalid buffer id ' + id);
+	}
+	return buf;
+}
+
+unregister(id){
+	if(this.#bufs.delete(id)){
+		rpi.buf_unregister(id);
+	}
+}
+
+close(){
+	for(let id of this.#bufs.keys()){
+		rpi.buf_unregister(id);
+	}
+	this.#bufs.clear();
+}
+
+}
+
+module.exports = BufferPool;
@@ -0,0 +1,245 @@
+/*!
+ * array-gpio/i2c-device.js
+ *
+ * Copyright(c) 2017 Ed Alegrid
+ * MIT Licensed
+ */
+
+'use strict';
+
+const rpi = require('./rpi.js');
+const RegMap = require('./regmap.js');
+
+/* Slave device handle, created with i2c.device(addr, options)
+ *
+ * Each transfer selects the device first, the controller address register
+ * is only written when a different device was used before, and no probe
+ * write is sent to the device (use probe() to check if it is present).
+ */
+class I2CDevice {
+
+#bus = 1;
+#addr = 0;
+
+// write-combining
+#combine = false;
+#inc = 0;
+#pending = [];
+#scheduled = false;
+#batch = 0;
+#status = 0;
+
+/* options = { speed, combine, autoIncrement }
+ * speed         - bus speed used with this device (default bus speed)
+ * combine       - merge register writes, see setCombining()
+ * autoIncrement - bits or-ed to the register address of merged writes (default 0)
+ */
+constructor(bus, addr, options){
+	let o = options === undefined ? {} : options;
+
+	if(!Number.isInteger(addr) || addr < 0 || addr > 0x7f){
+		throw new Error('Invalid i2c slave address ' + addr);
+	}
+	this.#bus = bus;
+	this.#addr = addr;
+
+	if(o.speed){
+		this.setSpeed(o.speed);
+	}
+	if(o.combine){
+		this.setCombining(true, o.autoIncrement);
+	}
+}
+
+#select(){
+	this.flush();
+	rpi.i2c_use(this.#bus);
+	rpi.i2c_set_slave_address(this.#addr);
+}
+
+/* Queue a register write [reg, data...], appended to the previous write if it continues at the next register */
+#queue(buf, len){
+	let last = this.#pending[this.#pending.length - 1];
+	let data = Buffer.from(buf.subarray(1, len));
+
+	if(last !== undefined && last.reg + last.len === buf[0]){
+		last.data.push(data);
+		last.len += data.length;
+	}
+	else{
+		this.#pending.push({ reg:buf[0], len:data.length, data:[data] });
+	}
+
+	if(!this.#scheduled && this.#batch === 0){
+		this.#scheduled = true;
+		process.nextTick(() => this.flush());
+	}
+}
+
+/* Merge register writes to adjacent registers into one burst transaction.
+ * Writes of at least one data byte ([reg, data...]) are queued and sent at the end of the current tick,
+ * at the end of a batch(), or before any other transfer of the device (in order).
+ * Queued writes return 0, a failed burst is kept in the status property.
+ */
+setCombining(on, autoIncrement){
+	if(!on){
+		this.flush();
+	}
+	this.#combine = !!on;
+	this.#inc = autoIncrement || 0;
+}
+
+/* Run fn with write-combining and send the merged writes when it returns, returns the flush status.
+ * If fn throws, the writes queued before the exception are still sent (as they would be w/o combining).
+ */
+batch(fn){
+	let status = 0;
+
+	this.#batch++;
+	try{
+		fn(this);
+	}
+	finally{
+		this.#batch--;
+		if(this.#batch === 0){
+			status = this.flush();
+		}
+	}
+	return status;
+}
+
+/* Send the queued writes in one native call, returns the status of the first failed burst (0 ok) */
+flush(){
+	this.#scheduled = false;
+	if(this.#pending.length === 0){
+		return 0;
+	}
+
+	let msgs = this.#pending.map((w) => {
+		let buf = Buffer.concat([Buffer.from([w.len > 1 ? w.reg | this.#inc : w.reg])].concat(w.data));
+		return { buf:buf };
+	});
+	this.#pending = [];
+
+	rpi.i2c_use(this.#bus);
+	let status = rpi.i2c_transfer(msgs, this.#addr).find((s) => s !== 0) || 0;
+	if(status && this.#status === 0){
+		this.#status = status;
+	}
+	return status;
+}
+
+/* first error status of the combined writes since the last clearStatus() (0 ok) */
+get status(){
+	return this.#status;
+}
+
+clearStatus(){
+	this.#status = 0;
+}
+
+/* bus speed used with this device, 0 = bus speed, returns the achieved rate */
+setSpeed(baud){
+	rpi.i2c_use(this.#bus);
+	return rpi.i2c_set_device_speed(this.#addr, baud);
+}
+
+/* returns 0 if the device acknowledges its address */
+probe(){
+	this.flush();
+	rpi.i2c_use(this.#bus);
+	return rpi.i2c_probe(this.#addr);
+}
+
+read(buf, len){
+	this.#select();
+	return rpi.i2c_read(buf, len);
+}
+
+write(buf, len){
+	if(len === undefined){
+		len = buf.length;
+	}
+	if((this.#combine || this.#batch) && len > 1 && len <= buf.length){
+		this.#queue(buf, len);
+		return 0;
+	}
+	this.#select();
+	return rpi.i2c_write(buf, len);
+}
+
+writeRead(wbuf, wlen, rbuf, rlen){
+	this.#select();
+	return rpi.i2c_write_read(wbuf, wlen, rbuf, rlen);
+}
+
+/* registered buffers (id, offset, length), see i2c.readBuf() */
+readBuf(id, off, len){
+	this.#select();
+	return rpi.i2c_read_buf(id, off, len);
+}
+
+writeBuf(id, off, len){
+	this.#select();
+	return rpi.i2c_write_buf(id, off, len);
+}
+
+writeReadBuf(wid, woff, wlen, rid, roff, rlen){
+	this.#select();
+	return rpi.i2c_write_read_buf(wid, woff, wlen, rid, roff, rlen);
+}
+
+/* array of messages { read, nostop, buf, offset, length } to this device, see i2c.transfer() */
+transfer(msgs){
+	this.flush();
+	rpi.i2c_use(this.#bus);
+	return rpi.i2c_transfer(msgs, this.#addr);
+}
+
+/* async versions, the device is selected in the worker thread together with the transfer */
+probeAsync(){
+	this.flush();
+	rpi.i2c_use(this.#bus);
+	return rpi.i2c_probe_async(this.#addr);
+}
+
+readAsync(buf, len){
+	this.flush();
+	rpi.i2c_use(this.#bus);
+	return rpi.i2c_read_async(buf, len, this.#addr);
+}
+
+writeAsync(buf, len){
+	this.flush();
+	rpi.i2c_use(this.#bus);
+	return rpi.i2c_write_async(buf, len, this.#addr);
+}
+
+writeReadAsync(wbuf, wlen, rbuf, rlen){
+	this.flush();
+	rpi.i2c_use(this.#bus);
+	return rpi.i2c_write_read_async(wbuf, wlen, rbuf, rlen, this.#addr);
+}
+
+transferAsync(msgs){
+	this.flush();
+	rpi.i2c_use(this.#bus);
+	return rpi.i2c_transfer_async(msgs, this.#addr);
+}
+
+/* register-map cache of this device, options = { size, volatile, autoIncrement } */
+regmap(options){
+	return new RegMap(this.#bus, this.#addr, options);
+}
+
+get address(){
+	return this.#addr;
+}
+
+get bus(){
+	return this.#bus;
+}
+
+}
+
+module.exports = I2CDevice;
@@ -8,13 +8,42 @@
 'use strict';
 
 const rpi = require('./rpi.js');
+const I2CDevice = require('./i2c-device.js');
 
-// 0 - SDA0 (GPIO 00/pin 27) and SCL0 (GPIO 01/pin 28) (disabled)
+// 0 - BSC0_BASE, using SDA0 (GPIO 00/pin 27) and SCL0 (GPIO 01/pin 28)
 // 1 - BSC1_BASE, using SDA1 (GPIO 02/pin 03) and SCL1 (GPIO 03/pin 05) (default)
+//
+// Each object drives its own controller, BSC0 and BSC1 objects can be used at the same time
+
+const scanModes = { auto:0, quick:1, read:2 };
+
+function scanArgs(o){
+	o = o === undefined ? {} : o;
+	if(o.mode !== undefined && scanModes[o.mode] === undefined){
+		throw new Error('Invalid i2c scan mode ' + o.mode);
+	}
+	return {
+		first:o.first === undefined ? 0x03 : o.first,
+		last:o.last === undefined ? 0x77 : o.last,
+		mode:scanModes[o.mode || 'auto'] | (o.cache ? 0x10 : 0),
+	};
+}
+
+/* addresses of the presence map */
+function scanList(map){
+	let list = [];
+	for(let addr = 0; addr < 128; addr++){
+		if(map[addr >> 3] & (1 << (addr & 7))){
+			list.push(addr);
+		}
+	}
+	return list;
+}
 
 class I2C {
 
 #init = 0;
+#bus = 1;
 
 #start(ps){
 	this.#init = 1;
@@ -22,6 +51,7 @@ class I2C {
 	        rpi.i2c_start(1);
 	}
 	else if(ps === 0 || ps === 1){
+		this.#bus = ps;
   		rpi.i2c_start(ps);
 	}
 	else{
@@ -42,44 +72,119 @@ constructor(ps){
 
 begin(){
 	this.#init = 1;
+	this.#bus = 1;
 	rpi.i2c_start(1);
 }
 
 setBaudRate(baud) {
 	if(this.#init){ 
-		rpi.i2c_set_baud_rate(baud);
-		let Baud = baud/1000;
+		rpi.i2c_use(this.#bus);
+		let Baud = rpi.i2c_set_baud_rate(baud)/1000;
 		console.log('I2C data rate: ' + Baud + ' kHz');
 	}
 }
 
 setTransferSpeed(baud) {
 	if(this.#init){
-  		rpi.i2c_set_baud_rate(baud);
-  		let Baud = baud/1000;
+  		rpi.i2c_use(this.#bus);
+  		let Baud = rpi.i2c_set_baud_rate(baud)/1000;
 		console.log('I2C data rate: ' + Baud + ' kHz');
 	}
 }
 
+/* set the bus speed (e.g. 100000, 400000, 1000000) from the actual core clock, returns the clock plan */
+setSpeed(baud) {
+	if(this.#init){
+		rpi.i2c_use(this.#bus);
+		rpi.i2c_set_baud_rate(baud);
+		return rpi.i2c_clock_plan(baud);
+	}
+}
+
+/* bus speed of a slave device, applied each time the device is selected (baud = 0 uses the bus speed) */
+setDeviceSpeed(addr, baud) {
+	if(this.#init){
+		rpi.i2c_use(this.#bus);
+		return rpi.i2c_set_device_speed(addr, baud);
+	}
+}
+
 setClockFreq(div) {
 	if(this.#init){
-	  	let freq = Math.round(250000000/div);
+	  	rpi.i2c_use(this.#bus);
+	  	let freq = Math.round(rpi.core_clock_freq()/div);
 	  	let Freq = Math.round(freq/1000);
 	  	console.log('I2C data rate: ' + Freq + ' kHz (div ' + div +')');
 	  	rpi.i2c_set_clock_divider(div);
 	}
 }
 
-/* returns 1 if successful, otherwise returns 0*/
+/* select the slave device of the following transfers (no return value) */
 setSlaveAddress(value){
 	if(this.#init){
+  		rpi.i2c_use(this.#bus);
   		return rpi.i2c_set_slave_address(value);
 	}
 }
 
-/* returns 1 if successful, otherwise returns 0*/
+/* Check if a slave device is present w/o writing to it, returns 0 if the address is acknowledged */
+probe(addr){
+	if(this.#init){
+		rpi.i2c_use(this.#bus);
+		return rpi.i2c_probe(addr);
+	}
+}
+
+probeAsync(addr){
+	if(this.#init){
+		rpi.i2c_use(this.#bus);
+		return rpi.i2c_probe_async(addr);
+	}
+	return Promise.reject(new Error('I2C is not started'));
+}
+
+/* Scan the bus, returns the addresses of the devices found
+ * options = { first, last, mode, cache }
+ * first, last - address range (default 0x03 - 0x77)
+ * mode        - 'auto' (default, quick writes and 1-byte reads for 0x30-0x37/0x50-0x5f), 'quick' or 'read'
+ * cache       - use the results of a previous scan of this bus
+ */
+scan(options){
+	if(this.#init){
+		let a = scanArgs(options);
+		rpi.i2c_use(this.#bus);
+		return scanList(rpi.i2c_scan(a.first, a.last, a.mode));
+	}
+}
+
+scanAsync(options){
+	if(this.#init){
+		let a = scanArgs(options);
+		rpi.i2c_use(this.#bus);
+		return rpi.i2c_scan_async(a.first, a.last, a.mode).then(scanList);
+	}
+	return Promise.reject(new Error('I2C is not started'));
+}
+
+/* Forget the cached scan results, e.g. after a device was connected */
+clearScan(){
+	if(this.#init){
+		rpi.i2c_use(this.#bus);
+		rpi.i2c_scan_clear();
+	}
+}
+
+/* Returns a handle of a slave device on this bus, options = { speed } */
+device(addr, options){
+	if(this.#init){
+		return new I2CDevice(this.#bus, addr, options);
+	}
+}
+
+/* select the slave device of the following transfers (no return value) */
 selectSlave(value){
 	if(this.#init){
+		rpi.i2c_use(this.#bus);
 		return rpi.i2c_set_slave_address(value);
 	}
 }
@@ -87,6 +192,7 @@ selectSlave(value){
 /* read data bytes from periphetal registers using node buffer objects */
 read(buf, len){
 	if(this.#init){
+		rpi.i2c_use(this.#bus);
 		rpi.i2c_read(buf, len);
 	}
 }
@@ -94,12 +200,97 @@ read(buf, len){
 /* write data bytes to periphetal registers using node buffer objects */
 write(buf, len){
 	if(this.#init){
+		rpi.i2c_use(this.#bus);
 		rpi.i2c_write(buf, len);
 	}
 }
 
+/* write then read data bytes using a repeated start (no stop between the write and the read),
+ * returns the transfer status (0 on success)
+ */
+writeRead(wbuf, wlen, rbuf, rlen){
+	if(this.#init){
+		rpi.i2c_use(this.#bus);
+		return rpi.i2c_write_read(wbuf, wlen, rbuf, rlen);
+	}
+}
+
+/* readBuf, writeBuf and writeReadBuf use buffers registered in a BufferPool (id, offset, length),
+ * returns the transfer status (0 on success)
+ */
+readBuf(id, off, len){
+	if(this.#init){
+		rpi.i2c_use(this.#bus);
+		return rpi.i2c_read_buf(id, off, len);
+	}
+}
+
+writeBuf(id, off, len){
+	if(this.#init){
+		rpi.i2c_use(this.#bus);
+		return rpi.i2c_write_buf(id, off, len);
+	}
+}
+
+writeReadBuf(wid, woff, wlen, rid, roff, rlen){
+	if(this.#init){
+		rpi.i2c_use(this.#bus);
+		return rpi.i2c_write_read_buf(wid, woff, wlen, rid, roff, rlen);
+	}
+}
+
+/* Execute an array of messages { addr, read, nostop, buf, offset, length } back-to-back in one call,
+ * a write w/ nostop followed by a read of the same address uses a repeated start,
+ * returns a buffer w/ the status of each message (0 on success)
+ */
+transfer(msgs){
+	if(this.#init){
+		rpi.i2c_use(this.#bus);
+		return rpi.i2c_transfer(msgs);
+	}
+}
+
+transferAsync(msgs){
+	if(this.#init){
+		rpi.i2c_use(this.#bus);
+		return rpi.i2c_transfer_async(msgs);
+	}
+	return Promise.reject(new Error('I2C is not started'));
+}
+
+/* async versions, returns a promise that resolves after the transfer is completed in a worker thread */
+readAsync(buf, len){
+	if(this.#init){
+		rpi.i2c_use(this.#bus);
+		return rpi.i2c_read_async(buf, len);
+	}
+	return Promise.reject(new Error('I2C is not started'));
+}
+
+writeAsync(buf, len){
+	if(this.#init){
+		rpi.i2c_use(this.#bus);
+		return rpi.i2c_write_async(buf, len);
+	}
+	return Promise.reject(new Error('I2C is not started'));
+}
+
+writeReadAsync(wbuf, wlen, rbuf, rlen){
+	if(this.#init){
+		rpi.i2c_use(this.#bus);
+		return rpi.i2c_write_read_async(wbuf, wlen, rbuf, rlen);
+	}
+	return Promise.reject(new Error('I2C is not started'));
+}
+
+/* controller of the object, 0 = BSC0, 1 = BSC1 */
+get bus(){
+	return this.#bus;
+}
+
 end(){
 	if(this.#init){	
+  		rpi.i2c_use(this.#bus);
   		rpi.i2c_stop();
 		this.#init = 0; 
 	}
@@ -107,6 +298,7 @@ end(){
 
 stop(){
 	if(this.#init){	
+  		rpi.i2c_use(this.#bus);
   		rpi.i2c_stop();
 		this.#init = 0; 
 	}
@@ -0,0 +1,166 @@
+/*!
+ * array-gpio/kernel-i2c.js
+ *
+ * Copyright(c) 2017 Ed Alegrid
+ * MIT Licensed
+ */
+
+'use strict';
+
+const rpi = require('./rpi.js');
+
+/* I2C through the kernel driver (/dev/i2c-<bus>), same transfer methods as i2c.js
+ *
+ * Does not need root or /dev/mem and can share the bus w/ kernel drivers. The transfers are I2C_RDWR
+ * ioctls, the messages of a transfer chained w/ nostop are sent in one ioctl. Adapters w/o plain i2c
+ * support (e.g. the i2c-stub test module) use SMBus commands for the common message patterns.
+ * The bus speed is set by the kernel (e.g. dtparam=i2c_arm_baudrate=400000).
+ */
+class KernelI2C {
+
+#id = -1;
+#bus = 1;
+#addr = 0;
+
+constructor(bus){
+	this.#bus = bus === undefined ? 1 : bus;
+	this.#id = rpi.kdev_i2c_open(this.#bus);
+	if(this.#id < 0){
+		throw new Error('Cannot open /dev/i2c-' + this.#bus);
+	}
+}
+
+#check(){
+	if(this.#id < 0){
+		throw new Error('I2C is not started');
+	}
+}
+
+/* status of a write and/or read, 0 on success */
+#xfer(wbuf, wlen, rbuf, rlen){
+	let msgs = [];
+	if(wbuf){
+		msgs.push({ buf:wbuf, length:wlen === undefined ? wbuf.length : wlen, nostop:!!rbuf });
+	}
+	if(rbuf){
+		msgs.push({ buf:rbuf, length:rlen === undefined ? rbuf.length : rlen, read:true });
+	}
+	return msgs;
+}
+
+#status(s){
+	for(const v of s){
+		if(v){
+			return v;
+		}
+	}
+	return 0;
+}
+
+/* the bus speed is fixed by the kernel driver */
+setBaudRate(baud) {}
+
+setTransferSpeed(baud) {}
+
+setSpeed(baud) {}
+
+/* returns 1 */
+setSlaveAddress(addr){
+	this.#addr = addr;
+	return 1;
+}
+
+selectSlave(addr){
+	this.#addr = addr;
+	return 1;
+}
+
+/* quick write, returns 0 if the address is acknowledged */
+probe(addr){
+	this.#check();
+	return rpi.kdev_i2c_transfer(this.#id, [{ addr:addr, buf:Buffer.alloc(0) }])[0];
+}
+
+probeAsync(addr){
+	if(this.#id < 0){
+		return Promise.reject(new Error('I2C is not started'));
+	}
+	return rpi.kdev_i2c_transfer_async(this.#id, [{ addr:addr, buf:Buffer.alloc(0) }]).then((s) => s[0]);
+}
+
+/* Scan the bus w/ quick writes, returns the addresses of the devices found, options = { first, last } */
+scan(options){
+	let o = options === undefined ? {} : options;
+	let list = [];
+	this.#check();
+	for(let addr = o.first === undefined ? 0x03 : o.first; addr <= (o.last === undefined ? 0x77 : o.last); addr++){
+		if(this.probe(addr) === 0){
+			list.push(addr);
+		}
+	}
+	return list;
+}
+
+read(buf, len){
+	this.#check();
+	return this.#status(rpi.kdev_i2c_transfer(this.#id, this.#xfer(null, 0, buf, len), this.#addr));
+}
+
+write(buf, len){
+	this.#check();
+	return this.#status(rpi.kdev_i2c_transfer(this.#id, this.#xfer(buf, len, null, 0), this.#addr));
+}
+
+/* write then read using a repeated start, returns the transfer status (0 on success) */
+writeRead(wbuf, wlen, rbuf, rlen){
+	this.#check();
+	return this.#status(rpi.kdev_i2c_transfer(this.#id, this.#xfer(wbuf, wlen, rbuf, rlen), this.#addr));
+}
+
+/* Execute an array of messages { addr, read, nostop, buf, offset, length } in one call,
+ * a message w/ nostop continues into the next one w/ a repeated start,
+ * returns a buffer w/ the status of each message (0 on success)
+ */
+transfer(msgs){
+	this.#check();
+	return rpi.kdev_i2c_transfer(this.#id, msgs, this.#addr);
+}
+
+/* async versions, returns a promise that resolves after the transfer is completed in a worker thread */
+transferAsync(msgs){
+	if(this.#id < 0){
+		return Promise.reject(new Error('I2C is not started'));
+	}
+	return rpi.kdev_i2c_transfer_async(this.#id, msgs, this.#addr);
+}
+
+readAsync(buf, len){
+	return this.transferAsync(this.#xfer(null, 0, buf, len)).then((s) => this.#status(s));
+}
+
+writeAsync(buf, len){
+	return this.transferAsync(this.#xfer(buf, len, null, 0)).then((s) => this.#status(s));
+}
+
+writeReadAsync(wbuf, wlen, rbuf, rlen){
+	return this.transferAsync(this.#xfer(wbuf, wlen, rbuf, rlen)).then((s) => this.#status(s));
+}
+
+get bus(){
+	return this.#bus;
+}
+
+end(){
+	if(this.#id >= 0){
+		rpi.kdev_close(this.#id);
+		this.#id = -1;
+	}
+}
+
+stop(){
+	this.end();
+}
+
+}
+
+module.exports = KernelI2C;
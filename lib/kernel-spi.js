@@ -0,0 +1,147 @@
+/*!
+ * array-gpio/kernel-spi.js
+ *
+ * Copyright(c) 2017 Ed Alegrid
+ * MIT Licensed
+ */
+
+'use strict';
+
+const rpi = require('./rpi.js');
+
+/* SPI through the kernel driver (/dev/spidev<bus>.<cs>), same transfer methods as spi.js
+ *
+ * Does not need root or /dev/mem, the transfers are SPI_IOC_MESSAGE ioctls and large transfers
+ * use the controller's dma. A transfer list is sent in as few messages as the spidev buffer size
+ * (spidev.bufsiz, default 4096 bytes) allows, larger transfers are split into several messages.
+ */
+class KernelSPI {
+
+#id = -1;
+#bus = 0;
+#cs = 0;
+#mode = 0;
+#speed = 0;
+#lsbFirst = false;
+#csHigh = false;
+
+constructor(bus, cs){
+	this.#bus = bus === undefined ? 0 : bus;
+	this.#cs = cs === undefined ? 0 : cs;
+	this.#open();
+}
+
+#open(){
+	this.#id = rpi.kdev_spi_open(this.#bus, this.#cs);
+	if(this.#id < 0){
+		throw new Error('Cannot open /dev/spidev' + this.#bus + '.' + this.#cs);
+	}
+	if(this.#mode || this.#speed || this.#lsbFirst || this.#csHigh){
+		this.#config();
+	}
+}
+
+#config(){
+	if(this.#id >= 0){
+		rpi.kdev_spi_config(this.#id, this.#mode, this.#speed, this.#lsbFirst, this.#csHigh);
+	}
+}
+
+#xfer(wbuf, rbuf, len){
+	return [{ tx:wbuf, rx:rbuf, length:len === undefined ? (wbuf || rbuf).length : len }];
+}
+
+setDataMode(mode){
+	this.#mode = mode;
+	this.#config();
+}
+
+/* SCLK = core clock / div, same divider as spi.js */
+setClockFreq(div){
+	this.setSpeed(Math.round(rpi.core_clock_freq()/div));
+}
+
+/* clock speed in Hz */
+setSpeed(hz){
+	this.#speed = hz;
+	this.#config();
+}
+
+setBitOrder(lsbFirst){
+	this.#lsbFirst = !!lsbFirst;
+	this.#config();
+}
+
+/* only the polarity of the selected chip select can be set */
+setCSPolarity(cs, active){
+	if(cs === this.#cs){
+		this.#csHigh = !!active;
+		this.#config();
+	}
+}
+
+/* the chip select is fixed by the device file, selecting another one reopens /dev/spidev<bus>.<cs> */
+chipSelect(cs){
+	if(cs !== this.#cs && this.#id >= 0){
+		rpi.kdev_close(this.#id);
+		this.#cs = cs;
+		this.#open();
+	}
+}
+
+/* Execute a list of transfers { mode, div, tx, txOffset, rx, rxOffset, length, hold, delay } in one call,
+ * cs is ignored, returns 0 on success
+ */
+transferList(xfers){
+	if(this.#id >= 0){
+		return rpi.kdev_spi_transfer(this.#id, xfers);
+	}
+}
+
+transferListAsync(xfers){
+	if(this.#id >= 0){
+		return rpi.kdev_spi_transfer_async(this.#id, xfers);
+	}
+	return Promise.reject(new Error('SPI is not started'));
+}
+
+/* transfer data bytes to/from periphetal registers using node buffer objects */
+dataTransfer(wbuf, rbuf, len){
+	return this.transferList(this.#xfer(wbuf, rbuf, len));
+}
+
+write(wbuf, len){
+	return this.transferList(this.#xfer(wbuf, null, len));
+}
+
+read(rbuf, len){
+	return this.transferList(this.#xfer(null, rbuf, len));
+}
+
+/* async versions, returns a promise that resolves after the transfer is completed in a worker thread */
+dataTransferAsync(wbuf, rbuf, len){
+	return this.transferListAsync(this.#xfer(wbuf, rbuf, len));
+}
+
+writeAsync(wbuf, len){
+	return this.transferListAsync(this.#xfer(wbuf, null, len));
+}
+
+readAsync(rbuf, len){
+	return this.transferListAsync(this.#xfer(null, rbuf, len));
+}
+
+get bus(){
+	return this.#bus;
+}
+
+end(){
+	if(this.#id >= 0){
+		rpi.kdev_close(this.#id);
+		this.#id = -1;
+	}
+}
+
+}
+
+module.exports = KernelSPI;
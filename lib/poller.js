@@ -0,0 +1,112 @@
+/*!
+ * array-gpio/poller.js
+ *
+ * Copyright(c) 2017 Ed Alegrid
+ * MIT Licensed
+ */
+
+'use strict';
+
+const rpi = require('./rpi.js');
+
+// SharedArrayBuffer layout (see src/poller.h): header | slot[slots]
+const HDR_SIZE = 32, SLOT_HDR_SIZE = 32;
+
+// max. no. of command bytes (POLLER_CMD_MAX)
+const CMD_MAX = 16;
+
+// slot word index
+const S_SEQ = 0, S_STATUS = 1, S_TS_LO = 2, S_TS_HI = 3, S_COUNT = 4, S_OVERRUNS = 5, S_LEN = 6, S_ADDR = 7;
+
+var started = false;
+
+class Poller {
+
+#slots = 0;
+#slotSize = 0;
+#words = null;
+
+/* options = { slots, dataSize, bus }, bus = 0 (BSC0) or 1 (BSC1, default) */
+constructor(options){
+	let o = options === undefined ? {} : options;
+
+	if(started){
+		throw new Error('I2C poller is already running');
+	}
+
+	this.#slots = o.slots || 32;
+	this.#slotSize = ((SLOT_HDR_SIZE + (o.dataSize || 32)) + 7) & ~7;
+	this.buffer = new SharedArrayBuffer(HDR_SIZE + this.#slots*this.#slotSize);
+
+	// the scheduler thread uses the controller selected at start
+	rpi.i2c_use(o.bus === 0 ? 0 : 1);
+
+	if(rpi.poller_start(this.buffer, this.#slots, this.#slotSize) !== 0){
+		throw new Error('I2C poller start failed');
+	}
+	started = true;
+
+	this.#words = new Uint32Array(this.buffer);
+}
+
+/* Read length bytes from addr every period ms after writing the command bytes (w/ a repeated start),
+ * returns the slot id of the job
+ */
+add(addr, command, length, period){
+	let cmd = Buffer.from(command || []);
+	if(!Number.isInteger(addr) || addr < 0 || addr > 0x7f || cmd.length > CMD_MAX || !Number.isInteger(length) ||
+		length < 1 || length > this.#slotSize - SLOT_HDR_SIZE || !(period > 0)){
+		throw new Error('Invalid i2c poller job');
+	}
+	let id = rpi.poller_add(addr, cmd, length, Math.round(period*1000));
+	if(id < 0){
+		throw new Error('Invalid i2c poller job or no free slot');
+	}
+	return id;
+}
+
+remove(id){
+	rpi.poller_remove(id);
+}
+
+/* Copy the latest result of a job into buf, returns { seq, status, timestamp, count, overruns, length }
+ * timestamp is a monotonic time in ns (same clock as process.hrtime.bigint())
+ */
+read(id, buf){
+	let w = (HDR_SIZE + id*this.#slotSize)/4;
+	let data = new Uint8Array(this.buffer, HDR_SIZE + id*this.#slotSize + SLOT_HDR_SIZE, this.#slotSize - SLOT_HDR_SIZE);
+	let seq, r;
+
+	// retry while the scheduler thread is updating the slot
+	do {
+		seq = Atomics.load(this.#words, w + S_SEQ);
+		if(seq & 1){
+			continue;
+		}
+		r = {
+			seq:seq >>> 1,
+			status:this.#words[w + S_STATUS],
+			timestamp:BigInt(this.#words[w + S_TS_HI]) << 32n | BigInt(this.#words[w + S_TS_LO]),
+			count:this.#words[w + S_COUNT],
+			overruns:this.#words[w + S_OVERRUNS],
+			length:this.#words[w + S_LEN],
+			addr:this.#words[w + S_ADDR],
+		};
+		if(buf !== undefined){
+			buf.set(data.subarray(0, Math.min(r.length, buf.length)));
+		}
+	} while((seq & 1) || Atomics.load(this.#words, w + S_SEQ) !== seq);
+
+	return r;
+}
+
+stop(){
+	if(started){
+		rpi.poller_stop();
+		started = false;
+	}
+}
+
+}
+
+module.exports = Poller;
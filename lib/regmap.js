@@ -0,0 +1,92 @@
+/*!
+ * array-gpio/regmap.js
+ *
+ * Copyright(c) 2017 Ed Alegrid
+ * MIT Licensed
+ */
+
+'use strict';
+
+const rpi = require('./rpi.js');
+
+/* Register-map cache of an i2c device w/ 8-bit registers, created with device.regmap(options)
+ *
+ * Writes to cacheable registers only update the cache, unchanged values are dropped
+ * and flush() writes each run of contiguous changed registers in one burst.
+ * Reads of cacheable registers are served from the cache once their value is known.
+ */
+class RegMap {
+
+#id = -1;
+
+/* options = { size, volatile, autoIncrement }
+ * size          - no. of registers (default 256)
+ * volatile      - registers that are always accessed on the device, e.g. [0x00, [0x28, 6]] (register or [register, count])
+ * autoIncrement - bits or-ed to the register address of multi-byte transfers (default 0)
+ */
+constructor(bus, addr, options){
+	let o = options === undefined ? {} : options;
+
+	this.#id = rpi.regmap_create(bus, addr, o.size || 256, o.autoIncrement || 0);
+	if(this.#id < 0){
+		throw new Error('Invalid register map or no free register map');
+	}
+
+	for(const v of o.volatile || []){
+		if(Array.isArray(v)){
+			rpi.regmap_volatile(this.#id, v[0], v[1], true);
+		}
+		else{
+			rpi.regmap_volatile(this.#id, v, 1, true);
+		}
+	}
+}
+
+/* declare n registers from reg as volatile or cacheable */
+volatile(reg, n, on){
+	rpi.regmap_volatile(this.#id, reg, n || 1, on === undefined ? true : on);
+}
+
+/* write a value or an array/buffer of values from reg, returns the i2c status of the volatile registers (0 ok) */
+write(reg, values){
+	let buf = Buffer.isBuffer(values) ? values : Buffer.from(typeof values === 'number' ? [values] : values);
+	return rpi.regmap_write(this.#id, reg, buf, buf.length);
+}
+
+/* read n registers from reg into buf (a new buffer if omitted), returns the buffer */
+read(reg, n, buf){
+	if(buf === undefined){
+		buf = Buffer.alloc(n || 1);
+	}
+	let status = rpi.regmap_read(this.#id, reg, buf, n || 1);
+	if(status){
+		throw new Error('I2C register read failed, status ' + status);
+	}
+	return buf;
+}
+
+/* write the changed registers to the device, returns the i2c status (0 ok) */
+flush(){
+	return rpi.regmap_flush(this.#id);
+}
+
+/* forget the cached values, e.g. after a device reset */
+invalidate(){
+	rpi.regmap_invalidate(this.#id);
+}
+
+/* returns { writes, dropped, bursts, hits, misses } */
+stats(){
+	return rpi.regmap_stats(this.#id);
+}
+
+close(){
+	if(this.#id >= 0){
+		rpi.regmap_destroy(this.#id);
+		this.#id = -1;
+	}
+}
+
+}
+
+module.exports = RegMap;
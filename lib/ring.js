@@ -0,0 +1,131 @@
+/*!
+ * array-gpio/ring.js
+ *
+ * Copyright(c) 2017 Ed Alegrid
+ * MIT Licensed
+ */
+
+'use strict';
+
+const rpi = require('./rpi.js');
+
+// SharedArrayBuffer layout (see src/ring.h): header | sqe[entries] | cqe[entries] | data
+const HDR_WORDS = 16, SQE_WORDS = 8, CQE_WORDS = 4;
+
+// header word index
+const H_ENTRIES = 3, H_DATA_OFFSET = 4, H_DATA_SIZE = 5, H_SQ_HEAD = 6, H_SQ_TAIL = 7,
+	H_CQ_HEAD = 8, H_CQ_TAIL = 9, H_FLAGS = 10, H_TPS = 11, H_COMPLETED = 12, H_ERRORS = 13;
+
+const RING_NEED_WAKEUP = 0x01, RING_F_ADDR = 0x01;
+
+const buses = { i2c:0, i2c1:0, spi:1, i2c0:2 };
+
+class Ring {
+
+#id = -1;
+#hdr = null;
+#sq = null;
+#cq = null;
+#mask = 0;
+#tail = 0;
+
+/* bus = 'i2c' (BSC1), 'i2c0' (BSC0) or 'spi', options = { entries, dataSize, onComplete } */
+constructor(bus, options){
+	let o = options === undefined ? {} : options;
+	let entries = 1;
+
+	if(buses[bus] === undefined){
+		throw new Error('Invalid ring bus ' + bus);
+	}
+	while(entries < (o.entries || 64)){
+		entries <<= 1;
+	}
+
+	this.buffer = new SharedArrayBuffer(HDR_WORDS*4 + entries*(SQE_WORDS + CQE_WORDS)*4 + (o.dataSize || 4096));
+
+	if(typeof o.onComplete === 'function'){
+		this.#id = rpi.ring_start(this.buffer, buses[bus], entries, () => this.reap(o.onComplete));
+	}
+	else{
+		this.#id = rpi.ring_start(this.buffer, buses[bus], entries);
+	}
+	if(this.#id < 0){
+		throw new Error('Ring start failed');
+	}
+
+	this.#hdr = new Uint32Array(this.buffer, 0, HDR_WORDS);
+	this.#mask = this.#hdr[H_ENTRIES] - 1;
+	this.#sq = new Uint32Array(this.buffer, HDR_WORDS*4, entries*SQE_WORDS);
+	this.#cq = new Uint32Array(this.buffer, HDR_WORDS*4 + entries*SQE_WORDS*4, entries*CQE_WORDS);
+	this.#tail = this.#hdr[H_SQ_TAIL];
+
+	/* transfer data, offsets in the descriptors are relative to this array */
+	this.data = new Uint8Array(this.buffer, this.#hdr[H_DATA_OFFSET], this.#hdr[H_DATA_SIZE]);
+}
+
+/* Add a transaction descriptor { addr, txOffset, txLength, rxOffset, rxLength, userData } to the
+ * submission ring w/o starting it, returns false if the ring is full
+ */
+queue(t){
+	if(this.#tail - Atomics.load(this.#hdr, H_SQ_HEAD) > this.#mask){
+		return false;
+	}
+
+	let i = (this.#tail & this.#mask) * SQE_WORDS;
+	this.#sq[i] = t.userData || 0;
+	this.#sq[i + 1] = t.addr || 0;
+	this.#sq[i + 2] = t.txOffset || 0;
+	this.#sq[i + 3] = t.txLength || 0;
+	this.#sq[i + 4] = t.rxOffset || 0;
+	this.#sq[i + 5] = t.rxLength || 0;
+	this.#sq[i + 6] = t.addr === undefined ? 0 : RING_F_ADDR;
+	this.#tail = (this.#tail + 1) >>> 0;
+
+	return true;
+}
+
+/* Start all queued transactions, returns the no. of transactions waiting to be executed */
+submit(){
+	Atomics.store(this.#hdr, H_SQ_TAIL, this.#tail);
+	if(Atomics.load(this.#hdr, H_FLAGS) & RING_NEED_WAKEUP){
+		rpi.ring_enter(this.#id);
+	}
+	return (this.#tail - Atomics.load(this.#hdr, H_SQ_HEAD)) >>> 0;
+}
+
+/* Call fn(userData, status, length, ns) for each completed transaction, returns the no. of completions */
+reap(fn){
+	let head = Atomics.load(this.#hdr, H_CQ_HEAD);
+	let tail = Atomics.load(this.#hdr, H_CQ_TAIL);
+	let n = 0;
+
+	while(head !== tail){
+		let i = (head & this.#mask) * CQE_WORDS;
+		fn(this.#cq[i], this.#cq[i + 1], this.#cq[i + 2], this.#cq[i + 3]);
+		head = (head + 1) >>> 0;
+		n++;
+	}
+	Atomics.store(this.#hdr, H_CQ_HEAD, head);
+
+	return n;
+}
+
+stats(){
+	return {
+		completed:Atomics.load(this.#hdr, H_COMPLETED),
+		errors:Atomics.load(this.#hdr, H_ERRORS),
+		tps:Atomics.load(this.#hdr, H_TPS),
+		pending:(this.#tail - Atomics.load(this.#hdr, H_SQ_HEAD)) >>> 0,
+	};
+}
+
+stop(){
+	if(this.#id >= 0){
+		rpi.ring_stop(this.#id);
+		this.#id = -1;
+	}
+}
+
+}
+
+module.exports = Ring;
@@ -14,10 +14,13 @@ const cc = require('bindings')('node_rpi');
 var rpi_board_rev = null, rpi_model = null, eventStarted = null, BcmPin = [];
 var rpiInit = { initialized:false, gpio:false, pwm:false , i2c:false , spi:false, gpiomem:false, devmem:false };
 
-if(arch === 'arm' || arch === 'arm64'){
-  	// continue
-}
-else{
+/* The register (/dev/mem, /dev/gpiomem) backends need a Raspberry Pi, they check the device on their first start.
+ * The kernel driver backends (i2c-dev, spidev) do not, so the module also loads on other hosts.
+ */
+function check_rpi(){
+	if(arch === 'arm' || arch === 'arm64'){
+		return;
+	}
   	console.log('Sorry, array-gpio has detected that your device is not a Raspberry Pi.\narray-gpio will only work in Raspberry Pi devices.\n');
   	throw new Error('Device is not a raspberry pi');
 }
@@ -198,6 +201,87 @@ function pinout(){
 var clock1 = 250000000;
 var clock2 = 400000000;
 
+/* Layout of the Float64Array returned by stats(), value = stats[subsystem * counters.length + counter] */
+const stats_subsystems = ['gpio', 'pwm', 'i2c', 'spi', 'timer'];
+const stats_counters = ['ops', 'regWrites', 'regReads', 'polls', 'errors', 'bytes', 'spinNs', 'waitNs'];
+
+/* Pending async transfers of each bus, a transfer starts only after the previous one on the same bus has completed */
+var busQueue = { i2c0:Promise.resolve(), i2c1:Promise.resolve(), spi:Promise.resolve(), spi1:Promise.resolve(), spi2:Promise.resolve() };
+
+/* async transfers of the software buses and kernel devices are queued per id ('soft' + id, 'kdev' + id) */
+function idQueue (type, id){
+	let q = type + id;
+	if(busQueue[q] === undefined){
+		busQueue[q] = Promise.resolve();
+	}
+	return q;
+}
+
+/* header pin to bcm gpio no. of a software bus pin, 0xff if unused */
+function soft_pin (pin){
+	return pin === undefined || pin === null ? 0xff : header_to_bcm(pin);
+}
+
+/* AUX mini spi controllers already started (bus 1 and 2) */
+var auxSpiStarted = [false, false, false];
+
+/* i2c controller used by the event loop thread (0 = BSC0, 1 = BSC1) and the controllers already started */
+var i2cBus = 1;
+var i2cStarted = [false, false];
+
+/* Queue an async native call on a bus, fn(cb) must call cb(status) from the worker thread completion */
+function busAsync (bus, fn){
+	let p = busQueue[bus].then(() => new Promise((resolve) => fn(resolve)));
+	busQueue[bus] = p.catch(() => {});
+	return p;
+}
+
+/* Check the buffer and length of an async transfer, returns the transfer length */
+function asyncLength (buf, len){
+	if(!Buffer.isBuffer(buf)){
+		throw new TypeError('Buffer object required');
+	}
+	if (len === undefined){
+		len = buf.length;
+	}
+	if (len > buf.length){
+		throw new Error('Insufficient buffer size');
+	}
+	return len;
+}
+
+/* Check the buffer and length of an i2c transfer (max. 65535 bytes), returns the transfer length */
+function i2cLength (buf, len){
+	len = asyncLength(buf, len);
+	if (len > 0xffff){
+		throw new RangeError('I2C transfer length over 65535 bytes');
+	}
+	return len;
+}
+
+/* Flat native transfer list of spi_transfer_list()
+ * xfer = { cs, mode, div, tx, txOffset, rx, rxOffset, length, hold, delay }
+ */
+function spiTransfers (xfers){
+	let list = [];
+	for(const x of xfers){
+		let len = x.length !== undefined ? x.length : (x.tx || x.rx).length - ((x.tx ? x.txOffset : x.rxOffset) || 0);
+		list.push(x.cs === undefined ? 0xff : x.cs, x.mode === undefined ? 0xff : x.mode, x.div || 0,
+			x.tx || null, x.txOffset || 0, x.rx || null, x.rxOffset || 0, len, x.hold ? 0x01 : 0, x.delay || 0);
+	}
+	return list;
+}
+
+/* Flat native message list of i2c_transfer(), msg = { addr, read, nostop, buf, offset, length } */
+function i2cMessages (msgs, addr){
+	let list = [];
+	for(const m of msgs){
+		let offset = m.offset || 0;
+		let len = m.length === undefined ? m.buf.length - offset : m.length;
+		list.push(m.addr === undefined ? addr : m.addr, (m.read ? 0x01 : 0) | (m.nostop ? 0x02 : 0), m.buf, offset, len);
+	}
+	return list;
+}
 class Rpi {
 
 constructor (init){
@@ -226,6 +310,7 @@ constructor (init){
 /* Explicit initialization of rpi lib */
 rpi_init (access) 
 {
+	check_rpi();
 	cc.rpi_init(access);
 	this.rpi_init_access = 1;      
 }
@@ -235,6 +320,95 @@ rpi_close ()
 	return cc.rpi_close();
 }
 
+/* core clock (Hz) of the i2c and spi clock dividers */
+core_clock_freq ()
+{
+	return cc.get_core_clock_freq();
+}
+
+/*
+ * Instrumentation counters
+ */
+stats ()
+{
+	return cc.rpi_stats();
+}
+
+stats_reset ()
+{
+	cc.rpi_stats_reset();
+}
+
+/* i2c/spi polling loops, adaptive = sleep for the bulk of a transfer, otherwise spin (minSleepUs 0 = keep) */
+bus_wait (adaptive, minSleepUs)
+{
+	cc.bus_wait(adaptive ? 1 : 0, minSleepUs || 0);
+}
+
+/* name = '' stops the shared memory export */
+stats_export (name)
+{
+	return cc.rpi_stats_export(name);
+}
+
+stats_layout ()
+{
+	return { subsystems:stats_subsystems, counters:stats_counters };
+}
+
+/*
+ * Register-level trace
+ */
+trace_start (size)
+{
+	cc.rpi_trace_start(size);
+}
+
+trace_stop ()
+{
+	cc.rpi_trace_stop();
+}
+
+trace_clear ()
+{
+	cc.rpi_trace_clear();
+}
+
+trace_dump (path)
+{
+	return cc.rpi_trace_dump(path);
+}
+
+/*
+ * Real-time profile of the native engine threads
+ *
+ * cpu = -1 any cpu, -2 first isolated cpu (isolcpus=)
+ */
+rt_profile (priority, cpu, mlock, prefault, spin)
+{
+	return cc.rpi_rt_profile(priority, cpu, mlock, prefault, spin);
+}
+
+rt_apply ()
+{
+	return cc.rpi_rt_apply();
+}
+
+rt_status ()
+{
+	let st = cc.rpi_rt_status();
+	return {
+		schedFifo:(st.flags & 0x01) !== 0,
+		priority:st.priority,
+		affinity:(st.flags & 0x02) !== 0,
+		cpu:st.cpu,
+		mlock:(st.flags & 0x04) !== 0,
+		prefault:(st.flags & 0x08) !== 0,
+		spin:(st.flags & 0x10) !== 0,
+		error:st.error
+	};
+}
+
 /*
  * GPIO
  */
@@ -243,6 +417,7 @@ gpio_open (pin, mode, init)
 	//console.log('open', pin)
 	let bcm_pin = header_to_bcm(pin);
 
+	check_rpi();
 	check_sys_gpio(bcm_pin, pin);
 
 	if(this.rpi_init_access){     
@@ -350,6 +525,7 @@ gpio_get_pud (pin)
  */
 pwm_init()
 {
+	check_rpi();
 	if(this.rpi_init_access){ 
 		if(!rpiInit.devmem){
 			rpiInit.devmem = true;
@@ -430,6 +606,7 @@ pwm_set_data (pin, data)
  */
 i2c_start(pinSet)
 {
+	check_rpi();
 	if(this.rpi_init_access){ 
 		if(!rpiInit.devmem){
 			rpiInit.devmem = true;
@@ -438,38 +615,82 @@ i2c_start(pinSet)
 		}
 	}
 	else{
-	  	if (!rpiInit.i2c){
+	  	let bus = pinSet === 0 ? 0 : 1;
+	  	if (!i2cStarted[bus]){
 			rpiInit.gpio = true;
 			rpiInit.i2c = true;
-			cc.i2c_start(pinSet);
+			i2cStarted[bus] = true;
+			cc.i2c_start(bus);
+			i2cBus = bus;
 		}
 	}
 }
 
+/* Select the i2c controller used by the following i2c calls (0 = BSC0, 1 = BSC1) */
+i2c_use (bus)
+{
+	if(bus !== i2cBus){
+		cc.i2c_use(bus);
+		i2cBus = bus;
+	}
+}
+
+i2c_bus ()
+{
+	return i2cBus;
+}
+
 i2c_set_slave_address (addr)
 {
  	return cc.i2c_select_slave(addr);
 }
 
+/* returns 0 if the slave device acknowledges its address, 1 on nack, 2 on clock stretch timeout */
+i2c_probe (addr)
+{
+	return cc.i2c_probe(addr);
+}
+
+/* Scan the addresses first - last, returns a 16-byte presence map (bit addr & 7 of byte addr >> 3)
+ * mode 0 = auto, 1 = quick write, 2 = 1-byte read, | 0x10 = use the cached results
+ */
+i2c_scan (first, last, mode)
+{
+	return cc.i2c_scan(first, last, mode);
+}
+
+i2c_scan_clear ()
+{
+	cc.i2c_scan_clear();
+}
+
 i2c_set_clock_divider (divider)
 {
 	cc.i2c_set_clock_freq(divider);
 }
 
+/* returns the achieved bus speed */
 i2c_set_baud_rate (baud)
 {
  	return cc.i2c_data_transfer_speed(baud);
 }
 
+/* returns the clock plan { baud, actual, core, cdiv, fedl, redl, clkt } of a bus speed w/o applying it */
+i2c_clock_plan (baud)
+{
+	return cc.i2c_clock_plan(baud);
+}
+
+/* bus speed used each time the slave device is selected, 0 = bus speed */
+i2c_set_device_speed (addr, baud)
+{
+	return cc.i2c_device_speed(addr, baud);
+}
+
 i2c_read (buf, len)
 {
 	try{
-		if (len === undefined){
-			len = buf.length;
-		}
-		if (len > buf.length){
-			throw new Error('Insufficient buffer size');
-		}
+		len = i2cLength(buf, len);
 		return cc.i2c_read(buf, len);
 	}
 	catch(e){
@@ -485,12 +706,7 @@ i2cByteRead ()
 i2c_write (buf, len)
 {
 	try{
-		if (len === undefined){
-			len = buf.length;
-		}
-		if (len > buf.length){
-			throw new Error('Insufficient buffer size');
-		}
+		len = i2cLength(buf, len);
 		return cc.i2c_write(buf, len);
 	}
 	catch(e){
@@ -498,9 +714,241 @@ i2c_write (buf, len)
 	}
 }
 
+/* Async i2c transfers resolve with the transfer status (0 on success), the buffer must not be modified until then.
+ * The optional addr selects the slave device inside the transfer (device handles).
+ */
+i2c_scan_async (first, last, mode)
+{
+	let bus = i2cBus;
+	return busAsync('i2c' + bus, (cb) => { this.i2c_use(bus); cc.i2c_scan_async(first, last, mode, cb); });
+}
+
+i2c_probe_async (addr)
+{
+	let bus = i2cBus;
+	return busAsync('i2c' + bus, (cb) => { this.i2c_use(bus); cc.i2c_probe_async(addr, cb); });
+}
+
+i2c_read_async (buf, len, addr)
+{
+	try{
+		len = i2cLength(buf, len);
+	}
+	catch(e){
+		return Promise.reject(e);
+	}
+	let bus = i2cBus;
+	if(addr !== undefined){
+		return busAsync('i2c' + bus, (cb) => { this.i2c_use(bus); cc.i2c_read_async(buf, len, cb, addr); });
+	}
+	return busAsync('i2c' + bus, (cb) => { this.i2c_use(bus); cc.i2c_read_async(buf, len, cb); });
+}
+
+i2c_write_async (buf, len, addr)
+{
+	try{
+		len = i2cLength(buf, len);
+	}
+	catch(e){
+		return Promise.reject(e);
+	}
+	let bus = i2cBus;
+	if(addr !== undefined){
+		return busAsync('i2c' + bus, (cb) => { this.i2c_use(bus); cc.i2c_write_async(buf, len, cb, addr); });
+	}
+	return busAsync('i2c' + bus, (cb) => { this.i2c_use(bus); cc.i2c_write_async(buf, len, cb); });
+}
+
+/* Write then read w/ a repeated start, e.g. write a register pointer and read the register data */
+i2c_write_read (wbuf, wlen, rbuf, rlen)
+{
+	try{
+		wlen = i2cLength(wbuf, wlen);
+		rlen = i2cLength(rbuf, rlen);
+		return cc.i2c_write_read(wbuf, wlen, rbuf, rlen);
+	}
+	catch(e){
+		console.log(e);
+	}
+}
+
+/* Execute an array of messages in one call, returns a buffer w/ the status of each message (0 on success),
+ * addr is used for the messages w/o an address
+ */
+i2c_transfer (msgs, addr)
+{
+	let status = Buffer.alloc(msgs.length);
+	cc.i2c_transfer(i2cMessages(msgs, addr), status);
+	return status;
+}
+
+i2c_transfer_async (msgs, addr)
+{
+	let list, status = Buffer.alloc(msgs.length);
+	try{
+		list = i2cMessages(msgs, addr);
+	}
+	catch(e){
+		return Promise.reject(e);
+	}
+	let bus = i2cBus;
+	return busAsync('i2c' + bus, (cb) => { this.i2c_use(bus); cc.i2c_transfer_async(list, status, cb); }).then(() => status);
+}
+
+i2c_write_read_async (wbuf, wlen, rbuf, rlen, addr)
+{
+	try{
+		wlen = i2cLength(wbuf, wlen);
+		rlen = i2cLength(rbuf, rlen);
+	}
+	catch(e){
+		return Promise.reject(e);
+	}
+	let bus = i2cBus;
+	if(addr !== undefined){
+		return busAsync('i2c' + bus, (cb) => { this.i2c_use(bus); cc.i2c_write_read_async(wbuf, wlen, rbuf, rlen, cb, addr); });
+	}
+	return busAsync('i2c' + bus, (cb) => { this.i2c_use(bus); cc.i2c_write_read_async(wbuf, wlen, rbuf, rlen, cb); });
+}
+
 i2c_stop ()
 {
 	cc.i2c_stop();
+	i2cStarted[i2cBus] = false;
+}
+
+/*
+ * Submission/completion rings
+ */
+ring_start (sab, bus, entries, cb)
+{
+	if(cb === undefined){
+		return cc.rpi_ring_start(sab, bus, entries);
+	}
+	return cc.rpi_ring_start(sab, bus, entries, cb);
+}
+
+ring_enter (id)
+{
+	cc.rpi_ring_enter(id);
+}
+
+ring_stop (id)
+{
+	cc.rpi_ring_stop(id);
+}
+
+/*
+ * Background i2c sensor polling
+ */
+poller_start (sab, slots, slotSize)
+{
+	return cc.rpi_poller_start(sab, slots, slotSize);
+}
+
+poller_add (addr, cmd, len, periodUs)
+{
+	return cc.rpi_poller_add(addr, cmd, cmd.length, len, periodUs);
+}
+
+poller_remove (slot)
+{
+	cc.rpi_poller_remove(slot);
+}
+
+poller_stop ()
+{
+	cc.rpi_poller_stop();
+}
+
+/* registered buffers, returns the buffer id or -1 */
+buf_register (ab)
+{
+	return cc.buf_register(ab);
+}
+
+buf_unregister (id)
+{
+	cc.buf_unregister(id);
+}
+
+/* transfers using registered buffers (id, offset, length), returns the transfer status */
+i2c_read_buf (id, off, len)
+{
+	return cc.i2c_read_buf(id, off, len);
+}
+
+i2c_write_buf (id, off, len)
+{
+	return cc.i2c_write_buf(id, off, len);
+}
+
+i2c_write_read_buf (wid, woff, wlen, rid, roff, rlen)
+{
+	return cc.i2c_write_read_buf(wid, woff, wlen, rid, roff, rlen);
+}
+
+/* wid or rid -1 sends zeros or discards the received bytes, returns 2 on a timeout */
+spi_transfer_buf (wid, woff, rid, roff, len)
+{
+	return cc.spi_transfer_buf(wid, woff, rid, roff, len);
+}
+
+spi_dev_transfer_buf (dev, wid, woff, rid, roff, len)
+{
+	return cc.spi_dev_transfer_buf(dev, wid, woff, rid, roff, len);
+}
+
+/* cmd holds cmdLen bytes for each entry of the channels buffer */
+sampler_start (sab, capacity, dev, cmd, cmdLen, channels, mask, shift, rate)
+{
+	return cc.rpi_sampler_start(sab, capacity, dev, cmd, cmdLen, channels, mask, shift, rate);
+}
+
+sampler_stop ()
+{
+	cc.rpi_sampler_stop();
+}
+
+/* i2c register-map cache, see src/regmap.h */
+regmap_create (bus, addr, nregs, inc)
+{
+	return cc.rpi_regmap_create(bus, addr, nregs, inc);
+}
+
+regmap_volatile (id, reg, n, on)
+{
+	cc.rpi_regmap_volatile(id, reg, n, on ? 1 : 0);
+}
+
+regmap_write (id, reg, buf, n)
+{
+	return cc.rpi_regmap_write(id, reg, buf, n);
+}
+
+regmap_read (id, reg, buf, n)
+{
+	return cc.rpi_regmap_read(id, reg, buf, n);
+}
+
+regmap_flush (id)
+{
+	return cc.rpi_regmap_flush(id);
+}
+
+regmap_invalidate (id)
+{
+	cc.rpi_regmap_invalidate(id);
+}
+
+regmap_stats (id)
+{
+	return cc.rpi_regmap_stats(id);
+}
+
+regmap_destroy (id)
+{
+	cc.rpi_regmap_destroy(id);
 }
 
 /*
@@ -513,6 +961,7 @@ spi_get_board_rev ()
 
 spi_start()
 {
+	check_rpi();
 	if(this.rpi_init_access){
 		if(!rpiInit.devmem){
 			rpiInit.devmem = true;
@@ -529,6 +978,200 @@ spi_start()
 	}
 }
 
+/*
+ * Software (bit-banged) SPI and I2C, pins are header pin numbers
+ */
+soft_init ()
+{
+	check_rpi();
+	if(this.rpi_init_access){
+		if(!rpiInit.gpiomem){
+			rpiInit.gpiomem = true;
+			cc.rpi_init(0);
+		}
+	}
+	else if(!rpiInit.gpio){
+		rpiInit.gpio = true;
+		cc.gpio_init();
+	}
+}
+
+/* returns the bus id or -1 */
+soft_spi_open (sclk, mosi, miso, cs, mode, lsbFirst, csHigh, freq)
+{
+	this.soft_init();
+	return cc.soft_spi_open(soft_pin(sclk), soft_pin(mosi), soft_pin(miso), soft_pin(cs), mode, lsbFirst ? 1 : 0, csHigh ? 1 : 0, freq);
+}
+
+soft_spi_config (id, mode, lsbFirst, freq)
+{
+	cc.soft_spi_config(id, mode, lsbFirst ? 1 : 0, freq);
+}
+
+/* wbuf or rbuf can be null */
+soft_spi_transfer (id, wbuf, rbuf, len)
+{
+	return cc.soft_spi_transfer(id, wbuf, rbuf, len);
+}
+
+soft_spi_transfer_async (id, wbuf, rbuf, len)
+{
+	try{
+		if(wbuf !== null){
+			len = asyncLength(wbuf, len);
+		}
+		if(rbuf !== null){
+			len = asyncLength(rbuf, len);
+		}
+	}
+	catch(e){
+		return Promise.reject(e);
+	}
+	return busAsync(idQueue('soft', id), (cb) => cc.soft_spi_transfer_async(id, wbuf, rbuf, len, cb));
+}
+
+/* returns the bus id or -1 */
+soft_i2c_open (scl, sda, freq, stretchUs)
+{
+	this.soft_init();
+	return cc.soft_i2c_open(soft_pin(scl), soft_pin(sda), freq, stretchUs || 0);
+}
+
+soft_i2c_config (id, freq, stretchUs)
+{
+	cc.soft_i2c_config(id, freq, stretchUs || 0);
+}
+
+/* wbuf or rbuf can be null w/ a zero length, returns the i2c status (0 ok, 1 nack, 2 clock stretch timeout) */
+soft_i2c_write_read (id, addr, wbuf, wlen, rbuf, rlen)
+{
+	return cc.soft_i2c_write_read(id, addr, wbuf, wlen, rbuf, rlen);
+}
+
+soft_i2c_write_read_async (id, addr, wbuf, wlen, rbuf, rlen)
+{
+	return busAsync(idQueue('soft', id), (cb) => cc.soft_i2c_write_read_async(id, addr, wbuf, wlen, rbuf, rlen, cb));
+}
+
+soft_close (id)
+{
+	cc.soft_close(id);
+}
+
+/* Kernel driver backends, /dev/i2c-<bus> and /dev/spidev<bus>.<cs>, no /dev/mem access is needed.
+ * Returns the device id or -1
+ */
+kdev_i2c_open (bus)
+{
+	return cc.kdev_i2c_open(bus);
+}
+
+kdev_spi_open (bus, cs)
+{
+	return cc.kdev_spi_open(bus, cs);
+}
+
+/* speed in Hz (0 = keep), returns 0 on success */
+kdev_spi_config (id, mode, speed, lsbFirst, csHigh)
+{
+	return cc.kdev_spi_config(id, mode, speed, (lsbFirst ? 0x01 : 0) | (csHigh ? 0x02 : 0));
+}
+
+/* same messages as i2c_transfer(), returns a buffer w/ the status of each message */
+kdev_i2c_transfer (id, msgs, addr)
+{
+	let status = Buffer.alloc(msgs.length);
+	cc.kdev_i2c_transfer(id, i2cMessages(msgs, addr), status);
+	return status;
+}
+
+kdev_i2c_transfer_async (id, msgs, addr)
+{
+	let list, status = Buffer.alloc(msgs.length);
+	try{
+		list = i2cMessages(msgs, addr);
+	}
+	catch(e){
+		return Promise.reject(e);
+	}
+	return busAsync(idQueue('kdev', id), (cb) => cc.kdev_i2c_transfer_async(id, list, status, cb)).then(() => status);
+}
+
+/* same transfers as spi_transfer_list() (cs is fixed by the device file), returns 0 on success */
+kdev_spi_transfer (id, xfers)
+{
+	return cc.kdev_spi_transfer(id, spiTransfers(xfers));
+}
+
+kdev_spi_transfer_async (id, xfers)
+{
+	let list;
+	try{
+		list = spiTransfers(xfers);
+	}
+	catch(e){
+		return Promise.reject(e);
+	}
+	return busAsync(idQueue('kdev', id), (cb) => cc.kdev_spi_transfer_async(id, list, cb));
+}
+
+kdev_close (id)
+{
+	cc.kdev_close(id);
+}
+
+/* AUX mini spi, bus 1 (SPI1) or 2 (SPI2) */
+aux_spi_start (bus)
+{
+	check_rpi();
+	if(this.rpi_init_access && !rpiInit.devmem){
+		rpiInit.devmem = true;
+		cc.rpi_init(1);
+	}
+	if(!auxSpiStarted[bus]){
+		if(cc.aux_spi_start(bus) !== 0){
+			throw new Error('AUX SPI' + bus + ' start failed');
+		}
+		rpiInit.gpio = true;
+		auxSpiStarted[bus] = true;
+	}
+}
+
+aux_spi_stop (bus)
+{
+	if(auxSpiStarted[bus]){
+		cc.aux_spi_stop(bus);
+		auxSpiStarted[bus] = false;
+	}
+}
+
+aux_spi_set (bus, div, mode, cs)
+{
+	cc.aux_spi_set(bus, div, mode, cs);
+}
+
+/* wbuf or rbuf can be null, returns 2 on a timeout */
+aux_spi_transfer (bus, wbuf, rbuf, len)
+{
+	return cc.aux_spi_transfer(bus, wbuf, rbuf, len);
+}
+
+aux_spi_transfer_async (bus, wbuf, rbuf, len)
+{
+	try{
+		if(wbuf !== null){
+			len = asyncLength(wbuf, len);
+		}
+		if(rbuf !== null){
+			len = asyncLength(rbuf, len);
+		}
+	}
+	catch(e){
+		return Promise.reject(e);
+	}
+	return busAsync('spi' + bus, (cb) => cc.aux_spi_transfer_async(bus, wbuf, rbuf, len, cb));
+}
+
 spi_chip_select (cs)
 {
 	cc.spi_chip_select(cs);
@@ -565,24 +1208,119 @@ spi_set_clock_freq (div)
     	} 
 }
 
+/* Execute a list of transfers in one call, chip select, mode and clock are only written when they change,
+ * a timeout skips the remaining transfers and returns 2
+ */
+spi_transfer_list (xfers)
+{
+	return cc.spi_transfer_list(spiTransfers(xfers));
+}
+
+spi_transfer_list_async (xfers)
+{
+	let list;
+	try{
+		list = spiTransfers(xfers);
+	}
+	catch(e){
+		return Promise.reject(e);
+	}
+	return busAsync('spi', (cb) => cc.spi_transfer_list_async(list, cb));
+}
+
+/* spi device contexts, returns the device id or -1 */
+spi_dev_open (cs, mode, csHigh, div)
+{
+	return cc.spi_dev_open(cs, mode, csHigh ? 1 : 0, div);
+}
+
+spi_dev_close (id)
+{
+	cc.spi_dev_close(id);
+}
+
+/* wbuf or rbuf can be null, returns 1 if the device id is invalid, 2 on a timeout */
+spi_dev_transfer (id, wbuf, rbuf, len)
+{
+	return cc.spi_dev_transfer(id, wbuf, rbuf, len);
+}
+
+spi_dev_transfer_async (id, wbuf, rbuf, len)
+{
+	try{
+		if(wbuf !== null){
+			len = asyncLength(wbuf, len);
+		}
+		if(rbuf !== null){
+			len = asyncLength(rbuf, len);
+		}
+	}
+	catch(e){
+		return Promise.reject(e);
+	}
+	return busAsync('spi', (cb) => cc.spi_dev_transfer_async(id, wbuf, rbuf, len, cb));
+}
+
+/* min. length of the transfers using 32-bit FIFO words, 0 = disabled */
+spi_set_bulk_threshold (len)
+{
+	cc.spi_set_bulk_threshold(len);
+}
+
 spi_set_data_mode (mode)
 {
 	cc.spi_set_data_mode(mode);
 }
 
+/* the spi transfers return 2 on a timeout, else 0 */
 spi_data_transfer (wbuf, rbuf, len) 
 {
-	cc.spi_data_transfer(wbuf, rbuf, len);
+	return cc.spi_data_transfer(wbuf, rbuf, len);
 }
 
 spi_write (wbuf, len) 
 {
-	cc.spi_write(wbuf, len);
+	return cc.spi_write(wbuf, len);
 }
 
 spi_read (rbuf, len) 
 {
-	cc.spi_read(rbuf, len);
+	return cc.spi_read(rbuf, len);
+}
+
+/* Async spi transfers resolve with the status when the transfer is complete, the buffers must not be modified until then */
+spi_data_transfer_async (wbuf, rbuf, len)
+{
+	try{
+		len = asyncLength(wbuf, len);
+		asyncLength(rbuf, len);
+	}
+	catch(e){
+		return Promise.reject(e);
+	}
+	return busAsync('spi', (cb) => cc.spi_data_transfer_async(wbuf, rbuf, len, cb));
+}
+
+spi_write_async (wbuf, len)
+{
+	try{
+		len = asyncLength(wbuf, len);
+	}
+	catch(e){
+		return Promise.reject(e);
+	}
+	return busAsync('spi', (cb) => cc.spi_write_async(wbuf, len, cb));
+}
+
+spi_read_async (rbuf, len)
+{
+	try{
+		len = asyncLength(rbuf, len);
+	}
+	catch(e){
+		return Promise.reject(e);
+	}
+	return busAsync('spi', (cb) => cc.spi_read_async(rbuf, len, cb));
 }
 
 spi_end ()
@@ -0,0 +1,167 @@
+/*!
+ * array-gpio/sampler.js
+ *
+ * Copyright(c) 2017 Ed Alegrid
+ * MIT Licensed
+ */
+
+'use strict';
+
+const rpi = require('./rpi.js');
+const SPIDevice = require('./spi-device.js');
+
+// SharedArrayBuffer layout (see src/sampler.h): header | rec[capacity]
+const HDR_WORDS = 16, REC_WORDS = 2;
+
+// header word index
+const H_CAPACITY = 2, H_HEAD = 4, H_TAIL = 5, H_COUNT = 6, H_OVERRUNS = 7, H_LATE = 8, H_RATE = 9, H_FLAGS = 10;
+
+const SAMPLER_RUNNING = 0x01, SAMPLER_ERROR = 0x02;
+
+// SAMPLER_CMD_MAX, SAMPLER_SEQ_MAX and SAMPLER_RATE_MAX
+const CMD_MAX = 8, SEQ_MAX = 32, RATE_MAX = 1000000;
+
+/* command bytes of a channel and value bits of the received bytes */
+const adcs = {
+	mcp3008:{ length:3, mask:0x3ff, shift:0, command:(ch) => [0x01, 0x80 | (ch << 4), 0x00] },
+	mcp3004:{ length:3, mask:0x3ff, shift:0, command:(ch) => [0x01, 0x80 | (ch << 4), 0x00] },
+	mcp3208:{ length:3, mask:0xfff, shift:0, command:(ch) => [0x06 | (ch >> 2), (ch & 3) << 6, 0x00] },
+	mcp3204:{ length:3, mask:0xfff, shift:0, command:(ch) => [0x06 | (ch >> 2), (ch & 3) << 6, 0x00] },
+};
+
+var started = false;
+
+class Sampler {
+
+#hdr = null;
+#rec = null;
+#mask = 0;
+#dev = null;
+#own = false;
+
+/* options = { adc, channels, rate, capacity, device }
+ * adc      - 'mcp3008', 'mcp3004', 'mcp3208', 'mcp3204' or { length, mask, shift, command:(ch) => bytes }
+ * channels - channel sequence sampled round-robin (default [0])
+ * rate     - total samples per second (default 10000)
+ * capacity - no. of samples the ring holds (default 65536, rounded up to a power of 2)
+ * device   - SPIDevice or spi device options { cs, mode, div, csHigh } (default { cs:0, mode:0, div:128 })
+ */
+constructor(options){
+	let o = options === undefined ? {} : options;
+	let adc = typeof o.adc === 'object' ? o.adc : adcs[o.adc || 'mcp3008'];
+	let channels = o.channels || [0];
+	let capacity = 1;
+
+	if(started){
+		throw new Error('SPI sampler is already running');
+	}
+	if(adc === undefined || typeof adc.command !== 'function'){
+		throw new Error('Invalid adc ' + o.adc);
+	}
+	// the samples are stored as 16-bit values
+	if(adc.mask !== undefined && (!Number.isInteger(adc.mask) || adc.mask < 0 || adc.mask > 0xffff)){
+		throw new Error('Invalid adc mask, max. 16 bits');
+	}
+	if(adc.length !== undefined && (!Number.isInteger(adc.length) || adc.length < 1 || adc.length > CMD_MAX)){
+		throw new Error('Invalid adc command length');
+	}
+	if(!Array.isArray(channels) || channels.length === 0 || channels.length > SEQ_MAX){
+		throw new Error('Invalid channel sequence');
+	}
+	if(o.rate !== undefined && !(o.rate >= 1 && o.rate <= RATE_MAX)){
+		throw new Error('Invalid sample rate ' + o.rate);
+	}
+	while(capacity < (o.capacity || 65536)){
+		capacity <<= 1;
+	}
+
+	let len = adc.length || 3;
+	let cmd = Buffer.alloc(channels.length*len);
+	channels.forEach((ch, i) => Buffer.from(adc.command(ch)).copy(cmd, i*len, 0, len));
+
+	if(o.device instanceof SPIDevice){
+		this.#dev = o.device;
+	}
+	else{
+		this.#dev = new SPIDevice(o.device || { cs:0, mode:0, div:128 });
+		this.#own = true;
+	}
+
+	this.buffer = new SharedArrayBuffer(HDR_WORDS*4 + capacity*REC_WORDS*4);
+
+	if(rpi.sampler_start(this.buffer, capacity, this.#dev.id, cmd, len, Buffer.from(channels),
+		adc.mask === undefined ? 0xffff : adc.mask, adc.shift || 0, o.rate || 10000) !== 0){
+		this.#close();
+		throw new Error('SPI sampler start failed');
+	}
+	started = true;
+
+	this.#hdr = new Uint32Array(this.buffer, 0, HDR_WORDS);
+	this.#rec = new Uint32Array(this.buffer, HDR_WORDS*4, capacity*REC_WORDS);
+	this.#mask = capacity - 1;
+}
+
+#close(){
+	if(this.#own){
+		this.#dev.close();
+	}
+	this.#dev = null;
+}
+
+/* Remove up to max samples (default all) from the ring, returns { length, values, channels, timestamps }
+ * timestamps are system timer values in us (32 bits, wraps after ~71 min)
+ */
+read(max){
+	let head = Atomics.load(this.#hdr, H_HEAD);
+	let tail = this.#hdr[H_TAIL];
+	let n = (head - tail) >>> 0;
+
+	if(max !== undefined && n > max){
+		n = max;
+	}
+
+	let r = { length:n, values:new Uint16Array(n), channels:new Uint8Array(n), timestamps:new Uint32Array(n) };
+
+	for(let k = 0; k < n; k++){
+		let i = ((tail + k) & this.#mask) * REC_WORDS;
+		let w = this.#rec[i + 1];
+		r.timestamps[k] = this.#rec[i];
+		r.values[k] = w & 0xffff;
+		r.channels[k] = (w >>> 16) & 0xff;
+	}
+	Atomics.store(this.#hdr, H_TAIL, (tail + n) >>> 0);
+
+	return r;
+}
+
+/* no. of samples waiting in the ring */
+get available(){
+	return (Atomics.load(this.#hdr, H_HEAD) - this.#hdr[H_TAIL]) >>> 0;
+}
+
+/* overruns: samples dropped because the ring was full, late: sample periods missed by the sampling thread */
+stats(){
+	let flags = Atomics.load(this.#hdr, H_FLAGS);
+	return {
+		count:Atomics.load(this.#hdr, H_COUNT),
+		overruns:Atomics.load(this.#hdr, H_OVERRUNS),
+		late:Atomics.load(this.#hdr, H_LATE),
+		pending:this.available,
+		rate:this.#hdr[H_RATE],
+		running:(flags & SAMPLER_RUNNING) !== 0,
+		error:(flags & SAMPLER_ERROR) !== 0,
+	};
+}
+
+/* the ring keeps the samples not read yet */
+stop(){
+	if(started && this.#dev){
+		rpi.sampler_stop();
+		this.#close();
+		started = false;
+	}
+}
+
+}
+
+module.exports = Sampler;
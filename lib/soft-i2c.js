@@ -0,0 +1,140 @@
+/*!
+ * array-gpio/soft-i2c.js
+ *
+ * Copyright(c) 2017 Ed Alegrid
+ * MIT Licensed
+ */
+
+'use strict';
+
+const rpi = require('./rpi.js');
+
+/* Software (bit-banged) I2C master on any two gpio pins, same transfer methods as i2c.js
+ *
+ * SDA and SCL are driven open-drain by switching the pins between input and output-low,
+ * external pull-up resistors are required. Slaves can stretch the clock.
+ * The transfer methods return the i2c status: 0 ok, 1 nack, 2 clock stretch timeout.
+ */
+class SoftI2C {
+
+#id = -1;
+#addr = 0;
+#speed = 100000;
+#stretch = 0;
+
+/* options = { scl, sda, speed, stretchTimeout }
+ * scl, sda       - header pin numbers
+ * speed          - bus speed in Hz, 0 = as fast as possible (default 100000)
+ * stretchTimeout - max. clock stretch in us (default 25000)
+ */
+constructor(options){
+	let o = options === undefined ? {} : options;
+
+	if(o.scl === undefined || o.sda === undefined){
+		throw new Error('scl and sda pins are required');
+	}
+	this.#speed = o.speed === undefined ? 100000 : o.speed;
+	this.#stretch = o.stretchTimeout || 0;
+
+	this.#id = rpi.soft_i2c_open(o.scl, o.sda, this.#speed, this.#stretch);
+	if(this.#id < 0){
+		throw new Error('Invalid software i2c pins or no free software bus');
+	}
+}
+
+#check(){
+	if(this.#id < 0){
+		throw new Error('Software I2C is closed');
+	}
+}
+
+/* bus speed in Hz, 0 = as fast as possible */
+setSpeed(baud){
+	this.#speed = baud;
+	if(this.#id >= 0){
+		rpi.soft_i2c_config(this.#id, this.#speed, this.#stretch);
+	}
+}
+
+setTransferSpeed(baud){
+	this.setSpeed(baud);
+}
+
+selectSlave(addr){
+	this.#addr = addr;
+}
+
+setSlaveAddress(addr){
+	this.#addr = addr;
+	return 1;
+}
+
+/* address only write, returns 0 if the address is acknowledged */
+probe(addr){
+	this.#check();
+	return rpi.soft_i2c_write_read(this.#id, addr, null, 0, null, 0);
+}
+
+/* returns the addresses acknowledging a quick write */
+scan(first, last){
+	let found = [];
+	this.#check();
+	for(let a = first === undefined ? 0x08 : first; a <= (last === undefined ? 0x77 : last); a++){
+		if(rpi.soft_i2c_write_read(this.#id, a, null, 0, null, 0) === 0){
+			found.push(a);
+		}
+	}
+	return found;
+}
+
+read(buf, len){
+	this.#check();
+	return rpi.soft_i2c_write_read(this.#id, this.#addr, null, 0, buf, len === undefined ? buf.length : len);
+}
+
+write(buf, len){
+	this.#check();
+	return rpi.soft_i2c_write_read(this.#id, this.#addr, buf, len === undefined ? buf.length : len, null, 0);
+}
+
+/* write then read using a repeated start */
+writeRead(wbuf, wlen, rbuf, rlen){
+	this.#check();
+	return rpi.soft_i2c_write_read(this.#id, this.#addr, wbuf, wlen === undefined ? wbuf.length : wlen,
+		rbuf, rlen === undefined ? rbuf.length : rlen);
+}
+
+/* async versions, returns a promise that resolves w/ the i2c status after the transfer is completed in a worker thread */
+readAsync(buf, len){
+	if(this.#id < 0){
+		return Promise.reject(new Error('Software I2C is closed'));
+	}
+	return rpi.soft_i2c_write_read_async(this.#id, this.#addr, null, 0, buf, len === undefined ? buf.length : len);
+}
+
+writeAsync(buf, len){
+	if(this.#id < 0){
+		return Promise.reject(new Error('Software I2C is closed'));
+	}
+	return rpi.soft_i2c_write_read_async(this.#id, this.#addr, buf, len === undefined ? buf.length : len, null, 0);
+}
+
+writeReadAsync(wbuf, wlen, rbuf, rlen){
+	if(this.#id < 0){
+		return Promise.reject(new Error('Software I2C is closed'));
+	}
+	return rpi.soft_i2c_write_read_async(this.#id, this.#addr, wbuf, wlen === undefined ? wbuf.length : wlen,
+		rbuf, rlen === undefined ? rbuf.length : rlen);
+}
+
+/* the pins are reset to inputs */
+end(){
+	if(this.#id >= 0){
+		rpi.soft_close(this.#id);
+		this.#id = -1;
+	}
+}
+
+}
+
+module.exports = SoftI2C;
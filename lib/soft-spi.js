@@ -0,0 +1,109 @@
+/*!
+ * array-gpio/soft-spi.js
+ *
+ * Copyright(c) 2017 Ed Alegrid
+ * MIT Licensed
+ */
+
+'use strict';
+
+const rpi = require('./rpi.js');
+
+/* Software (bit-banged) SPI master on any gpio pins, same transfer methods as spi.js
+ *
+ * The bits are clocked by a native loop using GPSET0/GPCLR0 mask writes, a transfer is one native call.
+ */
+class SoftSPI {
+
+#id = -1;
+#mode = 0;
+#lsbFirst = false;
+#freq = 0;
+
+/* options = { sclk, mosi, miso, cs, mode, lsbFirst, csHigh, freq }
+ * sclk, mosi, miso, cs - header pin numbers, mosi, miso or cs can be omitted
+ * mode                 - data mode 0 ~ 3 (default 0)
+ * lsbFirst             - send the least significant bit first (default false)
+ * csHigh               - the chip select is active high (default false)
+ * freq                 - clock frequency in Hz, 0 = as fast as possible (default 1000000)
+ */
+constructor(options){
+	let o = options === undefined ? {} : options;
+
+	if(o.sclk === undefined){
+		throw new Error('sclk pin is required');
+	}
+	this.#mode = o.mode || 0;
+	this.#lsbFirst = !!o.lsbFirst;
+	this.#freq = o.freq === undefined ? 1000000 : o.freq;
+
+	this.#id = rpi.soft_spi_open(o.sclk, o.mosi, o.miso, o.cs, this.#mode, this.#lsbFirst, o.csHigh, this.#freq);
+	if(this.#id < 0){
+		throw new Error('Invalid software spi pins or no free software bus');
+	}
+}
+
+#config(){
+	if(this.#id >= 0){
+		rpi.soft_spi_config(this.#id, this.#mode, this.#lsbFirst, this.#freq);
+	}
+}
+
+setDataMode(mode){
+	this.#mode = mode;
+	this.#config();
+}
+
+/* clock frequency in Hz, 0 = as fast as possible */
+setClockFreq(freq){
+	this.#freq = freq;
+	this.#config();
+}
+
+setBitOrder(lsbFirst){
+	this.#lsbFirst = !!lsbFirst;
+	this.#config();
+}
+
+/* full-duplex transfer of len bytes, wbuf or rbuf can be null */
+dataTransfer(wbuf, rbuf, len){
+	if(this.#id >= 0){
+		rpi.soft_spi_transfer(this.#id, wbuf, rbuf, len === undefined ? (wbuf || rbuf).length : len);
+	}
+}
+
+write(wbuf, len){
+	this.dataTransfer(wbuf, null, len);
+}
+
+read(rbuf, len){
+	this.dataTransfer(null, rbuf, len);
+}
+
+/* async versions, returns a promise that resolves after the transfer is completed in a worker thread */
+dataTransferAsync(wbuf, rbuf, len){
+	if(this.#id >= 0){
+		return rpi.soft_spi_transfer_async(this.#id, wbuf, rbuf, len);
+	}
+	return Promise.reject(new Error('Software SPI is closed'));
+}
+
+writeAsync(wbuf, len){
+	return this.dataTransferAsync(wbuf, null, len);
+}
+
+readAsync(rbuf, len){
+	return this.dataTransferAsync(null, rbuf, len);
+}
+
+/* the pins are reset to inputs */
+end(){
+	if(this.#id >= 0){
+		rpi.soft_close(this.#id);
+		this.#id = -1;
+	}
+}
+
+}
+
+module.exports = SoftSPI;
@@ -0,0 +1,99 @@
+/*!
+ * array-gpio/spi-device.js
+ *
+ * Copyright(c) 2017 Ed Alegrid
+ * MIT Licensed
+ */
+
+'use strict';
+
+const rpi = require('./rpi.js');
+
+/* Device context, created with spi.device(options)
+ *
+ * The chip select, data mode, CS polarity and clock divider are stored once as
+ * ready-made control/clock register values. Each transfer loads them and runs
+ * the transfer under the bus lock in a single native call, the clock register
+ * is only written when the divider differs from the current one.
+ */
+class SPIDevice {
+
+#id = -1;
+
+/* options = { cs, mode, div, csHigh }
+ * cs     - chip select 0..2 (default 0)
+ * mode   - data mode 0..3 (default 0)
+ * div    - clock divider, 0 keeps the current bus clock (default 0)
+ * csHigh - chip select is active high (default false)
+ */
+constructor(options){
+	let o = options === undefined ? {} : options;
+
+	this.#id = rpi.spi_dev_open(o.cs || 0, o.mode || 0, o.csHigh, o.div || 0);
+	if(this.#id < 0){
+		throw new Error('Invalid spi device options or no free device context');
+	}
+}
+
+#check(buf, len){
+	if(this.#id < 0){
+		throw new Error('SPI device is closed');
+	}
+	return len === undefined && buf ? buf.length : len;
+}
+
+get id(){
+	return this.#id;
+}
+
+/* Full-duplex transfer of len bytes, wbuf or rbuf can be null */
+transfer(wbuf, rbuf, len){
+	len = this.#check(wbuf || rbuf, len);
+	return rpi.spi_dev_transfer(this.#id, wbuf, rbuf, len);
+}
+
+/* Transfer using buffers registered in a BufferPool (id, offset), wid or rid -1 sends zeros or discards the received bytes */
+transferBuf(wid, woff, rid, roff, len){
+	this.#check(null, len);
+	return rpi.spi_dev_transfer_buf(this.#id, wid, woff, rid, roff, len);
+}
+
+/* Write len bytes, the received bytes are discarded */
+write(wbuf, len){
+	return this.transfer(wbuf, null, len);
+}
+
+/* Read len bytes while sending zeros */
+read(rbuf, len){
+	return this.transfer(null, rbuf, len);
+}
+
+/* async versions, returns a promise that resolves after the transfer is completed in a worker thread */
+transferAsync(wbuf, rbuf, len){
+	try{
+		len = this.#check(wbuf || rbuf, len);
+	}
+	catch(e){
+		return Promise.reject(e);
+	}
+	return rpi.spi_dev_transfer_async(this.#id, wbuf, rbuf, len);
+}
+
+writeAsync(wbuf, len){
+	return this.transferAsync(wbuf, null, len);
+}
+
+readAsync(rbuf, len){
+	return this.transferAsync(null, rbuf, len);
+}
+
+close(){
+	if(this.#id >= 0){
+		rpi.spi_dev_close(this.#id);
+		this.#id = -1;
+	}
+}
+
+}
+
+module.exports = SPIDevice;
@@ -8,6 +8,7 @@
 'use strict';
 
 const rpi = require('./rpi.js');
+const SPIDevice = require('./spi-device.js');
 
 class SPI {
 
@@ -45,6 +46,37 @@ setClockFreq(div) {
 	}
 }
 
+/* Execute a list of transfers { cs, mode, div, tx, txOffset, rx, rxOffset, length, hold, delay } back-to-back
+ * in one call, tx or rx can be omitted (zeros are sent, the received bytes are discarded)
+ */
+transferList(xfers){
+	if(this.#init){
+		return rpi.spi_transfer_list(xfers);
+	}
+}
+
+transferListAsync(xfers){
+	if(this.#init){
+		return rpi.spi_transfer_list_async(xfers);
+	}
+	return Promise.reject(new Error('SPI is not started'));
+}
+
+/* Open a device context { cs, mode, div, csHigh }, see spi-device.js */
+device(options){
+	if(this.#init){
+		return new SPIDevice(options);
+	}
+	throw new Error('SPI is not started');
+}
+
+/* transfers of at least len bytes pack four bytes in each FIFO access (default 16, 0 = disabled) */
+setBulkThreshold(len){
+	if(this.#init){
+		rpi.spi_set_bulk_threshold(len);
+	}
+}
+
 setCSPolarity(cs, active){
 	if(this.#init){
   		rpi.spi_set_cs_polarity(cs, active);
@@ -60,22 +92,51 @@ chipSelect(cs){
 /* transfer data bytes to/from periphetal registers using node buffer objects */
 dataTransfer (wbuf, rbuf, len){
 	if(this.#init){
-  		rpi.spi_data_transfer(wbuf, rbuf, len);
+  		return rpi.spi_data_transfer(wbuf, rbuf, len);
+	}
+}
+
+/* transfer using buffers registered in a BufferPool (id, offset), wid or rid -1 sends zeros or discards the received bytes */
+transferBuf(wid, woff, rid, roff, len){
+	if(this.#init){
+		return rpi.spi_transfer_buf(wid, woff, rid, roff, len);
 	}
 }
 
 /* transfer data bytes to periphetal registers using node buffer objects */
 write(wbuf, len){
 	if(this.#init){
-  		rpi.spi_write(wbuf, len);
+  		return rpi.spi_write(wbuf, len);
 	}
 }
 
 /* transfer data bytes from periphetal registers using node buffer objects */
 read(rbuf, len){
 	if(this.#init){
-  		rpi.spi_read(rbuf, len);
+  		return rpi.spi_read(rbuf, len);
+	}
+}
+
+/* async versions, returns a promise that resolves after the transfer is completed in a worker thread */
+dataTransferAsync (wbuf, rbuf, len){
+	if(this.#init){
+		return rpi.spi_data_transfer_async(wbuf, rbuf, len);
+	}
+	return Promise.reject(new Error('SPI is not started'));
+}
+
+writeAsync(wbuf, len){
+	if(this.#init){
+		return rpi.spi_write_async(wbuf, len);
+	}
+	return Promise.reject(new Error('SPI is not started'));
+}
+
+readAsync(rbuf, len){
+	if(this.#init){
+		return rpi.spi_read_async(rbuf, len);
 	}
+	return Promise.reject(new Error('SPI is not started'));
 }
 
 end(){
@@ -0,0 +1,476 @@
+/**
+ * kdev.c
+ *
+ * Copyright (c) 2017 Ed Alegrid <ealegrid@gmail.com>
+ * GNU General Public License v3.0
+ *
+ */
+
+#define  _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+#include <linux/spi/spidev.h>
+
+#include "kdev.h"
+
+#define KDEV_I2C		1
+#define KDEV_SPI		2
+
+/* Max. no. of messages of an I2C_RDWR ioctl (I2C_RDWR_IOCTL_MAX_MSGS) */
+#define KDEV_I2C_MSG_MAX	42
+
+/* Max. no. of transfers of a SPI_IOC_MESSAGE ioctl */
+#define KDEV_SPI_XFER_MAX	64
+
+/* spidev message buffer size if /sys/module/spidev/parameters/bufsiz can't be read */
+#define KDEV_SPI_BUFSIZ		4096
+
+/* i2c status codes, same as the register backend */
+#define KDEV_I2C_NACK		1
+#define KDEV_I2C_TIMEOUT	2
+#define KDEV_I2C_ERROR		4
+
+#define KDEV_HAS(d, f)		(((d)->funcs & (f)) == (f))
+
+typedef struct {
+	uint8_t type;
+	int fd;
+	unsigned long funcs;	// i2c adapter functionality (I2C_FUNCS)
+	int addr;		// i2c slave address of the SMBus commands, -1 = not set
+	uint8_t mode;		// spi mode byte of the device file
+	uint32_t bufsiz;	// max. no. of bytes of a spi message
+	pthread_mutex_t lock;
+} kdev_t;
+
+/* the device locks are initialized once and never reset, a closed device may still have waiters */
+static kdev_t kdev[KDEV_MAX] = { [0 ... KDEV_MAX - 1] = { .fd = -1, .lock = PTHREAD_MUTEX_INITIALIZER } };
+static pthread_mutex_t kdev_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* Core clock used to convert the spi clock dividers of a transfer list into Hz, read on each spi open */
+static uint32_t kdev_core_hz = 250000000;
+
+/* Allocate a device and open its file, returns the device id or -1 */
+static int32_t kdev_open(const char *path, uint8_t type){
+	int32_t i, id = -1;
+	int fd;
+
+	fd = open(path, O_RDWR | O_CLOEXEC);
+	if(fd < 0){
+		printf("%s() error: ", __func__);
+		printf("%s: %s\n", path, strerror(errno));
+		return -1;
+	}
+
+	pthread_mutex_lock(&kdev_mutex);
+	for(i = 0; i < KDEV_MAX; i++){
+		if(kdev[i].type == 0){
+			kdev[i].type = type;
+			kdev[i].fd = fd;
+			kdev[i].funcs = 0;
+			kdev[i].addr = -1;
+			kdev[i].mode = 0;
+			kdev[i].bufsiz = 0;
+			id = i;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&kdev_mutex);
+
+	if(id < 0){
+		close(fd);
+		printf("%s() error: ", __func__);
+		puts("no free kernel device");
+	}
+
+	return id;
+}
+
+/* Returns the locked device, NULL if the id is not an open device of this type */
+static kdev_t *kdev_get(int32_t id, uint8_t type){
+	kdev_t *d;
+
+	if(id < 0 || id >= KDEV_MAX){
+		return NULL;
+	}
+	d = &kdev[id];
+	pthread_mutex_lock(&d->lock);
+	if(d->type != type){
+		pthread_mutex_unlock(&d->lock);
+		return NULL;
+	}
+	return d;
+}
+
+void kdev_close(int32_t id){
+	kdev_t *d;
+
+	if(id < 0 || id >= KDEV_MAX){
+		return;
+	}
+	d = &kdev[id];
+
+	/* waits for a transfer in progress, the mutex is kept for callers still waiting on it */
+	pthread_mutex_lock(&kdev_mutex);
+	pthread_mutex_lock(&d->lock);
+	if(d->type != 0){
+		close(d->fd);
+		d->type = 0;
+		d->fd = -1;
+	}
+	pthread_mutex_unlock(&d->lock);
+	pthread_mutex_unlock(&kdev_mutex);
+}
+
+/**
+ *  I2C (/dev/i2c-N)
+ */
+int32_t kdev_i2c_open(uint8_t bus){
+	char path[32];
+	unsigned long funcs;
+	int32_t id;
+
+	snprintf(path, sizeof(path), "/dev/i2c-%u", bus);
+
+	id = kdev_open(path, KDEV_I2C);
+	if(id < 0){
+		return -1;
+	}
+
+	if(ioctl(kdev[id].fd, I2C_FUNCS, &funcs) < 0){
+		printf("%s() error: ", __func__);
+		printf("%s is not an i2c adapter\n", path);
+		kdev_close(id);
+		return -1;
+	}
+	kdev[id].funcs = funcs;
+
+	return id;
+}
+
+static uint8_t kdev_i2c_status(int err){
+	if(err == ENXIO || err == EREMOTEIO){
+		return KDEV_I2C_NACK;
+	}
+	if(err == ETIMEDOUT){
+		return KDEV_I2C_TIMEOUT;
+	}
+	return KDEV_I2C_ERROR;
+}
+
+/* Chained messages in one I2C_RDWR ioctl, repeated starts between them and a stop after the last one */
+static uint8_t kdev_i2c_rdwr(kdev_t *d, i2c_msg_t *m, uint32_t n){
+	struct i2c_msg km[KDEV_I2C_MSG_MAX];
+	struct i2c_rdwr_ioctl_data rdwr = { km, n };
+	uint32_t i;
+
+	for(i = 0; i < n; i++){
+		km[i].addr = m[i].addr;
+		km[i].flags = (m[i].flags & I2C_MSG_RD) ? I2C_M_RD : 0;
+		km[i].len = m[i].len;
+		km[i].buf = (uint8_t *)m[i].buf;
+	}
+
+	if(ioctl(d->fd, I2C_RDWR, &rdwr) < 0){
+		return kdev_i2c_status(errno);
+	}
+	return 0;
+}
+
+static uint8_t kdev_smbus(kdev_t *d, uint8_t addr, char rw, uint8_t cmd, int size, union i2c_smbus_data *data){
+	struct i2c_smbus_ioctl_data a = { rw, cmd, size, data };
+
+	if(d->addr != addr){
+		if(ioctl(d->fd, I2C_SLAVE, addr) < 0){
+			return KDEV_I2C_ERROR;
+		}
+		d->addr = addr;
+	}
+	if(ioctl(d->fd, I2C_SMBUS, &a) < 0){
+		return kdev_i2c_status(errno);
+	}
+	return 0;
+}
+
+/* SMBus command of a write (w), a read (r) or a register read (w + r w/ a repeated start),
+ * for adapters w/o I2C_FUNC_I2C
+ */
+static uint8_t kdev_i2c_smbus(kdev_t *d, const i2c_msg_t *w, i2c_msg_t *r){
+	union i2c_smbus_data data;
+	uint8_t *wb = w ? (uint8_t *)w->buf : NULL;
+	uint8_t s;
+
+	if(w && r){
+		if(w->len != 1){
+			return KDEV_I2C_ERROR;
+		}
+		if(r->len == 1 && KDEV_HAS(d, I2C_FUNC_SMBUS_READ_BYTE_DATA)){
+			s = kdev_smbus(d, w->addr, I2C_SMBUS_READ, wb[0], I2C_SMBUS_BYTE_DATA, &data);
+			r->buf[0] = data.byte;
+		}
+		else if(r->len == 2 && KDEV_HAS(d, I2C_FUNC_SMBUS_READ_WORD_DATA)){
+			s = kdev_smbus(d, w->addr, I2C_SMBUS_READ, wb[0], I2C_SMBUS_WORD_DATA, &data);
+			r->buf[0] = data.word & 0xff;
+			r->buf[1] = data.word >> 8;
+		}
+		else if(r->len > 0 && r->len <= I2C_SMBUS_BLOCK_MAX && KDEV_HAS(d, I2C_FUNC_SMBUS_READ_I2C_BLOCK)){
+			data.block[0] = r->len;
+			s = kdev_smbus(d, w->addr, I2C_SMBUS_READ, wb[0], I2C_SMBUS_I2C_BLOCK_DATA, &data);
+			memcpy(r->buf, data.block + 1, r->len);
+		}
+		else{
+			return KDEV_I2C_ERROR;
+		}
+	}
+	else if(r){
+		if(r->len != 1 || !KDEV_HAS(d, I2C_FUNC_SMBUS_READ_BYTE)){
+			return KDEV_I2C_ERROR;
+		}
+		s = kdev_smbus(d, r->addr, I2C_SMBUS_READ, 0, I2C_SMBUS_BYTE, &data);
+		r->buf[0] = data.byte;
+	}
+	else if(w->len == 0 && KDEV_HAS(d, I2C_FUNC_SMBUS_QUICK)){
+		s = kdev_smbus(d, w->addr, I2C_SMBUS_WRITE, 0, I2C_SMBUS_QUICK, NULL);
+	}
+	else if(w->len == 1 && KDEV_HAS(d, I2C_FUNC_SMBUS_WRITE_BYTE)){
+		s = kdev_smbus(d, w->addr, I2C_SMBUS_WRITE, wb[0], I2C_SMBUS_BYTE, NULL);
+	}
+	else if(w->len == 2 && KDEV_HAS(d, I2C_FUNC_SMBUS_WRITE_BYTE_DATA)){
+		data.byte = wb[1];
+		s = kdev_smbus(d, w->addr, I2C_SMBUS_WRITE, wb[0], I2C_SMBUS_BYTE_DATA, &data);
+	}
+	else if(w->len == 3 && KDEV_HAS(d, I2C_FUNC_SMBUS_WRITE_WORD_DATA)){
+		data.word = wb[1] | (wb[2] << 8);
+		s = kdev_smbus(d, w->addr, I2C_SMBUS_WRITE, wb[0], I2C_SMBUS_WORD_DATA, &data);
+	}
+	else if(w->len >= 2 && w->len <= I2C_SMBUS_BLOCK_MAX + 1 && KDEV_HAS(d, I2C_FUNC_SMBUS_WRITE_I2C_BLOCK)){
+		data.block[0] = w->len - 1;
+		memcpy(data.block + 1, wb + 1, w->len - 1);
+		s = kdev_smbus(d, w->addr, I2C_SMBUS_WRITE, wb[0], I2C_SMBUS_I2C_BLOCK_DATA, &data);
+	}
+	else{
+		return KDEV_I2C_ERROR;
+	}
+
+	return s;
+}
+
+uint32_t kdev_i2c_transfer(int32_t id, i2c_msg_t *msgs, uint32_t n){
+	kdev_t *d = kdev_get(id, KDEV_I2C);
+	uint32_t i, k, failed = 0;
+	uint8_t s;
+
+	if(d == NULL){
+		for(i = 0; i < n; i++){
+			msgs[i].status = KDEV_I2C_ERROR;
+		}
+		return n;
+	}
+
+	for(i = 0; i < n; i = k){
+		/* messages chained w/ I2C_MSG_NOSTOP go in one ioctl */
+		for(k = i + 1; k < n && k - i < KDEV_I2C_MSG_MAX && (msgs[k - 1].flags & I2C_MSG_NOSTOP); k++){
+			;
+		}
+
+		/* zero-length messages are not supported by all adapters, a single one is sent as a quick write */
+		if(KDEV_HAS(d, I2C_FUNC_I2C) && !(k - i == 1 && msgs[i].len == 0 && KDEV_HAS(d, I2C_FUNC_SMBUS_QUICK))){
+			s = kdev_i2c_rdwr(d, msgs + i, k - i);
+		}
+		else if(k - i == 1){
+			s = (msgs[i].flags & I2C_MSG_RD) ? kdev_i2c_smbus(d, NULL, &msgs[i]) : kdev_i2c_smbus(d, &msgs[i], NULL);
+		}
+		else if(k - i == 2 && !(msgs[i].flags & I2C_MSG_RD) && (msgs[i + 1].flags & I2C_MSG_RD) && msgs[i].addr == msgs[i + 1].addr){
+			s = kdev_i2c_smbus(d, &msgs[i], &msgs[i + 1]);
+		}
+		else{
+			s = KDEV_I2C_ERROR;
+		}
+
+		for(uint32_t j = i; j < k; j++){
+			msgs[j].status = s;
+			if(s){
+				failed++;
+			}
+		}
+	}
+
+	pthread_mutex_unlock(&d->lock);
+
+	return failed;
+}
+
+/**
+ *  SPI (/dev/spidevB.C)
+ */
+int32_t kdev_spi_open(uint8_t bus, uint8_t cs){
+	char path[32];
+	unsigned int bufsiz = 0;
+	FILE *f;
+	int32_t id;
+
+	snprintf(path, sizeof(path), "/dev/spidev%u.%u", bus, cs);
+
+	id = kdev_open(path, KDEV_SPI);
+	if(id < 0){
+		return -1;
+	}
+
+	if(ioctl(kdev[id].fd, SPI_IOC_RD_MODE, &kdev[id].mode) < 0){
+		printf("%s() error: ", __func__);
+		printf("%s is not a spidev device\n", path);
+		kdev_close(id);
+		return -1;
+	}
+
+	f = fopen("/sys/module/spidev/parameters/bufsiz", "r");
+	if(f != NULL){
+		if(fscanf(f, "%u", &bufsiz) != 1){
+			bufsiz = 0;
+		}
+		fclose(f);
+	}
+	kdev[id].bufsiz = bufsiz ? bufsiz : KDEV_SPI_BUFSIZ;
+
+	/* firmware core clock (mailbox), 250 MHz if it is not available */
+	__atomic_store_n(&kdev_core_hz, get_core_clock_freq(), __ATOMIC_RELAXED);
+
+	return id;
+}
+
+/* Write the mode byte of the device file if it has changed */
+static uint8_t kdev_spi_mode(kdev_t *d, uint8_t m){
+	if(m != d->mode){
+		if(ioctl(d->fd, SPI_IOC_WR_MODE, &m) < 0){
+			printf("%s() error: ", __func__);
+			puts(strerror(errno));
+			return 1;
+		}
+		d->mode = m;
+	}
+	return 0;
+}
+
+uint8_t kdev_spi_config(int32_t id, uint8_t mode, uint32_t speed, uint8_t flags){
+	kdev_t *d = kdev_get(id, KDEV_SPI);
+	uint8_t lsb = (flags & KDEV_SPI_LSB_FIRST) ? 1 : 0;
+	uint8_t rval = 0;
+
+	if(d == NULL){
+		printf("%s() error: ", __func__);
+		puts("invalid spi device");
+		return 1;
+	}
+
+	rval = kdev_spi_mode(d, (d->mode & ~(SPI_CPHA | SPI_CPOL | SPI_CS_HIGH)) | (mode & 3) |
+		((flags & KDEV_SPI_CS_HIGH) ? SPI_CS_HIGH : 0));
+
+	if(ioctl(d->fd, SPI_IOC_WR_LSB_FIRST, &lsb) < 0 && lsb){
+		printf("%s() error: ", __func__);
+		puts("lsb first is not supported by the spi controller");
+		rval = 1;
+	}
+
+	if(speed && ioctl(d->fd, SPI_IOC_WR_MAX_SPEED_HZ, &speed) < 0){
+		printf("%s() error: ", __func__);
+		puts(strerror(errno));
+		rval = 1;
+	}
+
+	pthread_mutex_unlock(&d->lock);
+
+	return rval;
+}
+
+/* Send the transfers collected as one message. Within a message the chip select stays asserted
+ * between transfers unless cs_change is set, on the last transfer cs_change keeps it asserted
+ */
+static uint8_t kdev_spi_flush(kdev_t *d, struct spi_ioc_transfer *t, const uint8_t *hold, uint32_t *k, uint32_t *bytes){
+	uint32_t i, n = *k;
+
+	if(n == 0){
+		return 0;
+	}
+
+	for(i = 0; i < n; i++){
+		t[i].cs_change = (i + 1 == n) ? hold[i] : !hold[i];
+	}
+
+	*k = 0;
+	*bytes = 0;
+
+	if(ioctl(d->fd, SPI_IOC_MESSAGE(n), t) < 0){
+		printf("%s() error: ", __func__);
+		puts(strerror(errno));
+		return 1;
+	}
+
+	memset(t, 0, n * sizeof(struct spi_ioc_transfer));
+	return 0;
+}
+
+uint8_t kdev_spi_transfer(int32_t id, const spi_xfer_t *x, uint32_t n){
+	struct spi_ioc_transfer t[KDEV_SPI_XFER_MAX];
+	uint8_t hold[KDEV_SPI_XFER_MAX];
+	kdev_t *d = kdev_get(id, KDEV_SPI);
+	uint32_t i, k = 0, bytes = 0, off, len;
+	uint8_t rval = 0;
+
+	if(d == NULL){
+		printf("%s() error: ", __func__);
+		puts("invalid spi device");
+		return 1;
+	}
+
+	memset(t, 0, sizeof(t));
+
+	for(i = 0; i < n && rval == 0; i++){
+		/* the mode applies to the whole message, a mode change starts a new one */
+		if(x[i].mode != SPI_XFER_KEEP && (x[i].mode & 3) != (d->mode & 3)){
+			rval = kdev_spi_flush(d, t, hold, &k, &bytes);
+			if(rval == 0){
+				rval = kdev_spi_mode(d, (d->mode & ~(SPI_CPHA | SPI_CPOL)) | (x[i].mode & 3));
+			}
+		}
+
+		/* a transfer larger than the message buffer is split into several messages */
+		off = 0;
+		do{
+			len = x[i].len - off < d->bufsiz ? x[i].len - off : d->bufsiz;
+
+			if(rval == 0 && (k == KDEV_SPI_XFER_MAX || bytes + len > d->bufsiz)){
+				rval = kdev_spi_flush(d, t, hold, &k, &bytes);
+			}
+			if(rval){
+				break;
+			}
+
+			t[k].tx_buf = x[i].tx ? (uintptr_t)(x[i].tx + off) : 0;
+			t[k].rx_buf = x[i].rx ? (uintptr_t)(x[i].rx + off) : 0;
+			t[k].len = len;
+			t[k].speed_hz = x[i].div ? kdev_core_hz / x[i].div : 0;
+			off += len;
+			t[k].delay_usecs = off == x[i].len ? (x[i].delay_us > 0xffff ? 0xffff : x[i].delay_us) : 0;
+			hold[k] = off == x[i].len ? (x[i].flags & SPI_XFER_CS_HOLD) != 0 : 1;
+			bytes += len;
+			k++;
+		} while(off < x[i].len);
+	}
+
+	if(rval == 0){
+		rval = kdev_spi_flush(d, t, hold, &k, &bytes);
+	}
+
+	pthread_mutex_unlock(&d->lock);
+
+	return rval;
+}
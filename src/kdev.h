@@ -0,0 +1,55 @@
+/**
+ * kdev.h
+ *
+ * Copyright (c) 2017 Ed Alegrid <ealegrid@gmail.com>
+ * GNU General Public License v3.0
+ *
+ */
+
+/* Kernel driver i2c (/dev/i2c-N) and spi (/dev/spidevB.C) backends */
+#ifndef KDEV_H
+#define KDEV_H
+
+#include <stdint.h>
+
+#include "rpi.h"
+
+/* Max. no. of open kernel devices */
+#define KDEV_MAX		16
+
+/* kdev_spi_config() flags */
+#define KDEV_SPI_LSB_FIRST	0x01
+#define KDEV_SPI_CS_HIGH	0x02
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Open /dev/i2c-<bus>, returns the device id or -1 */
+int32_t kdev_i2c_open(uint8_t bus);
+
+/* Execute the messages w/ I2C_RDWR ioctls, a message w/ I2C_MSG_NOSTOP continues into the next one
+ * w/ a repeated start and the chained messages are sent in one ioctl. Adapters w/o plain i2c
+ * support (e.g. i2c-stub) use SMBus commands for the common message patterns.
+ * The status of each message is set (0 ok, 1 nack, 2 timeout, 4 other error), returns the no. of failed messages
+ */
+uint32_t kdev_i2c_transfer(int32_t id, i2c_msg_t *msgs, uint32_t n);
+
+/* Open /dev/spidev<bus>.<cs>, returns the device id or -1 */
+int32_t kdev_spi_open(uint8_t bus, uint8_t cs);
+
+/* Data mode 0 ~ 3, default clock speed (Hz, 0 = keep) and KDEV_SPI_* flags, returns 0 on success */
+uint8_t kdev_spi_config(int32_t id, uint8_t mode, uint32_t speed, uint8_t flags);
+
+/* Execute the transfers w/ SPI_IOC_MESSAGE ioctls, consecutive transfers are sent in one message
+ * up to the spidev buffer size. The cs field is ignored (fixed by the device file), returns 0 on success
+ */
+uint8_t kdev_spi_transfer(int32_t id, const spi_xfer_t *x, uint32_t n);
+
+void kdev_close(int32_t id);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* KDEV_H */
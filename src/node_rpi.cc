@@ -5,7 +5,17 @@
  */
 
 #include <nan.h>
+#include <vector>
+#include <cstring>
 #include "rpi.h"
+#include "stats.h"
+#include "trace.h"
+#include "rt.h"
+#include "ring.h"
+#include "poller.h"
+#include "sampler.h"
+#include "regmap.h"
+#include "kdev.h"
 
 #define LIBNAME node_bcm
 
@@ -38,501 +48,2611 @@ NAN_METHOD(rpi_close)
 }
 
 /*
- *  Timers 
+ *  core clock (Hz) used by the i2c and spi clock dividers
  */
-NAN_METHOD(nswait)
+NAN_METHOD(get_core_clock_freq)
 {
-	if((info.Length() != 1) || (!info[0]->IsNumber())){
+	info.GetReturnValue().Set(get_core_clock_freq());
+}
+
+/*
+ *  Instrumentation counters
+ */
+NAN_METHOD(rpi_stats)
+{
+	uint64_t counters[STAT_SUBSYS * STAT_COUNTERS];
+	uint32_t i, n;
+
+	n = rpi_stats(counters, STAT_SUBSYS * STAT_COUNTERS);
+
+	v8::Local<v8::ArrayBuffer> ab = v8::ArrayBuffer::New(v8::Isolate::GetCurrent(), n * sizeof(double));
+	v8::Local<v8::Float64Array> stats = v8::Float64Array::New(ab, 0, n);
+	Nan::TypedArrayContents<double> data(stats);
+
+	for(i = 0; i < n; i++){
+		(*data)[i] = (double)counters[i];
+	}
+
+	info.GetReturnValue().Set(stats);
+}
+
+NAN_METHOD(rpi_stats_reset)
+{
+	rpi_stats_reset();
+}
+
+NAN_METHOD(rpi_stats_export)
+{
+	uint8_t rval;
+
+	if((info.Length() != 1) || (!info[0]->IsString())){
 		return ThrowTypeError("Incorrect arguments");
 	}
 
-	uint64_t arg = info[0]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
-	
-	nswait(arg);
+	Nan::Utf8String name(info[0]);
+
+	rval = rpi_stats_export(*name);
+
+	info.GetReturnValue().Set(rval);
 }
 
-NAN_METHOD(uswait)
+/*
+ *  Register-level trace
+ */
+NAN_METHOD(rpi_trace_start)
 {
 	if((info.Length() != 1) || (!info[0]->IsNumber())){
 		return ThrowTypeError("Incorrect arguments");
 	}
 
 	uint32_t arg = info[0]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
-	
-	uswait(arg);
+
+	rpi_trace_start(arg);
 }
 
-NAN_METHOD(mswait)
+NAN_METHOD(rpi_trace_stop)
 {
-	if((info.Length() != 1) || (!info[0]->IsNumber())){
+	rpi_trace_stop();
+}
+
+NAN_METHOD(rpi_trace_clear)
+{
+	rpi_trace_clear();
+}
+
+NAN_METHOD(rpi_trace_dump)
+{
+	int32_t rval;
+
+	if((info.Length() != 1) || (!info[0]->IsString())){
 		return ThrowTypeError("Incorrect arguments");
 	}
 
-	uint32_t arg = info[0]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
-	
-	mswait(arg);
+	Nan::Utf8String path(info[0]);
+
+	rval = rpi_trace_dump(*path);
+
+	info.GetReturnValue().Set(rval);
 }
 
 /*
- *  GPIO
+ *  Bus wait strategy
  */
-NAN_METHOD(gpio_init)
+/* bus_wait(adaptive, min_sleep_us), wait strategy of the i2c/spi polling loops */
+NAN_METHOD(bus_wait)
 {
-	gpio_init();
+	if((info.Length() != 2) || (!info[0]->IsNumber()) || (!info[1]->IsNumber())){
+		return ThrowTypeError("Incorrect arguments");
+	}
+
+	uint8_t adaptive = info[0]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+	uint32_t min_sleep_us = info[1]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+
+	bus_wait_set(adaptive, min_sleep_us);
 }
 
+/*
+ *  Real-time profile
+ */
+NAN_METHOD(rpi_rt_profile)
+{
+	uint8_t rval;
+	rt_profile_t p;
 
-NAN_METHOD(gpio_config) 
+	if((info.Length() != 5) || (!info[0]->IsNumber()) || (!info[1]->IsNumber()) || (!info[2]->IsNumber()) || 
+		(!info[3]->IsNumber()) || (!info[4]->IsNumber())){
+		return ThrowTypeError("Incorrect arguments");
+	}
+
+	p.priority = info[0]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+	p.cpu = info[1]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+	p.mlock = info[2]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+	p.prefault = info[3]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+	p.spin = info[4]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+
+	rval = rpi_rt_profile(&p);
+
+	info.GetReturnValue().Set(rval);
+}
+
+NAN_METHOD(rpi_rt_apply)
 {
-	if((info.Length() != 2) || (!info[0]->IsNumber()) || (!info[1]->IsNumber())){
+	uint8_t rval;
+
+	rval = rpi_rt_apply();
+
+	info.GetReturnValue().Set(rval);
+}
+
+NAN_METHOD(rpi_rt_status)
+{
+	rt_status_t st;
+
+	rpi_rt_status(&st);
+
+	v8::Local<v8::Object> obj = Nan::New<v8::Object>();
+	Nan::Set(obj, Nan::New("flags").ToLocalChecked(), Nan::New<v8::Uint32>(st.flags));
+	Nan::Set(obj, Nan::New("priority").ToLocalChecked(), Nan::New<v8::Int32>(st.priority));
+	Nan::Set(obj, Nan::New("cpu").ToLocalChecked(), Nan::New<v8::Int32>(st.cpu));
+	Nan::Set(obj, Nan::New("error").ToLocalChecked(), Nan::New<v8::Int32>(st.error));
+
+	info.GetReturnValue().Set(obj);
+}
+
+/*
+ *  Submission/completion rings
+ *
+ *  The ring lives in a SharedArrayBuffer, its backing store is kept alive until rpi_ring_stop().
+ *  The worker thread wakes up the event loop through an uv_async handle after each batch of completions.
+ */
+typedef struct {
+	uv_async_t async;
+	Nan::Callback *callback;
+	Nan::AsyncResource *resource;
+	std::shared_ptr<v8::BackingStore> store;
+} ring_js_t;
+
+static ring_js_t *ring_js[RING_MAX] = {};
+
+static void ring_notify(void *arg)
+{
+	uv_async_send((uv_async_t *)arg);
+}
+
+static void ring_complete(uv_async_t *handle)
+{
+	Nan::HandleScope scope;
+	ring_js_t *r = (ring_js_t *)handle->data;
+
+	r->callback->Call(0, NULL, r->resource);
+}
+
+static void ring_close(uv_handle_t *handle)
+{
+	ring_js_t *r = (ring_js_t *)handle->data;
+
+	delete r->callback;
+	delete r->resource;
+	delete r;
+}
+
+/* rpi_ring_start(sab, bus, entries[, callback]), returns the ring id or -1 */
+NAN_METHOD(rpi_ring_start)
+{
+	int32_t id;
+
+	if((info.Length() < 3) || (!info[0]->IsSharedArrayBuffer()) || (!info[1]->IsNumber()) || (!info[2]->IsNumber()) ||
+		(info.Length() > 3 && !info[3]->IsFunction())){
 		return ThrowTypeError("Incorrect arguments");
 	}
 
-	uint8_t arg1 = info[0]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
-	uint8_t arg2 = info[1]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+	uint8_t bus = info[1]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+	uint32_t entries = info[2]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
 
-	gpio_config(arg1, arg2);
+	ring_js_t *r = new ring_js_t();
+	r->store = info[0].As<v8::SharedArrayBuffer>()->GetBackingStore();
+	r->async.data = r;
+
+	if(info.Length() > 3){
+		r->callback = new Nan::Callback(info[3].As<v8::Function>());
+		r->resource = new Nan::AsyncResource("array-gpio:ring");
+		uv_async_init(Nan::GetCurrentEventLoop(), &r->async, ring_complete);
+	}
+
+	id = rpi_ring_start(r->store->Data(), r->store->ByteLength(), bus, entries,
+		r->callback ? ring_notify : NULL, &r->async);
+
+	if(id < 0){
+		if(r->callback){
+			uv_close((uv_handle_t *)&r->async, ring_close);
+		}
+		else{
+			delete r;
+		}
+	}
+	else{
+		ring_js[id] = r;
+	}
+
+	info.GetReturnValue().Set(id);
 }
 
-NAN_METHOD(gpio_input) 
+NAN_METHOD(rpi_ring_enter)
 {
 	if((info.Length() != 1) || (!info[0]->IsNumber())){
 		return ThrowTypeError("Incorrect arguments");
 	}
 
-	uint8_t arg = info[0]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
-	
-	gpio_input(arg);
+	int32_t id = info[0]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+
+	rpi_ring_enter(id);
 }
 
-NAN_METHOD(gpio_output) 
+NAN_METHOD(rpi_ring_stop)
 {
 	if((info.Length() != 1) || (!info[0]->IsNumber())){
 		return ThrowTypeError("Incorrect arguments");
 	}
 
-	uint8_t arg = info[0]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
-	
-	gpio_output(arg);
+	int32_t id = info[0]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+
+	if(id < 0 || id >= RING_MAX || ring_js[id] == NULL){
+		return;
+	}
+
+	rpi_ring_stop(id);
+
+	ring_js_t *r = ring_js[id];
+	ring_js[id] = NULL;
+
+	if(r->callback){
+		uv_close((uv_handle_t *)&r->async, ring_close);
+	}
+	else{
+		delete r;
+	}
 }
 
-NAN_METHOD(gpio_read) 
+/*
+ *  Background i2c sensor polling
+ *
+ *  The results are written into a SharedArrayBuffer, its backing store is kept alive until rpi_poller_stop().
+ */
+static std::shared_ptr<v8::BackingStore> poller_store;
+
+/* rpi_poller_start(sab, slots, slot_size), returns 0 on success */
+NAN_METHOD(rpi_poller_start)
 {
 	uint8_t rval;
 
+	if((info.Length() != 3) || (!info[0]->IsSharedArrayBuffer()) || (!info[1]->IsNumber()) || (!info[2]->IsNumber())){
+		return ThrowTypeError("Incorrect arguments");
+	}
+
+	uint32_t arg1 = info[1]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+	uint32_t arg2 = info[2]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+	std::shared_ptr<v8::BackingStore> store = info[0].As<v8::SharedArrayBuffer>()->GetBackingStore();
+
+	rval = rpi_poller_start(store->Data(), store->ByteLength(), arg1, arg2);
+	if(rval == 0){
+		poller_store = store;
+	}
+
+	info.GetReturnValue().Set(rval);
+}
+
+/* rpi_poller_add(addr, cmd, cmd_len, len, period_us), returns the slot index or -1 */
+NAN_METHOD(rpi_poller_add)
+{
+	int32_t rval;
+
+	if((info.Length() != 5) || (!info[0]->IsNumber()) || (!node::Buffer::HasInstance(info[1])) || (!info[2]->IsNumber()) || 
+		(!info[3]->IsNumber()) || (!info[4]->IsNumber())){
+		return ThrowTypeError("Incorrect arguments");
+	}
+
+	uint8_t addr = info[0]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+	v8::Local<v8::Object> cmd =  info[1]->ToObject(Nan::GetCurrentContext()).FromMaybe(v8::Local<v8::Object>());
+	uint32_t cmd_len = info[2]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+	uint32_t len = info[3]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+	uint32_t period = info[4]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+
+	/* rpi_poller_add() checks cmd_len against POLLER_CMD_MAX */
+	if(cmd_len > node::Buffer::Length(cmd)){
+		return ThrowTypeError("Incorrect arguments");
+	}
+
+	rval = rpi_poller_add(addr, node::Buffer::Data(cmd), cmd_len, len, period);
+
+	info.GetReturnValue().Set(rval);
+}
+
+NAN_METHOD(rpi_poller_remove)
+{
 	if((info.Length() != 1) || (!info[0]->IsNumber())){
 		return ThrowTypeError("Incorrect arguments");
 	}
 
-	uint8_t arg = info[0]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+	int32_t arg = info[0]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+
+	rpi_poller_remove(arg);
+}
+
+NAN_METHOD(rpi_poller_stop)
+{
+	rpi_poller_stop();
+	poller_store.reset();
+}
+
+/*
+ *  Continuous spi adc sampling
+ *
+ *  The samples are written into a SharedArrayBuffer ring, its backing store is kept alive until rpi_sampler_stop().
+ */
+static std::shared_ptr<v8::BackingStore> sampler_store;
+
+/* rpi_sampler_start(sab, capacity, dev, cmd, cmd_len, channels, mask, shift, rate), returns 0 on success
+ * cmd holds cmd_len command bytes for each entry of the channel sequence (channels buffer)
+ */
+NAN_METHOD(rpi_sampler_start)
+{
+	uint8_t rval;
+	sampler_cfg_t cfg = {};
+
+	if((info.Length() != 9) || (!info[0]->IsSharedArrayBuffer()) || (!info[1]->IsNumber()) || (!info[2]->IsNumber()) ||
+		(!node::Buffer::HasInstance(info[3])) || (!info[4]->IsNumber()) || (!node::Buffer::HasInstance(info[5])) ||
+		(!info[6]->IsNumber()) || (!info[7]->IsNumber()) || (!info[8]->IsNumber())){
+		return ThrowTypeError("Incorrect arguments");
+	}
+
+	uint32_t capacity = info[1]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+	cfg.dev = info[2]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+	cfg.cmd_len = info[4]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+	cfg.mask = info[6]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+	cfg.shift = info[7]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+	cfg.rate = info[8]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+
+	size_t nch = node::Buffer::Length(info[5]);
+	if(nch == 0 || nch > SAMPLER_SEQ_MAX || cfg.cmd_len == 0 || cfg.cmd_len > SAMPLER_CMD_MAX ||
+		node::Buffer::Length(info[3]) < nch * cfg.cmd_len){
+		return ThrowRangeError("Invalid channel sequence or command length");
+	}
+
+	cfg.nch = nch;
+	for(size_t i = 0; i < nch; i++){
+		cfg.ch[i] = node::Buffer::Data(info[5])[i];
+		memcpy(cfg.cmd[i], node::Buffer::Data(info[3]) + i * cfg.cmd_len, cfg.cmd_len);
+	}
+
+	std::shared_ptr<v8::BackingStore> store = info[0].As<v8::SharedArrayBuffer>()->GetBackingStore();
+
+	rval = rpi_sampler_start(store->Data(), store->ByteLength(), capacity, &cfg);
+	if(rval == 0){
+		sampler_store = store;
+	}
 
-	rval = gpio_read(arg);
-	
 	info.GetReturnValue().Set(rval);
 }
 
-NAN_METHOD(gpio_enable_async_rising_event) 
+NAN_METHOD(rpi_sampler_stop)
 {
-	if((info.Length() != 2) || (!info[0]->IsNumber()) || (!info[1]->IsNumber())){
+	rpi_sampler_stop();
+	sampler_store.reset();
+}
+
+/*
+ *  Registered buffer pool
+ *
+ *  ArrayBuffers are registered once, the *_buf transfer methods address them by (id, offset, length)
+ *  w/o any object conversion per call. The backing stores are kept alive until buf_unregister().
+ */
+#define BUFPOOL_MAX	64
+
+typedef struct {
+	std::shared_ptr<v8::BackingStore> store;
+	char *data;
+	size_t len;
+} bufpool_t;
+
+static bufpool_t bufpool[BUFPOOL_MAX];
+
+/* Checks the first n arguments are numbers */
+static bool buf_args(const Nan::FunctionCallbackInfo<v8::Value>& info, int n)
+{
+	if(info.Length() != n){
+		return false;
+	}
+	for(int i = 0; i < n; i++){
+		if(!info[i]->IsNumber()){
+			return false;
+		}
+	}
+	return true;
+}
+
+static int32_t buf_arg(const Nan::FunctionCallbackInfo<v8::Value>& info, int i)
+{
+	return info[i]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+}
+
+/* Pointer to len bytes at off of a registered buffer, NULL for id -1, returns false for an invalid range */
+static bool buf_ptr(int32_t id, uint32_t off, uint32_t len, char **p)
+{
+	if(id == -1){
+		*p = NULL;
+		return true;
+	}
+	if(id < 0 || id >= BUFPOOL_MAX || bufpool[id].data == NULL || off > bufpool[id].len || len > bufpool[id].len - off){
+		return false;
+	}
+	*p = bufpool[id].data + off;
+	return true;
+}
+
+/* buf_register(arrayBuffer|sharedArrayBuffer), returns the buffer id or -1 if the pool is full */
+NAN_METHOD(buf_register)
+{
+	std::shared_ptr<v8::BackingStore> store;
+	int32_t id;
+
+	if(info.Length() == 1 && info[0]->IsSharedArrayBuffer()){
+		store = info[0].As<v8::SharedArrayBuffer>()->GetBackingStore();
+	}
+	else if(info.Length() == 1 && info[0]->IsArrayBuffer()){
+		store = info[0].As<v8::ArrayBuffer>()->GetBackingStore();
+	}
+	else{
 		return ThrowTypeError("Incorrect arguments");
 	}
 
-	uint8_t arg1 = info[0]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
-	uint8_t arg2 = info[1]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+	for(id = 0; id < BUFPOOL_MAX; id++){
+		if(bufpool[id].data == NULL){
+			bufpool[id].store = store;
+			bufpool[id].data = (char *)store->Data();
+			bufpool[id].len = store->ByteLength();
+			break;
+		}
+	}
 
-	gpio_enable_async_rising_event(arg1, arg2);
+	info.GetReturnValue().Set(id < BUFPOOL_MAX ? id : -1);
 }
 
-NAN_METHOD(gpio_detect_input_event) 
+NAN_METHOD(buf_unregister)
+{
+	if(!buf_args(info, 1)){
+		return ThrowTypeError("Incorrect arguments");
+	}
+
+	int32_t id = buf_arg(info, 0);
+
+	if(id >= 0 && id < BUFPOOL_MAX){
+		bufpool[id].data = NULL;
+		bufpool[id].len = 0;
+		bufpool[id].store.reset();
+	}
+}
+
+/* i2c_read_buf(id, offset, len), returns the i2c status */
+NAN_METHOD(i2c_read_buf)
 {
 	uint8_t rval;
+	char *rbuf;
 
-	if((info.Length() != 1) || (!info[0]->IsNumber())){
+	if(!buf_args(info, 3)){
 		return ThrowTypeError("Incorrect arguments");
 	}
+	uint32_t len = buf_arg(info, 2);
+	if(!buf_ptr(buf_arg(info, 0), buf_arg(info, 1), len, &rbuf) || rbuf == NULL || len > 0xffff){
+		return ThrowRangeError("Invalid buffer range");
+	}
 
-	uint8_t arg = info[0]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+	i2c_lock();
+	rval = i2c_read(rbuf, len);
+	i2c_unlock();
+
+	info.GetReturnValue().Set(rval);
+}
+
+/* i2c_write_buf(id, offset, len), returns the i2c status */
+NAN_METHOD(i2c_write_buf)
+{
+	uint8_t rval;
+	char *wbuf;
+
+	if(!buf_args(info, 3)){
+		return ThrowTypeError("Incorrect arguments");
+	}
+	uint32_t len = buf_arg(info, 2);
+	if(!buf_ptr(buf_arg(info, 0), buf_arg(info, 1), len, &wbuf) || wbuf == NULL || len > 0xffff){
+		return ThrowRangeError("Invalid buffer range");
+	}
+
+	i2c_lock();
+	rval = i2c_write(wbuf, len);
+	i2c_unlock();
+
+	info.GetReturnValue().Set(rval);
+}
+
+/* i2c_write_read_buf(wid, woffset, wlen, rid, roffset, rlen), returns the i2c status */
+NAN_METHOD(i2c_write_read_buf)
+{
+	uint8_t rval;
+	char *wbuf, *rbuf;
+
+	if(!buf_args(info, 6)){
+		return ThrowTypeError("Incorrect arguments");
+	}
+	uint32_t wlen = buf_arg(info, 2);
+	uint32_t rlen = buf_arg(info, 5);
+	if(!buf_ptr(buf_arg(info, 0), buf_arg(info, 1), wlen, &wbuf) || !buf_ptr(buf_arg(info, 3), buf_arg(info, 4), rlen, &rbuf) ||
+		wbuf == NULL || rbuf == NULL || wlen > 0xffff || rlen > 0xffff){
+		return ThrowRangeError("Invalid buffer range");
+	}
+
+	i2c_lock();
+	rval = i2c_write_read(wbuf, wlen, rbuf, rlen);
+	i2c_unlock();
 
-	rval = gpio_detect_input_event(arg);
-	
 	info.GetReturnValue().Set(rval);
 }
 
-NAN_METHOD(gpio_reset_all_events) 
+/* spi_transfer_buf(wid, woffset, rid, roffset, len), wid or rid -1 sends zeros or discards the received bytes,
+ * returns 2 on a timeout
+ */
+NAN_METHOD(spi_transfer_buf)
+{
+	uint8_t rval;
+	char *wbuf, *rbuf;
+
+	if(!buf_args(info, 5)){
+		return ThrowTypeError("Incorrect arguments");
+	}
+	uint32_t len = buf_arg(info, 4);
+	if(!buf_ptr(buf_arg(info, 0), buf_arg(info, 1), len, &wbuf) || !buf_ptr(buf_arg(info, 2), buf_arg(info, 3), len, &rbuf)){
+		return ThrowRangeError("Invalid buffer range");
+	}
+
+	spi_lock();
+	rval = spi_transfer(wbuf, rbuf, len);
+	spi_unlock();
+
+	info.GetReturnValue().Set(rval);
+}
+
+/* spi_dev_transfer_buf(dev, wid, woffset, rid, roffset, len), returns 1 if the device id is invalid, 2 on a timeout */
+NAN_METHOD(spi_dev_transfer_buf)
+{
+	uint8_t rval = 1;
+	char *wbuf, *rbuf;
+
+	if(!buf_args(info, 6)){
+		return ThrowTypeError("Incorrect arguments");
+	}
+	uint32_t len = buf_arg(info, 5);
+	if(!buf_ptr(buf_arg(info, 1), buf_arg(info, 2), len, &wbuf) || !buf_ptr(buf_arg(info, 3), buf_arg(info, 4), len, &rbuf)){
+		return ThrowRangeError("Invalid buffer range");
+	}
+
+	spi_lock();
+	if(spi_dev_select(buf_arg(info, 0)) == 0){
+		rval = spi_transfer(wbuf, rbuf, len);
+	}
+	spi_unlock();
+
+	info.GetReturnValue().Set(rval);
+}
+
+/*
+ *  i2c register-map cache
+ */
+/* rpi_regmap_create(bus, addr, nregs, inc), returns the map id or -1 */
+NAN_METHOD(rpi_regmap_create)
+{
+	int32_t rval;
+
+	if((info.Length() != 4) || (!info[0]->IsNumber()) || (!info[1]->IsNumber()) || (!info[2]->IsNumber()) || (!info[3]->IsNumber())){
+		return ThrowTypeError("Incorrect arguments");
+	}
+
+	uint8_t bus = info[0]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+	uint8_t addr = info[1]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+	uint16_t nregs = info[2]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+	uint8_t inc = info[3]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+
+	rval = rpi_regmap_create(bus, addr, nregs, inc);
+
+	info.GetReturnValue().Set(rval);
+}
+
+/* rpi_regmap_volatile(id, reg, n, on) */
+NAN_METHOD(rpi_regmap_volatile)
+{
+	if((info.Length() != 4) || (!info[0]->IsNumber()) || (!info[1]->IsNumber()) || (!info[2]->IsNumber()) || (!info[3]->IsNumber())){
+		return ThrowTypeError("Incorrect arguments");
+	}
+
+	int32_t id = info[0]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+	uint8_t reg = info[1]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+	uint16_t n = info[2]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+	uint8_t on = info[3]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+
+	rpi_regmap_set_volatile(id, reg, n, on);
+}
+
+/* rpi_regmap_write(id, reg, buf, n) and rpi_regmap_read(id, reg, buf, n), return the i2c status */
+static void regmap_rw(const Nan::FunctionCallbackInfo<v8::Value>& info, uint8_t write)
+{
+	uint8_t rval;
+
+	if((info.Length() != 4) || (!info[0]->IsNumber()) || (!info[1]->IsNumber()) || (!node::Buffer::HasInstance(info[2])) ||
+		(!info[3]->IsNumber())){
+		return ThrowTypeError("Incorrect arguments");
+	}
+
+	int32_t id = info[0]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+	uint8_t reg = info[1]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+	uint32_t n = info[3]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+
+	if(n > 0xffff || n > node::Buffer::Length(info[2])){
+		return ThrowTypeError("Incorrect arguments");
+	}
+
+	uint8_t *buf = (uint8_t *)node::Buffer::Data(info[2]);
+
+	if(write){
+		rval = rpi_regmap_write(id, reg, buf, n);
+	}
+	else{
+		rval = rpi_regmap_read(id, reg, buf, n);
+	}
+
+	info.GetReturnValue().Set(rval);
+}
+
+NAN_METHOD(rpi_regmap_write)
+{
+	regmap_rw(info, 1);
+}
+
+NAN_METHOD(rpi_regmap_read)
+{
+	regmap_rw(info, 0);
+}
+
+NAN_METHOD(rpi_regmap_flush)
+{
+	uint8_t rval;
+
+	if((info.Length() != 1) || (!info[0]->IsNumber())){
+		return ThrowTypeError("Incorrect arguments");
+	}
+
+	int32_t id = info[0]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+
+	rval = rpi_regmap_flush(id);
+
+	info.GetReturnValue().Set(rval);
+}
+
+NAN_METHOD(rpi_regmap_invalidate)
+{
+	if((info.Length() != 1) || (!info[0]->IsNumber())){
+		return ThrowTypeError("Incorrect arguments");
+	}
+
+	int32_t id = info[0]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+
+	rpi_regmap_invalidate(id);
+}
+
+NAN_METHOD(rpi_regmap_stats)
+{
+	regmap_stats_t s;
+
+	if((info.Length() != 1) || (!info[0]->IsNumber())){
+		return ThrowTypeError("Incorrect arguments");
+	}
+
+	int32_t id = info[0]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+
+	rpi_regmap_stats(id, &s);
+
+	v8::Local<v8::Object> obj = Nan::New<v8::Object>();
+	Nan::Set(obj, Nan::New("writes").ToLocalChecked(), Nan::New<v8::Uint32>(s.writes));
+	Nan::Set(obj, Nan::New("dropped").ToLocalChecked(), Nan::New<v8::Uint32>(s.dropped));
+	Nan::Set(obj, Nan::New("bursts").ToLocalChecked(), Nan::New<v8::Uint32>(s.bursts));
+	Nan::Set(obj, Nan::New("hits").ToLocalChecked(), Nan::New<v8::Uint32>(s.hits));
+	Nan::Set(obj, Nan::New("misses").ToLocalChecked(), Nan::New<v8::Uint32>(s.misses));
+
+	info.GetReturnValue().Set(obj);
+}
+
+NAN_METHOD(rpi_regmap_destroy)
+{
+	if((info.Length() != 1) || (!info[0]->IsNumber())){
+		return ThrowTypeError("Incorrect arguments");
+	}
+
+	int32_t id = info[0]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+
+	rpi_regmap_destroy(id);
+}
+
+/*
+ *  Timers 
+ */
+NAN_METHOD(nswait)
+{
+	if((info.Length() != 1) || (!info[0]->IsNumber())){
+		return ThrowTypeError("Incorrect arguments");
+	}
+
+	uint64_t arg = info[0]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+	
+	nswait(arg);
+}
+
+NAN_METHOD(uswait)
+{
+	if((info.Length() != 1) || (!info[0]->IsNumber())){
+		return ThrowTypeError("Incorrect arguments");
+	}
+
+	uint32_t arg = info[0]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+	
+	uswait(arg);
+}
+
+NAN_METHOD(mswait)
+{
+	if((info.Length() != 1) || (!info[0]->IsNumber())){
+		return ThrowTypeError("Incorrect arguments");
+	}
+
+	uint32_t arg = info[0]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+	
+	mswait(arg);
+}
+
+/*
+ *  GPIO
+ */
+NAN_METHOD(gpio_init)
+{
+	gpio_init();
+}
+
+
+NAN_METHOD(gpio_config) 
+{
+	if((info.Length() != 2) || (!info[0]->IsNumber()) || (!info[1]->IsNumber())){
+		return ThrowTypeError("Incorrect arguments");
+	}
+
+	uint8_t arg1 = info[0]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+	uint8_t arg2 = info[1]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+
+	gpio_config(arg1, arg2);
+}
+
+NAN_METHOD(gpio_input) 
+{
+	if((info.Length() != 1) || (!info[0]->IsNumber())){
+		return ThrowTypeError("Incorrect arguments");
+	}
+
+	uint8_t arg = info[0]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+	
+	gpio_input(arg);
+}
+
+NAN_METHOD(gpio_output) 
+{
+	if((info.Length() != 1) || (!info[0]->IsNumber())){
+		return ThrowTypeError("Incorrect arguments");
+	}
+
+	uint8_t arg = info[0]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+	
+	gpio_output(arg);
+}
+
+NAN_METHOD(gpio_read) 
+{
+	uint8_t rval;
+
+	if((info.Length() != 1) || (!info[0]->IsNumber())){
+		return ThrowTypeError("Incorrect arguments");
+	}
+
+	uint8_t arg = info[0]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+
+	rval = gpio_read(arg);
+	
+	info.GetReturnValue().Set(rval);
+}
+
+NAN_METHOD(gpio_enable_async_rising_event) 
+{
+	if((info.Length() != 2) || (!info[0]->IsNumber()) || (!info[1]->IsNumber())){
+		return ThrowTypeError("Incorrect arguments");
+	}
+
+	uint8_t arg1 = info[0]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+	uint8_t arg2 = info[1]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+
+	gpio_enable_async_rising_event(arg1, arg2);
+}
+
+NAN_METHOD(gpio_detect_input_event) 
+{
+	uint8_t rval;
+
+	if((info.Length() != 1) || (!info[0]->IsNumber())){
+		return ThrowTypeError("Incorrect arguments");
+	}
+
+	uint8_t arg = info[0]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+
+	rval = gpio_detect_input_event(arg);
+	
+	info.GetReturnValue().Set(rval);
+}
+
+NAN_METHOD(gpio_reset_all_events) 
+{
+	if((info.Length() != 1) || (!info[0]->IsNumber())){
+		return ThrowTypeError("Incorrect arguments");
+	}
+
+	uint8_t arg = info[0]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+	
+	gpio_reset_all_events(arg);
+}
+
+NAN_METHOD(gpio_reset_event) 
+{
+	if((info.Length() != 1) || (!info[0]->IsNumber())){
+		return ThrowTypeError("Incorrect arguments");
+	}
+
+	uint8_t arg = info[0]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+	
+	gpio_reset_event(arg);
+}
+
+NAN_METHOD(gpio_write) 
+{
+	uint8_t rval;
+
+	if((info.Length() != 2) || (!info[0]->IsNumber()) || (!info[1]->IsNumber())){
+		return ThrowTypeError("Incorrect arguments");
+	}
+
+	uint8_t arg1 = info[0]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+	uint8_t arg2 = info[1]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+
+	rval = gpio_write(arg1, arg2);
+
+	info.GetReturnValue().Set(rval);
+}
+
+NAN_METHOD(gpio_set_pud)
+{
+	if((info.Length() != 2) || (!info[0]->IsNumber()) || (!info[1]->IsNumber())){
+		return ThrowTypeError("Incorrect arguments");
+	}
+
+	uint8_t arg1 = info[0]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+	uint8_t arg2 = info[1]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+
+	gpio_set_pud(arg1, arg2);
+}
+
+NAN_METHOD(gpio_get_pud)
+{
+	uint8_t ret;
+
+	if((info.Length() != 1) || (!info[0]->IsNumber())){
+		return ThrowTypeError("Incorrect arguments");
+	}
+
+	uint8_t arg1 = info[0]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+	
+	ret = gpio_get_pud(arg1);
+
+	info.GetReturnValue().Set(ret);
+}
+
+/*
+ *  PWM
+ */
+NAN_METHOD(pwm_init)
+{
+	pwm_init();
+}
+NAN_METHOD(pwm_set_pin)
+{
+	if((info.Length() != 1) || (!info[0]->IsNumber())){
+		return ThrowTypeError("Incorrect arguments");
+	}
+
+	uint8_t arg = info[0]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+
+	pwm_set_pin(arg);
+}
+
+NAN_METHOD(pwm_reset_pin)
+{
+	if((info.Length() != 1) || (!info[0]->IsNumber())){
+		return ThrowTypeError("Incorrect arguments");
+	}
+
+	uint8_t arg = info[0]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+
+	pwm_reset_pin(arg);
+}
+
+NAN_METHOD(pwm_reset_all_pins)
+{
+	pwm_reset_all_pins();
+}
+
+NAN_METHOD(pwm_set_clock_freq)
+{
+	uint8_t rval;
+
+	if((info.Length() != 1) || (!info[0]->IsNumber())){
+		return ThrowTypeError("Incorrect arguments");
+	}
+
+	uint32_t arg = info[0]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+
+	rval = pwm_set_clock_freq(arg);
+	
+	info.GetReturnValue().Set(rval);
+}
+
+NAN_METHOD(pwm_clk_status)
+{
+	uint8_t rval;
+	
+	rval = pwm_clk_status();
+	
+	info.GetReturnValue().Set(rval);
+}
+
+NAN_METHOD(pwm_enable)
+{
+	if((info.Length() != 2) || (!info[0]->IsNumber()) || (!info[1]->IsNumber())){
+		return ThrowTypeError("Incorrect arguments");
+	}
+
+	uint8_t arg1 = info[0]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+	uint8_t arg2 = info[1]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+
+	pwm_enable(arg1, arg2);
+}
+
+NAN_METHOD(pwm_set_mode)
+{
+	if((info.Length() != 2) || (!info[0]->IsNumber()) || (!info[1]->IsNumber())){
+		return ThrowTypeError("Incorrect arguments");
+	}
+
+	uint8_t arg1 = info[0]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+	uint8_t arg2 = info[1]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+
+	pwm_set_mode(arg1, arg2);
+}
+
+NAN_METHOD(pwm_set_pola)
+{
+	if((info.Length() != 2) || (!info[0]->IsNumber()) || (!info[1]->IsNumber())){
+		return ThrowTypeError("Incorrect arguments");
+	}
+
+	uint8_t arg1 = info[0]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+	uint8_t arg2 = info[1]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+
+	pwm_set_pola(arg1, arg2);
+}
+
+NAN_METHOD(pwm_set_data)
+{
+	if((info.Length() != 2) || (!info[0]->IsNumber()) || (!info[1]->IsNumber())){
+		return ThrowTypeError("Incorrect arguments");
+	}
+
+	uint8_t arg1 = info[0]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+	uint32_t arg2 = info[1]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+
+	pwm_set_data(arg1, arg2);
+}
+
+NAN_METHOD(pwm_set_range)
+{
+	if((info.Length() != 2) || (!info[0]->IsNumber()) || (!info[1]->IsNumber())){
+		return ThrowTypeError("Incorrect arguments");
+	}
+
+	uint8_t arg1 = info[0]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+	uint32_t arg2 = info[1]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+
+	pwm_set_range(arg1, arg2);
+}
+
+/*
+ *  i2c
+ */
+/* Check the length of an i2c transfer from/to buf, throws a RangeError and returns false if it is invalid */
+static bool i2c_check_len(v8::Local<v8::Object> buf, uint32_t len)
+{
+	if(len > 0xffff){
+		ThrowRangeError("I2C transfer length over 65535 bytes");
+		return false;
+	}
+	if(len > node::Buffer::Length(buf)){
+		ThrowRangeError("Insufficient buffer size");
+		return false;
+	}
+	return true;
+}
+
+NAN_METHOD(i2c_start)
+{
+	if((info.Length() != 1) || (!info[0]->IsNumber() )){
+		return ThrowTypeError("Incorrect argument");
+	}
+
+	uint8_t arg = info[0]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+        
+	i2c_start(arg);
+}
+
+NAN_METHOD(i2c_stop)
+{
+	i2c_stop();
+}
+
+NAN_METHOD(i2c_use)
+{
+	if((info.Length() != 1) || (!info[0]->IsNumber())){
+		return ThrowTypeError("Incorrect arguments");
+	}
+
+	uint8_t arg = info[0]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+
+	i2c_use(arg);
+}
+
+NAN_METHOD(i2c_select_slave)
+{
+	if((info.Length() != 1) || (!info[0]->IsNumber())){
+		return ThrowTypeError("Incorrect arguments");
+	}
+
+	uint8_t arg = info[0]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+        
+	i2c_lock();
+	i2c_select_slave(arg);
+	i2c_unlock();
+}
+
+NAN_METHOD(i2c_probe)
+{
+	uint8_t rval;
+
+	if((info.Length() != 1) || (!info[0]->IsNumber())){
+		return ThrowTypeError("Incorrect arguments");
+	}
+
+	uint8_t arg = info[0]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+
+	i2c_lock();
+	rval = i2c_probe(arg);
+	i2c_unlock();
+
+	info.GetReturnValue().Set(rval);
+}
+
+/* 128-bit presence map as a 16-byte buffer, the device at addr is bit (addr & 7) of byte (addr >> 3) */
+static v8::Local<v8::Object> i2c_scan_buffer(const uint32_t map[4])
+{
+	char bytes[16];
+
+	for(int i = 0; i < 16; i++){
+		bytes[i] = map[i >> 2] >> ((i & 3) * 8);
+	}
+
+	return Nan::CopyBuffer(bytes, 16).ToLocalChecked();
+}
+
+/* i2c_scan(first, last, mode), returns the presence map */
+NAN_METHOD(i2c_scan)
+{
+	uint32_t map[4];
+
+	if((info.Length() != 3) || (!info[0]->IsNumber()) || (!info[1]->IsNumber()) || (!info[2]->IsNumber())){
+		return ThrowTypeError("Incorrect arguments");
+	}
+
+	uint8_t first = info[0]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+	uint8_t last = info[1]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+	uint8_t mode = info[2]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+
+	i2c_lock();
+	i2c_scan(first, last, mode, map);
+	i2c_unlock();
+
+	info.GetReturnValue().Set(i2c_scan_buffer(map));
+}
+
+NAN_METHOD(i2c_scan_clear)
+{
+	i2c_lock();
+	i2c_scan_clear();
+	i2c_unlock();
+}
+
+NAN_METHOD(i2c_set_clock_freq)
+{
+	if((info.Length() != 1) || (!info[0]->IsNumber())){
+		return ThrowTypeError("Incorrect arguments");
+	}
+	uint16_t arg = info[0]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+
+	i2c_lock();
+	i2c_set_clock_freq(arg);
+	i2c_unlock();
+}
+
+NAN_METHOD(i2c_data_transfer_speed)
+{
+	if((info.Length() != 1) || (!info[0]->IsNumber())){
+		return ThrowTypeError("Incorrect arguments");
+	}
+
+	uint32_t arg = info[0]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+	uint32_t rval;
+
+	i2c_lock();
+	rval = i2c_data_transfer_speed(arg);
+	i2c_unlock();
+
+	info.GetReturnValue().Set(rval);
+}
+
+NAN_METHOD(i2c_clock_plan)
+{
+	i2c_clock_plan_t plan;
+
+	if((info.Length() != 1) || (!info[0]->IsNumber())){
+		return ThrowTypeError("Incorrect arguments");
+	}
+
+	uint32_t arg = info[0]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+
+	i2c_clock_plan(arg, &plan);
+
+	v8::Local<v8::Object> obj = Nan::New<v8::Object>();
+	Nan::Set(obj, Nan::New("baud").ToLocalChecked(), Nan::New<v8::Uint32>(plan.baud));
+	Nan::Set(obj, Nan::New("actual").ToLocalChecked(), Nan::New<v8::Uint32>(plan.actual));
+	Nan::Set(obj, Nan::New("core").ToLocalChecked(), Nan::New<v8::Uint32>(plan.core));
+	Nan::Set(obj, Nan::New("cdiv").ToLocalChecked(), Nan::New<v8::Uint32>(plan.cdiv));
+	Nan::Set(obj, Nan::New("fedl").ToLocalChecked(), Nan::New<v8::Uint32>(plan.fedl));
+	Nan::Set(obj, Nan::New("redl").ToLocalChecked(), Nan::New<v8::Uint32>(plan.redl));
+	Nan::Set(obj, Nan::New("clkt").ToLocalChecked(), Nan::New<v8::Uint32>(plan.clkt));
+
+	info.GetReturnValue().Set(obj);
+}
+
+NAN_METHOD(i2c_device_speed)
+{
+	uint32_t rval;
+
+	if((info.Length() != 2) || (!info[0]->IsNumber()) || (!info[1]->IsNumber())){
+		return ThrowTypeError("Incorrect arguments");
+	}
+
+	uint8_t arg1 = info[0]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+	uint32_t arg2 = info[1]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+
+	i2c_lock();
+	rval = i2c_device_speed(arg1, arg2);
+	i2c_unlock();
+
+	info.GetReturnValue().Set(rval);
+}
+
+NAN_METHOD(i2c_write)
+{
+  	uint8_t rval;
+
+	if((info.Length() != 2) || (!info[0]->IsObject()) || (!info[1]->IsNumber())){
+		return ThrowTypeError("Incorrect arguments");
+	}
+
+	v8::Local<v8::Object> wbuf =  info[0]->ToObject(Nan::GetCurrentContext()).FromMaybe(v8::Local<v8::Object>());
+	uint32_t arg = info[1]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+
+	if(!i2c_check_len(wbuf, arg)){
+		return;
+	}
+
+	i2c_lock();
+	rval = i2c_write(node::Buffer::Data(wbuf), arg);
+	i2c_unlock();
+	
+	info.GetReturnValue().Set(rval);
+}
+
+NAN_METHOD(i2c_read)
+{
+	uint8_t rval;
+
+	if((info.Length() != 2) || (!info[0]->IsObject()) || (!info[1]->IsNumber())){
+		return ThrowTypeError("Incorrect arguments");
+	}
+	
+	v8::Local<v8::Object> rbuf =  info[0]->ToObject(Nan::GetCurrentContext()).FromMaybe(v8::Local<v8::Object>());
+	uint32_t arg = info[1]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+
+	if(!i2c_check_len(rbuf, arg)){
+		return;
+	}
+
+	i2c_lock();
+	rval = i2c_read(node::Buffer::Data(rbuf), arg);
+	i2c_unlock();
+	
+	info.GetReturnValue().Set(rval);
+}
+
+NAN_METHOD(i2c_write_read)
+{
+	uint8_t rval;
+
+	if((info.Length() != 4) || (!info[0]->IsObject()) || (!info[1]->IsNumber()) || (!info[2]->IsObject()) || (!info[3]->IsNumber())){
+		return ThrowTypeError("Incorrect arguments");
+	}
+
+	v8::Local<v8::Object> wbuf =  info[0]->ToObject(Nan::GetCurrentContext()).FromMaybe(v8::Local<v8::Object>());
+	uint32_t arg1 = info[1]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+	v8::Local<v8::Object> rbuf =  info[2]->ToObject(Nan::GetCurrentContext()).FromMaybe(v8::Local<v8::Object>());
+	uint32_t arg2 = info[3]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+
+	if(!i2c_check_len(wbuf, arg1) || !i2c_check_len(rbuf, arg2)){
+		return;
+	}
+
+	i2c_lock();
+	rval = i2c_write_read(node::Buffer::Data(wbuf), arg1, node::Buffer::Data(rbuf), arg2);
+	i2c_unlock();
+
+	info.GetReturnValue().Set(rval);
+}
+
+NAN_METHOD(i2c_byte_read)
+{
+	uint8_t rval;
+
+	i2c_lock();
+	rval = i2c_byte_read();
+	i2c_unlock();
+	
+	info.GetReturnValue().Set(rval);
+}
+
+/*
+ *  SPI
+ */
+NAN_METHOD(spi_start)
+{
+	spi_start();
+}
+
+NAN_METHOD(spi_stop)
+{
+	spi_stop();
+}
+
+NAN_METHOD(spi_set_clock_freq)
+{
+	if((info.Length() != 1) || (!info[0]->IsNumber())){
+		return ThrowTypeError("Incorrect arguments");
+	}
+
+	uint16_t arg = info[0]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+
+	spi_lock();
+	spi_set_clock_freq(arg);
+	spi_unlock();
+}
+
+NAN_METHOD(spi_set_bulk_threshold)
+{
+	if((info.Length() != 1) || (!info[0]->IsNumber())){
+		return ThrowTypeError("Incorrect arguments");
+	}
+
+	uint32_t arg = info[0]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+
+	spi_lock();
+	spi_set_bulk_threshold(arg);
+	spi_unlock();
+}
+
+NAN_METHOD(spi_set_data_mode)
+{
+	if((info.Length() != 1) || (!info[0]->IsNumber())){
+		return ThrowTypeError("Incorrect arguments");
+	}
+
+	uint8_t arg = info[0]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+
+	spi_lock();
+	spi_set_data_mode(arg);
+	spi_unlock();
+}
+
+NAN_METHOD(spi_set_chip_select_polarity)
+{
+	if((info.Length() != 2) || (!info[0]->IsNumber()) || (!info[1]->IsNumber())){
+		return ThrowTypeError("Incorrect arguments");
+	}
+
+	uint8_t arg1 = info[0]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+	uint8_t arg2 = info[1]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+
+	spi_lock();
+	spi_set_chip_select_polarity(arg1, arg2);
+	spi_unlock();
+}
+
+NAN_METHOD(spi_chip_select)
+{
+	if((info.Length() != 1) || (!info[0]->IsNumber())){
+		return ThrowTypeError("Incorrect arguments");
+	}
+
+	uint8_t arg = info[0]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+
+	spi_lock();
+	spi_chip_select(arg);
+	spi_unlock();
+}
+
+/*
+ *  spi transfer lists
+ *
+ *  list is a flat array of [cs, mode, div, tx, tx_offset, rx, rx_offset, len, flags, delay_us] entries,
+ *  tx or rx can be null (zeros are sent, the received bytes are discarded)
+ */
+static bool spi_xfer_parse(v8::Local<v8::Array> list, std::vector<spi_xfer_t> &x)
+{
+	v8::Local<v8::Context> ctx = Nan::GetCurrentContext();
+	uint32_t n = list->Length() / 10;
+	uint32_t v[10];
+
+	if(list->Length() % 10){
+		return false;
+	}
+
+	x.resize(n);
+
+	for(uint32_t i = 0; i < n; i++){
+		v8::Local<v8::Value> tx = Nan::Get(list, i*10 + 3).ToLocalChecked();
+		v8::Local<v8::Value> rx = Nan::Get(list, i*10 + 5).ToLocalChecked();
+
+		for(uint32_t k = 0; k < 10; k++){
+			if(k != 3 && k != 5){
+				v[k] = Nan::Get(list, i*10 + k).ToLocalChecked()->Uint32Value(ctx).ToChecked();
+			}
+		}
+
+		x[i].cs = v[0];
+		x[i].mode = v[1];
+		x[i].div = v[2];
+		x[i].len = v[7];
+		x[i].flags = v[8];
+		x[i].delay_us = v[9];
+		x[i].tx = NULL;
+		x[i].rx = NULL;
+
+		if(node::Buffer::HasInstance(tx)){
+			if((size_t)v[4] + v[7] > node::Buffer::Length(tx)){
+				return false;
+			}
+			x[i].tx = node::Buffer::Data(tx) + v[4];
+		}
+		else if(!tx->IsNull()){
+			return false;
+		}
+
+		if(node::Buffer::HasInstance(rx)){
+			if((size_t)v[6] + v[7] > node::Buffer::Length(rx)){
+				return false;
+			}
+			x[i].rx = node::Buffer::Data(rx) + v[6];
+		}
+		else if(!rx->IsNull()){
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/* spi_transfer_list(list), returns 2 on a timeout */
+NAN_METHOD(spi_transfer_list)
+{
+	uint8_t rval;
+	std::vector<spi_xfer_t> x;
+
+	if((info.Length() != 1) || (!info[0]->IsArray()) || (!spi_xfer_parse(info[0].As<v8::Array>(), x))){
+		return ThrowTypeError("Incorrect arguments");
+	}
+
+	spi_lock();
+	rval = spi_transfer_list(x.data(), x.size());
+	spi_unlock();
+
+	info.GetReturnValue().Set(rval);
+}
+
+class SpiListWorker : public Nan::AsyncWorker {
+public:
+	SpiListWorker(Nan::Callback *callback, std::vector<spi_xfer_t> &v)
+		: Nan::AsyncWorker(callback, "array-gpio:spi"), rval(0) {
+		x.swap(v);
+	}
+
+	void Execute(){
+		spi_lock();
+		rval = spi_transfer_list(x.data(), x.size());
+		spi_unlock();
+	}
+
+	void HandleOKCallback(){
+		Nan::HandleScope scope;
+		v8::Local<v8::Value> argv[] = { Nan::New<v8::Uint32>(rval) };
+		callback->Call(1, argv, async_resource);
+	}
+
+private:
+	std::vector<spi_xfer_t> x;
+	uint8_t rval;
+};
+
+/* spi_transfer_list_async(list, cb), the buffers are kept alive through the list */
+NAN_METHOD(spi_transfer_list_async)
+{
+	std::vector<spi_xfer_t> x;
+
+	if((info.Length() != 2) || (!info[0]->IsArray()) || (!info[1]->IsFunction()) || (!spi_xfer_parse(info[0].As<v8::Array>(), x))){
+		return ThrowTypeError("Incorrect arguments");
+	}
+
+	Nan::Callback *cb = new Nan::Callback(info[1].As<v8::Function>());
+
+	SpiListWorker *worker = new SpiListWorker(cb, x);
+	worker->SaveToPersistent("list", info[0]);
+
+	Nan::AsyncQueueWorker(worker);
+}
+
+/*
+ *  spi device contexts
+ */
+/* spi_dev_open(cs, mode, cs_high, div), returns the device id or -1 */
+NAN_METHOD(spi_dev_open)
+{
+	int32_t rval;
+
+	if((info.Length() != 4) || (!info[0]->IsNumber()) || (!info[1]->IsNumber()) || (!info[2]->IsNumber()) || (!info[3]->IsNumber())){
+		return ThrowTypeError("Incorrect arguments");
+	}
+
+	uint8_t cs = info[0]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+	uint8_t mode = info[1]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+	uint8_t cs_high = info[2]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+	uint16_t div = info[3]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+
+	spi_lock();
+	rval = spi_dev_open(cs, mode, cs_high, div);
+	spi_unlock();
+
+	info.GetReturnValue().Set(rval);
+}
+
+NAN_METHOD(spi_dev_close)
+{
+	if((info.Length() != 1) || (!info[0]->IsNumber())){
+		return ThrowTypeError("Incorrect arguments");
+	}
+
+	int32_t id = info[0]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+
+	spi_lock();
+	spi_dev_close(id);
+	spi_unlock();
+}
+
+/* Buffer data or NULL for a null argument, the length is checked against len */
+static bool spi_dev_buffer(v8::Local<v8::Value> v, uint32_t len, char **data)
+{
+	if(v->IsNull()){
+		*data = NULL;
+		return true;
+	}
+	if(!node::Buffer::HasInstance(v) || len > node::Buffer::Length(v)){
+		return false;
+	}
+	*data = node::Buffer::Data(v);
+	return true;
+}
+
+/* spi_dev_transfer(id, tx, rx, len), tx or rx can be null, returns 1 if the device id is invalid, 2 on a timeout */
+NAN_METHOD(spi_dev_transfer)
+{
+	char *tx, *rx;
+	uint8_t rval = 1;
+
+	if((info.Length() != 4) || (!info[0]->IsNumber()) || (!info[3]->IsNumber())){
+		return ThrowTypeError("Incorrect arguments");
+	}
+
+	int32_t id = info[0]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+	uint32_t len = info[3]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+
+	if(!spi_dev_buffer(info[1], len, &tx) || !spi_dev_buffer(info[2], len, &rx)){
+		return ThrowTypeError("Incorrect arguments");
+	}
+
+	spi_lock();
+	if(spi_dev_select(id) == 0){
+		rval = spi_transfer(tx, rx, len);
+	}
+	spi_unlock();
+
+	info.GetReturnValue().Set(rval);
+}
+
+/* spi_data_transfer(wbuf, rbuf, len), returns 2 on a timeout */
+NAN_METHOD(spi_data_transfer)
+{
+	uint8_t rval;
+
+	if((info.Length() != 3) || (!info[0]->IsObject()) || (!info[1]->IsObject()) || (!info[2]->IsNumber())){
+		return ThrowTypeError("Incorrect arguments");
+	}
+
+	v8::Local<v8::Object> wbuf =  info[0]->ToObject(Nan::GetCurrentContext()).FromMaybe(v8::Local<v8::Object>());
+	v8::Local<v8::Object> rbuf =  info[1]->ToObject(Nan::GetCurrentContext()).FromMaybe(v8::Local<v8::Object>());
+	
+	uint32_t arg = info[2]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+
+	if(arg > node::Buffer::Length(wbuf) || arg > node::Buffer::Length(rbuf)){
+		return ThrowRangeError("Insufficient buffer size");
+	}
+
+	spi_lock();
+	rval = spi_data_transfer(node::Buffer::Data(wbuf), node::Buffer::Data(rbuf), arg);
+	spi_unlock();
+
+	info.GetReturnValue().Set(rval);
+}
+
+NAN_METHOD(spi_write)
+{
+	uint8_t rval;
+
+ 	if((info.Length() != 2) || (!info[0]->IsObject()) || (!info[1]->IsNumber())){
+		return ThrowTypeError("Incorrect arguments");
+	}
+
+	v8::Local<v8::Object> wbuf =  info[0]->ToObject(Nan::GetCurrentContext()).FromMaybe(v8::Local<v8::Object>());
+	uint32_t arg = info[1]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+
+	if(arg > node::Buffer::Length(wbuf)){
+		return ThrowRangeError("Insufficient buffer size");
+	}
+	if(rpi_sampler_running()){
+		return ThrowError("spi write() and read() can not be used while the spi sampler is running, use transfer()");
+	}
+
+	spi_lock();
+	rval = spi_write(node::Buffer::Data(wbuf), arg);
+	spi_unlock();
+
+	info.GetReturnValue().Set(rval);
+}
+
+NAN_METHOD(spi_read)
+{
+	uint8_t rval;
+
+	if((info.Length() != 2) || (!info[0]->IsObject()) || (!info[1]->IsNumber())){
+		return ThrowTypeError("Incorrect arguments");
+	}
+
+	v8::Local<v8::Object> rbuf =  info[0]->ToObject(Nan::GetCurrentContext()).FromMaybe(v8::Local<v8::Object>());
+	uint32_t arg = info[1]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+
+	if(arg > node::Buffer::Length(rbuf)){
+		return ThrowRangeError("Insufficient buffer size");
+	}
+	if(rpi_sampler_running()){
+		return ThrowError("spi write() and read() can not be used while the spi sampler is running, use transfer()");
+	}
+
+	spi_lock();
+	rval = spi_read(node::Buffer::Data(rbuf), arg);
+	spi_unlock();
+
+	info.GetReturnValue().Set(rval);
+}
+
+/*
+ *  Asynchronous i2c and spi transfers
+ *
+ *  The transfer runs in a libuv worker thread while holding the bus lock, the callback
+ *  receives the i2c or spi status code (0 on success). The node buffers are used in place,
+ *  they are kept alive in the worker persistent storage until the callback.
+ */
+enum { I2C_ASYNC_WRITE, I2C_ASYNC_READ, I2C_ASYNC_WRITE_READ, I2C_ASYNC_PROBE };
+enum { SPI_ASYNC_TRANSFER, SPI_ASYNC_WRITE, SPI_ASYNC_READ, SPI_ASYNC_DEV };
+
+class I2cWorker : public Nan::AsyncWorker {
+public:
+	I2cWorker(Nan::Callback *callback, uint8_t op, char *buf, uint16_t len, char *rbuf = NULL, uint16_t rlen = 0)
+		: Nan::AsyncWorker(callback, "array-gpio:i2c"), op(op), buf(buf), len(len), rbuf(rbuf), rlen(rlen), rval(0),
+		bus(i2c_current_bus()), addr(-1) {}
+
+	/* select the slave device inside the transfer lock (device handles) */
+	void SetAddress(uint8_t a){
+		addr = a;
+	}
+
+	void Execute(){
+		/* same controller as the calling thread */
+		i2c_use(bus);
+		i2c_lock();
+		if(addr >= 0){
+			i2c_set_address(addr);
+		}
+		if(op == I2C_ASYNC_PROBE){
+			rval = i2c_probe(len);
+		}
+		else if(op == I2C_ASYNC_WRITE){
+			rval = i2c_write(buf, len);
+		}
+		else if(op == I2C_ASYNC_WRITE_READ){
+			rval = i2c_write_read(buf, len, rbuf, rlen);
+		}
+		else{
+			rval = i2c_read(buf, len);
+		}
+		i2c_unlock();
+	}
+
+	void HandleOKCallback(){
+		Nan::HandleScope scope;
+		v8::Local<v8::Value> argv[] = { Nan::New<v8::Uint32>(rval) };
+		callback->Call(1, argv, async_resource);
+	}
+
+private:
+	uint8_t op;
+	char *buf;
+	uint16_t len;
+	char *rbuf;
+	uint16_t rlen;
+	uint8_t rval;
+	uint8_t bus;
+	int16_t addr;
+};
+
+class SpiWorker : public Nan::AsyncWorker {
+public:
+	SpiWorker(Nan::Callback *callback, uint8_t op, char *wbuf, char *rbuf, uint32_t len)
+		: Nan::AsyncWorker(callback, "array-gpio:spi"), op(op), wbuf(wbuf), rbuf(rbuf), len(len), rval(0), dev(-1) {}
+
+	/* device context selected inside the transfer lock (SPI_ASYNC_DEV) */
+	void SetDevice(int32_t id){
+		dev = id;
+	}
+
+	void Execute(){
+		spi_lock();
+		if(op == SPI_ASYNC_DEV){
+			rval = 1;
+			if(spi_dev_select(dev) == 0){
+				rval = spi_transfer(wbuf, rbuf, len);
+			}
+		}
+		else if(op == SPI_ASYNC_TRANSFER){
+			rval = spi_data_transfer(wbuf, rbuf, len);
+		}
+		else if(op == SPI_ASYNC_WRITE){
+			rval = spi_write(wbuf, len);
+		}
+		else{
+			rval = spi_read(rbuf, len);
+		}
+		spi_unlock();
+	}
+
+	void HandleOKCallback(){
+		Nan::HandleScope scope;
+		v8::Local<v8::Value> argv[] = { Nan::New<v8::Uint32>(rval) };
+		callback->Call(1, argv, async_resource);
+	}
+
+private:
+	uint8_t op;
+	char *wbuf;
+	char *rbuf;
+	uint32_t len;
+	uint8_t rval;
+	int32_t dev;
+};
+
+NAN_METHOD(i2c_probe_async)
+{
+	if((info.Length() != 2) || (!info[0]->IsNumber()) || (!info[1]->IsFunction())){
+		return ThrowTypeError("Incorrect arguments");
+	}
+
+	uint8_t arg = info[0]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+	Nan::Callback *cb = new Nan::Callback(info[1].As<v8::Function>());
+
+	Nan::AsyncQueueWorker(new I2cWorker(cb, I2C_ASYNC_PROBE, NULL, arg));
+}
+
+/* i2c_write_async(wbuf, len, cb[, addr]) and i2c_read_async(rbuf, len, cb[, addr]) */
+void i2c_rw_async(const Nan::FunctionCallbackInfo<v8::Value>& info, uint8_t op)
+{
+	if((info.Length() < 3) || (info.Length() > 4) || (!info[0]->IsObject()) || (!info[1]->IsNumber()) || (!info[2]->IsFunction()) ||
+		(info.Length() == 4 && !info[3]->IsNumber())){
+		return ThrowTypeError("Incorrect arguments");
+	}
+
+	v8::Local<v8::Object> buf =  info[0]->ToObject(Nan::GetCurrentContext()).FromMaybe(v8::Local<v8::Object>());
+	uint32_t arg = info[1]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+
+	if(!i2c_check_len(buf, arg)){
+		return;
+	}
+
+	Nan::Callback *cb = new Nan::Callback(info[2].As<v8::Function>());
+
+	I2cWorker *worker = new I2cWorker(cb, op, node::Buffer::Data(buf), arg);
+	worker->SaveToPersistent("buf", buf);
+	if(info.Length() == 4){
+		worker->SetAddress(info[3]->IntegerValue(Nan::GetCurrentContext()).ToChecked());
+	}
+
+	Nan::AsyncQueueWorker(worker);
+}
+
+NAN_METHOD(i2c_write_async)
+{
+	i2c_rw_async(info, I2C_ASYNC_WRITE);
+}
+
+NAN_METHOD(i2c_read_async)
+{
+	i2c_rw_async(info, I2C_ASYNC_READ);
+}
+
+NAN_METHOD(i2c_write_read_async)
+{
+	if((info.Length() < 5) || (info.Length() > 6) || (!info[0]->IsObject()) || (!info[1]->IsNumber()) || (!info[2]->IsObject()) ||
+		(!info[3]->IsNumber()) || (!info[4]->IsFunction()) || (info.Length() == 6 && !info[5]->IsNumber())){
+		return ThrowTypeError("Incorrect arguments");
+	}
+
+	v8::Local<v8::Object> wbuf =  info[0]->ToObject(Nan::GetCurrentContext()).FromMaybe(v8::Local<v8::Object>());
+	uint32_t arg1 = info[1]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+	v8::Local<v8::Object> rbuf =  info[2]->ToObject(Nan::GetCurrentContext()).FromMaybe(v8::Local<v8::Object>());
+	uint32_t arg2 = info[3]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+
+	if(!i2c_check_len(wbuf, arg1) || !i2c_check_len(rbuf, arg2)){
+		return;
+	}
+
+	Nan::Callback *cb = new Nan::Callback(info[4].As<v8::Function>());
+
+	I2cWorker *worker = new I2cWorker(cb, I2C_ASYNC_WRITE_READ, node::Buffer::Data(wbuf), arg1, node::Buffer::Data(rbuf), arg2);
+	worker->SaveToPersistent("wbuf", wbuf);
+	worker->SaveToPersistent("rbuf", rbuf);
+	if(info.Length() == 6){
+		worker->SetAddress(info[5]->IntegerValue(Nan::GetCurrentContext()).ToChecked());
+	}
+
+	Nan::AsyncQueueWorker(worker);
+}
+
+/*
+ *  i2c message arrays
+ *
+ *  list is a flat array of [addr, flags, buf, offset, len] entries, one per message,
+ *  the status of each message is stored in the status buffer, returns the no. of failed messages
+ */
+static bool i2c_msg_parse(v8::Local<v8::Array> list, std::vector<i2c_msg_t> &msgs)
+{
+	v8::Local<v8::Context> ctx = Nan::GetCurrentContext();
+	uint32_t n = list->Length() / 5;
+
+	if(list->Length() % 5){
+		return false;
+	}
+
+	msgs.resize(n);
+
+	for(uint32_t i = 0; i < n; i++){
+		v8::Local<v8::Value> buf = Nan::Get(list, i*5 + 2).ToLocalChecked();
+		if(!node::Buffer::HasInstance(buf)){
+			return false;
+		}
+		uint32_t addr = Nan::Get(list, i*5).ToLocalChecked()->Uint32Value(ctx).ToChecked();
+		uint32_t flags = Nan::Get(list, i*5 + 1).ToLocalChecked()->Uint32Value(ctx).ToChecked();
+		uint32_t offset = Nan::Get(list, i*5 + 3).ToLocalChecked()->Uint32Value(ctx).ToChecked();
+		uint32_t len = Nan::Get(list, i*5 + 4).ToLocalChecked()->Uint32Value(ctx).ToChecked();
+
+		if(addr > 0x7f || len > 0xffff || (size_t)offset + len > node::Buffer::Length(buf)){
+			return false;
+		}
+
+		msgs[i].addr = addr;
+		msgs[i].flags = flags;
+		msgs[i].len = len;
+		msgs[i].buf = node::Buffer::Data(buf) + offset;
+		msgs[i].status = 0;
+	}
+
+	return true;
+}
+
+NAN_METHOD(i2c_transfer)
+{
+	std::vector<i2c_msg_t> msgs;
+	uint32_t rval;
+
+	if((info.Length() != 2) || (!info[0]->IsArray()) || (!node::Buffer::HasInstance(info[1])) ||
+		(!i2c_msg_parse(info[0].As<v8::Array>(), msgs)) || (node::Buffer::Length(info[1]) < msgs.size())){
+		return ThrowTypeError("Incorrect arguments");
+	}
+
+	char *status = node::Buffer::Data(info[1]);
+
+	i2c_lock();
+	rval = i2c_transfer(msgs.data(), msgs.size());
+	i2c_unlock();
+
+	for(size_t i = 0; i < msgs.size(); i++){
+		status[i] = msgs[i].status;
+	}
+
+	info.GetReturnValue().Set(rval);
+}
+
+class I2cTransferWorker : public Nan::AsyncWorker {
+public:
+	I2cTransferWorker(Nan::Callback *callback, std::vector<i2c_msg_t> &m, char *status)
+		: Nan::AsyncWorker(callback, "array-gpio:i2c"), status(status), rval(0), bus(i2c_current_bus()) {
+		msgs.swap(m);
+	}
+
+	void Execute(){
+		i2c_use(bus);
+		i2c_lock();
+		rval = i2c_transfer(msgs.data(), msgs.size());
+		i2c_unlock();
+
+		for(size_t i = 0; i < msgs.size(); i++){
+			status[i] = msgs[i].status;
+		}
+	}
+
+	void HandleOKCallback(){
+		Nan::HandleScope scope;
+		v8::Local<v8::Value> argv[] = { Nan::New<v8::Uint32>(rval) };
+		callback->Call(1, argv, async_resource);
+	}
+
+private:
+	std::vector<i2c_msg_t> msgs;
+	char *status;
+	uint32_t rval;
+	uint8_t bus;
+};
+
+class I2cScanWorker : public Nan::AsyncWorker {
+public:
+	I2cScanWorker(Nan::Callback *callback, uint8_t first, uint8_t last, uint8_t mode)
+		: Nan::AsyncWorker(callback, "array-gpio:i2c"), first(first), last(last), mode(mode), bus(i2c_current_bus()) {}
+
+	void Execute(){
+		i2c_use(bus);
+		i2c_lock();
+		i2c_scan(first, last, mode, map);
+		i2c_unlock();
+	}
+
+	void HandleOKCallback(){
+		Nan::HandleScope scope;
+		v8::Local<v8::Value> argv[] = { i2c_scan_buffer(map) };
+		callback->Call(1, argv, async_resource);
+	}
+
+private:
+	uint8_t first;
+	uint8_t last;
+	uint8_t mode;
+	uint8_t bus;
+	uint32_t map[4];
+};
+
+/* i2c_scan_async(first, last, mode, cb) */
+NAN_METHOD(i2c_scan_async)
+{
+	if((info.Length() != 4) || (!info[0]->IsNumber()) || (!info[1]->IsNumber()) || (!info[2]->IsNumber()) || (!info[3]->IsFunction())){
+		return ThrowTypeError("Incorrect arguments");
+	}
+
+	uint8_t first = info[0]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+	uint8_t last = info[1]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+	uint8_t mode = info[2]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+	Nan::Callback *cb = new Nan::Callback(info[3].As<v8::Function>());
+
+	Nan::AsyncQueueWorker(new I2cScanWorker(cb, first, last, mode));
+}
+
+/* i2c_transfer_async(list, status, cb), the message buffers are kept alive through the list */
+NAN_METHOD(i2c_transfer_async)
+{
+	std::vector<i2c_msg_t> msgs;
+
+	if((info.Length() != 3) || (!info[0]->IsArray()) || (!node::Buffer::HasInstance(info[1])) || (!info[2]->IsFunction()) ||
+		(!i2c_msg_parse(info[0].As<v8::Array>(), msgs)) || (node::Buffer::Length(info[1]) < msgs.size())){
+		return ThrowTypeError("Incorrect arguments");
+	}
+
+	Nan::Callback *cb = new Nan::Callback(info[2].As<v8::Function>());
+
+	I2cTransferWorker *worker = new I2cTransferWorker(cb, msgs, node::Buffer::Data(info[1]));
+	worker->SaveToPersistent("list", info[0]);
+	worker->SaveToPersistent("status", info[1]);
+
+	Nan::AsyncQueueWorker(worker);
+}
+
+/*
+ *  kernel driver backends (i2c-dev, spidev)
+ */
+NAN_METHOD(kdev_i2c_open)
+{
+	if((info.Length() != 1) || (!info[0]->IsNumber())){
+		return ThrowTypeError("Incorrect arguments");
+	}
+
+	uint8_t bus = info[0]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+
+	info.GetReturnValue().Set(kdev_i2c_open(bus));
+}
+
+NAN_METHOD(kdev_spi_open)
+{
+	if((info.Length() != 2) || (!info[0]->IsNumber()) || (!info[1]->IsNumber())){
+		return ThrowTypeError("Incorrect arguments");
+	}
+
+	uint8_t bus = info[0]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+	uint8_t cs = info[1]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+
+	info.GetReturnValue().Set(kdev_spi_open(bus, cs));
+}
+
+/* kdev_spi_config(id, mode, speed, flags) */
+NAN_METHOD(kdev_spi_config)
 {
-	if((info.Length() != 1) || (!info[0]->IsNumber())){
+	if((info.Length() != 4) || (!info[0]->IsNumber()) || (!info[1]->IsNumber()) || (!info[2]->IsNumber()) || (!info[3]->IsNumber())){
 		return ThrowTypeError("Incorrect arguments");
 	}
 
-	uint8_t arg = info[0]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
-	
-	gpio_reset_all_events(arg);
+	int32_t id = info[0]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+	uint8_t mode = info[1]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+	uint32_t speed = info[2]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+	uint8_t flags = info[3]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+
+	info.GetReturnValue().Set(kdev_spi_config(id, mode, speed, flags));
 }
 
-NAN_METHOD(gpio_reset_event) 
+NAN_METHOD(kdev_close)
 {
 	if((info.Length() != 1) || (!info[0]->IsNumber())){
 		return ThrowTypeError("Incorrect arguments");
 	}
 
-	uint8_t arg = info[0]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
-	
-	gpio_reset_event(arg);
+	kdev_close(info[0]->IntegerValue(Nan::GetCurrentContext()).ToChecked());
 }
 
-NAN_METHOD(gpio_write) 
+/* kdev_i2c_transfer(id, list, status), same message list as i2c_transfer(), returns the no. of failed messages */
+NAN_METHOD(kdev_i2c_transfer)
 {
-	uint8_t rval;
+	std::vector<i2c_msg_t> msgs;
 
-	if((info.Length() != 2) || (!info[0]->IsNumber()) || (!info[1]->IsNumber())){
+	if((info.Length() != 3) || (!info[0]->IsNumber()) || (!info[1]->IsArray()) || (!node::Buffer::HasInstance(info[2])) ||
+		(!i2c_msg_parse(info[1].As<v8::Array>(), msgs)) || (node::Buffer::Length(info[2]) < msgs.size())){
 		return ThrowTypeError("Incorrect arguments");
 	}
 
-	uint8_t arg1 = info[0]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
-	uint8_t arg2 = info[1]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+	int32_t id = info[0]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+	char *status = node::Buffer::Data(info[2]);
+	uint32_t rval = kdev_i2c_transfer(id, msgs.data(), msgs.size());
 
-	rval = gpio_write(arg1, arg2);
+	for(size_t i = 0; i < msgs.size(); i++){
+		status[i] = msgs[i].status;
+	}
 
 	info.GetReturnValue().Set(rval);
 }
 
-NAN_METHOD(gpio_set_pud)
+/* kdev_spi_transfer(id, list), same transfer list as spi_transfer_list(), returns 0 on success */
+NAN_METHOD(kdev_spi_transfer)
 {
-	if((info.Length() != 2) || (!info[0]->IsNumber()) || (!info[1]->IsNumber())){
+	std::vector<spi_xfer_t> x;
+
+	if((info.Length() != 2) || (!info[0]->IsNumber()) || (!info[1]->IsArray()) || (!spi_xfer_parse(info[1].As<v8::Array>(), x))){
 		return ThrowTypeError("Incorrect arguments");
 	}
 
-	uint8_t arg1 = info[0]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
-	uint8_t arg2 = info[1]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+	int32_t id = info[0]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
 
-	gpio_set_pud(arg1, arg2);
+	info.GetReturnValue().Set(kdev_spi_transfer(id, x.data(), x.size()));
 }
 
-NAN_METHOD(gpio_get_pud)
+/* The ioctl blocks the worker thread only, large spi transfers use the kernel driver's dma */
+class KdevWorker : public Nan::AsyncWorker {
+public:
+	KdevWorker(Nan::Callback *callback, int32_t id, std::vector<i2c_msg_t> &m, char *status)
+		: Nan::AsyncWorker(callback, "array-gpio:kdev"), id(id), status(status), rval(0) {
+		msgs.swap(m);
+	}
+
+	KdevWorker(Nan::Callback *callback, int32_t id, std::vector<spi_xfer_t> &v)
+		: Nan::AsyncWorker(callback, "array-gpio:kdev"), id(id), status(NULL), rval(0) {
+		x.swap(v);
+	}
+
+	void Execute(){
+		if(status == NULL){
+			rval = kdev_spi_transfer(id, x.data(), x.size());
+			return;
+		}
+
+		rval = kdev_i2c_transfer(id, msgs.data(), msgs.size());
+
+		for(size_t i = 0; i < msgs.size(); i++){
+			status[i] = msgs[i].status;
+		}
+	}
+
+	void HandleOKCallback(){
+		Nan::HandleScope scope;
+		v8::Local<v8::Value> argv[] = { Nan::New<v8::Uint32>(rval) };
+		callback->Call(1, argv, async_resource);
+	}
+
+private:
+	int32_t id;
+	std::vector<i2c_msg_t> msgs;
+	std::vector<spi_xfer_t> x;
+	char *status;
+	uint32_t rval;
+};
+
+/* kdev_i2c_transfer_async(id, list, status, cb), the message buffers are kept alive through the list */
+NAN_METHOD(kdev_i2c_transfer_async)
 {
-	uint8_t ret;
+	std::vector<i2c_msg_t> msgs;
 
-	if((info.Length() != 1) || (!info[0]->IsNumber())){
+	if((info.Length() != 4) || (!info[0]->IsNumber()) || (!info[1]->IsArray()) || (!node::Buffer::HasInstance(info[2])) || (!info[3]->IsFunction()) ||
+		(!i2c_msg_parse(info[1].As<v8::Array>(), msgs)) || (node::Buffer::Length(info[2]) < msgs.size())){
 		return ThrowTypeError("Incorrect arguments");
 	}
 
-	uint8_t arg1 = info[0]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
-	
-	ret = gpio_get_pud(arg1);
+	int32_t id = info[0]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+	Nan::Callback *cb = new Nan::Callback(info[3].As<v8::Function>());
 
-	info.GetReturnValue().Set(ret);
-}
+	KdevWorker *worker = new KdevWorker(cb, id, msgs, node::Buffer::Data(info[2]));
+	worker->SaveToPersistent("list", info[1]);
+	worker->SaveToPersistent("status", info[2]);
 
-/*
- *  PWM
- */
-NAN_METHOD(pwm_init)
-{
-	pwm_init();
+	Nan::AsyncQueueWorker(worker);
 }
-NAN_METHOD(pwm_set_pin)
+
+/* kdev_spi_transfer_async(id, list, cb), the buffers are kept alive through the list */
+NAN_METHOD(kdev_spi_transfer_async)
 {
-	if((info.Length() != 1) || (!info[0]->IsNumber())){
+	std::vector<spi_xfer_t> x;
+
+	if((info.Length() != 3) || (!info[0]->IsNumber()) || (!info[1]->IsArray()) || (!info[2]->IsFunction()) ||
+		(!spi_xfer_parse(info[1].As<v8::Array>(), x))){
 		return ThrowTypeError("Incorrect arguments");
 	}
 
-	uint8_t arg = info[0]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+	int32_t id = info[0]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+	Nan::Callback *cb = new Nan::Callback(info[2].As<v8::Function>());
 
-	pwm_set_pin(arg);
+	KdevWorker *worker = new KdevWorker(cb, id, x);
+	worker->SaveToPersistent("list", info[1]);
+
+	Nan::AsyncQueueWorker(worker);
 }
 
-NAN_METHOD(pwm_reset_pin)
+NAN_METHOD(spi_data_transfer_async)
 {
-	if((info.Length() != 1) || (!info[0]->IsNumber())){
+	if((info.Length() != 4) || (!info[0]->IsObject()) || (!info[1]->IsObject()) || (!info[2]->IsNumber()) || (!info[3]->IsFunction())){
 		return ThrowTypeError("Incorrect arguments");
 	}
 
-	uint8_t arg = info[0]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+	v8::Local<v8::Object> wbuf =  info[0]->ToObject(Nan::GetCurrentContext()).FromMaybe(v8::Local<v8::Object>());
+	v8::Local<v8::Object> rbuf =  info[1]->ToObject(Nan::GetCurrentContext()).FromMaybe(v8::Local<v8::Object>());
+	uint32_t arg = info[2]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
 
-	pwm_reset_pin(arg);
-}
+	if(arg > node::Buffer::Length(wbuf) || arg > node::Buffer::Length(rbuf)){
+		return ThrowRangeError("Insufficient buffer size");
+	}
 
-NAN_METHOD(pwm_reset_all_pins)
-{
-	pwm_reset_all_pins();
+	Nan::Callback *cb = new Nan::Callback(info[3].As<v8::Function>());
+
+	SpiWorker *worker = new SpiWorker(cb, SPI_ASYNC_TRANSFER, node::Buffer::Data(wbuf), node::Buffer::Data(rbuf), arg);
+	worker->SaveToPersistent("wbuf", wbuf);
+	worker->SaveToPersistent("rbuf", rbuf);
+
+	Nan::AsyncQueueWorker(worker);
 }
 
-NAN_METHOD(pwm_set_clock_freq)
+/* spi_write_async(wbuf, len, cb) and spi_read_async(rbuf, len, cb) */
+void spi_rw_async(const Nan::FunctionCallbackInfo<v8::Value>& info, uint8_t op)
 {
-	uint8_t rval;
-
-	if((info.Length() != 1) || (!info[0]->IsNumber())){
+	if((info.Length() != 3) || (!info[0]->IsObject()) || (!info[1]->IsNumber()) || (!info[2]->IsFunction())){
 		return ThrowTypeError("Incorrect arguments");
 	}
 
-	uint32_t arg = info[0]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+	v8::Local<v8::Object> buf =  info[0]->ToObject(Nan::GetCurrentContext()).FromMaybe(v8::Local<v8::Object>());
+	uint32_t arg = info[1]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
 
-	rval = pwm_set_clock_freq(arg);
-	
-	info.GetReturnValue().Set(rval);
+	if(arg > node::Buffer::Length(buf)){
+		return ThrowRangeError("Insufficient buffer size");
+	}
+	if(rpi_sampler_running()){
+		return ThrowError("spi write() and read() can not be used while the spi sampler is running, use transfer()");
+	}
+
+	Nan::Callback *cb = new Nan::Callback(info[2].As<v8::Function>());
+
+	SpiWorker *worker = new SpiWorker(cb, op, node::Buffer::Data(buf), node::Buffer::Data(buf), arg);
+	worker->SaveToPersistent("buf", buf);
+
+	Nan::AsyncQueueWorker(worker);
 }
 
-NAN_METHOD(pwm_clk_status)
+NAN_METHOD(spi_write_async)
 {
-	uint8_t rval;
-	
-	rval = pwm_clk_status();
-	
-	info.GetReturnValue().Set(rval);
+	spi_rw_async(info, SPI_ASYNC_WRITE);
 }
 
-NAN_METHOD(pwm_enable)
+NAN_METHOD(spi_read_async)
 {
-	if((info.Length() != 2) || (!info[0]->IsNumber()) || (!info[1]->IsNumber())){
+	spi_rw_async(info, SPI_ASYNC_READ);
+}
+
+/*
+ *  AUX mini SPI (bus 1 = SPI1, 2 = SPI2)
+ */
+NAN_METHOD(aux_spi_start)
+{
+	if((info.Length() != 1) || (!info[0]->IsNumber())){
 		return ThrowTypeError("Incorrect arguments");
 	}
 
-	uint8_t arg1 = info[0]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
-	uint8_t arg2 = info[1]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+	uint8_t bus = info[0]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
 
-	pwm_enable(arg1, arg2);
+	info.GetReturnValue().Set(aux_spi_start(bus));
 }
 
-NAN_METHOD(pwm_set_mode)
+NAN_METHOD(aux_spi_stop)
 {
-	if((info.Length() != 2) || (!info[0]->IsNumber()) || (!info[1]->IsNumber())){
+	if((info.Length() != 1) || (!info[0]->IsNumber())){
 		return ThrowTypeError("Incorrect arguments");
 	}
 
-	uint8_t arg1 = info[0]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
-	uint8_t arg2 = info[1]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+	uint8_t bus = info[0]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
 
-	pwm_set_mode(arg1, arg2);
+	aux_spi_lock(bus);
+	aux_spi_stop(bus);
+	aux_spi_unlock(bus);
 }
 
-NAN_METHOD(pwm_set_pola)
+/* aux_spi_set(bus, clock divider, data mode, chip select), settings used by the next transfers */
+NAN_METHOD(aux_spi_set)
 {
-	if((info.Length() != 2) || (!info[0]->IsNumber()) || (!info[1]->IsNumber())){
+	if((info.Length() != 4) || (!info[0]->IsNumber()) || (!info[1]->IsNumber()) || (!info[2]->IsNumber()) || (!info[3]->IsNumber())){
 		return ThrowTypeError("Incorrect arguments");
 	}
 
-	uint8_t arg1 = info[0]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
-	uint8_t arg2 = info[1]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+	uint8_t bus = info[0]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+	uint16_t div = info[1]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+	uint8_t mode = info[2]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+	uint8_t cs = info[3]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
 
-	pwm_set_pola(arg1, arg2);
+	aux_spi_lock(bus);
+	aux_spi_set_clock_freq(bus, div);
+	aux_spi_set_data_mode(bus, mode);
+	aux_spi_chip_select(bus, cs);
+	aux_spi_unlock(bus);
 }
 
-NAN_METHOD(pwm_set_data)
+/* aux_spi_transfer(bus, wbuf, rbuf, len), wbuf or rbuf can be null, returns 2 on a timeout */
+NAN_METHOD(aux_spi_transfer)
 {
-	if((info.Length() != 2) || (!info[0]->IsNumber()) || (!info[1]->IsNumber())){
+	uint8_t rval;
+	char *wbuf, *rbuf;
+
+	if((info.Length() != 4) || (!info[0]->IsNumber()) || (!info[3]->IsNumber())){
 		return ThrowTypeError("Incorrect arguments");
 	}
 
-	uint8_t arg1 = info[0]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
-	uint32_t arg2 = info[1]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
-
-	pwm_set_data(arg1, arg2);
-}
+	uint8_t bus = info[0]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+	uint32_t len = info[3]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
 
-NAN_METHOD(pwm_set_range)
-{
-	if((info.Length() != 2) || (!info[0]->IsNumber()) || (!info[1]->IsNumber())){
+	if(!spi_dev_buffer(info[1], len, &wbuf) || !spi_dev_buffer(info[2], len, &rbuf)){
 		return ThrowTypeError("Incorrect arguments");
 	}
 
-	uint8_t arg1 = info[0]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
-	uint32_t arg2 = info[1]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+	aux_spi_lock(bus);
+	rval = aux_spi_transfer(bus, wbuf, rbuf, len);
+	aux_spi_unlock(bus);
 
-	pwm_set_range(arg1, arg2);
+	info.GetReturnValue().Set(rval);
 }
 
-/*
- *  i2c
- */
-NAN_METHOD(i2c_start)
-{
-	if((info.Length() != 1) || (!info[0]->IsNumber() )){
-		return ThrowTypeError("Incorrect argument");
+class AuxSpiWorker : public Nan::AsyncWorker {
+public:
+	AuxSpiWorker(Nan::Callback *callback, uint8_t bus, char *wbuf, char *rbuf, uint32_t len)
+		: Nan::AsyncWorker(callback, "array-gpio:aux-spi"), bus(bus), wbuf(wbuf), rbuf(rbuf), len(len), rval(0) {}
+
+	void Execute(){
+		aux_spi_lock(bus);
+		rval = aux_spi_transfer(bus, wbuf, rbuf, len);
+		aux_spi_unlock(bus);
 	}
 
-	uint8_t arg = info[0]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
-        
-	i2c_start(arg);
-}
+	void HandleOKCallback(){
+		Nan::HandleScope scope;
+		v8::Local<v8::Value> argv[] = { Nan::New<v8::Uint32>(rval) };
+		callback->Call(1, argv, async_resource);
+	}
 
-NAN_METHOD(i2c_stop)
-{
-	i2c_stop();
-}
+private:
+	uint8_t bus;
+	char *wbuf;
+	char *rbuf;
+	uint32_t len;
+	uint8_t rval;
+};
 
-NAN_METHOD(i2c_select_slave)
+NAN_METHOD(aux_spi_transfer_async)
 {
-	if((info.Length() != 1) || (!info[0]->IsNumber())){
+	char *wbuf, *rbuf;
+
+	if((info.Length() != 5) || (!info[0]->IsNumber()) || (!info[3]->IsNumber()) || (!info[4]->IsFunction())){
 		return ThrowTypeError("Incorrect arguments");
 	}
 
-	uint8_t arg = info[0]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
-        
-	i2c_select_slave(arg);
-}
+	uint8_t bus = info[0]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+	uint32_t len = info[3]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
 
-NAN_METHOD(i2c_set_clock_freq)
-{
-	if((info.Length() != 1) || (!info[0]->IsNumber())){
+	if(!spi_dev_buffer(info[1], len, &wbuf) || !spi_dev_buffer(info[2], len, &rbuf)){
 		return ThrowTypeError("Incorrect arguments");
 	}
-	uint16_t arg = info[0]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
 
-	i2c_set_clock_freq(arg);
+	Nan::Callback *cb = new Nan::Callback(info[4].As<v8::Function>());
+
+	AuxSpiWorker *worker = new AuxSpiWorker(cb, bus, wbuf, rbuf, len);
+	worker->SaveToPersistent("wbuf", info[1]);
+	worker->SaveToPersistent("rbuf", info[2]);
+
+	Nan::AsyncQueueWorker(worker);
 }
 
-NAN_METHOD(i2c_data_transfer_speed)
+/*
+ *  Software (bit-banged) SPI and I2C
+ */
+/* soft_spi_open(sclk, mosi, miso, cs, mode, lsb_first, cs_high, freq), pins 0xff unused, returns the bus id or -1 */
+NAN_METHOD(soft_spi_open)
 {
-	if((info.Length() != 1) || (!info[0]->IsNumber())){
+	uint8_t arg[7];
+
+	if(!buf_args(info, 8)){
 		return ThrowTypeError("Incorrect arguments");
 	}
+	for(int i = 0; i < 7; i++){
+		arg[i] = buf_arg(info, i);
+	}
+	uint32_t freq = info[7]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
 
-	uint32_t arg = info[0]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
-
-	i2c_data_transfer_speed(arg);
+	info.GetReturnValue().Set(soft_spi_open(arg[0], arg[1], arg[2], arg[3], arg[4], arg[5], arg[6], freq));
 }
 
-NAN_METHOD(i2c_write)
+/* soft_spi_config(id, mode, lsb_first, freq) */
+NAN_METHOD(soft_spi_config)
 {
-  	uint8_t rval;
-
-	if((info.Length() != 2) || (!info[0]->IsObject()) || (!info[1]->IsNumber())){
+	if(!buf_args(info, 4)){
 		return ThrowTypeError("Incorrect arguments");
 	}
 
-	v8::Local<v8::Object> wbuf =  info[0]->ToObject(Nan::GetCurrentContext()).FromMaybe(v8::Local<v8::Object>());
-	uint8_t arg = info[1]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+	int32_t id = buf_arg(info, 0);
+	uint32_t freq = info[3]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
 
-	rval = i2c_write(node::Buffer::Data(wbuf), arg);
-	
-	info.GetReturnValue().Set(rval);
+	soft_lock(id);
+	soft_spi_config(id, buf_arg(info, 1), buf_arg(info, 2), freq);
+	soft_unlock(id);
 }
 
-NAN_METHOD(i2c_read)
+/* soft_spi_transfer(id, wbuf, rbuf, len), wbuf or rbuf can be null, returns 1 if the bus id is invalid */
+NAN_METHOD(soft_spi_transfer)
 {
 	uint8_t rval;
+	char *wbuf, *rbuf;
 
-	if((info.Length() != 2) || (!info[0]->IsObject()) || (!info[1]->IsNumber())){
+	if((info.Length() != 4) || (!info[0]->IsNumber()) || (!info[3]->IsNumber())){
 		return ThrowTypeError("Incorrect arguments");
 	}
-	
-	v8::Local<v8::Object> rbuf =  info[0]->ToObject(Nan::GetCurrentContext()).FromMaybe(v8::Local<v8::Object>());
-	uint8_t arg = info[1]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
 
-	rval = i2c_read(node::Buffer::Data(rbuf), arg);
-	
-	info.GetReturnValue().Set(rval);
-}
+	int32_t id = buf_arg(info, 0);
+	uint32_t len = info[3]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
 
-NAN_METHOD(i2c_byte_read)
-{
-	uint8_t rval;
+	if(!spi_dev_buffer(info[1], len, &wbuf) || !spi_dev_buffer(info[2], len, &rbuf)){
+		return ThrowTypeError("Incorrect arguments");
+	}
+
+	soft_lock(id);
+	rval = soft_spi_transfer(id, wbuf, rbuf, len);
+	soft_unlock(id);
 
-	rval = i2c_byte_read();
-	
 	info.GetReturnValue().Set(rval);
 }
 
-/*
- *  SPI
- */
-NAN_METHOD(spi_start)
+/* soft_i2c_open(scl, sda, freq, stretch_us), returns the bus id or -1 */
+NAN_METHOD(soft_i2c_open)
 {
-	spi_start();
-}
+	if(!buf_args(info, 4)){
+		return ThrowTypeError("Incorrect arguments");
+	}
 
-NAN_METHOD(spi_stop)
-{
-	spi_stop();
+	uint8_t scl = buf_arg(info, 0);
+	uint8_t sda = buf_arg(info, 1);
+	uint32_t freq = info[2]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+	uint32_t stretch = info[3]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+
+	info.GetReturnValue().Set(soft_i2c_open(scl, sda, freq, stretch));
 }
 
-NAN_METHOD(spi_set_clock_freq)
+/* soft_i2c_config(id, freq, stretch_us) */
+NAN_METHOD(soft_i2c_config)
 {
-	if((info.Length() != 1) || (!info[0]->IsNumber())){
+	if(!buf_args(info, 3)){
 		return ThrowTypeError("Incorrect arguments");
 	}
 
-	uint16_t arg = info[0]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+	int32_t id = buf_arg(info, 0);
+	uint32_t freq = info[1]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+	uint32_t stretch = info[2]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
 
-	spi_set_clock_freq(arg);
+	soft_lock(id);
+	soft_i2c_config(id, freq, stretch);
+	soft_unlock(id);
 }
 
-NAN_METHOD(spi_set_data_mode)
+/* Check the soft_i2c_write_read() arguments (id, addr, wbuf, wlen, rbuf, rlen) */
+static bool soft_i2c_args(const Nan::FunctionCallbackInfo<v8::Value>& info, char **wbuf, uint32_t *wlen, char **rbuf, uint32_t *rlen)
 {
-	if((info.Length() != 1) || (!info[0]->IsNumber())){
-		return ThrowTypeError("Incorrect arguments");
+	if((!info[0]->IsNumber()) || (!info[1]->IsNumber()) || (!info[3]->IsNumber()) || (!info[5]->IsNumber())){
+		return false;
 	}
 
-	uint8_t arg = info[0]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+	*wlen = info[3]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+	*rlen = info[5]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
 
-	spi_set_data_mode(arg);
+	return spi_dev_buffer(info[2], *wlen, wbuf) && spi_dev_buffer(info[4], *rlen, rbuf) &&
+		(*wbuf || *wlen == 0) && (*rbuf || *rlen == 0);
 }
 
-NAN_METHOD(spi_set_chip_select_polarity)
+/* soft_i2c_write_read(id, addr, wbuf, wlen, rbuf, rlen), wbuf or rbuf can be null w/ a zero length,
+ * returns the i2c status (0 ok, 1 nack, 2 clock stretch timeout)
+ */
+NAN_METHOD(soft_i2c_write_read)
 {
-	if((info.Length() != 2) || (!info[0]->IsNumber()) || (!info[1]->IsNumber())){
+	uint8_t rval;
+	char *wbuf, *rbuf;
+	uint32_t wlen, rlen;
+
+	if((info.Length() != 6) || !soft_i2c_args(info, &wbuf, &wlen, &rbuf, &rlen)){
 		return ThrowTypeError("Incorrect arguments");
 	}
 
-	uint8_t arg1 = info[0]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
-	uint8_t arg2 = info[1]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+	int32_t id = buf_arg(info, 0);
+	uint8_t addr = buf_arg(info, 1);
 
-	spi_set_chip_select_polarity(arg1, arg2);
+	soft_lock(id);
+	rval = soft_i2c_write_read(id, addr, wbuf, wlen, rbuf, rlen);
+	soft_unlock(id);
+
+	info.GetReturnValue().Set(rval);
 }
 
-NAN_METHOD(spi_chip_select)
+NAN_METHOD(soft_close)
 {
-	if((info.Length() != 1) || (!info[0]->IsNumber())){
+	if(!buf_args(info, 1)){
 		return ThrowTypeError("Incorrect arguments");
 	}
 
-	uint8_t arg = info[0]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+	int32_t id = buf_arg(info, 0);
 
-	spi_chip_select(arg);
+	/* soft_close() takes the bus lock itself */
+	soft_close(id);
 }
 
-NAN_METHOD(spi_data_transfer)
+class SoftWorker : public Nan::AsyncWorker {
+public:
+	SoftWorker(Nan::Callback *callback, int32_t id, int16_t addr, char *wbuf, uint32_t wlen, char *rbuf, uint32_t rlen)
+		: Nan::AsyncWorker(callback, "array-gpio:soft"), id(id), addr(addr), wbuf(wbuf), wlen(wlen), rbuf(rbuf), rlen(rlen), rval(0) {}
+
+	/* addr < 0 is a spi transfer of wlen bytes */
+	void Execute(){
+		soft_lock(id);
+		if(addr < 0){
+			rval = soft_spi_transfer(id, wbuf, rbuf, wlen);
+		}
+		else{
+			rval = soft_i2c_write_read(id, addr, wbuf, wlen, rbuf, rlen);
+		}
+		soft_unlock(id);
+	}
+
+	void HandleOKCallback(){
+		Nan::HandleScope scope;
+		v8::Local<v8::Value> argv[] = { Nan::New<v8::Uint32>(rval) };
+		callback->Call(1, argv, async_resource);
+	}
+
+private:
+	int32_t id;
+	int16_t addr;
+	char *wbuf;
+	uint32_t wlen;
+	char *rbuf;
+	uint32_t rlen;
+	uint8_t rval;
+};
+
+NAN_METHOD(soft_spi_transfer_async)
 {
-	if((info.Length() != 3) || (!info[0]->IsObject()) || (!info[1]->IsObject()) || (!info[2]->IsNumber())){
+	char *wbuf, *rbuf;
+
+	if((info.Length() != 5) || (!info[0]->IsNumber()) || (!info[3]->IsNumber()) || (!info[4]->IsFunction())){
 		return ThrowTypeError("Incorrect arguments");
 	}
 
-	v8::Local<v8::Object> wbuf =  info[0]->ToObject(Nan::GetCurrentContext()).FromMaybe(v8::Local<v8::Object>());
-	v8::Local<v8::Object> rbuf =  info[1]->ToObject(Nan::GetCurrentContext()).FromMaybe(v8::Local<v8::Object>());
-	
-	uint8_t arg = info[2]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+	int32_t id = buf_arg(info, 0);
+	uint32_t len = info[3]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+
+	if(!spi_dev_buffer(info[1], len, &wbuf) || !spi_dev_buffer(info[2], len, &rbuf)){
+		return ThrowTypeError("Incorrect arguments");
+	}
+
+	Nan::Callback *cb = new Nan::Callback(info[4].As<v8::Function>());
 
-	spi_data_transfer(node::Buffer::Data(wbuf), node::Buffer::Data(rbuf), arg);
+	SoftWorker *worker = new SoftWorker(cb, id, -1, wbuf, len, rbuf, len);
+	worker->SaveToPersistent("wbuf", info[1]);
+	worker->SaveToPersistent("rbuf", info[2]);
+
+	Nan::AsyncQueueWorker(worker);
 }
 
-NAN_METHOD(spi_write)
+NAN_METHOD(soft_i2c_write_read_async)
 {
- 	if((info.Length() != 2) || (!info[0]->IsObject()) || (!info[1]->IsNumber())){
+	char *wbuf, *rbuf;
+	uint32_t wlen, rlen;
+
+	if((info.Length() != 7) || !soft_i2c_args(info, &wbuf, &wlen, &rbuf, &rlen) || (!info[6]->IsFunction())){
 		return ThrowTypeError("Incorrect arguments");
 	}
 
-	v8::Local<v8::Object> wbuf =  info[0]->ToObject(Nan::GetCurrentContext()).FromMaybe(v8::Local<v8::Object>());
-	uint8_t arg = info[1]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+	int32_t id = buf_arg(info, 0);
+	uint8_t addr = buf_arg(info, 1);
+
+	Nan::Callback *cb = new Nan::Callback(info[6].As<v8::Function>());
 
-	spi_write(node::Buffer::Data(wbuf), arg);
+	SoftWorker *worker = new SoftWorker(cb, id, addr, wbuf, wlen, rbuf, rlen);
+	worker->SaveToPersistent("wbuf", info[2]);
+	worker->SaveToPersistent("rbuf", info[4]);
+
+	Nan::AsyncQueueWorker(worker);
 }
 
-NAN_METHOD(spi_read)
+NAN_METHOD(spi_dev_transfer_async)
 {
-	if((info.Length() != 2) || (!info[0]->IsObject()) || (!info[1]->IsNumber())){
+	char *tx, *rx;
+
+	if((info.Length() != 5) || (!info[0]->IsNumber()) || (!info[3]->IsNumber()) || (!info[4]->IsFunction())){
 		return ThrowTypeError("Incorrect arguments");
 	}
 
-	v8::Local<v8::Object> rbuf =  info[0]->ToObject(Nan::GetCurrentContext()).FromMaybe(v8::Local<v8::Object>());
-	uint8_t arg = info[1]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+	int32_t id = info[0]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+	uint32_t len = info[3]->IntegerValue(Nan::GetCurrentContext()).ToChecked();
+
+	if(!spi_dev_buffer(info[1], len, &tx) || !spi_dev_buffer(info[2], len, &rx)){
+		return ThrowTypeError("Incorrect arguments");
+	}
+
+	Nan::Callback *cb = new Nan::Callback(info[4].As<v8::Function>());
+
+	SpiWorker *worker = new SpiWorker(cb, SPI_ASYNC_DEV, tx, rx, len);
+	worker->SetDevice(id);
+	worker->SaveToPersistent("wbuf", info[1]);
+	worker->SaveToPersistent("rbuf", info[2]);
 
-	spi_read(node::Buffer::Data(rbuf), arg);
+	Nan::AsyncQueueWorker(worker);
 }
 
 NAN_MODULE_INIT(setup)
 {
 	NAN_EXPORT(target, rpi_init);
 	NAN_EXPORT(target, rpi_close);
+	NAN_EXPORT(target, get_core_clock_freq);
+	NAN_EXPORT(target, rpi_stats);
+	NAN_EXPORT(target, rpi_stats_reset);
+	NAN_EXPORT(target, rpi_stats_export);
+	NAN_EXPORT(target, rpi_trace_start);
+	NAN_EXPORT(target, rpi_trace_stop);
+	NAN_EXPORT(target, rpi_trace_clear);
+	NAN_EXPORT(target, rpi_trace_dump);
+	NAN_EXPORT(target, bus_wait);
+	NAN_EXPORT(target, rpi_rt_profile);
+	NAN_EXPORT(target, rpi_rt_apply);
+	NAN_EXPORT(target, rpi_rt_status);
+	NAN_EXPORT(target, rpi_ring_start);
+	NAN_EXPORT(target, rpi_sampler_start);
+	NAN_EXPORT(target, rpi_sampler_stop);
+	NAN_EXPORT(target, buf_register);
+	NAN_EXPORT(target, buf_unregister);
+	NAN_EXPORT(target, i2c_read_buf);
+	NAN_EXPORT(target, i2c_write_buf);
+	NAN_EXPORT(target, i2c_write_read_buf);
+	NAN_EXPORT(target, spi_transfer_buf);
+	NAN_EXPORT(target, spi_dev_transfer_buf);
+	NAN_EXPORT(target, rpi_ring_enter);
+	NAN_EXPORT(target, rpi_ring_stop);
+	NAN_EXPORT(target, rpi_poller_start);
+	NAN_EXPORT(target, rpi_poller_add);
+	NAN_EXPORT(target, rpi_poller_remove);
+	NAN_EXPORT(target, rpi_poller_stop);
+	NAN_EXPORT(target, rpi_regmap_create);
+	NAN_EXPORT(target, rpi_regmap_volatile);
+	NAN_EXPORT(target, rpi_regmap_write);
+	NAN_EXPORT(target, rpi_regmap_read);
+	NAN_EXPORT(target, rpi_regmap_flush);
+	NAN_EXPORT(target, rpi_regmap_invalidate);
+	NAN_EXPORT(target, rpi_regmap_stats);
+	NAN_EXPORT(target, rpi_regmap_destroy);
 	NAN_EXPORT(target, nswait);
 	NAN_EXPORT(target, uswait);
 	NAN_EXPORT(target, mswait);
@@ -567,23 +2687,69 @@ NAN_MODULE_INIT(setup)
 	/* i2c */
 	NAN_EXPORT(target, i2c_start);
 	NAN_EXPORT(target, i2c_stop);
+	NAN_EXPORT(target, i2c_use);
 	NAN_EXPORT(target, i2c_select_slave);
+	NAN_EXPORT(target, i2c_probe);
+	NAN_EXPORT(target, i2c_scan);
+	NAN_EXPORT(target, i2c_scan_clear);
 	NAN_EXPORT(target, i2c_set_clock_freq);
 	NAN_EXPORT(target, i2c_data_transfer_speed);
+	NAN_EXPORT(target, i2c_clock_plan);
+	NAN_EXPORT(target, i2c_device_speed);
 	NAN_EXPORT(target, i2c_write);
 	NAN_EXPORT(target, i2c_read);
+	NAN_EXPORT(target, i2c_write_read);
+	NAN_EXPORT(target, i2c_transfer);
 	NAN_EXPORT(target, i2c_byte_read);
+	NAN_EXPORT(target, i2c_probe_async);
+	NAN_EXPORT(target, i2c_scan_async);
+	NAN_EXPORT(target, i2c_transfer_async);
+	NAN_EXPORT(target, i2c_write_async);
+	NAN_EXPORT(target, i2c_read_async);
+	NAN_EXPORT(target, i2c_write_read_async);
 
 	/* spi */
 	NAN_EXPORT(target, spi_start);
 	NAN_EXPORT(target, spi_stop);
 	NAN_EXPORT(target, spi_set_clock_freq);
+	NAN_EXPORT(target, spi_set_bulk_threshold);
+	NAN_EXPORT(target, spi_transfer_list);
+	NAN_EXPORT(target, spi_transfer_list_async);
+	NAN_EXPORT(target, spi_dev_open);
+	NAN_EXPORT(target, spi_dev_close);
+	NAN_EXPORT(target, spi_dev_transfer);
+	NAN_EXPORT(target, spi_dev_transfer_async);
+	NAN_EXPORT(target, aux_spi_start);
+	NAN_EXPORT(target, aux_spi_stop);
+	NAN_EXPORT(target, aux_spi_set);
+	NAN_EXPORT(target, aux_spi_transfer);
+	NAN_EXPORT(target, aux_spi_transfer_async);
+	NAN_EXPORT(target, soft_spi_open);
+	NAN_EXPORT(target, soft_spi_config);
+	NAN_EXPORT(target, soft_spi_transfer);
+	NAN_EXPORT(target, soft_spi_transfer_async);
+	NAN_EXPORT(target, soft_i2c_open);
+	NAN_EXPORT(target, soft_i2c_config);
+	NAN_EXPORT(target, soft_i2c_write_read);
+	NAN_EXPORT(target, soft_i2c_write_read_async);
+	NAN_EXPORT(target, soft_close);
+	NAN_EXPORT(target, kdev_i2c_open);
+	NAN_EXPORT(target, kdev_spi_open);
+	NAN_EXPORT(target, kdev_spi_config);
+	NAN_EXPORT(target, kdev_close);
+	NAN_EXPORT(target, kdev_i2c_transfer);
+	NAN_EXPORT(target, kdev_spi_transfer);
+	NAN_EXPORT(target, kdev_i2c_transfer_async);
+	NAN_EXPORT(target, kdev_spi_transfer_async);
 	NAN_EXPORT(target, spi_set_data_mode);
 	NAN_EXPORT(target, spi_set_chip_select_polarity);
 	NAN_EXPORT(target, spi_chip_select);
 	NAN_EXPORT(target, spi_data_transfer);
 	NAN_EXPORT(target, spi_write);
 	NAN_EXPORT(target, spi_read);
+	NAN_EXPORT(target, spi_data_transfer_async);
+	NAN_EXPORT(target, spi_write_async);
+	NAN_EXPORT(target, spi_read_async);
 }
 
 NODE_MODULE(LIBNAME, setup)
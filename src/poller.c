@@ -0,0 +1,282 @@
+/**
+ * poller.c
+ *
+ * Copyright (c) 2017 Ed Alegrid <ealegrid@gmail.com>
+ * GNU General Public License v3.0
+ *
+ */
+
+#define  _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "rpi.h"
+#include "rt.h"
+#include "poller.h"
+
+typedef struct {
+	uint8_t used;
+	uint32_t gen;		// changes each time the slot is reused
+	uint8_t addr;
+	uint8_t cmd_len;
+	char cmd[POLLER_CMD_MAX];
+	uint16_t len;
+	uint64_t period;	// ns
+	uint64_t next;		// time of the next read (ns)
+} poller_job_t;
+
+static poller_hdr_t *poller_hdr = NULL;
+static poller_job_t *poller_job = NULL;
+static char *poller_buf = NULL;
+static uint32_t poller_slots = 0;
+static uint32_t poller_slot_size = 0;
+static uint8_t poller_run = 0;
+static uint32_t poller_gen = 0;
+static uint8_t poller_bus = 1;
+
+static pthread_t poller_thread;
+static pthread_mutex_t poller_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t poller_cond;
+
+static uint64_t poller_now_ns(){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static poller_slot_t *poller_slot(uint32_t i){
+	return (poller_slot_t *)((uint8_t *)poller_hdr + sizeof(poller_hdr_t) + i * poller_slot_size);
+}
+
+/* Publish a result, readers retry while seq is odd or has changed during their copy */
+static void poller_publish(uint32_t i, poller_job_t *j, uint8_t status, uint64_t ts, uint32_t overruns){
+	poller_slot_t *s = poller_slot(i);
+	uint32_t seq = s->seq;
+
+	__atomic_store_n(&s->seq, seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	s->status = status;
+	s->ts_lo = (uint32_t)ts;
+	s->ts_hi = (uint32_t)(ts >> 32);
+	s->count++;
+	s->overruns += overruns;
+	s->len = j->len;
+	s->addr = j->addr;
+	if(status == 0){
+		memcpy(s->data, poller_buf, j->len);
+	}
+
+	__atomic_store_n(&s->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+static void *poller_worker(void *p){
+	poller_job_t job;
+	uint64_t now = 0, next = 0;
+	uint32_t i, k = 0, overruns = 0;
+	uint8_t status = 0, addr = 0;
+	struct timespec ts;
+
+	rpi_rt_apply();
+	rt_prefault(poller_hdr, sizeof(poller_hdr_t) + poller_slots * poller_slot_size);
+
+	i2c_use(poller_bus);
+
+	pthread_mutex_lock(&poller_lock);
+
+	while(poller_run){
+		/* job w/ the earliest deadline */
+		next = UINT64_MAX;
+		for(i = 0; i < poller_slots; i++){
+			if(poller_job[i].used && poller_job[i].next < next){
+				next = poller_job[i].next;
+				k = i;
+			}
+		}
+
+		if(next == UINT64_MAX){
+			pthread_cond_wait(&poller_cond, &poller_lock);
+			continue;
+		}
+
+		now = poller_now_ns();
+		if(next > now){
+			if(rt_spin_only()){
+				pthread_mutex_unlock(&poller_lock);
+				rt_spin_ns(next - now);
+				pthread_mutex_lock(&poller_lock);
+			}
+			else{
+				ts.tv_sec = next / 1000000000ULL;
+				ts.tv_nsec = next % 1000000000ULL;
+				pthread_cond_timedwait(&poller_cond, &poller_lock, &ts);
+			}
+			/* the jobs may have changed in the meantime */
+			continue;
+		}
+
+		job = poller_job[k];
+
+		/* skip the periods missed because the bus was busy */
+		overruns = 0;
+		if(now - next >= job.period){
+			overruns = (now - next) / job.period;
+		}
+		poller_job[k].next = next + (uint64_t)(overruns + 1) * job.period;
+
+		pthread_mutex_unlock(&poller_lock);
+
+		/* the slave selected by the application (e.g. i2c.selectSlave()) is restored before the bus is released */
+		i2c_lock();
+		addr = i2c_get_address();
+		i2c_set_address(job.addr);
+		if(job.cmd_len){
+			status = i2c_write_read(job.cmd, job.cmd_len, poller_buf, job.len);
+		}
+		else{
+			status = i2c_read(poller_buf, job.len);
+		}
+		i2c_set_address(addr);
+		i2c_unlock();
+
+		pthread_mutex_lock(&poller_lock);
+
+		/* publish only if the job was not removed during the read */
+		if(poller_job[k].used && poller_job[k].gen == job.gen){
+			poller_publish(k, &job, status, poller_now_ns(), overruns);
+		}
+	}
+
+	pthread_mutex_unlock(&poller_lock);
+
+	return NULL;
+}
+
+uint8_t rpi_poller_start(void *mem, size_t size, uint32_t slots, uint32_t slot_size){
+	pthread_condattr_t attr;
+
+	if(poller_run){
+		printf("%s() error: ", __func__);
+		puts("poller is already running");
+		return 1;
+	}
+
+	if(mem == NULL || ((uintptr_t)mem & 7) || slots == 0 || slot_size <= sizeof(poller_slot_t) || (slot_size & 7) ||
+		size < sizeof(poller_hdr_t) + (size_t)slots * slot_size){
+		printf("%s() error: ", __func__);
+		puts("invalid poller memory size");
+		return 1;
+	}
+
+	poller_job = calloc(slots, sizeof(poller_job_t));
+	poller_buf = malloc(slot_size);
+	if(poller_job == NULL || poller_buf == NULL){
+		free(poller_job);
+		free(poller_buf);
+		return 1;
+	}
+
+	memset(mem, 0, sizeof(poller_hdr_t) + (size_t)slots * slot_size);
+	poller_hdr = mem;
+	poller_hdr->magic = POLLER_MAGIC;
+	poller_hdr->version = POLLER_VERSION;
+	poller_hdr->slots = slots;
+	poller_hdr->slot_size = slot_size;
+	poller_slots = slots;
+	poller_slot_size = slot_size;
+	poller_bus = i2c_current_bus();
+
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&poller_cond, &attr);
+	pthread_condattr_destroy(&attr);
+
+	poller_run = 1;
+
+	if(pthread_create(&poller_thread, NULL, poller_worker, NULL) != 0){
+		perror("rpi_poller_start pthread_create");
+		poller_run = 0;
+		pthread_cond_destroy(&poller_cond);
+		free(poller_job);
+		free(poller_buf);
+		poller_job = NULL;
+		poller_buf = NULL;
+		return 1;
+	}
+
+	return 0;
+}
+
+int32_t rpi_poller_add(uint8_t addr, const char *cmd, uint32_t cmd_len, uint32_t len, uint32_t period_us){
+	int32_t slot = -1;
+	uint32_t i;
+
+	if(!poller_run || addr > 0x7f || cmd_len > POLLER_CMD_MAX || len == 0 || len > 0xffff ||
+		len > poller_slot_size - sizeof(poller_slot_t) || period_us == 0){
+		printf("%s() error: ", __func__);
+		puts("invalid poller job");
+		return -1;
+	}
+
+	pthread_mutex_lock(&poller_lock);
+
+	for(i = 0; i < poller_slots; i++){
+		if(!poller_job[i].used){
+			slot = i;
+			break;
+		}
+	}
+
+	if(slot >= 0){
+		poller_job_t *j = &poller_job[slot];
+		j->addr = addr;
+		j->cmd_len = cmd_len;
+		memcpy(j->cmd, cmd, cmd_len);
+		j->len = len;
+		j->period = (uint64_t)period_us * 1000;
+		j->next = poller_now_ns();
+		j->gen = ++poller_gen;
+		j->used = 1;
+		pthread_cond_signal(&poller_cond);
+	}
+
+	pthread_mutex_unlock(&poller_lock);
+
+	return slot;
+}
+
+void rpi_poller_remove(int32_t slot){
+	if(!poller_run || slot < 0 || (uint32_t)slot >= poller_slots){
+		return;
+	}
+
+	pthread_mutex_lock(&poller_lock);
+	poller_job[slot].used = 0;
+	pthread_cond_signal(&poller_cond);
+	pthread_mutex_unlock(&poller_lock);
+}
+
+void rpi_poller_stop(){
+	if(!poller_run){
+		return;
+	}
+
+	pthread_mutex_lock(&poller_lock);
+	poller_run = 0;
+	pthread_cond_signal(&poller_cond);
+	pthread_mutex_unlock(&poller_lock);
+
+	pthread_join(poller_thread, NULL);
+
+	pthread_cond_destroy(&poller_cond);
+	free(poller_job);
+	free(poller_buf);
+	poller_job = NULL;
+	poller_buf = NULL;
+	poller_hdr = NULL;
+}
@@ -0,0 +1,69 @@
+/**
+ * poller.h
+ *
+ * Copyright (c) 2017 Ed Alegrid <ealegrid@gmail.com>
+ * GNU General Public License v3.0
+ *
+ */
+
+/* Background i2c sensor polling scheduler */
+#ifndef POLLER_H
+#define POLLER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define POLLER_MAGIC		0x4c504741	// 'AGPL'
+#define POLLER_VERSION		1
+
+/* Max. no. of command bytes written before each read */
+#define POLLER_CMD_MAX		16
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Shared memory layout: header | slot[slots], each slot is slot_size bytes */
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t slots;
+	uint32_t slot_size;
+	uint32_t reserved[4];
+} poller_hdr_t;
+
+/* Latest result of a job, written with a sequence lock (seq is odd while the slot is updated) */
+typedef struct {
+	uint32_t seq;
+	uint32_t status;	// i2c status code of the last read (0 ok)
+	uint32_t ts_lo;		// monotonic time stamp of the last read (ns)
+	uint32_t ts_hi;
+	uint32_t count;		// no. of reads
+	uint32_t overruns;	// no. of periods skipped because the bus was too busy
+	uint32_t len;		// no. of data bytes
+	uint32_t addr;		// slave address
+	uint8_t data[];
+} poller_slot_t;
+
+/* Start the scheduler thread writing into a shared memory region of slots * slot_size bytes after the header,
+ * the jobs run on the i2c controller currently used by the calling thread and restore its slave address after each read.
+ * returns 0 on success, 1 on error
+ */
+uint8_t rpi_poller_start(void *mem, size_t size, uint32_t slots, uint32_t slot_size);
+
+/* Add a job reading len bytes from addr every period_us after writing the command bytes (w/ a repeated start),
+ * returns the slot index or -1 if there is no free slot
+ */
+int32_t rpi_poller_add(uint8_t addr, const char *cmd, uint32_t cmd_len, uint32_t len, uint32_t period_us);
+
+/* Remove a job, its slot keeps the last result */
+void rpi_poller_remove(int32_t slot);
+
+/* Stop and join the scheduler thread */
+void rpi_poller_stop();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* POLLER_H */
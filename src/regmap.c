@@ -0,0 +1,294 @@
+/**
+ * regmap.c
+ *
+ * Copyright (c) 2017 Ed Alegrid <ealegrid@gmail.com>
+ * GNU General Public License v3.0
+ *
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "rpi.h"
+#include "regmap.h"
+
+/* Register flags */
+#define REG_VALID		0x01	// cached value is the device value (or a pending write)
+#define REG_DIRTY		0x02	// cached value is not written to the device yet
+#define REG_VOLATILE		0x04	// not cached
+
+typedef struct {
+	uint8_t bus;
+	uint8_t addr;
+	uint8_t inc;
+	uint16_t nregs;
+	uint8_t val[256];
+	uint8_t flags[256];
+	regmap_stats_t stats;
+} regmap_t;
+
+/* Controller of the calling thread and slave address of the map controller before regmap_select() */
+typedef struct {
+	uint8_t bus;
+	uint8_t addr;
+} regmap_prev_t;
+
+static regmap_t *regmap[REGMAP_MAX] = {};
+static pthread_mutex_t regmap_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static regmap_t *regmap_get(int32_t id){
+	if(id < 0 || id >= REGMAP_MAX){
+		return NULL;
+	}
+	return regmap[id];
+}
+
+/* Select the device of a map, the previous controller and slave address are restored by regmap_release() */
+static void regmap_select(regmap_t *m, regmap_prev_t *prev){
+	prev->bus = i2c_current_bus();
+
+	i2c_use(m->bus);
+	i2c_lock();
+	prev->addr = i2c_get_address();
+	i2c_set_address(m->addr);
+}
+
+static void regmap_release(const regmap_prev_t *prev){
+	i2c_set_address(prev->addr);
+	i2c_unlock();
+	i2c_use(prev->bus);
+}
+
+/* Write n registers to the device in one burst */
+static uint8_t regmap_burst(regmap_t *m, uint8_t reg, const uint8_t *val, uint16_t n){
+	char buf[257];
+
+	buf[0] = n > 1 ? reg | m->inc : reg;
+	memcpy(buf + 1, val, n);
+	m->stats.bursts++;
+
+	return i2c_write(buf, n + 1);
+}
+
+int32_t rpi_regmap_create(uint8_t bus, uint8_t addr, uint16_t nregs, uint8_t inc){
+	int32_t id = -1, i;
+
+	if(addr > 0x7f || nregs == 0 || nregs > 256){
+		printf("%s() error: ", __func__);
+		puts("invalid register map");
+		return -1;
+	}
+
+	pthread_mutex_lock(&regmap_lock);
+	for(i = 0; i < REGMAP_MAX; i++){
+		if(regmap[i] == NULL){
+			id = i;
+			break;
+		}
+	}
+	if(id >= 0){
+		regmap[id] = calloc(1, sizeof(regmap_t));
+		if(regmap[id] == NULL){
+			id = -1;
+		}
+		else{
+			regmap[id]->bus = bus ? 1 : 0;
+			regmap[id]->addr = addr;
+			regmap[id]->inc = inc;
+			regmap[id]->nregs = nregs;
+		}
+	}
+	pthread_mutex_unlock(&regmap_lock);
+
+	return id;
+}
+
+void rpi_regmap_set_volatile(int32_t id, uint8_t reg, uint16_t n, uint8_t on){
+	regmap_t *m = regmap_get(id);
+	uint16_t i;
+
+	if(m == NULL){
+		return;
+	}
+
+	for(i = reg; i < reg + n && i < m->nregs; i++){
+		m->flags[i] = on ? REG_VOLATILE : 0;
+	}
+}
+
+uint8_t rpi_regmap_write(int32_t id, uint8_t reg, const uint8_t *val, uint16_t n){
+	regmap_t *m = regmap_get(id);
+	regmap_prev_t prev;
+	uint16_t i, k;
+	uint8_t vol = 0, status = 0;
+
+	if(m == NULL || reg + n > m->nregs){
+		return 4;
+	}
+
+	m->stats.writes += n;
+
+	/* cacheable registers */
+	for(i = 0; i < n; i++){
+		uint8_t *f = &m->flags[reg + i];
+		if(*f & REG_VOLATILE){
+			vol = 1;
+			continue;
+		}
+		if((*f & REG_VALID) && m->val[reg + i] == val[i]){
+			m->stats.dropped++;
+			continue;
+		}
+		m->val[reg + i] = val[i];
+		*f |= REG_VALID | REG_DIRTY;
+	}
+
+	/* the device sees the writes in program order, the pending cached writes go before the volatile ones */
+	if(vol && (status = rpi_regmap_flush(id))){
+		return status;
+	}
+
+	/* volatile registers are written right away, each contiguous run in one burst */
+	for(i = 0; i < n; i = k){
+		if(!(m->flags[reg + i] & REG_VOLATILE)){
+			k = i + 1;
+			continue;
+		}
+		for(k = i; k < n && (m->flags[reg + k] & REG_VOLATILE); k++);
+
+		regmap_select(m, &prev);
+		status = regmap_burst(m, reg + i, val + i, k - i);
+		regmap_release(&prev);
+
+		if(status){
+			break;
+		}
+	}
+
+	return status;
+}
+
+uint8_t rpi_regmap_read(int32_t id, uint8_t reg, uint8_t *val, uint16_t n){
+	regmap_t *m = regmap_get(id);
+	regmap_prev_t prev;
+	char cmd;
+	uint16_t i;
+	uint8_t status;
+
+	if(m == NULL || n == 0 || reg + n > m->nregs){
+		return 4;
+	}
+
+	for(i = 0; i < n; i++){
+		if((m->flags[reg + i] & (REG_VALID | REG_VOLATILE)) != REG_VALID){
+			break;
+		}
+	}
+	if(i == n){
+		memcpy(val, &m->val[reg], n);
+		m->stats.hits++;
+		return 0;
+	}
+
+	cmd = n > 1 ? reg | m->inc : reg;
+	m->stats.misses++;
+
+	regmap_select(m, &prev);
+	status = i2c_write_read(&cmd, 1, (char *)val, n);
+	regmap_release(&prev);
+
+	if(status){
+		return status;
+	}
+
+	/* update the cache, a pending write is newer than the device value */
+	for(i = 0; i < n; i++){
+		uint8_t *f = &m->flags[reg + i];
+		if(*f & REG_VOLATILE){
+			continue;
+		}
+		if(*f & REG_DIRTY){
+			val[i] = m->val[reg + i];
+		}
+		else{
+			m->val[reg + i] = val[i];
+			*f |= REG_VALID;
+		}
+	}
+
+	return 0;
+}
+
+uint8_t rpi_regmap_flush(int32_t id){
+	regmap_t *m = regmap_get(id);
+	regmap_prev_t prev;
+	uint16_t i, k;
+	uint8_t rval, status = 0;
+
+	if(m == NULL){
+		return 4;
+	}
+
+	for(i = 0; i < m->nregs; i = k){
+		if(!(m->flags[i] & REG_DIRTY)){
+			k = i + 1;
+			continue;
+		}
+		for(k = i; k < m->nregs && (m->flags[k] & REG_DIRTY); k++);
+
+		regmap_select(m, &prev);
+		rval = regmap_burst(m, i, &m->val[i], k - i);
+		regmap_release(&prev);
+
+		if(rval){
+			if(!status){
+				status = rval;
+			}
+			continue;
+		}
+		for(; i < k; i++){
+			m->flags[i] &= ~REG_DIRTY;
+		}
+	}
+
+	return status;
+}
+
+void rpi_regmap_invalidate(int32_t id){
+	regmap_t *m = regmap_get(id);
+	uint16_t i;
+
+	if(m == NULL){
+		return;
+	}
+
+	for(i = 0; i < m->nregs; i++){
+		m->flags[i] &= REG_VOLATILE;
+	}
+}
+
+void rpi_regmap_stats(int32_t id, regmap_stats_t *stats){
+	regmap_t *m = regmap_get(id);
+
+	if(m == NULL){
+		memset(stats, 0, sizeof(regmap_stats_t));
+		return;
+	}
+	*stats = m->stats;
+}
+
+void rpi_regmap_destroy(int32_t id){
+	regmap_t *m;
+
+	pthread_mutex_lock(&regmap_lock);
+	m = regmap_get(id);
+	if(m != NULL){
+		regmap[id] = NULL;
+	}
+	pthread_mutex_unlock(&regmap_lock);
+
+	free(m);
+}
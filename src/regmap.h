@@ -0,0 +1,66 @@
+/**
+ * regmap.h
+ *
+ * Copyright (c) 2017 Ed Alegrid <ealegrid@gmail.com>
+ * GNU General Public License v3.0
+ *
+ */
+
+/* Register-map cache of i2c slave devices w/ 8-bit register addresses and values */
+#ifndef REGMAP_H
+#define REGMAP_H
+
+#include <stdint.h>
+
+/* Max. number of register maps */
+#define REGMAP_MAX		32
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+	uint32_t writes;	// register writes requested
+	uint32_t dropped;	// writes dropped because the cached value was unchanged
+	uint32_t bursts;	// bus write transactions of the flushes
+	uint32_t hits;		// reads served from the cache
+	uint32_t misses;	// reads from the device
+} regmap_stats_t;
+
+/* Create the register map of a device w/ nregs registers (1 - 256) on an i2c controller (0 = BSC0, 1 = BSC1),
+ * inc is or-ed to the register address of multi-byte transfers (auto-increment bit of some devices, else 0).
+ * All registers are cacheable, returns the map id or -1 on error
+ */
+int32_t rpi_regmap_create(uint8_t bus, uint8_t addr, uint16_t nregs, uint8_t inc);
+
+/* Declare n registers from reg as volatile (always accessed on the device) or cacheable */
+void rpi_regmap_set_volatile(int32_t id, uint8_t reg, uint16_t n, uint8_t on);
+
+/* Write n registers from reg, cacheable registers are updated in the cache and only marked dirty if their
+ * value changed, volatile registers are written to the device right away after flushing the dirty registers.
+ * returns the i2c status (0 ok)
+ */
+uint8_t rpi_regmap_write(int32_t id, uint8_t reg, const uint8_t *val, uint16_t n);
+
+/* Read n registers from reg, served from the cache if all registers are cacheable and known,
+ * returns the i2c status (0 ok)
+ */
+uint8_t rpi_regmap_read(int32_t id, uint8_t reg, uint8_t *val, uint16_t n);
+
+/* Write the dirty registers to the device, each run of contiguous dirty registers in one burst,
+ * returns the i2c status of the first failed burst (0 ok), failed registers stay dirty
+ */
+uint8_t rpi_regmap_flush(int32_t id);
+
+/* Forget the cached values (e.g. after a device reset), dirty registers are dropped */
+void rpi_regmap_invalidate(int32_t id);
+
+void rpi_regmap_stats(int32_t id, regmap_stats_t *stats);
+
+void rpi_regmap_destroy(int32_t id);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* REGMAP_H */
@@ -0,0 +1,335 @@
+/**
+ * ring.c
+ *
+ * Copyright (c) 2017 Ed Alegrid <ealegrid@gmail.com>
+ * GNU General Public License v3.0
+ *
+ */
+
+#define  _DEFAULT_SOURCE	// for nanosleep()
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "rpi.h"
+#include "rt.h"
+#include "ring.h"
+
+/* Time the worker thread keeps polling an empty submission ring before it sleeps */
+#define RING_IDLE_SPIN_NS	50000
+
+typedef struct {
+	ring_hdr_t *hdr;
+	ring_sqe_t *sqe;
+	ring_cqe_t *cqe;
+	uint8_t *data;
+	uint32_t data_size;	// private copy, the header is writable by the submitter
+	uint32_t mask;
+	uint8_t bus;
+	volatile uint8_t run;
+	uint8_t kick;
+	void (*notify)(void *);
+	void *arg;
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+} ring_t;
+
+static ring_t *ring[RING_MAX] = {};
+static pthread_mutex_t ring_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static uint64_t ring_now_ns(){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Check that a data range is inside the data area */
+static uint8_t ring_range_ok(ring_t *r, uint32_t off, uint32_t len){
+	return off <= r->data_size && len <= r->data_size - off;
+}
+
+/* Execute one transaction, s is a private copy of the submission entry, returns the completion status */
+static uint32_t ring_execute(ring_t *r, const ring_sqe_t *s, uint32_t *len){
+	uint32_t status = 0;
+	char *tx = (char *)r->data + s->tx_off;
+	char *rx = (char *)r->data + s->rx_off;
+
+	*len = 0;
+
+	if(!ring_range_ok(r, s->tx_off, s->tx_len) || !ring_range_ok(r, s->rx_off, s->rx_len)){
+		return RING_EINVAL;
+	}
+	/* max. i2c transfer length and 7-bit slave address */
+	if(r->bus != RING_SPI && (s->tx_len > 0xffff || s->rx_len > 0xffff || ((s->flags & RING_F_ADDR) && s->addr > 0x7f))){
+		return RING_EINVAL;
+	}
+	/* chip select 0 ~ 2 */
+	if(r->bus == RING_SPI && (s->flags & RING_F_ADDR) && s->addr > 2){
+		return RING_EINVAL;
+	}
+
+	if(r->bus != RING_SPI){
+		i2c_lock();
+		if(s->flags & RING_F_ADDR){
+			i2c_set_address(s->addr);
+		}
+		/* write then read using a repeated start */
+		if(s->tx_len && s->rx_len){
+			status = i2c_write_read(tx, s->tx_len, rx, s->rx_len);
+		}
+		else if(s->tx_len){
+			status = i2c_write(tx, s->tx_len);
+		}
+		else if(s->rx_len){
+			status = i2c_read(rx, s->rx_len);
+		}
+		if(status == 0){
+			*len = s->tx_len + s->rx_len;
+		}
+		i2c_unlock();
+	}
+	else{
+		/* full-duplex transfer when both tx and rx are used */
+		if(s->tx_len && s->rx_len && s->tx_len != s->rx_len){
+			return RING_EINVAL;
+		}
+		spi_lock();
+		if(s->flags & RING_F_ADDR){
+			spi_chip_select(s->addr);
+		}
+		if(s->tx_len && s->rx_len){
+			status = spi_transfer(tx, rx, s->tx_len);
+		}
+		else if(s->tx_len){
+			status = spi_transfer(tx, NULL, s->tx_len);
+		}
+		else if(s->rx_len){
+			status = spi_transfer(NULL, rx, s->rx_len);
+		}
+		spi_unlock();
+		if(status == 0){
+			*len = s->tx_len ? s->tx_len : s->rx_len;
+		}
+	}
+
+	return status;
+}
+
+/* Sleep until rpi_ring_enter() or rpi_ring_stop() unless new entries show up in the meantime */
+static void ring_sleep(ring_t *r, uint32_t head){
+	pthread_mutex_lock(&r->lock);
+	__atomic_or_fetch(&r->hdr->flags, RING_NEED_WAKEUP, __ATOMIC_SEQ_CST);
+	while(r->run && !r->kick && __atomic_load_n(&r->hdr->sq_tail, __ATOMIC_SEQ_CST) == head){
+		pthread_cond_wait(&r->cond, &r->lock);
+	}
+	r->kick = 0;
+	__atomic_and_fetch(&r->hdr->flags, ~RING_NEED_WAKEUP, __ATOMIC_SEQ_CST);
+	pthread_mutex_unlock(&r->lock);
+}
+
+static void *ring_worker(void *p){
+	ring_t *r = p;
+	ring_hdr_t *h = r->hdr;
+	uint32_t head = h->sq_head, n = 0, len = 0, last = 0;
+	uint64_t idle = 0, now = 0, window = ring_now_ns(), t0 = 0;
+	struct timespec full = { 0, 50000 };
+
+	rpi_rt_apply();
+	rt_prefault(h, h->data_offset + h->data_size);
+
+	if(r->bus != RING_SPI){
+		i2c_use(r->bus == RING_I2C0 ? 0 : 1);
+	}
+
+	while(r->run){
+		if(__atomic_load_n(&h->sq_tail, __ATOMIC_ACQUIRE) == head){
+			if(n && r->notify){
+				r->notify(r->arg);
+			}
+			n = 0;
+
+			/* poll for a short while before going to sleep, or forever in spin-only mode */
+			now = ring_now_ns();
+			if(idle == 0){
+				idle = now;
+			}
+			if(!rt_spin_only() && now - idle > RING_IDLE_SPIN_NS){
+				ring_sleep(r, head);
+				idle = 0;
+			}
+			continue;
+		}
+		idle = 0;
+
+		/* completion ring is full, wait for the reaper */
+		if(h->cq_tail - __atomic_load_n(&h->cq_head, __ATOMIC_ACQUIRE) > r->mask){
+			if(n && r->notify){
+				r->notify(r->arg);
+			}
+			n = 0;
+			nanosleep(&full, NULL);
+			continue;
+		}
+
+		ring_sqe_t s;
+		ring_cqe_t *c = &r->cqe[h->cq_tail & r->mask];
+
+		/* the submitter can still write the shared entry, validate and use a copy only */
+		memcpy(&s, &r->sqe[head & r->mask], sizeof(s));
+		__atomic_signal_fence(__ATOMIC_SEQ_CST);
+
+		t0 = ring_now_ns();
+		c->status = ring_execute(r, &s, &len);
+		now = ring_now_ns();
+		c->user_data = s.user_data;
+		c->len = len;
+		c->ns = now - t0 > UINT32_MAX ? UINT32_MAX : (uint32_t)(now - t0);
+
+		if(c->status){
+			__atomic_store_n(&h->errors, h->errors + 1, __ATOMIC_RELAXED);
+		}
+		__atomic_store_n(&h->completed, h->completed + 1, __ATOMIC_RELAXED);
+		__atomic_store_n(&h->cq_tail, h->cq_tail + 1, __ATOMIC_RELEASE);
+		__atomic_store_n(&h->sq_head, ++head, __ATOMIC_RELEASE);
+		n++;
+
+		/* transactions per second, updated once a second */
+		if(now - window >= 1000000000ULL){
+			h->tps = (uint32_t)((uint64_t)(h->completed - last) * 1000000000ULL / (now - window));
+			last = h->completed;
+			window = now;
+		}
+	}
+
+	if(n && r->notify){
+		r->notify(r->arg);
+	}
+	__atomic_or_fetch(&h->flags, RING_STOPPED, __ATOMIC_SEQ_CST);
+
+	return NULL;
+}
+
+int32_t rpi_ring_start(void *mem, size_t size, uint8_t bus, uint32_t entries, void (*notify)(void *), void *arg){
+	ring_hdr_t *h = mem;
+	ring_t *r = NULL;
+	uint32_t n = 1, offset = 0;
+	int32_t id = -1, i;
+
+	if(bus != RING_I2C && bus != RING_SPI && bus != RING_I2C0){
+		printf("%s() error: ", __func__);
+		puts("invalid bus");
+		return -1;
+	}
+
+	while(n < entries){
+		n <<= 1;
+	}
+	offset = sizeof(ring_hdr_t) + n * (sizeof(ring_sqe_t) + sizeof(ring_cqe_t));
+
+	if(mem == NULL || ((uintptr_t)mem & 7) || size < offset){
+		printf("%s() error: ", __func__);
+		puts("ring memory is too small for the no. of entries");
+		return -1;
+	}
+
+	pthread_mutex_lock(&ring_lock);
+
+	for(i = 0; i < RING_MAX; i++){
+		if(ring[i] == NULL){
+			id = i;
+			break;
+		}
+	}
+	if(id < 0 || (r = calloc(1, sizeof(ring_t))) == NULL){
+		pthread_mutex_unlock(&ring_lock);
+		printf("%s() error: ", __func__);
+		puts("no more rings available");
+		return -1;
+	}
+
+	memset(h, 0, sizeof(ring_hdr_t));
+	h->magic = RING_MAGIC;
+	h->version = RING_VERSION;
+	h->bus = bus;
+	h->entries = n;
+	h->data_offset = offset;
+	h->data_size = size - offset;
+
+	r->hdr = h;
+	r->sqe = (ring_sqe_t *)((uint8_t *)mem + sizeof(ring_hdr_t));
+	r->cqe = (ring_cqe_t *)(r->sqe + n);
+	r->data = (uint8_t *)mem + offset;
+	r->data_size = size - offset;
+	r->mask = n - 1;
+	r->bus = bus;
+	r->run = 1;
+	r->notify = notify;
+	r->arg = arg;
+	pthread_mutex_init(&r->lock, NULL);
+	pthread_cond_init(&r->cond, NULL);
+
+	if(pthread_create(&r->thread, NULL, ring_worker, r) != 0){
+		pthread_mutex_unlock(&ring_lock);
+		perror("rpi_ring_start pthread_create");
+		free(r);
+		return -1;
+	}
+
+	ring[id] = r;
+
+	pthread_mutex_unlock(&ring_lock);
+
+	return id;
+}
+
+void rpi_ring_enter(int32_t id){
+	ring_t *r = NULL;
+
+	if(id < 0 || id >= RING_MAX || (r = ring[id]) == NULL){
+		return;
+	}
+
+	pthread_mutex_lock(&r->lock);
+	r->kick = 1;
+	pthread_cond_signal(&r->cond);
+	pthread_mutex_unlock(&r->lock);
+}
+
+void rpi_ring_stop(int32_t id){
+	ring_t *r = NULL;
+
+	pthread_mutex_lock(&ring_lock);
+	if(id >= 0 && id < RING_MAX){
+		r = ring[id];
+		ring[id] = NULL;
+	}
+	pthread_mutex_unlock(&ring_lock);
+
+	if(r == NULL){
+		return;
+	}
+
+	pthread_mutex_lock(&r->lock);
+	r->run = 0;
+	pthread_cond_signal(&r->cond);
+	pthread_mutex_unlock(&r->lock);
+
+	pthread_join(r->thread, NULL);
+
+	pthread_mutex_destroy(&r->lock);
+	pthread_cond_destroy(&r->cond);
+	free(r);
+}
+
+void rpi_ring_stop_all(){
+	int32_t i;
+
+	for(i = 0; i < RING_MAX; i++){
+		rpi_ring_stop(i);
+	}
+}
@@ -0,0 +1,98 @@
+/**
+ * ring.h
+ *
+ * Copyright (c) 2017 Ed Alegrid <ealegrid@gmail.com>
+ * GNU General Public License v3.0
+ *
+ */
+
+/* Submission/completion rings for i2c and spi bus transactions */
+#ifndef RING_H
+#define RING_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Max. number of rings running at the same time */
+#define RING_MAX		4
+
+#define RING_MAGIC		0x47524741	// 'AGRG'
+#define RING_VERSION		1
+
+/* Buses */
+#define RING_I2C		0		// BSC1
+#define RING_SPI		1
+#define RING_I2C0		2		// BSC0
+
+/* Header flags */
+#define RING_NEED_WAKEUP	0x01		// worker thread is sleeping, call rpi_ring_enter() after a submit
+#define RING_STOPPED		0x02		// worker thread has exited
+
+/* Submission entry flags */
+#define RING_F_ADDR		0x01		// select addr (i2c slave address or spi chip select) before the transfer
+
+/* Completion status besides the i2c status codes (0 ok, 1 nack, 2 clock stretch or spi timeout, 4 incomplete) */
+#define RING_EINVAL		0xff		// invalid submission entry
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Shared memory layout: header | sqe[entries] | cqe[entries] | data[data_size] */
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t bus;
+	uint32_t entries;	// no. of sqe and cqe entries, power of 2
+	uint32_t data_offset;	// byte offset of the data area
+	uint32_t data_size;	// byte size of the data area
+	uint32_t sq_head;	// written by the worker thread
+	uint32_t sq_tail;	// written by the submitter
+	uint32_t cq_head;	// written by the reaper
+	uint32_t cq_tail;	// written by the worker thread
+	uint32_t flags;
+	uint32_t tps;		// transactions per second during the last second
+	uint32_t completed;	// total no. of completed transactions (wraps)
+	uint32_t errors;	// total no. of completions w/ non-zero status
+	uint32_t reserved[2];
+} ring_hdr_t;
+
+typedef struct {
+	uint32_t user_data;	// copied to the completion entry
+	uint32_t addr;		// i2c slave address or spi chip select (w/ RING_F_ADDR)
+	uint32_t tx_off;	// write data offset inside the data area
+	uint32_t tx_len;
+	uint32_t rx_off;	// read data offset inside the data area
+	uint32_t rx_len;
+	uint32_t flags;
+	uint32_t reserved;
+} ring_sqe_t;
+
+typedef struct {
+	uint32_t user_data;
+	uint32_t status;
+	uint32_t len;		// no. of bytes transferred
+	uint32_t ns;		// transaction time
+} ring_cqe_t;
+
+/* Start a worker thread executing the transactions of a ring placed in mem.
+ * entries is rounded up to a power of 2, the rest of mem after the entries is the data area.
+ * notify(arg) is called from the worker thread after a batch of completions (can be NULL).
+ * returns the ring id or -1 on error
+ */
+int32_t rpi_ring_start(void *mem, size_t size, uint8_t bus, uint32_t entries, void (*notify)(void *), void *arg);
+
+/* Wake up the worker thread after new submissions (only needed when RING_NEED_WAKEUP is set) */
+void rpi_ring_enter(int32_t id);
+
+/* Stop and join the worker thread, pending submissions are not executed */
+void rpi_ring_stop(int32_t id);
+
+/* Stop all the running rings */
+void rpi_ring_stop_all();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* RING_H */
@@ -15,11 +15,20 @@
 #include <sys/mman.h>
 #include <errno.h>
 #include <string.h>
+#include <stddef.h>
 #include <stdbool.h>
 #include <unistd.h>
 #include <time.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
 
 #include "rpi.h"
+#include "stats.h"
+#include "trace.h"
+#include "rt.h"
+#include "ring.h"
+#include "poller.h"
+#include "sampler.h"
 
 // Documentation References
 // https://www.raspberrypi.com/documentation/computers/raspberry-pi.html
@@ -43,9 +52,9 @@
 #define SPI0_BASE	(peri_base + 0x204000)		// 0x7E204000 SPI0
 #define BSC0_BASE	(peri_base + 0x205000)		// 0x7E205000 BSC0 // GPIO 00 & 01/pin 27 & 28
 #define PWM_BASE 	(peri_base + 0x20C000)		// 0x7E20C000 PWM0 
-#define AUX_BASE	(peri_base + 0x215000)		// 0x7E215000 unused
-#define SPI1_BASE	(peri_base + 0x215080)		// 0x7E215080 unused
-#define SPI2_BASE	(peri_base + 0x2150C0)		// 0x7E2150C0 unused
+#define AUX_BASE	(peri_base + 0x215000)		// 0x7E215000 AUX enables, mini SPI1/SPI2
+#define SPI1_BASE	(peri_base + 0x215080)		// 0x7E215080 mini SPI1 // GPIO 16 ~ 21
+#define SPI2_BASE	(peri_base + 0x2150C0)		// 0x7E2150C0 mini SPI2 // GPIO 40 ~ 45
 #define BSC1_BASE	(peri_base + 0x804000)		// 0x7E804000 BSC1 // GPIO 02 & 03/pin 03 & 05
 
 /* Size of memory block or length of bytes to be used during mmap() */
@@ -61,6 +70,12 @@
 #define ST_C1		(ST_PERI_BASE + 0x10/4)
 #define ST_C2		(ST_PERI_BASE + 0x14/4)
 #define ST_C3		(ST_PERI_BASE + 0x18/4)
+
+/* /dev/gpiomem only exposes the gpio block, the system timer counter read by
+ * st_read() has its own /dev/mem mapping (see st_map())
+ */
+#define ST_MAP_INDEX	7
+#define ST_MAP_CLO	(base_pointer[ST_MAP_INDEX] + 0x04/4)
  
 /* PWM control manager clocks control registers
  * https://www.scribd.com/doc/127599939/BCM2835-Audio-clocks
@@ -128,8 +143,12 @@
 #define SPI_LTOH	(SPI_PERI_BASE + 0x10/4)
 #define SPI_DC		(SPI_PERI_BASE + 0x14/4)
 
+/* AUX registers, mapped on demand by aux_spi_start() */
+#define AUX_PERI_BASE	base_pointer[8]	// AUX_BASE
+#define AUX_ENABLES	(AUX_PERI_BASE + 0x04/4)
+
 /* I2C registers */
-#define I2C_PERI_BASE	base_pointer[5]	// BSC1_BASE
+#define I2C_PERI_BASE	i2c_ctx->base	// BSC1_BASE (base_pointer[5]) or BSC0_BASE (base_pointer[6]) of the calling thread
 #define I2C_C		(I2C_PERI_BASE + 0x00/4)
 #define I2C_S		(I2C_PERI_BASE + 0x04/4)  
 #define I2C_DLEN	(I2C_PERI_BASE + 0x08/4)  
@@ -161,6 +180,40 @@ volatile uint32_t peri_base = 0;
 /* core_clock frequency for for all RPI models */
 uint32_t core_clock_freq = 250000000; // 250 MHz 
 
+/* VideoCore mailbox property interface (/dev/vcio) */
+#define MBOX_PROPERTY		_IOWR(100, 0, char *)
+#define MBOX_GET_CLOCK_RATE	0x00030002
+#define MBOX_CLOCK_CORE		4
+
+/* Get the actual core clock from the firmware, core_clock_freq is used if the mailbox is not available */
+uint32_t get_core_clock_freq(){
+	static uint32_t freq = 0;
+	uint32_t msg[8] = { sizeof(msg), 0, MBOX_GET_CLOCK_RATE, 8, 4, MBOX_CLOCK_CORE, 0, 0 };
+	int fd = -1;
+
+	if(freq){
+		return freq;
+	}
+
+	if((fd = open("/dev/vcio", O_RDWR)) < 0){
+		if(debug) perror("get_core_clock_freq open /dev/vcio");
+		return core_clock_freq;
+	}
+
+	if(ioctl(fd, MBOX_PROPERTY, msg) < 0 || msg[1] != 0x80000000 || msg[6] == 0){
+		if(debug) puts("get_core_clock_freq(): mailbox request failed.");
+		close(fd);
+		return core_clock_freq;
+	}
+	close(fd);
+
+	freq = core_clock_freq = msg[6];
+
+	if(debug) printf("core clock: %u Hz\n", freq);
+
+	return freq;
+}
+
 /**********************************
 
    RPI Initialization Functions
@@ -270,9 +323,19 @@ uint8_t set_each_peri_mmap(uint8_t peri_type){
 	}
 	else if(peri_type == 3){
 		mem = "/dev/mem", type = "i2c"; 
-		start_index = 5, end_index = 7;	
+		start_index = 5, end_index = 6;	
 		base_add[5] = BSC1_BASE;
-		//base_add[6] = BSC0_BASE;
+	}
+	/* BSC0 is only mapped (and reset) when bus 0 is started, it may be used by the firmware (HAT EEPROM) */
+	else if(peri_type == 5){
+		mem = "/dev/mem", type = "i2c0"; 
+		start_index = 6, end_index = 7;	
+		base_add[6] = BSC0_BASE;
+	}
+	else if(peri_type == 4){
+		mem = "/dev/mem", type = "aux"; 
+		start_index = 8, end_index = 9;	
+		base_add[8] = AUX_BASE;
 	}
 	else{
 		return 1;
@@ -342,17 +405,16 @@ uint8_t set_all_peri_mmap(uint8_t access){
 	base_add[3] = PWM_BASE;
 	base_add[4] = SPI0_BASE;
 	base_add[5] = BSC1_BASE;
-	//base_add[6] = BSC0_BASE;
 
 	// access = 0, non-root
 	if (access == 0 && init_gpiomem == 0){
 		mem = "/dev/gpiomem", type = "gpio"; 
 		start_index = 0, end_index = 3; 		
 	}
- 	// access = 1, root
+ 	// access = 1, root (BSC0 is mapped by i2c_start(0))
 	else if(access == 1 && init_devmem == 0) {
 		mem = "/dev/mem", type = "pwm, i2c, spi"; 
-		start_index = 3, end_index = 7;
+		start_index = 3, end_index = 6;
 	}
 	else{
 		return 1;
@@ -421,15 +483,29 @@ void rpi_init(uint8_t access) {
 	rpi_init_access = 1;
 }
 
-/* Close the library and reset all memory pointers to 0 or NULL
+/* Close the library and reset all memory pointers to 0 or NULL,
+ * the background threads are stopped first as they still access the mapped registers
  */
 uint8_t rpi_close()
 {
 	uint32_t i;
 	uint8_t end_index = 7;
 
+	rpi_sampler_stop();
+	rpi_poller_stop();
+	rpi_ring_stop_all();
+
 	rpi_init_access = 1;
 
+	if(base_pointer[ST_MAP_INDEX]){
+		munmap((uint32_t *) base_pointer[ST_MAP_INDEX], BLOCK_SIZE);
+		base_pointer[ST_MAP_INDEX] = NULL;
+	}
+	if(AUX_PERI_BASE){
+		munmap((uint32_t *) AUX_PERI_BASE, BLOCK_SIZE);
+		AUX_PERI_BASE = NULL;
+	}
+
 	for(i = 0; i < end_index; i++){
 	 	if (munmap((uint32_t *) base_pointer[i] , BLOCK_SIZE) < 0){
   			perror("munmap() error");
@@ -461,8 +537,23 @@ void nswait(uint64_t ns) {
  	struct timespec req = { ns / 1000000, ns % 1000000 };  
  	struct timespec rem;
 
+	STAT_INC(STAT_TIMER, STAT_OPS);
+	STAT_TIME_BEGIN(t0);
+	TRACE_SPAN(t1);
+
+	/* engine threads in spin-only mode never sleep */
+	if(rt_spin_only()){
+		rt_spin_ns(ns);
+		STAT_TIME_END(STAT_TIMER, STAT_SPIN_NS, t0);
+		TRACE_WAIT(__func__, t1);
+		return;
+	}
+
   	while ( nanosleep(&req,&rem) == -1 )
    		req.tv_nsec = rem.tv_nsec;
+
+	STAT_TIME_END(STAT_TIMER, STAT_WAIT_NS, t0);
+	TRACE_WAIT(__func__, t1);
 }
 
 /* Time delay function in microseconds, valid only if us is below 1000 */
@@ -470,8 +561,23 @@ void uswait(uint32_t us) {
 	struct timespec req = { us / 1000, us % 1000 * 1000 };
 	struct timespec rem;
 
+	STAT_INC(STAT_TIMER, STAT_OPS);
+	STAT_TIME_BEGIN(t0);
+	TRACE_SPAN(t1);
+
+	/* engine threads in spin-only mode never sleep */
+	if(rt_spin_only()){
+		rt_spin_ns((uint64_t)us * 1000);
+		STAT_TIME_END(STAT_TIMER, STAT_SPIN_NS, t0);
+		TRACE_WAIT(__func__, t1);
+		return;
+	}
+
 	while ( nanosleep(&req,&rem) == -1 )
 	 	req.tv_nsec = rem.tv_nsec;
+
+	STAT_TIME_END(STAT_TIMER, STAT_WAIT_NS, t0);
+	TRACE_WAIT(__func__, t1);
 }
 
 /* Time delay function in milliseconds */
@@ -479,8 +585,159 @@ void mswait(uint32_t ms) {
 	struct timespec req = { ms / 1000, ms % 1000 * 1000000 };
 	struct timespec rem;
 
+	STAT_INC(STAT_TIMER, STAT_OPS);
+	STAT_TIME_BEGIN(t0);
+	TRACE_SPAN(t1);
+
+	/* engine threads in spin-only mode never sleep */
+	if(rt_spin_only()){
+		rt_spin_ns((uint64_t)ms * 1000000);
+		STAT_TIME_END(STAT_TIMER, STAT_SPIN_NS, t0);
+		TRACE_WAIT(__func__, t1);
+		return;
+	}
+
 	while ( nanosleep(&req, &rem) == -1 )
 	  	req.tv_nsec = rem.tv_nsec;
+
+	STAT_TIME_END(STAT_TIMER, STAT_WAIT_NS, t0);
+	TRACE_WAIT(__func__, t1);
+}
+
+/* Adaptive wait of the bus polling loops
+ *
+ * The loops still poll the status registers, but each poll calls bus_wait_poll() which sleeps while the
+ * expected completion (estimated from the bus clock and byte count) is far away and spins only within
+ * BUS_WAIT_MARGIN_NS of it. A sleep is capped by the slice, the time the bus needs for the part of the
+ * FIFO the loop keeps free, a late wake-up only stalls the bus clock, no data is lost.
+ * The loops give up after the deadline instead of spinning forever.
+ */
+#define BUS_WAIT_MARGIN_NS	50000
+
+/* The clock is read every BUS_WAIT_POLLS polls, fast buses pay for it only once per few FIFO accesses */
+#define BUS_WAIT_POLLS		8
+
+static uint8_t bus_wait_adaptive = 1;
+static uint64_t bus_wait_min_sleep = 100000;	// ns, about the nanosleep() wake-up latency
+
+typedef struct {
+	uint64_t start;
+	uint64_t done;		// expected completion
+	uint64_t deadline;
+	uint64_t slice;		// max. sleep between two polls
+	uint64_t slept;		// time spent sleeping
+	uint32_t polls;
+	uint8_t overdue;	// the expected completion has passed by more than a slice
+} bus_wait_t;
+
+void bus_wait_set(uint8_t adaptive, uint32_t min_sleep_us){
+	bus_wait_adaptive = adaptive;
+	if(min_sleep_us){
+		bus_wait_min_sleep = (uint64_t)min_sleep_us * 1000;
+	}
+}
+
+static uint64_t bus_now_ns(){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* expect_ns - expected transfer time, slice_ns - max. sleep, timeout_ns - allowed time after the expected completion */
+static void bus_wait_begin(bus_wait_t *w, uint64_t expect_ns, uint64_t slice_ns, uint64_t timeout_ns){
+	w->start = bus_now_ns();
+	w->done = w->start + expect_ns;
+	w->deadline = w->done + timeout_ns;
+	w->slice = slice_ns;
+	w->slept = 0;
+	w->polls = 0;
+	w->overdue = 0;
+}
+
+/* Called once per poll, returns 1 after the deadline */
+static uint8_t bus_wait_poll(bus_wait_t *w){
+	uint64_t now, ns;
+	struct timespec ts;
+
+	if(++w->polls % BUS_WAIT_POLLS){
+		return 0;
+	}
+
+	now = bus_now_ns();
+	if(now >= w->deadline){
+		return 1;
+	}
+
+	/* overdue by more than a slice (e.g. clock stretching), yield a slice at a time until the deadline */
+	if(now > w->done + (w->overdue ? 0 : w->slice)){
+		w->done = now + w->slice + BUS_WAIT_MARGIN_NS;
+		w->overdue = 1;
+	}
+
+	/* engine threads in spin-only mode never sleep */
+	if(bus_wait_adaptive && w->done > now + BUS_WAIT_MARGIN_NS + bus_wait_min_sleep && !rt_spin_only()){
+		ns = w->done - now - BUS_WAIT_MARGIN_NS;
+		ns = ns < w->slice ? ns : w->slice;
+		if(ns >= bus_wait_min_sleep){
+			ts.tv_sec = ns / 1000000000ULL;
+			ts.tv_nsec = ns % 1000000000ULL;
+			nanosleep(&ts, NULL);
+			w->slept += bus_now_ns() - now;
+		}
+	}
+	return 0;
+}
+
+/* Adds the sleep and spin time of the wait to the counters of subsystem s */
+static void bus_wait_end(bus_wait_t *w, uint8_t s){
+	uint64_t total = bus_now_ns() - w->start;
+
+	STAT_ADD(s, STAT_WAIT_NS, w->slept);
+	STAT_ADD(s, STAT_SPIN_NS, total > w->slept ? total - w->slept : 0);
+}
+
+/* Map the system timer registers (root access), returns 0 on success */
+uint8_t st_map()
+{
+	int fd;
+	void *p;
+
+	if(base_pointer[ST_MAP_INDEX]){
+		return 0;
+	}
+	/* peri_base is set by rpi_init() */
+	if(peri_base == 0){
+		return 1;
+	}
+
+	if((fd = open("/dev/mem", O_RDWR|O_SYNC)) < 0){
+		return 1;
+	}
+	base_add[ST_MAP_INDEX] = ST_BASE;
+	p = mmap(NULL, BLOCK_SIZE, PROT_READ, MAP_SHARED, fd, base_add[ST_MAP_INDEX]);
+	close(fd);
+
+	if(p == MAP_FAILED){
+		perror("st_map mmap");
+		return 1;
+	}
+	base_pointer[ST_MAP_INDEX] = p;
+
+	return 0;
+}
+
+/* Lower 32 bits of the free-running 1 MHz system timer,
+ * CLOCK_MONOTONIC in microseconds if the timer is not mapped
+ */
+uint32_t st_read()
+{
+	struct timespec ts;
+
+	if(base_pointer[ST_MAP_INDEX]){
+		return *ST_MAP_CLO;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint32_t)((uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000);
 }
 
 /*********************************************************
@@ -494,6 +751,8 @@ uint32_t setBit(volatile uint32_t* reg, uint8_t position)
 {
 	volatile uint32_t result = 0; 
 	uint32_t mask = 1 << position;
+	STAT_CUR(STAT_REG_WRITES);
+	TRACE_REG(reg, *reg | mask);
 	__sync_synchronize();
 	result = *reg |= mask;
 	__sync_synchronize();
@@ -505,6 +764,8 @@ uint32_t clearBit(volatile uint32_t* reg, uint8_t position)
 {
 	volatile uint32_t result = 0; 
 	uint32_t mask = 1 << position;
+	STAT_CUR(STAT_REG_WRITES);
+	TRACE_REG(reg, *reg & ~mask);
 	__sync_synchronize();
 	result = *reg &= ~mask;
 	__sync_synchronize();
@@ -515,18 +776,22 @@ uint32_t clearBit(volatile uint32_t* reg, uint8_t position)
 uint8_t isBitSet(volatile uint32_t* reg, uint8_t position)
 {
 	uint32_t mask = 1 << position;
+	STAT_CUR(STAT_REG_READS);
 	return *reg & mask ? 1 : 0;
 }
 
 /* Read content of a peripheral register */
 uint32_t pr_read(volatile uint32_t* reg)
 {
+	STAT_CUR(STAT_REG_READS);
 	return *reg;
 }
 
 /* Write a value to a peripheral register  */
 uint32_t pr_write(volatile uint32_t* reg,  uint32_t value)
 {
+	STAT_CUR(STAT_REG_WRITES);
+	TRACE_REG(reg, value);
 	*reg = value;
 	return *reg;
 }
@@ -570,6 +835,11 @@ void gpio_init(){
  *  0x2		     010		GPIO Pin takes alternate function 5
  *
  */
+/* Serializes the read-modify-write of the GPFSEL registers (10 pins each) between threads,
+ * e.g. a software i2c bus toggling its pins while another pin of the same register is configured
+ */
+static pthread_mutex_t gpfsel_lock = PTHREAD_MUTEX_INITIALIZER;
+
 void set_gpio(uint8_t pin, uint8_t fsel){
 	/* get base address (GPFSEL0 to GPFSEL5) using *(GPFSEL0 + (pin/10))
 	 * get mask using (alt << ((pin)%10)*3)
@@ -578,11 +848,15 @@ void set_gpio(uint8_t pin, uint8_t fsel){
 	// get the GPFSEL0 pointer (GPFSEL0 ~ GPFSEL5) based on the pin number selected
 	volatile uint32_t *gpsel = (uint32_t *)(GPIO_GPFSEL0 + (pin/10));
 	uint32_t mask = ~ (7 <<  (pin % 10)*3);	// mask to reset fsel to 0 first
+	STAT_CUR(STAT_REG_WRITES);
+	pthread_mutex_lock(&gpfsel_lock);
 	*gpsel &= mask;   					     	// reset gpsel value to 0
 	mask = (fsel <<  ((pin) % 10)*3);	      	// mask for new fsel value   
+	TRACE_REG(gpsel, *gpsel | mask);
 	__sync_synchronize();
 	*gpsel |= mask; 					     	// write new fsel value to gpselect pointer
 	__sync_synchronize();
+	pthread_mutex_unlock(&gpfsel_lock);
 }
 
 /* Set a GPIO pin as input
@@ -609,6 +883,7 @@ void gpio_output(uint8_t pin){
  * mode = 2 	alternate function 5
  */
 void gpio_config(uint8_t pin, uint8_t mode) {
+	STAT_ENTER(STAT_GPIO);
 	if(mode == 0){ 
 		set_gpio(pin, 0);		// input
 	}
@@ -634,6 +909,7 @@ void gpio_config(uint8_t pin, uint8_t mode) {
   		set_gpio(pin, 2);		// alt-func 5
 	}	
 	else{
+		STAT_INC(STAT_GPIO, STAT_ERRORS);
 		printf("%s() error: ", __func__);
   		puts("Invalid mode parameter.");
 	}
@@ -646,17 +922,23 @@ void gpio_config(uint8_t pin, uint8_t mode) {
  */
 uint8_t gpio_write(uint8_t pin, uint8_t bit) {
 	volatile uint32_t *p = NULL;
+	STAT_ENTER(STAT_GPIO);
 	__sync_synchronize();
 
 	if(bit == 1) {
 		p = (uint32_t *)GPIO_GPSET0;
+		TRACE_REG(p, 1 << pin);
 		*p = 1 << pin; 
+		STAT_INC(STAT_GPIO, STAT_REG_WRITES);
 	} 
 	else if(bit == 0 ) {
 		p = (uint32_t *)GPIO_GPCLR0;
+		TRACE_REG(p, 1 << pin);
 		*p = 1 << pin;
+		STAT_INC(STAT_GPIO, STAT_REG_WRITES);
 	}
 	else{
+		STAT_INC(STAT_GPIO, STAT_ERRORS);
 		printf("%s() error: ", __func__);
 		puts("Invalid bit parameter");
 	}
@@ -695,11 +977,13 @@ void gpio_pulse(uint8_t pin, uint32_t td){
  * 1 (ON  state)
  */
 uint8_t gpio_read(uint8_t pin) {
+	STAT_ENTER(STAT_GPIO);
 	return isBitSet(GPIO_GPLEV0, pin);
 }
 
 /* Remove all configured event detection from a GPIO pin */
 void gpio_reset_all_events (uint8_t pin) {
+	STAT_ENTER(STAT_GPIO);
 	clearBit(GPIO_GPREN0, pin);
 	mswait(1);
 	clearBit(GPIO_GPFEN0, pin);
@@ -804,6 +1088,7 @@ void gpio_enable_falling_event (uint8_t pin, uint8_t bit) {
  * bit = 1 (event detection is enabled or ON)
  */
 void gpio_enable_async_rising_event (uint8_t pin, uint8_t bit) {
+	STAT_ENTER(STAT_GPIO);
 	if(bit == 1){
   		setBit(GPIO_GPAREN0, pin);
 	}
@@ -839,6 +1124,7 @@ void gpio_enable_async_falling_event (uint8_t pin, uint8_t bit) {
  * Note: The GPIO pin must be configured for any level or edge event detection.
  */
 uint8_t gpio_detect_input_event(uint8_t pin) {
+	STAT_ENTER(STAT_GPIO);
 	return isBitSet(GPIO_GPEDS0, pin);
 }
 
@@ -847,6 +1133,7 @@ uint8_t gpio_detect_input_event(uint8_t pin) {
  * from gpio_detect_input_event(pin)
  */  
 void gpio_reset_event(uint8_t pin) {
+	STAT_ENTER(STAT_GPIO);
   	setBit(GPIO_GPEDS0, pin);
 }
 
@@ -867,6 +1154,7 @@ void gpio_reset_event(uint8_t pin) {
  * value = 2, 0x2 or 10b, // Enable pull-up 		
  */
 void gpio_set_pud(uint8_t pin, uint8_t pud) {
+	STAT_ENTER(STAT_GPIO);
 	if(cpu_type == 4){
 	        uint32_t pull = 0x0;
 	        uint32_t lsb = (pin & 0xf) << 1; 
@@ -1004,6 +1292,8 @@ uint8_t clk_status(){
 void set_clock_div(uint32_t div){
 	// using 5A as clock manager password for PASSWD field on bit num 31-21
 
+	TRACE_BEGIN(TRACE_PWM, __func__);
+
 	/* disable PWM while performing clk operations */
 	clearBit(PWM_CTL, 0);
 	clearBit(PWM_CTL, 8);
@@ -1012,9 +1302,11 @@ void set_clock_div(uint32_t div){
 
 	/* check clk SRC and disable it temporarily */
 	if(get_clk_src() == OSC){
+		TRACE_REG(CM_PWMCTL, 0x5A000001);
 		*CM_PWMCTL = 0x5A000001;  // stop the 19.2 MHz oscillator clock
 	}
 	else if(get_clk_src() == PLLD) {
+		TRACE_REG(CM_PWMCTL, 0x5A000006);
 		*CM_PWMCTL = 0x5A000006;  // stop the PLLD clock
 	}
 
@@ -1022,6 +1314,7 @@ void set_clock_div(uint32_t div){
 
 	/* forced reset if clk is still running */
 	if(isBitSet(CM_PWMCTL, 7)){
+		TRACE_REG(CM_PWMCTL, 0x5A000020);
 		*CM_PWMCTL = 0x5A000020;  // kill the clock
 		uswait(100);
 	}
@@ -1030,14 +1323,18 @@ void set_clock_div(uint32_t div){
 	 * general purpose register (CM_GP2DIV) while clk is not running
   	 */
 	if(!isBitSet(CM_PWMCTL, 7)){
+		TRACE_REG(CM_PWMDIV, 0x5A000000 | ( div << 12 ));
 		*CM_PWMDIV = 0x5A000000 | ( div << 12 );
 	}
  
 	uswait(20); 
+
+	TRACE_END(TRACE_PWM, __func__);
 }
 
 /* Set clock frequency using a divisor value */
 uint8_t pwm_set_clock_freq(uint32_t divider) {
+	STAT_ENTER(STAT_PWM);
 	if(divider > 0 && divider < 4096){
 		set_clock_div(divider);
 	}
@@ -1048,6 +1345,7 @@ uint8_t pwm_set_clock_freq(uint32_t divider) {
 	} 
 	
 	/* set clock source to 19.2 MHz oscillator and enable it */   
+	TRACE_REG(CM_PWMCTL, 0x5A000011);
 	*CM_PWMCTL = 0x5A000011;
 	
 	uswait(10);
@@ -1139,6 +1437,7 @@ void pwm_reg_ctrl(uint8_t n, uint8_t position){
  * n = 1 (Enable)
  */
 void pwm_enable(uint8_t pin, uint8_t n){
+	STAT_ENTER(STAT_PWM);
 	// Channel 1
 	if( pin == 18 || pin == 12) {    // GPIO 18/12, PHY 12/32     
 	  	pwm_reg_ctrl(n, 0); 
@@ -1159,6 +1458,7 @@ void pwm_enable(uint8_t pin, uint8_t n){
  * n = 1 (Enable M/S)
  */
 void pwm_set_mode(uint8_t pin, uint8_t n){
+	STAT_ENTER(STAT_PWM);
 	// Channel 1
 	if( pin == 18 || pin == 12) {	    // GPIO 18/12, PHY 12/32     
 	  	pwm_reg_ctrl(n, 7); 
@@ -1179,6 +1479,7 @@ void pwm_set_mode(uint8_t pin, uint8_t n){
  * n = 1 (Reverse)
  */
 void pwm_set_pola(uint8_t pin, uint8_t n){
+	STAT_ENTER(STAT_PWM);
 	// Channel 1
 	if( pin == 18 || pin == 12) {	    // GPIO 18/12, PHY 12/32     
 		pwm_reg_ctrl(n, 4); 
@@ -1195,14 +1496,17 @@ void pwm_set_pola(uint8_t pin, uint8_t n){
 
 /* Sets PWM range data or 'period T' of the pulse */
 void pwm_set_range(uint8_t pin, uint32_t range){
+	STAT_ENTER(STAT_PWM);
 	// Channel 1
 	if( pin == 18 || pin == 12) {	    // GPIO 18/12, PHY 12/32     
 		*PWM_RNG1 = range;
+		STAT_CUR(STAT_REG_WRITES);
 		reset_status_reg();
 	}
 	// Channel 2
 	else if(pin == 13 || pin == 19) { // GPIO 13/19, PHY 33/35
 		*PWM_RNG2 = range;
+		STAT_CUR(STAT_REG_WRITES);
 		reset_status_reg();
 	}
 	else{
@@ -1213,14 +1517,17 @@ void pwm_set_range(uint8_t pin, uint32_t range){
 
 /* Sets PWM data or 'pulse width' of the pulse to generate */
 void pwm_set_data(uint8_t pin, uint32_t data){
+	STAT_ENTER(STAT_PWM);
   	// Channel 1
   	if( pin == 18 || pin == 12) {		// GPIO 18/12, PHY 12/32 
    		*PWM_DAT1 = data;
+		STAT_CUR(STAT_REG_WRITES);
 		reset_status_reg();
 	}
   	// Channel 2
   	else if(pin == 13 || pin == 19) {	// GPIO 13/19, PHY 33/35
   		*PWM_DAT2 = data;
+		STAT_CUR(STAT_REG_WRITES);
   		reset_status_reg();
   	}
   	else{
@@ -1248,7 +1555,54 @@ void clear_fifo(volatile uint32_t* reg){
 // Write cycles place data into the 16-byte FIFO ready for BSC bus transmission (sends data to FIFO)
 // Read cycles access data received from the BSC bus (read data from FIFO).
 
-uint8_t i2c_pin_set = 1;
+/* One context per BSC controller
+ *
+ * 0 - BSC0, using SDA0 (GPIO 00/pin 27) and SCL0 (GPIO 01/pin 28)
+ * 1 - BSC1, using SDA1 (GPIO 02/pin 03) and SCL1 (GPIO 03/pin 05)
+ */
+typedef struct {
+	volatile uint32_t *base;
+	pthread_mutex_t mutex;			// serializes the controller between threads
+	i2c_clock_plan_t plan_bus;		// clock plan of the bus
+	i2c_clock_plan_t plan_dev[128];		// clock plan of each slave device address
+	uint16_t plan_cur;			// CDIV currently applied (0 = unknown)
+	uint8_t addr_cur;			// slave address currently in I2C_A (I2C_ADDR_NONE = unknown)
+	uint32_t scan_map[4];			// devices found by i2c_scan()
+	uint32_t scan_done[4];			// addresses scanned
+} i2c_ctx_t;
+
+#define I2C_ADDR_NONE	0xff
+
+/* Clock stretch timeout (SCL cycles) during a scan, a missing device does not stretch the clock */
+#define I2C_SCAN_CLKT	0x10
+
+static i2c_ctx_t i2c_bus[2] = {
+	{ .mutex = PTHREAD_MUTEX_INITIALIZER, .addr_cur = I2C_ADDR_NONE },
+	{ .mutex = PTHREAD_MUTEX_INITIALIZER, .addr_cur = I2C_ADDR_NONE },
+};
+
+/* Controller used by the i2c functions in the calling thread, BSC1 by default */
+static __thread i2c_ctx_t *i2c_ctx = &i2c_bus[1];
+
+/* Errors are only reported through the status codes (no console output) while set, see i2c_transfer() */
+static __thread uint8_t i2c_quiet = 0;
+
+/* Select the controller used by the calling thread */
+void i2c_use(uint8_t bus){
+	i2c_ctx = &i2c_bus[bus ? 1 : 0];
+}
+
+uint8_t i2c_current_bus(){
+	return i2c_ctx == &i2c_bus[0] ? 0 : 1;
+}
+
+void i2c_lock(){
+	pthread_mutex_lock(&i2c_ctx->mutex);
+}
+
+void i2c_unlock(){
+	pthread_mutex_unlock(&i2c_ctx->mutex);
+}
 
 /* Reset all status register error bits */
 void i2c_reset_error_status(){
@@ -1259,22 +1613,32 @@ void i2c_reset_error_status(){
 /* Start I2C operation immediately w/o calling rpi_init(1)
  * (Initialization process is integrated with the function) 
  *
- * Choose the set of pins (SDA/SCL) to use
+ * Choose the controller and its set of pins (SDA/SCL) to use,
+ * the calling thread uses the controller afterwards (see i2c_use())
  *
- * value 1 (GPIO 02/pin 03 SDA1, GPIO 03/pin 05 SCL1)
- * value 0 (GPIO 00/pin 27 SDA0, GPIO 01/pin 28 SCL0)
+ * value 1 (BSC1, GPIO 02/pin 03 SDA1, GPIO 03/pin 05 SCL1)
+ * value 0 (BSC0, GPIO 00/pin 27 SDA0, GPIO 01/pin 28 SCL0)
  */
 void i2c_start(uint8_t sel) {
-	if(rpi_init_access == 0){
-	    	gpio_init();  // init gpio for alt pin sel
-	    	set_each_peri_mmap(3); // init i2c
+	STAT_ENTER(STAT_I2C);
+	/* map the selected controller only, do not remap (and reset) a controller in use */
+	if(base_pointer[sel ? 5 : 6] == 0){
+		if(rpi_init_access == 0){
+			gpio_init();  // init gpio for alt pin sel
+		}
+		set_each_peri_mmap(sel ? 3 : 5); // init i2c
 	}
 
 	mswait(5);
+
+	i2c_use(sel);
+	i2c_ctx->base = base_pointer[sel ? 5 : 6];
+	i2c_ctx->addr_cur = I2C_ADDR_NONE;
+	i2c_scan_clear();
 	
 	if(debug){
 	    printf("I2C_PERI_BASE: %lu\n", (unsigned long)I2C_PERI_BASE);
-	    //printf("I2C_PERI_BASE2: %lu\n", (unsigned long)I2C_PERI_BASE2);
+	    printf("base_pointer[5]: %lu\n", (unsigned long)base_pointer[5]);
 	    printf("base_pointer[6]: %lu\n", (unsigned long)base_pointer[6]);
 	}
 
@@ -1288,13 +1652,11 @@ void i2c_start(uint8_t sel) {
 
 	// BSC0_BASE, using SDA0 (GPIO 00/pin 27) and SCL0 (GPIO 01/pin 28) 
 	if(sel == 0){
-        i2c_pin_set = 0;
 		set_gpio(0, 4);	// GPIO 00 alt 100b, alt 0 SDA0 
 		set_gpio(1, 4);	// GPIO 01 alt 100b, alt 0 SCL0  
 	}
 	// BSC1_BASE, using SDA1 (GPIO 02/pin 03) and SCL1 (GPIO 03/pin 05) 
-	else if(sel == 1){
-        i2c_pin_set = 1;
+	else{
 		set_gpio(2, 4);	// GPIO 02 alt 100b, alt 0 SDA1 
 		set_gpio(3, 4);	// GPIO 03 alt 100b, alt 0 SCL1 
 	}
@@ -1306,84 +1668,159 @@ void i2c_start(uint8_t sel) {
 	//*I2C_C |= 0x00008000;
 }
 
-/* Set falling and rising clock delay
- *
- * The REDL field specifies the number core clocks to wait after the rising edge before
- * sampling the incoming data.
+/* Data delays and clock stretch timeout of an even clock divider
  *
- * The FEDL field specifies the number core clocks to wait after the falling edge before
- * outputting the next data bit.
+ * FEDL = CDIV/16 and REDL = CDIV/4, at least 1 but below CDIV/2 (larger delays make the controller malfunction),
+ * CLKT = 35 ms worth of SCL cycles.
+ */
+static void i2c_clock_plan_div(uint32_t core, uint32_t cdiv, i2c_clock_plan_t *plan)
+{
+	plan->core = core;
+	plan->cdiv = cdiv;
+	plan->fedl = cdiv/16 ? cdiv/16 : 1;
+	plan->redl = cdiv/4 ? cdiv/4 : 1;
+	if(plan->fedl >= cdiv/2){
+		plan->fedl = cdiv/2 - 1;
+	}
+	if(plan->redl >= cdiv/2){
+		plan->redl = cdiv/2 - 1;
+	}
+	plan->actual = core/cdiv;
+	plan->clkt = plan->actual/1000*35 > 0xffff ? 0xffff : plan->actual/1000*35;
+}
+
+/* Set clock frequency for data transfer using a divisor value
  *
- * Note: Care must be taken in choosing values for FEDL and REDL as it is possible to
- * cause the BSC master to malfunction by setting values of CDIV/2 or greater. Therefore
- * the delay values should always be set to less than CDIV/2.
+ * The divider becomes the bus clock plan, so it is restored after a slave device w/ its own speed
+ * and not replaced by a previous i2c_data_transfer_speed() the next time a device is selected.
  */
-uint32_t set_clock_delay(uint8_t FEDL, uint8_t REDL){
+void i2c_set_clock_freq(uint16_t divider)
+{
+	i2c_clock_plan_t *plan = &i2c_ctx->plan_bus;
+
+	/* CDIV is always rounded down to an even number, 0 = 32768 */
+	uint32_t cdiv = divider & 0xfffe ? divider & 0xfffe : 32768;
+
+	STAT_ENTER(STAT_I2C);
 
-	volatile uint32_t cdiv = *I2C_DIV;
-	volatile uint8_t msb = FEDL;
-	volatile uint8_t lsb = REDL;
+	memset(plan, 0, sizeof(i2c_clock_plan_t));
+	i2c_clock_plan_div(core_clock_freq, cdiv, plan);
+	plan->baud = plan->actual;
 
-	// reset data delay register msb and lsb using 0x0030 reset value
-	*I2C_DEL = (volatile uint32_t)(0x0030 << 16 | 0x0030);
+	/* written even if the divider is already set, the delays and timeout may differ */
+	i2c_ctx->plan_cur = 0;
+	i2c_clock_apply(plan);
+}
+
+/* Compute the clock divider, data delays and clock stretch timeout for a bus speed
+ *
+ * CDIV is the smallest even divider that does not exceed the requested speed,
+ * the delays and timeout see i2c_clock_plan_div().
+ * returns 0 on success, 1 on invalid speed
+ */
+uint8_t i2c_clock_plan(uint32_t baud, i2c_clock_plan_t *plan)
+{
+	uint32_t core = get_core_clock_freq();
+	uint32_t cdiv = 0;
 
-  	// set a new msb and lsb values to data delay register
-	volatile uint32_t value = (volatile uint32_t)(msb << 16 | lsb);
+	memset(plan, 0, sizeof(i2c_clock_plan_t));
 
-	if((FEDL < (cdiv/2)) && (REDL < (cdiv/2))){
-		*I2C_DEL = value;
+	if(baud == 0 || baud > core/2){
+		printf("%s() error: ", __func__);
+		puts("invalid i2c bus speed");
+		return 1;
 	}
-	else{
-		puts("i2c_set_clock_freq() error: Clock delay is higher than cdiv/2.");
-		return 1; 	
+
+	cdiv = (core + baud - 1)/baud;
+	cdiv += cdiv & 1;
+	if(cdiv > 0xfffe){
+		cdiv = 0xfffe;
 	}
 
-	return *I2C_DEL;
+	plan->baud = baud;
+	i2c_clock_plan_div(core, cdiv, plan);
+
+	return 0;
 }
 
-/* Set clock frequency for data transfer using a divisor value */
-void i2c_set_clock_freq(uint16_t divider)
+/* Write a clock plan into the DIV, DEL and CLKT registers, skipped if it is already applied */
+void i2c_clock_apply(const i2c_clock_plan_t *plan)
 {
-	volatile uint32_t div_reg = *I2C_DIV;
-	volatile uint32_t msb = div_reg & 0xFFFF0000;
-	volatile uint32_t lsb = div_reg & 0x0000FFFF;
-
 	volatile uint32_t *div = I2C_DIV;
+	volatile uint32_t *del = I2C_DEL;
+	volatile uint32_t *clkt = I2C_CLKT;
+
+	if(plan->cdiv == 0 || plan->cdiv == i2c_ctx->plan_cur){
+		return;
+	}
 
-  	lsb = 0x05DC;
+	TRACE_REG(div, plan->cdiv);
+	*div = plan->cdiv;
+	TRACE_REG(del, (plan->fedl << 16) | plan->redl);
+	*del = (plan->fedl << 16) | plan->redl;
+	TRACE_REG(clkt, plan->clkt);
+	*clkt = plan->clkt;
+	STAT_ADD(STAT_I2C, STAT_REG_WRITES, 3);
 
-	*div = (volatile uint32_t)(msb << 16 | lsb);
+	i2c_ctx->plan_cur = plan->cdiv;
+}
+
+/* Set data transfer speed from a baud rate(bits per second) value, returns the achieved rate */
+uint32_t i2c_data_transfer_speed(uint32_t baud)
+{
+	STAT_ENTER(STAT_I2C);
 
-	*div = divider;
+	if(i2c_clock_plan(baud, &i2c_ctx->plan_bus)){
+		return 0;
+	}
+	i2c_clock_apply(&i2c_ctx->plan_bus);
 
-	set_clock_delay(1, 1);
+	return i2c_ctx->plan_bus.actual;
 }
 
-/* Set data transfer speed from a baud rate(bits per second) value */
-void i2c_data_transfer_speed(uint32_t baud)
+/* Use a different bus speed each time a slave device is selected (baud = 0 uses the bus speed),
+ * returns the achieved rate
+ */
+uint32_t i2c_device_speed(uint8_t addr, uint32_t baud)
 {
-	/* get the divisor value from the 250 MHz system clock source */
-	//uint32_t divider = (CORE_CLK_FREQ/baud); 
-	uint32_t divider = (core_clock_freq/baud); 		
+	STAT_ENTER(STAT_I2C);
+
+	if(baud == 0){
+		memset(&i2c_ctx->plan_dev[addr & 0x7f], 0, sizeof(i2c_clock_plan_t));
+		return i2c_ctx->plan_bus.actual;
+	}
+	if(i2c_clock_plan(baud, &i2c_ctx->plan_dev[addr & 0x7f])){
+		return 0;
+	}
 
+	return i2c_ctx->plan_dev[addr & 0x7f].actual;
+}
 
-	i2c_set_clock_freq((uint16_t)divider);
+/* Apply the clock plan of a slave device, or the bus plan if the device has none */
+static void i2c_clock_select(uint8_t addr)
+{
+	if(i2c_ctx->plan_dev[addr & 0x7f].cdiv){
+		i2c_clock_apply(&i2c_ctx->plan_dev[addr & 0x7f]);
+	}
+	else if(i2c_ctx->plan_bus.cdiv){
+		i2c_clock_apply(&i2c_ctx->plan_bus);
+	}
 }
 
-uint8_t i2c_rw_error(uint8_t i, uint8_t buf_len){
+uint8_t i2c_rw_error(uint16_t i, uint16_t buf_len){
 
 	uint8_t result = 0;
 
 	if(i < buf_len)
 	{
 		result = 4;
-		printf("%s(): ", __func__);
+		if(!i2c_quiet) printf("%s(): ", __func__);
     		if(debug) puts("Data tansfer is incomplete.");
 	}
 	else if(i > buf_len)
 	{
 		result = 4;
-		printf("%s(): ", __func__);
+		if(!i2c_quiet) printf("%s(): ", __func__);
     		if(debug) puts("Data tansfer error.");
 	}
 
@@ -1391,7 +1828,7 @@ uint8_t i2c_rw_error(uint8_t i, uint8_t buf_len){
 	if(isBitSet(I2C_S, 8))
 	{
 		result = 1;
-		printf("%s(): ", __func__);
+		if(!i2c_quiet) printf("%s(): ", __func__);
     		if(debug) puts("Slave address is not acknowledged.");
 	}
 
@@ -1399,8 +1836,8 @@ uint8_t i2c_rw_error(uint8_t i, uint8_t buf_len){
 	else if(isBitSet(I2C_S, 9))
 	{
 		result = 2;
-		printf("%s(): ", __func__); 
-    		puts("Clock stretch timeout.");
+		if(!i2c_quiet) printf("%s(): ", __func__);
+    		if(!i2c_quiet) puts("Clock stretch timeout.");
 	}
 	/* write error
 	 * Check if FIFO is empty and all data is sent to FIFO
@@ -1410,7 +1847,7 @@ uint8_t i2c_rw_error(uint8_t i, uint8_t buf_len){
 	{
 		if(debug) puts("The i2c controller did not send all the data to slave device.");
 		result = 4;
-		printf("%s(): ", __func__);
+		if(!i2c_quiet) printf("%s(): ", __func__);
 		if(debug) puts("Not all data were sent to the slave device.");
 	}
 	/* read error
@@ -1421,7 +1858,7 @@ uint8_t i2c_rw_error(uint8_t i, uint8_t buf_len){
 	{
 		if(debug) puts("The i2c controller did not receive all the data from slave device.");
 		result = 4;
-		printf("%s(): ", __func__); 
+		if(!i2c_quiet) printf("%s(): ", __func__);
  		if(debug) puts("Not all data were received from the slave device.");
 	}
 
@@ -1436,66 +1873,245 @@ uint8_t i2c_rw_error(uint8_t i, uint8_t buf_len){
 	else
 	{
 		result = 4;
-    		printf("%s(): ", __func__);
+    		if(!i2c_quiet) printf("%s(): ", __func__);
 		if(debug) puts("Data transfer is incomplete.");
 	}
 
+	if(result){
+		STAT_INC(STAT_I2C, STAT_ERRORS);
+	}
+
 	return result;
 }
 
-/* Slave device address write test, internal use only */
-uint8_t i2c_slave_write_test(const char* wbuf, uint8_t wbuf_len)
+/* Select a slave device, I2C_A is only written when the device changes
+ * (use i2c_probe() to check if the device is present)
+ */
+void i2c_select_slave(uint8_t addr)
+{
+	STAT_ENTER(STAT_I2C);
+	TRACE_BEGIN(TRACE_I2C, __func__);
+	i2c_set_address(addr);
+	TRACE_END(TRACE_I2C, __func__);
+}
+
+/* Write the slave address into I2C_A w/o applying the clock plan of the device */
+static void i2c_write_address(uint8_t addr)
 {
-	volatile uint32_t *dlen  = I2C_DLEN;
-	volatile uint32_t *fifo  = I2C_FIFO;
+	volatile uint32_t *a = I2C_A;
 
-	uint8_t i = 0;
+	if(addr == i2c_ctx->addr_cur){
+		return;
+	}
 
-	/* Empty fifo buffer from previous write cycle transaction */ 
+	TRACE_REG(a, addr);
+	*a = addr;
+	i2c_ctx->addr_cur = addr;
+	STAT_INC(STAT_I2C, STAT_REG_WRITES);
+}
+
+/* Set the slave device address and apply its clock plan */
+void i2c_set_address(uint8_t addr)
+{
+	i2c_clock_select(addr);
+	i2c_write_address(addr);
+}
+
+/* Get the slave device address currently in I2C_A, background jobs restore it after their transfers */
+uint8_t i2c_get_address()
+{
+	STAT_INC(STAT_I2C, STAT_REG_READS);
+	return *I2C_A & 0x7f;
+}
+
+/* Time an i2c transfer may take longer than expected (clock stretching), above the CLKT timeout */
+#define I2C_WAIT_TIMEOUT_NS	100000000ULL
+
+/* Start the wait of a transfer of len bytes plus the address byte at the current bus clock (9 SCL cycles per byte) */
+static void i2c_wait_begin(bus_wait_t *w, uint32_t len)
+{
+	uint32_t cdiv = *I2C_DIV & 0xfffe;
+	uint64_t byte_ns = 9ULL * (cdiv ? cdiv : 32768) * 1000000000ULL / core_clock_freq;
+
+	/* the loops service the 16-byte FIFO at ¼/¾ full, half of it leaves room for a late wake-up */
+	bus_wait_begin(w, (len + 1) * byte_ns, 8 * byte_ns, 4 * (len + 1) * byte_ns + I2C_WAIT_TIMEOUT_NS);
+}
+
+/* Abort a transfer that has not completed before the deadline, returns the status code */
+static uint8_t i2c_wait_timeout(const char *fn)
+{
+	clearBit(I2C_C, 15);	// disable the controller to abort the transfer
 	clear_fifo(I2C_C);
+	i2c_reset_error_status();
+	setBit(I2C_C, 15);
+	STAT_INC(STAT_I2C, STAT_ERRORS);
 
-	/* Clear all errors from previous transaction */
+	if(!i2c_quiet) printf("%s(): ", fn);
+	if(!i2c_quiet) puts("Transfer timeout.");
+
+	return 4;
+}
+
+/* Address-only probe cycle, a 1-byte read or a zero-length quick write, the caller applies the clock plan.
+ * returns 0 if the address is acknowledged, 1 on nack, 2 on clock stretch timeout
+ */
+static uint8_t i2c_probe_cycle(uint8_t addr, uint8_t read)
+{
+	volatile uint32_t *dlen = I2C_DLEN;
+	uint8_t result = 0;
+	uint32_t polls = 0;
+
+	i2c_write_address(addr);
+
+	clear_fifo(I2C_C);
 	i2c_reset_error_status();
 
-	*dlen = wbuf_len;	// sets the max. no of bytes for FIFO write cycle
+	TRACE_REG(dlen, read);
+	*dlen = read;
 
-	clearBit(I2C_C, 0); 	// clear READ field to initiate a write packet transfer
-	setBit(I2C_C, 7);   	// set ST field to start the data transfer
+	if(read){
+		setBit(I2C_C, 0);	// set READ field
+	}
+	else{
+		clearBit(I2C_C, 0);	// write w/o data, only the address is sent
+	}
+	setBit(I2C_C, 7);	// set ST field to start the data transfer
 
-	/* Check i2c status register during a write transfer */
-	while(!isBitSet(I2C_S, 1))  // if DONE field = 1, data transfer is complete
-	{
-		while(isBitSet(I2C_S, 2) && (i <= wbuf_len))
-		{
-			*fifo = wbuf[i];
-			i++;
+	bus_wait_t bw;
+	i2c_wait_begin(&bw, read);
+	TRACE_SPAN(t1);
+
+	while(!isBitSet(I2C_S, 1)){	// wait for DONE, also set after an error
+		polls++;
+		if(bus_wait_poll(&bw)){
+			bus_wait_end(&bw, STAT_I2C);
+			return i2c_wait_timeout(__func__);
 		}
 	}
 
-	return i2c_rw_error(i, wbuf_len);
+	bus_wait_end(&bw, STAT_I2C);
+	STAT_ADD(STAT_I2C, STAT_POLLS, polls);
+	TRACE_POLL(TRACE_I2C, __func__, I2C_S, t1, polls);
+
+	if(isBitSet(I2C_S, 8)){
+		result = 1;
+	}
+	else if(isBitSet(I2C_S, 9)){
+		result = 2;
+	}
+
+	/* discard the byte read and clear DONE/ERR/CLKT */
+	clear_fifo(I2C_C);
+	i2c_reset_error_status();
+
+	return result;
 }
 
-/* Get slave device address */
-void i2c_select_slave(uint8_t addr)
+/* Check if a slave device acknowledges its address using a 1-byte read (nothing is written to the device),
+ * returns 0 if the device is present, 1 on nack, 2 on clock stretch timeout
+ */
+uint8_t i2c_probe(uint8_t addr)
 {
-	volatile uint32_t *a = I2C_A; 
-	*a = addr;
+	uint8_t result;
+
+	STAT_ENTER(STAT_I2C);
+	TRACE_BEGIN(TRACE_I2C, __func__);
+
+	i2c_clock_select(addr);
+	result = i2c_probe_cycle(addr, 1);
+
+	TRACE_END(TRACE_I2C, __func__);
+
+	return result;
+}
+
+/* Scan the addresses first - last, the address of each device found is set in the 128-bit map.
+ *
+ * I2C_SCAN_AUTO uses quick writes except for 0x30-0x37 and 0x50-0x5f (1-byte reads, same as i2cdetect),
+ * I2C_SCAN_QUICK and I2C_SCAN_READ use one probe type for all addresses. With I2C_SCAN_CACHED the addresses
+ * already scanned on this controller are taken from the previous results.
+ * All addresses are probed at the bus speed (the device speeds are not applied) and
+ * the clock stretch timeout is shortened during the scan.
+ *
+ * returns the no. of devices found
+ */
+uint8_t i2c_scan(uint8_t first, uint8_t last, uint8_t mode, uint32_t map[4])
+{
+	volatile uint32_t *clkt = I2C_CLKT;
+	uint32_t clkt_save;
+	uint16_t addr;
+	uint8_t read, found = 0;
+
+	STAT_ENTER(STAT_I2C);
+	TRACE_BEGIN(TRACE_I2C, __func__);
+
+	memset(map, 0, 4 * sizeof(uint32_t));
+
+	/* the CLKT restored after the scan is the one of the applied plan */
+	if(i2c_ctx->plan_bus.cdiv){
+		i2c_clock_apply(&i2c_ctx->plan_bus);
+	}
+	clkt_save = *clkt;
+
+	TRACE_REG(clkt, I2C_SCAN_CLKT);
+	*clkt = I2C_SCAN_CLKT;
+
+	for(addr = first; addr <= last && addr < 0x80; addr++){
+		uint32_t bit = 1U << (addr & 31);
 
-	char buf[2] = { 0x01 };
+		if(!(mode & I2C_SCAN_CACHED) || !(i2c_ctx->scan_done[addr >> 5] & bit)){
+			if((mode & 0x0f) == I2C_SCAN_AUTO){
+				read = (addr >= 0x30 && addr <= 0x37) || (addr >= 0x50 && addr <= 0x5f);
+			}
+			else{
+				read = (mode & 0x0f) == I2C_SCAN_READ;
+			}
+
+			if(i2c_probe_cycle(addr, read) == 0){
+				i2c_ctx->scan_map[addr >> 5] |= bit;
+			}
+			else{
+				i2c_ctx->scan_map[addr >> 5] &= ~bit;
+			}
+			i2c_ctx->scan_done[addr >> 5] |= bit;
+		}
 
-	/* check slave address write error */
-	if(i2c_slave_write_test(buf, 1) > 0){
-		puts("Please check slave device address or slave pin connection.");
+		if(i2c_ctx->scan_map[addr >> 5] & bit){
+			map[addr >> 5] |= bit;
+			found++;
+		}
 	}
+
+	TRACE_REG(clkt, clkt_save);
+	*clkt = clkt_save;
+
+	TRACE_END(TRACE_I2C, __func__);
+
+	return found;
+}
+
+/* Forget the scan results of the controller */
+void i2c_scan_clear()
+{
+	memset(i2c_ctx->scan_map, 0, sizeof(i2c_ctx->scan_map));
+	memset(i2c_ctx->scan_done, 0, sizeof(i2c_ctx->scan_done));
 }
 
-/* Write a number of bytes into a slave device */
-uint8_t i2c_write(const char* wbuf, uint8_t wbuf_len)
+/* Write a number of bytes into a slave device
+ *
+ * Transfers longer than the 16-byte FIFO are streamed in a single transaction (up to 65535 bytes),
+ * the FIFO is pre-filled before the start and refilled each time TXW reports it is less than ¼ full.
+ */
+uint8_t i2c_write(const char* wbuf, uint16_t wbuf_len)
 {
 	volatile uint32_t *dlen	= I2C_DLEN;
 	volatile uint32_t *fifo	= I2C_FIFO;
 
-	uint8_t i = 0;
+	uint16_t i = 0;
+	uint8_t rval = 0;
+
+	STAT_ENTER(STAT_I2C);
+	TRACE_BEGIN(TRACE_I2C, __func__);
 
 	/* Empty fifo buffer from previous write cycle transaction */ 
 	clear_fifo(I2C_C);
@@ -1503,43 +2119,81 @@ uint8_t i2c_write(const char* wbuf, uint8_t wbuf_len)
 	/* Clear all errors from previous transaction */
 	i2c_reset_error_status();
 
-	*dlen = wbuf_len; // sets the max. no of bytes for FIFO write cycle
+	TRACE_REG(dlen, wbuf_len);
+	*dlen = wbuf_len; // sets the no. of bytes of the whole transfer (16-bit DLEN)
 
-	if( wbuf_len > 16){
-		printf("%s() warning: ", __func__); 
-		puts("Maximum number of bytes per one write cycle is 16 bytes, beyond this data will be ignored.");
-		wbuf_len = 16;
+	/* Pre-fill the FIFO, TXD = 1 FIFO can accept data */
+	while((i < wbuf_len) && isBitSet(I2C_S, 4))
+	{
+		TRACE_REG(fifo, wbuf[i]);
+		*fifo = wbuf[i];
+		i++;
 	}
 
 	/* Start a write transfer */
 	clearBit(I2C_C, 0); // clear READ field to initiate a write packet transfer
 	setBit(I2C_C, 7);   // set ST field to start the write transfer
 
+	uint32_t polls = 0;
+	uint8_t timeout = 0;
+
+	bus_wait_t bw;
+	i2c_wait_begin(&bw, wbuf_len);
+	TRACE_SPAN(t1);
+
 	while(!isBitSet(I2C_S, 1)) // if DONE field = 1, data transfer is complete
 	{
+		polls++;
+		if(bus_wait_poll(&bw)){
+			timeout = 1;
+			break;
+		}
 		// TXW = 0 FIFO is at least ¼ full and a write is underway
-		// TXW = 1 FIFO is less than ¼ full and a write is underway
-		while(isBitSet(I2C_S, 2) && (i <= wbuf_len))
+		// TXW = 1 FIFO is less than ¼ full and a write is underway, refill it while TXD = 1
+		if((i < wbuf_len) && isBitSet(I2C_S, 2))
 		{
-			*fifo = wbuf[i];
-			i++;
+			while((i < wbuf_len) && isBitSet(I2C_S, 4))
+			{
+				TRACE_REG(fifo, wbuf[i]);
+				*fifo = wbuf[i];
+				i++;
+			}
 		}
 	}
 
-	return i2c_rw_error(i, wbuf_len);
+	bus_wait_end(&bw, STAT_I2C);
+	STAT_ADD(STAT_I2C, STAT_POLLS, polls);
+	TRACE_POLL(TRACE_I2C, __func__, I2C_S, t1, polls);
+	STAT_ADD(STAT_I2C, STAT_BYTES, i);
+	STAT_ADD(STAT_I2C, STAT_REG_WRITES, i);
+
+	rval = timeout ? i2c_wait_timeout(__func__) : i2c_rw_error(i, wbuf_len);
+
+	TRACE_END(TRACE_I2C, __func__);
+
+	return rval;
 }
 
-/* Read a number of bytes from a slave device */
-uint8_t i2c_read(char* rbuf, uint8_t rbuf_len)
+/* Read a number of bytes from a slave device
+ *
+ * Transfers longer than the 16-byte FIFO are streamed in a single transaction (up to 65535 bytes),
+ * the FIFO is drained each time RXR reports it is ¾ full and once more after DONE.
+ */
+uint8_t i2c_read(char* rbuf, uint16_t rbuf_len)
 {
 	volatile uint32_t *dlen = I2C_DLEN; 
 	volatile uint32_t *fifo = I2C_FIFO;
 
-	uint8_t i = 0;
+	uint16_t i = 0;
+	uint8_t rval = 0;
+
+	STAT_ENTER(STAT_I2C);
+	TRACE_BEGIN(TRACE_I2C, __func__);
 
 	clear_fifo(I2C_C);
 	i2c_reset_error_status();
 
+	TRACE_REG(dlen, rbuf_len);
 	*dlen = rbuf_len;  
 
 	/* Start a read transfer */
@@ -1549,16 +2203,234 @@ uint8_t i2c_read(char* rbuf, uint8_t rbuf_len)
 	//equivalent operation
 	//*I2C_C |= 0x00000081;
 
+	uint32_t polls = 0;
+	uint8_t timeout = 0;
+
+	bus_wait_t bw;
+	i2c_wait_begin(&bw, rbuf_len);
+	TRACE_SPAN(t1);
+
 	while(!isBitSet(I2C_S, 1))  // if DONE field = 1, data transfer is complete
 	{
-    	while(isBitSet(I2C_S, 5) && (rbuf_len >= i )) // check RXD field (RXD = 0 FIFO is empty, RXD = 1 FIFO contains at least 1 byte of data)
+		polls++;
+		if(bus_wait_poll(&bw)){
+			timeout = 1;
+			break;
+		}
+		// RXR = 1 FIFO is ¾ or more full and a read is underway, drain it while RXD = 1 (FIFO contains data)
+		if(isBitSet(I2C_S, 3))
+		{
+			while((i < rbuf_len) && isBitSet(I2C_S, 5))
+			{
+				rbuf[i] = *fifo;
+				i++;
+			}
+		}
+	}
+
+	/* Read the bytes left in the FIFO after the transfer is done */
+	while((i < rbuf_len) && isBitSet(I2C_S, 5))
+	{
+		rbuf[i] = *fifo;
+		i++;
+	}
+
+	bus_wait_end(&bw, STAT_I2C);
+	STAT_ADD(STAT_I2C, STAT_POLLS, polls);
+	TRACE_POLL(TRACE_I2C, __func__, I2C_S, t1, polls);
+	STAT_ADD(STAT_I2C, STAT_BYTES, i);
+	STAT_ADD(STAT_I2C, STAT_REG_READS, i);
+
+	rval = timeout ? i2c_wait_timeout(__func__) : i2c_rw_error(i, rbuf_len);
+
+	TRACE_END(TRACE_I2C, __func__);
+
+	return rval;
+}
+
+/* Write a number of bytes (e.g. a register pointer) then read a number of bytes using a repeated start
+ *
+ * The read transfer is started as soon as the controller reports the write transfer as active (TA),
+ * after all write bytes are in the FIFO, so the controller issues a repeated start instead of a stop.
+ * If the write transfer is already done at that point, the read runs as a separate transfer.
+ */
+uint8_t i2c_write_read(const char* wbuf, uint16_t wbuf_len, char* rbuf, uint16_t rbuf_len)
+{
+	volatile uint32_t *dlen = I2C_DLEN;
+	volatile uint32_t *fifo = I2C_FIFO;
+	volatile uint32_t *c = I2C_C;
+
+	uint16_t i = 0, j = 0;
+	uint8_t rval = 0;
+
+	STAT_ENTER(STAT_I2C);
+	TRACE_BEGIN(TRACE_I2C, __func__);
+
+	clear_fifo(I2C_C);
+	i2c_reset_error_status();
+
+	TRACE_REG(dlen, wbuf_len);
+	*dlen = wbuf_len;
+
+	/* Pre-fill the FIFO, TXD = 1 FIFO can accept data */
+	while((i < wbuf_len) && isBitSet(I2C_S, 4))
+	{
+		TRACE_REG(fifo, wbuf[i]);
+		*fifo = wbuf[i];
+		i++;
+	}
+
+	/* Start the write transfer */
+	clearBit(I2C_C, 0);
+	setBit(I2C_C, 7);
+
+	uint32_t polls = 0;
+
+	/* one wait for both phases, the read phase has its own address byte */
+	bus_wait_t bw;
+	i2c_wait_begin(&bw, wbuf_len + rbuf_len + 1);
+	TRACE_SPAN(t1);
+
+	/* Refill the FIFO until all write bytes are queued, then wait for TA */
+	while(!isBitSet(I2C_S, 1))
+	{
+		polls++;
+		if(bus_wait_poll(&bw)){
+			bus_wait_end(&bw, STAT_I2C);
+			STAT_ADD(STAT_I2C, STAT_POLLS, polls);
+			rval = i2c_wait_timeout(__func__);
+			TRACE_END(TRACE_I2C, __func__);
+			return rval;
+		}
+		if(i < wbuf_len)
+		{
+			while((i < wbuf_len) && isBitSet(I2C_S, 4))
+			{
+				TRACE_REG(fifo, wbuf[i]);
+				*fifo = wbuf[i];
+				i++;
+			}
+		}
+		else if(isBitSet(I2C_S, 0))
+		{
+			break;
+		}
+	}
+
+	STAT_ADD(STAT_I2C, STAT_BYTES, i);
+	STAT_ADD(STAT_I2C, STAT_REG_WRITES, i);
+
+	/* NACK of the slave address or data, no read phase */
+	if(isBitSet(I2C_S, 8) || isBitSet(I2C_S, 9))
+	{
+		bus_wait_end(&bw, STAT_I2C);
+		STAT_ADD(STAT_I2C, STAT_POLLS, polls);
+		TRACE_POLL(TRACE_I2C, __func__, I2C_S, t1, polls);
+		rval = i2c_rw_error(i, wbuf_len);
+		TRACE_END(TRACE_I2C, __func__);
+		return rval;
+	}
+
+	/* Write transfer already done (stop sent), reset DONE for a separate read transfer */
+	if(isBitSet(I2C_S, 1))
+	{
+		setBit(I2C_S, 1);
+	}
+
+	/* Start the read transfer, a repeated start if the write transfer is still active */
+	TRACE_REG(dlen, rbuf_len);
+	*dlen = rbuf_len;
+	TRACE_REG(c, 0x00008081);
+	*c = 0x00008081; // I2CEN | ST | READ
+	STAT_INC(STAT_I2C, STAT_REG_WRITES);
+
+	uint8_t timeout = 0;
+
+	while(!isBitSet(I2C_S, 1))
+	{
+		polls++;
+		if(bus_wait_poll(&bw)){
+			timeout = 1;
+			break;
+		}
+		// RXR = 1 FIFO is ¾ or more full, drain it while RXD = 1
+		if(isBitSet(I2C_S, 3))
 		{
-    		rbuf[i] = *fifo;
-    		i++;
+			while((j < rbuf_len) && isBitSet(I2C_S, 5))
+			{
+				rbuf[j] = *fifo;
+				j++;
+			}
+		}
+	}
+
+	while((j < rbuf_len) && isBitSet(I2C_S, 5))
+	{
+		rbuf[j] = *fifo;
+		j++;
+	}
+
+	bus_wait_end(&bw, STAT_I2C);
+	STAT_ADD(STAT_I2C, STAT_POLLS, polls);
+	TRACE_POLL(TRACE_I2C, __func__, I2C_S, t1, polls);
+	STAT_ADD(STAT_I2C, STAT_BYTES, j);
+	STAT_ADD(STAT_I2C, STAT_REG_READS, j);
+
+	rval = timeout ? i2c_wait_timeout(__func__) : i2c_rw_error(j, rbuf_len);
+
+	TRACE_END(TRACE_I2C, __func__);
+
+	return rval;
+}
+
+/* Execute an array of messages back-to-back (like the Linux I2C_RDWR ioctl)
+ *
+ * A write w/ I2C_MSG_NOSTOP followed by a read of the same address is executed with a repeated start,
+ * otherwise I2C_MSG_NOSTOP is ignored. Each message is executed even if a previous one failed,
+ * the status of each message (0 ok, 1 nack, 2 clock stretch timeout, 4 incomplete) is stored in msgs[i].status
+ * instead of the console error messages.
+ *
+ * returns the no. of failed messages
+ */
+uint32_t i2c_transfer(i2c_msg_t *msgs, uint32_t n)
+{
+	uint32_t i, failed = 0;
+
+	STAT_ENTER(STAT_I2C);
+	TRACE_BEGIN(TRACE_I2C, __func__);
+
+	i2c_quiet = 1;
+
+	for(i = 0; i < n; i++){
+		i2c_msg_t *m = &msgs[i];
+
+		i2c_set_address(m->addr);
+
+		if(!(m->flags & I2C_MSG_RD) && (m->flags & I2C_MSG_NOSTOP) && i + 1 < n &&
+			(msgs[i + 1].flags & I2C_MSG_RD) && msgs[i + 1].addr == m->addr){
+			m->status = i2c_write_read(m->buf, m->len, msgs[i + 1].buf, msgs[i + 1].len);
+			msgs[i + 1].status = m->status;
+			i++;
+		}
+		else if(m->flags & I2C_MSG_RD){
+			m->status = i2c_read(m->buf, m->len);
+		}
+		else{
+			m->status = i2c_write(m->buf, m->len);
+		}
+	}
+
+	i2c_quiet = 0;
+
+	for(i = 0; i < n; i++){
+		if(msgs[i].status){
+			failed++;
 		}
 	}
 
-	return i2c_rw_error(i, rbuf_len);
+	TRACE_END(TRACE_I2C, __func__);
+
+	return failed;
 }
 
 /* Read one byte of data from a slave device */
@@ -1569,6 +2441,9 @@ uint8_t i2c_byte_read(void){
 
 	uint8_t i = 0;
 
+	STAT_ENTER(STAT_I2C);
+	TRACE_BEGIN(TRACE_I2C, __func__);
+
 	/* Empty fifo buffer from previous write cycle transactions */ 
 	clear_fifo(I2C_C);
 
@@ -1580,21 +2455,46 @@ uint8_t i2c_byte_read(void){
 	setBit(I2C_C, 7); // set ST field, start the data transfer
 
 	/* Set Data Length */
+	TRACE_REG(dlen, 1);
 	*dlen = 1; // one byte only   
 
 	uint8_t data = 0;
 
+	uint32_t polls = 0;
+	uint8_t timeout = 0;
+
+	bus_wait_t bw;
+	i2c_wait_begin(&bw, 1);
+	TRACE_SPAN(t1);
+
 	/* keep reading data from fifo until Status Register field DONE bit = 1 */
 	while(!isBitSet(I2C_S, 1))  // 0 = Transfer not completed. 1 = Transfer completed. Cleared by writing 1 to the field 
 	{
+		polls++;
+		if(bus_wait_poll(&bw)){
+			timeout = 1;
+			break;
+		}
 		/* keep reading data from FIFO register */
 		while(isBitSet(I2C_S, 5)) // Status Register RXD bit, 0 = fifo is empty, 1 = still has data
 		{
 			data = *fifo;
+			STAT_INC(STAT_I2C, STAT_BYTES);
 		}
 	}
 
-	i2c_rw_error(i, 1);
+	bus_wait_end(&bw, STAT_I2C);
+	STAT_ADD(STAT_I2C, STAT_POLLS, polls);
+	TRACE_POLL(TRACE_I2C, __func__, I2C_S, t1, polls);
+
+	if(timeout){
+		i2c_wait_timeout(__func__);
+	}
+	else{
+		i2c_rw_error(i, 1);
+	}
+
+	TRACE_END(TRACE_I2C, __func__);
 
 	return data;
 }
@@ -1602,13 +2502,18 @@ uint8_t i2c_byte_read(void){
 /* Stop I2C operation, reset pin as input */
 void i2c_stop() {
 
+	STAT_ENTER(STAT_I2C);
+
 	clear_fifo(I2C_C);
 
 	i2c_reset_error_status();
 
 	clearBit(I2C_C, 15);
 
-	if(i2c_pin_set == 0){
+	i2c_ctx->addr_cur = I2C_ADDR_NONE;
+	i2c_scan_clear();
+
+	if(i2c_ctx == &i2c_bus[0]){
 		set_gpio(0, 0);	/* alt 00b, PHY 27, GPIO 00, alt 0 	SDA */
 		set_gpio(1, 0); /* alt 00b, PHY 28, GPIO 01, alt 0 	SCL */
 	}
@@ -1623,8 +2528,23 @@ void i2c_stop() {
 	SPI Functons
 
 *********************/
+/* Serializes the spi bus between the event loop and worker threads */
+static pthread_mutex_t spi_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* Last divider written to SPI_CLK (0 = unknown) */
+static uint32_t spi_clk_cur = 0;
+
+void spi_lock(){
+	pthread_mutex_lock(&spi_mutex);
+}
+
+void spi_unlock(){
+	pthread_mutex_unlock(&spi_mutex);
+}
+
 /* Start SPI operation */
 void spi_start() {
+	STAT_ENTER(STAT_SPI);
 	if(rpi_init_access == 0){
 		gpio_init();  // map gpio for alt pin sel
 		set_each_peri_mmap(2); // map spi peripheral register
@@ -1651,11 +2571,14 @@ void spi_start() {
 
 	clearBit(SPI_CS, 13); 	// set SPI to SPI Master (Standard SPI)
 	clear_fifo(SPI_CS); 	  // Clear SPI TX and RX FIFO 
+	spi_clk_cur = 0;
 }
 
 /* Stop SPI operation */
 void spi_stop() {
 
+	STAT_ENTER(STAT_SPI);
+
 	clear_fifo(SPI_CS);	  // Clear SPI TX and RX FIFO 
 
 	set_gpio(8,  0);  // PHY 24, GPIO 8,  using value 0 , set to input  CE0
@@ -1669,7 +2592,11 @@ void spi_stop() {
 void spi_set_clock_freq(uint16_t divider){
 
 	volatile uint32_t *div = SPI_CLK;
+	STAT_ENTER(STAT_SPI);
+	TRACE_REG(div, divider);
  	*div = divider;
+	spi_clk_cur = divider;
+	STAT_INC(STAT_SPI, STAT_REG_WRITES);
 }
 
 /* Set SPI data mode
@@ -1680,7 +2607,8 @@ void spi_set_clock_freq(uint16_t divider){
  * SPI Mode3 = 3,  CPOL = 1, CPHA = 1
  */
 void spi_set_data_mode(uint8_t mode){
-    
+	STAT_ENTER(STAT_SPI);
+
 	if(mode == 0){
 		clearBit(SPI_CS, 2); 		//CPHA 0
     	clearBit(SPI_CS, 3); 		//CPOL 0
@@ -1694,8 +2622,8 @@ void spi_set_data_mode(uint8_t mode){
 		setBit(SPI_CS, 3);		  	//CPOL 1
 	}
 	else if(mode == 3){
-		clearBit(SPI_CS, 2);		//CPHA 1
-		clearBit(SPI_CS, 3);		//CPOL 1
+		setBit(SPI_CS, 2);		//CPHA 1
+		setBit(SPI_CS, 3);		//CPOL 1
 	}
   	else{
 	    	printf("%s() error: ", __func__);
@@ -1723,15 +2651,88 @@ void spi_chip_select(uint8_t cs)
 {
 	volatile uint32_t *cs_addr = SPI_CS;
 
+	STAT_ENTER(STAT_SPI);
+	STAT_INC(STAT_SPI, STAT_REG_WRITES);
+
 	uint32_t mask = ~ (3 <<  0);	// clear bit 0 and 1 first
 	*cs_addr &= mask;	// set mask to value 0
 	mask = (cs <<  0);	// write cs value to set SPI data mode   
 	*cs_addr |= mask; 	// set cs value 
 }
 
+/* SPI device contexts
+ *
+ * The SPI_CS value (chip select, data mode, chip select polarity, TA = 0) and the SPI_CLK divider of
+ * each device are computed once, selecting a device is a store to SPI_CS and a store to SPI_CLK
+ * if its divider differs from the last one written.
+ */
+typedef struct {
+	uint8_t used;
+	uint32_t cs;
+	uint32_t clk;
+} spi_dev_t;
+
+static spi_dev_t spi_dev[SPI_DEV_MAX] = {};
+
+/* returns the device id or -1 if there is no free context */
+int32_t spi_dev_open(uint8_t cs, uint8_t mode, uint8_t cs_high, uint16_t div)
+{
+	int32_t i;
+
+	if(cs > 2 || mode > 3){
+		printf("%s() error: ", __func__);
+		puts("invalid chip select or mode");
+		return -1;
+	}
+
+	for(i = 0; i < SPI_DEV_MAX; i++){
+		if(!spi_dev[i].used){
+			spi_dev[i].cs = cs | (mode << 2) | (cs_high ? 1 << (21 + cs) : 0);
+			spi_dev[i].clk = div;
+			spi_dev[i].used = 1;
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+void spi_dev_close(int32_t id)
+{
+	if(id >= 0 && id < SPI_DEV_MAX){
+		spi_dev[id].used = 0;
+	}
+}
+
+/* returns 1 if the device id is invalid */
+uint8_t spi_dev_select(int32_t id)
+{
+	volatile uint32_t *cs = SPI_CS;
+	volatile uint32_t *clk = SPI_CLK;
+
+	if(id < 0 || id >= SPI_DEV_MAX || !spi_dev[id].used){
+		return 1;
+	}
+
+	TRACE_REG(cs, spi_dev[id].cs);
+	*cs = spi_dev[id].cs;
+	STAT_INC(STAT_SPI, STAT_REG_WRITES);
+
+	if(spi_dev[id].clk && spi_dev[id].clk != spi_clk_cur){
+		TRACE_REG(clk, spi_dev[id].clk);
+		*clk = spi_dev[id].clk;
+		spi_clk_cur = spi_dev[id].clk;
+		STAT_INC(STAT_SPI, STAT_REG_WRITES);
+	}
+
+	return 0;
+}
+
 /* Set chip select polarity */
 void spi_set_chip_select_polarity(uint8_t cs, uint8_t active)
 {
+	STAT_ENTER(STAT_SPI);
+
 	/* Mask the appropriate CSPOLn bit */
 	clearBit(SPI_CS, 21);
 	clearBit(SPI_CS, 22);
@@ -1757,56 +2758,330 @@ void spi_set_chip_select_polarity(uint8_t cs, uint8_t active)
 	}
 }
 
-/* Writes and reads a number of bytes to/from a slave device */
-void spi_data_transfer(char* wbuf, char* rbuf, uint8_t len)
+/* Max. no. of bytes in flight, the RX FIFO must be able to hold every byte clocked out */
+#define SPI_FIFO_DEPTH	64
+
+/* No. of bytes received by spi_write() and left in the RX FIFO for spi_read() */
+static uint32_t spi_rx_pending = 0;
+
+/* Time a spi transfer may take longer than expected, the slave can't stretch the clock */
+#define SPI_WAIT_TIMEOUT_NS	10000000ULL
+
+/* Start the wait of a transfer of len bytes at the current SPI_CLK divider,
+ * the pumps keep up to SPI_FIFO_DEPTH bytes in flight, a sleep covers half of them
+ */
+static void spi_wait_begin(bus_wait_t *w, uint32_t len)
+{
+	uint32_t div = spi_clk_cur ? spi_clk_cur : (*SPI_CLK & 0xffff);
+	uint64_t byte_ns = 8ULL * (div ? div : 65536) * 1000000000ULL / core_clock_freq;
+
+	bus_wait_begin(w, len * byte_ns, SPI_FIFO_DEPTH / 2 * byte_ns, 4 * len * byte_ns + SPI_WAIT_TIMEOUT_NS);
+}
+
+/* End a timed out transfer, clears TA, DMAEN and the FIFOs so the next transfer starts clean,
+ * returns 2 (timeout, same status code as the i2c clock stretch timeout)
+ */
+static uint8_t spi_wait_timeout(const char *fn)
+{
+	clearBit(SPI_CS, 7);
+	clearBit(SPI_CS, 8);
+	clear_fifo(SPI_CS);
+	spi_rx_pending = 0;
+
+	STAT_INC(STAT_SPI, STAT_ERRORS);
+	printf("%s() error: ", fn);
+	puts("transfer timeout");
+	return 2;
+}
+
+/* Interleaved TX/RX FIFO pump
+ *
+ * Sends wlen bytes from wbuf (zeros if wbuf is NULL) while receiving rlen bytes into rbuf (discarded if rbuf is NULL).
+ * inflight is the no. of bytes already clocked out and not read yet. The TX FIFO is kept topped up, but never
+ * more bytes are in flight than the RX FIFO can hold, so the transfer does not stall on a full RX FIFO.
+ * Returns 2 on a timeout (the transfer is ended), else 0.
+ */
+static uint8_t spi_pump(const char* wbuf, uint32_t wlen, char* rbuf, uint32_t rlen, uint32_t inflight)
 {
 	volatile uint32_t *fifo = SPI_FIFO;
 
-	uint32_t w = 0; // write count index 
+	uint32_t w = 0; // write count index
 	uint32_t r = 0; // read count index
+	uint32_t polls = 0;
+	uint8_t timeout = 0;
+	char b;
+
+	bus_wait_t bw;
+	spi_wait_begin(&bw, wlen > rlen ? wlen : rlen);
+	TRACE_SPAN(t1);
+
+	while (w < wlen || r < rlen)
+	{
+		polls++;
+		if(bus_wait_poll(&bw)){
+			timeout = spi_wait_timeout(__func__);
+			break;
+		}
+		// TX fifo is not full, add/write more bytes
+		while((w < wlen) && (inflight + w - r < SPI_FIFO_DEPTH) && isBitSet(SPI_CS, 18))
+		{
+			b = wbuf ? wbuf[w] : 0;
+			TRACE_REG(fifo, b);
+			*fifo = b;
+			w++;
+		}
+		// RX fifo is not empty, read more received bytes
+		while((r < rlen) && isBitSet(SPI_CS, 17))
+		{
+			b = *fifo;
+			if(rbuf){
+				rbuf[r] = b;
+			}
+			r++;
+		}
+	}
+
+	bus_wait_end(&bw, STAT_SPI);
+	STAT_ADD(STAT_SPI, STAT_POLLS, polls);
+	TRACE_POLL(TRACE_SPI, __func__, SPI_CS, t1, polls);
+	STAT_ADD(STAT_SPI, STAT_BYTES, w);
+	STAT_ADD(STAT_SPI, STAT_REG_WRITES, w);
+	STAT_ADD(STAT_SPI, STAT_REG_READS, r);
+	return timeout;
+}
+
+/* Min. transfer length of the 32-bit word FIFO path of spi_transfer() (0 = disabled) */
+static uint32_t spi_bulk_min = 16;
+
+/* Max. no. of bytes of one DLEN run of the word FIFO path, a multiple of 4 so the words stay aligned */
+#define SPI_BULK_CHUNK	0xfffc
+
+void spi_set_bulk_threshold(uint32_t len){
+	spi_bulk_min = len;
+}
+
+/* 32-bit word FIFO pump (DMAEN mode w/o DMA)
+ *
+ * With DMAEN set each FIFO access carries four bytes (LSB first) and the controller clocks DLEN bytes,
+ * the unused bytes of the last word are ignored. No more words are in flight than the RX FIFO can hold,
+ * so the TX FIFO always has room and is written w/o status checks. The RX FIFO is read in blocks of
+ * 12 words w/o status checks while RXR reports it is ¾ full. Returns 2 on a timeout, else 0.
+ */
+static uint8_t spi_pump_words(const char* wbuf, char* rbuf, uint32_t len)
+{
+	volatile uint32_t *fifo = SPI_FIFO;
+	volatile uint32_t *dlen = SPI_DLEN;
+	volatile uint32_t *cs = SPI_CS;
+
+	uint32_t words = (len + 3) / 4;
+	uint32_t w = 0; // words written
+	uint32_t r = 0; // words read
+	uint32_t polls = 0, reg_reads = 0;
+	uint32_t run, k, v, n;
+	uint8_t timeout = 0;
+
+	bus_wait_t bw;
+	spi_wait_begin(&bw, len);
+	TRACE_SPAN(t1);
+
+	for(run = 0; run < len && !timeout; run += SPI_BULK_CHUNK){
+		n = len - run < SPI_BULK_CHUNK ? len - run : SPI_BULK_CHUNK;
+		TRACE_REG(dlen, n);
+		*dlen = n;
+
+		uint32_t wend = (run + n + 3) / 4;
+
+		while(r < wend)
+		{
+			polls++;
+			if(bus_wait_poll(&bw)){
+				timeout = spi_wait_timeout(__func__);
+				break;
+			}
+			// TX, the in-flight limit keeps the FIFO from overflowing
+			while((w < wend) && (w - r < SPI_FIFO_DEPTH / 4))
+			{
+				v = 0;
+				if(wbuf){
+					k = len - w*4 < 4 ? len - w*4 : 4;
+					memcpy(&v, wbuf + w*4, k);
+				}
+				TRACE_REG(fifo, v);
+				*fifo = v;
+				w++;
+			}
+
+			// RX, RXR = 1 FIFO is ¾ or more full (12 words), else read while RXD = 1
+			uint32_t s = *cs;
+			reg_reads++;
+			if((s & (1 << 19)) && wend - r >= 12)
+			{
+				for(k = 0; k < 12; k++, r++)
+				{
+					v = *fifo;
+					if(rbuf){
+						memcpy(rbuf + r*4, &v, len - r*4 < 4 ? len - r*4 : 4);
+					}
+				}
+				reg_reads += 12;
+			}
+			else if(s & (1 << 17))
+			{
+				v = *fifo;
+				if(rbuf){
+					memcpy(rbuf + r*4, &v, len - r*4 < 4 ? len - r*4 : 4);
+				}
+				r++;
+				reg_reads++;
+			}
+		}
+	}
+
+	bus_wait_end(&bw, STAT_SPI);
+	STAT_ADD(STAT_SPI, STAT_POLLS, polls);
+	TRACE_POLL(TRACE_SPI, __func__, SPI_CS, t1, polls);
+	STAT_ADD(STAT_SPI, STAT_BYTES, len);
+	STAT_ADD(STAT_SPI, STAT_REG_WRITES, words);
+	STAT_ADD(STAT_SPI, STAT_REG_READS, reg_reads);
+	return timeout;
+}
+
+/* Transfer w/o clearing TA when hold is set, so the chip select stays asserted for the next transfer */
+static uint8_t spi_run(const char* wbuf, char* rbuf, uint32_t len, uint8_t hold)
+{
+	uint8_t result;
 
 	/* Clear TX and RX fifo's */
 	clear_fifo(SPI_CS);
+	spi_rx_pending = 0;
 
-	/* Set TA = 1 to start data transfer */
-	setBit(SPI_CS, 7);   // done = 1
+	if(spi_bulk_min && len >= spi_bulk_min){
+		/* Set DMAEN and TA = 1 to start data transfer */
+		setBit(SPI_CS, 8);
+		setBit(SPI_CS, 7);
 
-	/* Write data to FIFO */
-	while (w < len) 
-	{
-	    	// TX fifo is not full, add/write more bytes
-    		while(isBitSet(SPI_CS, 18) && (w < len))
-    		{
-    			*fifo = wbuf[w];
-    			w++;
-    		}
+		result = spi_pump_words(wbuf, rbuf, len);
+
+		if(!hold){
+			clearBit(SPI_CS, 7);
+		}
+		clearBit(SPI_CS, 8);
 	}
+	else{
+		/* Set TA = 1 to start data transfer */
+		setBit(SPI_CS, 7);
+
+		result = spi_pump(wbuf, len, rbuf, len, 0);
 
-	/* read data from FIFO */
-	while (r < len)
-	{ 
-    	// RX fifo is not empty, read more received bytes 
-		while(isBitSet(SPI_CS, 17) && (r < len ))
-    		{
-    			rbuf[r] = *fifo;
-    			r++;
-    		}
+		/* Set TA = 0, all bytes are received so the transfer is done */
+		if(!hold){
+			clearBit(SPI_CS, 7);
+		}
 	}
+	return result;
+}
 
-	/* Set TA = 0, transfer is done */
-	clearBit(SPI_CS, 7);  // Done = 0
+/* Full-duplex transfer of len bytes (up to 4 GB) in one chip select cycle,
+ * wbuf = NULL sends zeros (read-only), rbuf = NULL discards the received bytes (write-only).
+ * Transfers of at least spi_bulk_min bytes use the 32-bit word FIFO path. Returns 2 on a timeout, else 0.
+ */
+uint8_t spi_transfer(const char* wbuf, char* rbuf, uint32_t len)
+{
+	uint8_t result;
+
+	STAT_ENTER(STAT_SPI);
+	TRACE_BEGIN(TRACE_SPI, __func__);
+
+	result = spi_run(wbuf, rbuf, len, 0);
+
+	TRACE_END(TRACE_SPI, __func__);
+	return result;
+}
+
+/* Execute a list of transfers back-to-back
+ *
+ * The chip select and data mode bits of SPI_CS and the SPI_CLK divider are only written when they change,
+ * SPI_XFER_KEEP keeps the current chip select or mode and a divider of 0 keeps the current clock.
+ * With SPI_XFER_CS_HOLD the chip select stays asserted into the next transfer if it uses the same chip select and mode.
+ * A timeout ends the list, the remaining transfers are skipped. Returns 2 on a timeout, else 0.
+ */
+uint8_t spi_transfer_list(const spi_xfer_t *x, uint32_t n)
+{
+	volatile uint32_t *cs_reg = SPI_CS;
+	volatile uint32_t *clk = SPI_CLK;
+
+	uint32_t i, want, cur = *cs_reg & 0x0f;	// CS (bit 0-1), CPHA (bit 2), CPOL (bit 3)
+	uint8_t held = 0, hold, result = 0;
+
+	STAT_ENTER(STAT_SPI);
+	TRACE_BEGIN(TRACE_SPI, __func__);
+	STAT_INC(STAT_SPI, STAT_REG_READS);
+
+	for(i = 0; i < n; i++){
+		want = cur;
+		if(x[i].cs != SPI_XFER_KEEP){
+			want = (want & ~0x03) | (x[i].cs & 0x03);
+		}
+		if(x[i].mode != SPI_XFER_KEEP){
+			want = (want & ~0x0c) | ((x[i].mode & 0x03) << 2);
+		}
+
+		if(want != cur){
+			/* end a held transfer before the chip select or mode changes */
+			uint32_t v = (*cs_reg & ~(0x0f | (1 << 7))) | want;
+			TRACE_REG(cs_reg, v);
+			*cs_reg = v;
+			STAT_INC(STAT_SPI, STAT_REG_WRITES);
+			cur = want;
+			held = 0;
+		}
 
-	/* DONE should be zero for complete data transfer */
-	if(isBitSet(SPI_CS, 16)){
-    		printf("%s() error: ", __func__);
-    		puts("data transfer error");
+		if(x[i].div && x[i].div != spi_clk_cur){
+			TRACE_REG(clk, x[i].div);
+			*clk = x[i].div;
+			spi_clk_cur = x[i].div;
+			STAT_INC(STAT_SPI, STAT_REG_WRITES);
+		}
+
+		hold = (x[i].flags & SPI_XFER_CS_HOLD) && i + 1 < n;
+		result = spi_run(x[i].tx, x[i].rx, x[i].len, hold);
+		held = hold && !result;
+		if(result){
+			break;
+		}
+
+		if(x[i].delay_us){
+			uswait(x[i].delay_us);
+		}
+	}
+
+	if(held){
+		clearBit(SPI_CS, 7);
 	}
+
+	TRACE_END(TRACE_SPI, __func__);
+	return result;
 }
 
-/* Writes a number of bytes to SPI device */
-void spi_write(char* wbuf, uint8_t wbuf_len)
+/* Writes and reads a number of bytes to/from a slave device */
+uint8_t spi_data_transfer(char* wbuf, char* rbuf, uint32_t len)
 {
-	volatile uint32_t *fifo = SPI_FIFO;
+	return spi_transfer(wbuf, rbuf, len);
+}
+
+/* Writes a number of bytes to SPI device
+ *
+ * The transfer stays active and the bytes received during the last SPI_FIFO_DEPTH bytes are kept
+ * in the RX FIFO for a following spi_read(), the bytes received before are discarded.
+ * Returns 2 on a timeout (the transfer is ended), else 0.
+ */
+uint8_t spi_write(char* wbuf, uint32_t wbuf_len)
+{
+	uint32_t keep = wbuf_len < SPI_FIFO_DEPTH ? wbuf_len : SPI_FIFO_DEPTH;
+	uint8_t result;
+
+	STAT_ENTER(STAT_SPI);
+	TRACE_BEGIN(TRACE_SPI, __func__);
 
 	/* Clear TX and RX fifo's */
 	clear_fifo(SPI_CS);
@@ -1814,46 +3089,884 @@ void spi_write(char* wbuf, uint8_t wbuf_len)
 	/* start data transfer, set TA = 1 */
 	setBit(SPI_CS, 7); 
 
-	uint8_t i = 0;
-
-	while (i < wbuf_len) 
-	{
-		// TX fifo is not full, add/write more bytes
-		while(isBitSet(SPI_CS, 18) && (i < wbuf_len))
-		{
-	   		*fifo = wbuf[i];
-	   		i++;
-	 	}
+	result = spi_pump(wbuf, wbuf_len, NULL, wbuf_len - keep, 0);
+	if(!result){
+		spi_rx_pending = keep;
 	}
+
+	TRACE_END(TRACE_SPI, __func__);
+	return result;
 }
 
-/* read a number of bytes from SPI device */
-void spi_read(char* rbuf, uint8_t rbuf_len)
+/* read a number of bytes from SPI device
+ *
+ * After spi_write() the bytes received during the write are read first, then zeros are sent to
+ * receive the rest. W/o a preceding spi_write() zeros are sent for all bytes (read-only transfer).
+ * Returns 2 on a timeout, else 0.
+ */
+uint8_t spi_read(char* rbuf, uint32_t rbuf_len)
 {
-	volatile uint32_t *fifo = SPI_FIFO;
+	uint32_t pending = spi_rx_pending;
+	uint8_t result;
+
+	STAT_ENTER(STAT_SPI);
 
 	if(!isBitSet(SPI_CS, 7)){
-		printf("%s() error: ", __func__);
-		puts("Nothing to read from fifo.");
-		return;
+		return spi_transfer(NULL, rbuf, rbuf_len);
 	}
 
-	/* continue data transfer from spi_write start transfer */
-	//setBit(SPI_CS, 7); // currently no need to set to start data transfer
-
-	uint8_t i = 0;
+	TRACE_BEGIN(TRACE_SPI, __func__);
 
-	while (i < rbuf_len) 
-	{
-		// TX fifo is not full, add/write more bytes
-		while(isBitSet(SPI_CS, 17) && (i < rbuf_len))
-		{
-	   		rbuf[i] = *fifo;
-	   		i++;
-	 	}
-	}
+	/* continue data transfer from spi_write start transfer */
+	result = spi_pump(NULL, rbuf_len > pending ? rbuf_len - pending : 0, rbuf, rbuf_len, pending);
+	spi_rx_pending = 0;
 
 	/* Set TA = 0, transfer is done */
 	clearBit(SPI_CS, 7);
+
+	TRACE_END(TRACE_SPI, __func__);
+	return result;
+}
+
+/********************
+
+	AUX mini SPI (SPI1, SPI2) Functions
+
+*********************/
+/* Mini SPI register offsets (words) from the SPI1 or SPI2 block */
+#define AUX_SPI_CNTL0		(0x00/4)
+#define AUX_SPI_CNTL1		(0x04/4)
+#define AUX_SPI_STAT		(0x08/4)
+#define AUX_SPI_IO		(0x20/4)	// last data of a transfer, the chip select is released after it
+#define AUX_SPI_TXHOLD		(0x30/4)	// data w/ the chip select kept asserted
+
+/* CNTL0 */
+#define AUX_CNTL0_SPEED		20		// SCLK = core clock / (2 * (speed + 1)), 12 bits
+#define AUX_CNTL0_CS		17		// chip select pattern, 3 bits, 0 = asserted
+#define AUX_CNTL0_VAR_WIDTH	(1 << 14)	// shift length in bits 28:24 of each FIFO word
+#define AUX_CNTL0_ENABLE	(1 << 11)
+#define AUX_CNTL0_IN_RISING	(1 << 10)
+#define AUX_CNTL0_CLEAR_FIFO	(1 << 9)
+#define AUX_CNTL0_OUT_RISING	(1 << 8)
+#define AUX_CNTL0_CPOL		(1 << 7)
+#define AUX_CNTL0_MSBF_OUT	(1 << 6)
+
+/* CNTL1 */
+#define AUX_CNTL1_MSBF_IN	(1 << 1)
+
+/* STAT */
+#define AUX_STAT_BUSY		(1 << 6)
+#define AUX_STAT_RX_EMPTY	(1 << 7)
+#define AUX_STAT_TX_FULL	(1 << 10)
+
+/* 4 FIFO entries of up to 24 bits (3 bytes) each */
+#define AUX_SPI_FIFO_DEPTH	4
+#define AUX_SPI_WORD_BYTES	3
+
+typedef struct {
+	uint32_t offset;	// byte offset of the register block inside the AUX page
+	uint8_t pin;		// first gpio pin, SPI1 GPIO 16 ~ 21 (CE2, CE1, CE0, MISO, MOSI, SCLK),
+				// SPI2 GPIO 40 ~ 45 (MISO, MOSI, SCLK, CE0, CE1, CE2)
+	uint32_t cntl0;		// speed, data mode and chip select of the next transfer
+	uint32_t cntl0_cur;	// last value written to CNTL0 (0 = unknown)
+	pthread_mutex_t lock;
+	uint8_t fsel[6];	// function of the pins before aux_spi_start(), restored by aux_spi_stop()
+} aux_spi_t;
+
+/* Each controller has its own lock, SPI0, SPI1 and SPI2 can transfer in parallel from separate threads */
+static aux_spi_t aux_spi[2] = {
+	{ 0x80, 16, 0, 0, PTHREAD_MUTEX_INITIALIZER, { 0 } },
+	{ 0xC0, 40, 0, 0, PTHREAD_MUTEX_INITIALIZER, { 0 } },
+};
+
+/* Function select of a pin (0 input, 1 output, 2 ~ 7 alt functions) */
+static uint8_t aux_spi_pin_fsel(uint8_t pin)
+{
+	return *(GPIO_GPFSEL0 + pin/10) >> (pin % 10)*3 & 7;
+}
+
+/* Controller of bus 1 (SPI1) or 2 (SPI2), NULL for an invalid bus */
+static aux_spi_t *aux_spi_get(uint8_t bus)
+{
+	if(bus < 1 || bus > 2){
+		printf("%s() error: ", __func__);
+		puts("invalid aux spi bus, use 1 or 2");
+		return NULL;
+	}
+	return &aux_spi[bus - 1];
+}
+
+static volatile uint32_t *aux_spi_reg(aux_spi_t *a)
+{
+	return AUX_PERI_BASE + a->offset/4;
+}
+
+void aux_spi_lock(uint8_t bus)
+{
+	aux_spi_t *a = aux_spi_get(bus);
+	if(a){
+		pthread_mutex_lock(&a->lock);
+	}
+}
+
+void aux_spi_unlock(uint8_t bus)
+{
+	aux_spi_t *a = aux_spi_get(bus);
+	if(a){
+		pthread_mutex_unlock(&a->lock);
+	}
+}
+
+/* Start a mini SPI controller, returns 0 on success */
+uint8_t aux_spi_start(uint8_t bus)
+{
+	aux_spi_t *a = aux_spi_get(bus);
+	volatile uint32_t *reg;
+	uint8_t i;
+
+	STAT_ENTER(STAT_SPI);
+
+	if(a == NULL){
+		return 1;
+	}
+	if(rpi_init_access == 0){
+		gpio_init();  // map gpio for alt pin sel
+	}
+	if(AUX_PERI_BASE == 0){
+		set_each_peri_mmap(4); // map aux peripheral register
+	}
+
+	__sync_synchronize();
+	if(AUX_PERI_BASE == 0 || AUX_PERI_BASE == MAP_FAILED){
+		printf("%s() error: ", __func__);
+		puts("Invalid memory-mapped AUX peripheral base register");
+		return 1;
+	}
+
+	setBit(AUX_ENABLES, bus);	// bit 1 SPI1, bit 2 SPI2
+
+	/* alt 4 on all six pins, their function is saved on the first start only
+	 * (e.g. GPIO 40 ~ 45 are the audio PWM pins on a Pi 3/4)
+	 */
+	for(i = 0; i < 6; i++){
+		if(a->cntl0_cur == 0){
+			a->fsel[i] = aux_spi_pin_fsel(a->pin + i);
+		}
+		set_gpio(a->pin + i, 3);
+	}
+
+	mswait(5);
+
+	/* mode 0, chip select 0, SCLK = core clock / 128 */
+	a->cntl0 = AUX_CNTL0_VAR_WIDTH | AUX_CNTL0_ENABLE | AUX_CNTL0_MSBF_OUT | AUX_CNTL0_IN_RISING |
+		(6 << AUX_CNTL0_CS) | (63 << AUX_CNTL0_SPEED);
+
+	reg = aux_spi_reg(a);
+	reg[AUX_SPI_CNTL1] = AUX_CNTL1_MSBF_IN;
+	reg[AUX_SPI_CNTL0] = a->cntl0 | AUX_CNTL0_CLEAR_FIFO;
+	reg[AUX_SPI_CNTL0] = a->cntl0;
+	a->cntl0_cur = a->cntl0;
+	STAT_ADD(STAT_SPI, STAT_REG_WRITES, 3);
+
+	return 0;
+}
+
+/* Stop a mini SPI controller */
+void aux_spi_stop(uint8_t bus)
+{
+	aux_spi_t *a = aux_spi_get(bus);
+	uint8_t i;
+
+	STAT_ENTER(STAT_SPI);
+
+	if(a == NULL || AUX_PERI_BASE == 0){
+		return;
+	}
+
+	aux_spi_reg(a)[AUX_SPI_CNTL0] = AUX_CNTL0_CLEAR_FIFO;
+	aux_spi_reg(a)[AUX_SPI_CNTL0] = 0;
+	a->cntl0_cur = 0;
+	clearBit(AUX_ENABLES, bus);
+
+	for(i = 0; i < 6; i++){
+		set_gpio(a->pin + i, a->fsel[i]);  // previous pin function
+	}
+}
+
+/* SCLK = core clock / divider, the divider is rounded to an even value (2 ~ 8192) */
+void aux_spi_set_clock_freq(uint8_t bus, uint16_t divider)
+{
+	aux_spi_t *a = aux_spi_get(bus);
+	uint32_t speed = divider > 2 ? divider/2 - 1 : 0;
+
+	if(a == NULL){
+		return;
+	}
+	if(speed > 0xfff){
+		speed = 0xfff;
+	}
+	a->cntl0 = (a->cntl0 & ~(0xfffu << AUX_CNTL0_SPEED)) | (speed << AUX_CNTL0_SPEED);
+}
+
+/* The mini SPI has no clock phase setting, CPHA selects the opposite clock edges (modes 0 and 2 are the native ones) */
+void aux_spi_set_data_mode(uint8_t bus, uint8_t mode)
+{
+	aux_spi_t *a = aux_spi_get(bus);
+	uint8_t cpol = mode >> 1, cpha = mode & 1;
+
+	if(a == NULL){
+		return;
+	}
+	if(mode > 3){
+		printf("%s() error: ", __func__);
+		puts("invalid spi data mode");
+		return;
+	}
+
+	a->cntl0 &= ~(AUX_CNTL0_CPOL | AUX_CNTL0_IN_RISING | AUX_CNTL0_OUT_RISING);
+	if(cpol){
+		a->cntl0 |= AUX_CNTL0_CPOL;
+	}
+	a->cntl0 |= (cpol == cpha) ? AUX_CNTL0_IN_RISING : AUX_CNTL0_OUT_RISING;
+}
+
+/* Chip select 0 ~ 2 (active low) */
+void aux_spi_chip_select(uint8_t bus, uint8_t cs)
+{
+	aux_spi_t *a = aux_spi_get(bus);
+
+	if(a == NULL){
+		return;
+	}
+	if(cs > 2){
+		printf("%s() error: ", __func__);
+		puts("invalid chip select");
+		return;
+	}
+	a->cntl0 = (a->cntl0 & ~(7u << AUX_CNTL0_CS)) | ((7u & ~(1u << cs)) << AUX_CNTL0_CS);
+}
+
+/* Full-duplex transfer of len bytes, wbuf = NULL sends zeros, rbuf = NULL discards the received bytes.
+ *
+ * The bytes are packed three per 24-bit FIFO entry (variable width mode), all entries but the last one
+ * go through TXHOLD so the chip select stays asserted during the whole transfer. Up to 4 entries are in
+ * flight, so the RX FIFO never overflows. Call with the controller lock held (aux_spi_lock()).
+ * Returns 2 on a timeout (the FIFOs are cleared, which ends the transfer), else 0.
+ */
+uint8_t aux_spi_transfer(uint8_t bus, const char *wbuf, char *rbuf, uint32_t len)
+{
+	aux_spi_t *a = aux_spi_get(bus);
+	volatile uint32_t *reg;
+	uint32_t w = 0, r = 0, n, k, data, inflight = 0, polls = 0;
+	uint8_t result = 0;
+
+	STAT_ENTER(STAT_SPI);
+
+	if(a == NULL || AUX_PERI_BASE == 0 || len == 0){
+		return 0;
+	}
+
+	TRACE_BEGIN(TRACE_SPI, __func__);
+
+	/* SCLK = core clock / (2 * (speed + 1)), a sleep covers half of the FIFO entries in flight */
+	uint64_t byte_ns = 16ULL * ((a->cntl0 >> AUX_CNTL0_SPEED & 0xfff) + 1) * 1000000000ULL / core_clock_freq;
+	bus_wait_t bw;
+	bus_wait_begin(&bw, len * byte_ns, AUX_SPI_FIFO_DEPTH / 2 * AUX_SPI_WORD_BYTES * byte_ns, 4 * len * byte_ns + SPI_WAIT_TIMEOUT_NS);
+
+	reg = aux_spi_reg(a);
+
+	/* speed, mode or chip select changed since the last transfer */
+	if(a->cntl0 != a->cntl0_cur){
+		TRACE_REG(&reg[AUX_SPI_CNTL0], a->cntl0);
+		reg[AUX_SPI_CNTL0] = a->cntl0;
+		a->cntl0_cur = a->cntl0;
+		STAT_INC(STAT_SPI, STAT_REG_WRITES);
+	}
+
+	while(w < len || r < len){
+		polls++;
+		if(bus_wait_poll(&bw)){
+			/* dropping the TXHOLD entries also releases the chip select */
+			reg[AUX_SPI_CNTL0] = a->cntl0_cur | AUX_CNTL0_CLEAR_FIFO;
+			reg[AUX_SPI_CNTL0] = a->cntl0_cur;
+			STAT_INC(STAT_SPI, STAT_ERRORS);
+			printf("%s() error: ", __func__);
+			puts("transfer timeout");
+			result = 2;
+			break;
+		}
+		while(w < len && inflight < AUX_SPI_FIFO_DEPTH && !(reg[AUX_SPI_STAT] & AUX_STAT_TX_FULL)){
+			n = len - w > AUX_SPI_WORD_BYTES ? AUX_SPI_WORD_BYTES : len - w;
+			data = (n * 8) << 24;
+			for(k = 0; k < n; k++){
+				data |= (uint32_t)(wbuf ? (uint8_t)wbuf[w + k] : 0) << (8 * (2 - k));
+			}
+			w += n;
+			reg[w < len ? AUX_SPI_TXHOLD : AUX_SPI_IO] = data;
+			inflight++;
+		}
+		while(inflight && !(reg[AUX_SPI_STAT] & AUX_STAT_RX_EMPTY)){
+			data = reg[AUX_SPI_IO];
+			n = len - r > AUX_SPI_WORD_BYTES ? AUX_SPI_WORD_BYTES : len - r;
+			if(rbuf){
+				for(k = 0; k < n; k++){
+					rbuf[r + k] = data >> (8 * (n - 1 - k));
+				}
+			}
+			r += n;
+			inflight--;
+		}
+	}
+
+	bus_wait_end(&bw, STAT_SPI);
+	STAT_ADD(STAT_SPI, STAT_POLLS, polls);
+	STAT_ADD(STAT_SPI, STAT_BYTES, len);
+	STAT_ADD(STAT_SPI, STAT_REG_WRITES, (len + 2) / 3);
+	STAT_ADD(STAT_SPI, STAT_REG_READS, (len + 2) / 3);
+	TRACE_END(TRACE_SPI, __func__);
+	return result;
+}
+
+/********************
+
+	Software (bit-banged) SPI and I2C Functions
+
+*********************/
+/* Bus types */
+#define SOFT_SPI		1
+#define SOFT_I2C		2
+
+typedef struct {
+	volatile uint32_t *fsel;	// GPFSEL register of the pin
+	uint32_t fmask;			// function select bits of the pin
+	uint32_t fout;			// output function select value
+	uint32_t mask;			// GPSET0/GPCLR0/GPLEV0 bit (0 = unused pin)
+} soft_pin_t;
+
+typedef struct {
+	uint8_t type;			// 0 = unused
+	soft_pin_t clk;			// SCLK or SCL
+	soft_pin_t dout;		// MOSI or SDA
+	soft_pin_t din;			// MISO
+	soft_pin_t cs;
+	uint8_t mode;
+	uint8_t lsb_first;
+	uint8_t cs_high;
+	uint32_t delay;			// spin loops per half clock period
+	uint32_t stretch_us;		// i2c clock stretch timeout
+	pthread_mutex_t lock;
+} soft_bus_t;
+
+/* the bus locks are initialized once, a closed slot may still have a waiter on its lock */
+static soft_bus_t soft_bus[SOFT_BUS_MAX] = { [0 ... SOFT_BUS_MAX - 1] = { .lock = PTHREAD_MUTEX_INITIALIZER } };
+static pthread_mutex_t soft_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* Spin loop iterations per microsecond, measured on the first open */
+static uint32_t soft_loops_us = 0;
+
+static inline void soft_spin(uint32_t n)
+{
+	while(n--){
+		__asm__ __volatile__("" ::: "memory");
+	}
+}
+
+static void soft_calibrate()
+{
+	struct timespec t0, t1;
+	uint64_t ns;
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	soft_spin(1000000);
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+
+	ns = (uint64_t)(t1.tv_sec - t0.tv_sec) * 1000000000ULL + t1.tv_nsec - t0.tv_nsec;
+	soft_loops_us = ns ? 1000000000ULL / ns : 1000;
+	if(soft_loops_us == 0){
+		soft_loops_us = 1;
+	}
+}
+
+/* Spin loops for half a clock period at freq Hz, 0 = no delay (as fast as the gpio writes go) */
+static uint32_t soft_half_period(uint32_t freq)
+{
+	if(freq == 0){
+		return 0;
+	}
+	return (uint64_t)soft_loops_us * 500000 / freq;
+}
+
+static void soft_pin_init(soft_pin_t *p, uint8_t pin)
+{
+	if(pin == SOFT_PIN_NONE){
+		p->mask = 0;
+		return;
+	}
+	p->fsel = GPIO_GPFSEL0 + pin/10;
+	p->fmask = 7 << (pin % 10)*3;
+	p->fout = 1 << (pin % 10)*3;
+	p->mask = 1 << pin;
+}
+
+/* Open-drain emulation, the pin is released (input, pulled high) or driven low (output w/ a cleared latch),
+ * the GPFSEL register is shared w/ 9 other pins so the update holds the same lock as set_gpio()
+ */
+static inline void soft_od(soft_pin_t *p, uint8_t high)
+{
+	uint32_t v;
+
+	pthread_mutex_lock(&gpfsel_lock);
+	v = *p->fsel & ~p->fmask;
+	*p->fsel = high ? v : v | p->fout;
+	pthread_mutex_unlock(&gpfsel_lock);
+}
+
+/* Allocate a bus slot, returns the id or -1 */
+static int32_t soft_alloc(uint8_t type)
+{
+	int32_t i;
+
+	pthread_mutex_lock(&soft_mutex);
+	if(soft_loops_us == 0){
+		soft_calibrate();
+	}
+	for(i = 0; i < SOFT_BUS_MAX; i++){
+		if(soft_bus[i].type == 0){
+			memset(&soft_bus[i], 0, offsetof(soft_bus_t, lock));
+			soft_bus[i].type = type;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&soft_mutex);
+
+	if(i == SOFT_BUS_MAX){
+		printf("%s() error: ", __func__);
+		puts("no free software bus");
+		return -1;
+	}
+	return i;
+}
+
+static soft_bus_t *soft_get(int32_t id, uint8_t type)
+{
+	if(id < 0 || id >= SOFT_BUS_MAX || soft_bus[id].type != type){
+		return NULL;
+	}
+	return &soft_bus[id];
+}
+
+static uint8_t soft_pin_ok(uint8_t pin)
+{
+	return pin < 28 || pin == SOFT_PIN_NONE;
+}
+
+void soft_lock(int32_t id)
+{
+	if(id >= 0 && id < SOFT_BUS_MAX){
+		pthread_mutex_lock(&soft_bus[id].lock);
+	}
+}
+
+void soft_unlock(int32_t id)
+{
+	if(id >= 0 && id < SOFT_BUS_MAX){
+		pthread_mutex_unlock(&soft_bus[id].lock);
+	}
+}
+
+/* Release the pins (inputs) and the bus slot */
+void soft_close(int32_t id)
+{
+	soft_bus_t *b;
+	soft_pin_t *p[4];
+	uint8_t i;
+
+	if(id < 0 || id >= SOFT_BUS_MAX || soft_bus[id].type == 0){
+		return;
+	}
+	b = &soft_bus[id];
+	p[0] = &b->clk, p[1] = &b->dout, p[2] = &b->din, p[3] = &b->cs;
+
+	/* wait for a transfer in progress */
+	pthread_mutex_lock(&b->lock);
+	pthread_mutex_lock(&gpfsel_lock);
+	for(i = 0; i < 4; i++){
+		if(p[i]->mask){
+			*p[i]->fsel &= ~p[i]->fmask;
+		}
+	}
+	pthread_mutex_unlock(&gpfsel_lock);
+
+	pthread_mutex_lock(&soft_mutex);
+	b->type = 0;
+	pthread_mutex_unlock(&soft_mutex);
+	pthread_mutex_unlock(&b->lock);
+}
+
+/* Open a software SPI master on gpio pins 0 ~ 27 (mosi, miso or cs SOFT_PIN_NONE if unused),
+ * mode 0 ~ 3, freq in Hz (0 = as fast as possible), returns the bus id or -1
+ */
+int32_t soft_spi_open(uint8_t sclk, uint8_t mosi, uint8_t miso, uint8_t cs, uint8_t mode, uint8_t lsb_first, uint8_t cs_high, uint32_t freq)
+{
+	volatile uint32_t *set = GPIO_GPSET0, *clr = GPIO_GPCLR0;
+	soft_bus_t *b;
+	int32_t id;
+
+	STAT_ENTER(STAT_SPI);
+
+	if(sclk >= 28 || !soft_pin_ok(mosi) || !soft_pin_ok(miso) || !soft_pin_ok(cs) || mode > 3){
+		printf("%s() error: ", __func__);
+		puts("invalid pin or mode");
+		return -1;
+	}
+	if((id = soft_alloc(SOFT_SPI)) < 0){
+		return -1;
+	}
+
+	b = &soft_bus[id];
+	soft_pin_init(&b->clk, sclk);
+	soft_pin_init(&b->dout, mosi);
+	soft_pin_init(&b->din, miso);
+	soft_pin_init(&b->cs, cs);
+	b->mode = mode;
+	b->lsb_first = lsb_first;
+	b->cs_high = cs_high;
+	b->delay = soft_half_period(freq);
+
+	/* idle levels: sclk = CPOL, mosi low, cs released */
+	*(mode & 2 ? set : clr) = b->clk.mask;
+	set_gpio(sclk, 1);
+	if(b->dout.mask){
+		*clr = b->dout.mask;
+		set_gpio(mosi, 1);
+	}
+	if(b->din.mask){
+		set_gpio(miso, 0);
+	}
+	if(b->cs.mask){
+		*(cs_high ? clr : set) = b->cs.mask;
+		set_gpio(cs, 1);
+	}
+
+	return id;
+}
+
+/* Change the mode and clock of a software SPI bus */
+void soft_spi_config(int32_t id, uint8_t mode, uint8_t lsb_first, uint32_t freq)
+{
+	soft_bus_t *b = soft_get(id, SOFT_SPI);
+
+	if(b == NULL || mode > 3){
+		return;
+	}
+	b->mode = mode;
+	b->lsb_first = lsb_first;
+	b->delay = soft_half_period(freq);
+	*(mode & 2 ? GPIO_GPSET0 : GPIO_GPCLR0) = b->clk.mask;
+}
+
+/* Full-duplex transfer of len bytes, wbuf = NULL sends zeros, rbuf = NULL discards the received bytes.
+ * Each clock edge and data bit is a single GPSET0/GPCLR0 mask write, barriers only wrap the whole transfer.
+ * returns 1 if the bus id is invalid
+ */
+uint8_t soft_spi_transfer(int32_t id, const char *wbuf, char *rbuf, uint32_t len)
+{
+	soft_bus_t *b = soft_get(id, SOFT_SPI);
+	volatile uint32_t *set = GPIO_GPSET0, *clr = GPIO_GPCLR0, *lev = GPIO_GPLEV0;
+	volatile uint32_t *lead, *trail;
+	uint32_t clk, dout, din, d, i, k, sh;
+	uint8_t out, in, cpha;
+
+	STAT_ENTER(STAT_SPI);
+
+	if(b == NULL){
+		return 1;
+	}
+
+	TRACE_BEGIN(TRACE_SPI, __func__);
+
+	clk = b->clk.mask, dout = b->dout.mask, din = b->din.mask, d = b->delay;
+	cpha = b->mode & 1;
+	lead = b->mode & 2 ? clr : set;
+	trail = b->mode & 2 ? set : clr;
+
+	__sync_synchronize();
+
+	if(b->cs.mask){
+		*(b->cs_high ? set : clr) = b->cs.mask;
+	}
+
+	for(i = 0; i < len; i++){
+		out = wbuf ? wbuf[i] : 0;
+		in = 0;
+		for(k = 0; k < 8; k++){
+			sh = b->lsb_first ? k : 7 - k;
+			if(!cpha){
+				if(dout){
+					*((out >> sh) & 1 ? set : clr) = dout;
+				}
+				soft_spin(d);
+				*lead = clk;
+				if(din && (*lev & din)){
+					in |= 1 << sh;
+				}
+				soft_spin(d);
+				*trail = clk;
+			}
+			else{
+				*lead = clk;
+				if(dout){
+					*((out >> sh) & 1 ? set : clr) = dout;
+				}
+				soft_spin(d);
+				*trail = clk;
+				if(din && (*lev & din)){
+					in |= 1 << sh;
+				}
+				soft_spin(d);
+			}
+		}
+		if(rbuf){
+			rbuf[i] = in;
+		}
+	}
+
+	if(b->cs.mask){
+		*(b->cs_high ? clr : set) = b->cs.mask;
+	}
+
+	__sync_synchronize();
+
+	STAT_ADD(STAT_SPI, STAT_BYTES, len);
+	STAT_ADD(STAT_SPI, STAT_REG_WRITES, len * (dout ? 24 : 16));
+	STAT_ADD(STAT_SPI, STAT_REG_READS, din ? len * 8 : 0);
+	TRACE_END(TRACE_SPI, __func__);
+
+	return 0;
+}
+
+/*
+ * Software I2C
+ *
+ * SDA and SCL are open-drain: the output latch of both pins is cleared once, a line is driven low by
+ * switching its pin to output and released by switching it back to input (external pull-ups required).
+ */
+#define SOFT_I2C_NACK		1
+#define SOFT_I2C_CLKT		2
+
+/* Release SCL and wait while a slave stretches the clock, returns 0 or SOFT_I2C_CLKT */
+static uint8_t soft_scl_high(soft_bus_t *b)
+{
+	volatile uint32_t *lev = GPIO_GPLEV0;
+	struct timespec ts;
+	uint64_t end = 0, now;
+
+	soft_od(&b->clk, 1);
+	while(!(*lev & b->clk.mask)){
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		now = (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+		if(end == 0){
+			end = now + b->stretch_us;
+		}
+		else if(now > end){
+			return SOFT_I2C_CLKT;
+		}
+	}
+	return 0;
+}
+
+static uint8_t soft_i2c_start(soft_bus_t *b)
+{
+	uint8_t rval;
+
+	soft_od(&b->dout, 1);
+	soft_spin(b->delay);
+	if((rval = soft_scl_high(b))){
+		return rval;
+	}
+	soft_spin(b->delay);
+	soft_od(&b->dout, 0);
+	soft_spin(b->delay);
+	soft_od(&b->clk, 0);
+	return 0;
+}
+
+static void soft_i2c_stop(soft_bus_t *b)
+{
+	soft_od(&b->dout, 0);
+	soft_spin(b->delay);
+	soft_scl_high(b);
+	soft_spin(b->delay);
+	soft_od(&b->dout, 1);
+	soft_spin(b->delay);
+}
+
+/* Write a byte, returns 0 on ack, SOFT_I2C_NACK or SOFT_I2C_CLKT */
+static uint8_t soft_i2c_write_byte(soft_bus_t *b, uint8_t v)
+{
+	volatile uint32_t *lev = GPIO_GPLEV0;
+	uint8_t k, nack;
+
+	for(k = 0; k < 8; k++){
+		soft_od(&b->dout, (v >> (7 - k)) & 1);
+		soft_spin(b->delay);
+		if(soft_scl_high(b)){
+			return SOFT_I2C_CLKT;
+		}
+		soft_spin(b->delay);
+		soft_od(&b->clk, 0);
+	}
+
+	/* ack bit */
+	soft_od(&b->dout, 1);
+	soft_spin(b->delay);
+	if(soft_scl_high(b)){
+		return SOFT_I2C_CLKT;
+	}
+	soft_spin(b->delay);
+	nack = (*lev & b->dout.mask) != 0;
+	soft_od(&b->clk, 0);
+
+	return nack ? SOFT_I2C_NACK : 0;
+}
+
+/* Read a byte into v, then ack (more bytes follow) or nack it, returns 0 or SOFT_I2C_CLKT */
+static uint8_t soft_i2c_read_byte(soft_bus_t *b, char *v, uint8_t ack)
+{
+	volatile uint32_t *lev = GPIO_GPLEV0;
+	uint8_t k, in = 0;
+
+	soft_od(&b->dout, 1);
+	for(k = 0; k < 8; k++){
+		soft_spin(b->delay);
+		if(soft_scl_high(b)){
+			return SOFT_I2C_CLKT;
+		}
+		soft_spin(b->delay);
+		in = (in << 1) | ((*lev & b->dout.mask) != 0);
+		soft_od(&b->clk, 0);
+	}
+	*v = in;
+
+	soft_od(&b->dout, !ack);
+	soft_spin(b->delay);
+	if(soft_scl_high(b)){
+		return SOFT_I2C_CLKT;
+	}
+	soft_spin(b->delay);
+	soft_od(&b->clk, 0);
+	soft_od(&b->dout, 1);
+
+	return 0;
+}
+
+/* Open a software I2C master on gpio pins 0 ~ 27, freq in Hz (0 = as fast as possible),
+ * stretch_us is the clock stretch timeout. Returns the bus id or -1
+ */
+int32_t soft_i2c_open(uint8_t scl, uint8_t sda, uint32_t freq, uint32_t stretch_us)
+{
+	volatile uint32_t *clr = GPIO_GPCLR0, *lev = GPIO_GPLEV0;
+	soft_bus_t *b;
+	int32_t id;
+	uint8_t k;
+
+	STAT_ENTER(STAT_I2C);
+
+	if(scl >= 28 || sda >= 28 || scl == sda){
+		printf("%s() error: ", __func__);
+		puts("invalid pin");
+		return -1;
+	}
+	if((id = soft_alloc(SOFT_I2C)) < 0){
+		return -1;
+	}
+
+	b = &soft_bus[id];
+	soft_pin_init(&b->clk, scl);
+	soft_pin_init(&b->dout, sda);
+	b->din.mask = 0;
+	b->cs.mask = 0;
+	b->delay = soft_half_period(freq);
+	b->stretch_us = stretch_us ? stretch_us : 25000;
+
+	/* both lines released, a driven line is low */
+	soft_od(&b->clk, 1);
+	soft_od(&b->dout, 1);
+	*clr = b->clk.mask | b->dout.mask;
+
+	/* bus recovery, clock out a slave holding SDA low */
+	for(k = 0; k < 9 && !(*lev & b->dout.mask); k++){
+		soft_od(&b->clk, 0);
+		soft_spin(b->delay);
+		soft_scl_high(b);
+		soft_spin(b->delay);
+	}
+	soft_i2c_stop(b);
+
+	return id;
+}
+
+void soft_i2c_config(int32_t id, uint32_t freq, uint32_t stretch_us)
+{
+	soft_bus_t *b = soft_get(id, SOFT_I2C);
+
+	if(b == NULL){
+		return;
+	}
+	b->delay = soft_half_period(freq);
+	if(stretch_us){
+		b->stretch_us = stretch_us;
+	}
+}
+
+/* Write wlen bytes then read rlen bytes from addr, with a repeated start if both are non-zero.
+ * wlen = rlen = 0 is a quick write (address only).
+ * returns 0 on success, 1 if the address or a data byte is not acknowledged, 2 on a clock stretch timeout
+ * (same codes as the hardware i2c functions), 0xff if the bus id is invalid
+ */
+uint8_t soft_i2c_write_read(int32_t id, uint8_t addr, const char *wbuf, uint32_t wlen, char *rbuf, uint32_t rlen)
+{
+	soft_bus_t *b = soft_get(id, SOFT_I2C);
+	uint8_t rval = 0;
+	uint32_t i;
+
+	STAT_ENTER(STAT_I2C);
+
+	if(b == NULL){
+		return 0xff;
+	}
+
+	TRACE_BEGIN(TRACE_I2C, __func__);
+	__sync_synchronize();
+
+	if(wlen || !rlen){
+		rval = soft_i2c_start(b);
+		if(rval == 0){
+			rval = soft_i2c_write_byte(b, addr << 1);
+		}
+		for(i = 0; i < wlen && rval == 0; i++){
+			rval = soft_i2c_write_byte(b, wbuf[i]);
+		}
+	}
+	if(rlen && rval == 0){
+		rval = soft_i2c_start(b);
+		if(rval == 0){
+			rval = soft_i2c_write_byte(b, (addr << 1) | 1);
+		}
+		for(i = 0; i < rlen && rval == 0; i++){
+			rval = soft_i2c_read_byte(b, &rbuf[i], i + 1 < rlen);
+		}
+	}
+	soft_i2c_stop(b);
+
+	__sync_synchronize();
+
+	if(rval){
+		STAT_INC(STAT_I2C, STAT_ERRORS);
+	}
+	STAT_ADD(STAT_I2C, STAT_BYTES, wlen + rlen);
+	TRACE_END(TRACE_I2C, __func__);
+
+	return rval;
 }
 
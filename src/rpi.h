@@ -33,6 +33,18 @@ void uswait(uint32_t us);  //microsecond
 
 void mswait(uint32_t ms);  //millisecond
 
+/* Map the 1 MHz system timer (needs root access), returns 0 on success */
+uint8_t st_map();
+
+/* System timer counter in microseconds (lower 32 bits, wraps after ~71 minutes) */
+uint32_t st_read();
+
+/* Wait strategy of the i2c/spi polling loops, adaptive = 1 (default) sleeps for the bulk of a transfer
+ * and spins only near its expected completion, 0 always spins. Waits shorter than min_sleep_us are spun
+ * (0 keeps the current value, default 100 us)
+ */
+void bus_wait_set(uint8_t adaptive, uint32_t min_sleep_us);
+
 /**
  *  GPIO
  */
@@ -104,22 +116,80 @@ void pwm_set_range(uint8_t pin, uint32_t range);
 /**
  *  I2C
  */
+typedef struct {
+	uint32_t baud;		// requested bus speed
+	uint32_t core;		// core clock used for the plan
+	uint32_t actual;	// achieved bus speed
+	uint16_t cdiv;		// clock divider
+	uint16_t fedl;		// falling edge delay
+	uint16_t redl;		// rising edge delay
+	uint16_t clkt;		// clock stretch timeout (SCL cycles)
+} i2c_clock_plan_t;
+
+/* i2c_transfer() message flags */
+#define I2C_MSG_RD		0x01	// read, otherwise write
+#define I2C_MSG_NOSTOP		0x02	// write followed by a read of the same address w/ a repeated start
+
+typedef struct {
+	uint8_t addr;
+	uint8_t flags;
+	uint16_t len;
+	char *buf;
+	uint8_t status;		// set by i2c_transfer()
+} i2c_msg_t;
+
+uint32_t get_core_clock_freq();
+
 void i2c_start(uint8_t sel);
 
 void i2c_stop();
 
 void i2c_select_slave(uint8_t addr); 
 
+void i2c_set_address(uint8_t addr);
+
+uint8_t i2c_get_address();
+
+uint8_t i2c_probe(uint8_t addr);
+
+/* i2c_scan() modes */
+#define I2C_SCAN_AUTO		0
+#define I2C_SCAN_QUICK		1
+#define I2C_SCAN_READ		2
+#define I2C_SCAN_CACHED		0x10	// flag, use the previous results of the scanned addresses
+
+uint8_t i2c_scan(uint8_t first, uint8_t last, uint8_t mode, uint32_t map[4]);
+
+void i2c_scan_clear();
+
 void i2c_set_clock_freq(uint16_t divider);
 
-void i2c_data_transfer_speed(uint32_t baud);
+uint32_t i2c_data_transfer_speed(uint32_t baud);
+
+uint8_t i2c_clock_plan(uint32_t baud, i2c_clock_plan_t *plan);
+
+void i2c_clock_apply(const i2c_clock_plan_t *plan);
+
+uint32_t i2c_device_speed(uint8_t addr, uint32_t baud);
 
-uint8_t i2c_write(const char * wbuf, uint8_t len);
+uint8_t i2c_write(const char * wbuf, uint16_t len);
 
-uint8_t i2c_read(char * rbuf, uint8_t len);
+uint8_t i2c_read(char * rbuf, uint16_t len);
+
+uint8_t i2c_write_read(const char * wbuf, uint16_t wlen, char * rbuf, uint16_t rlen);
+
+uint32_t i2c_transfer(i2c_msg_t *msgs, uint32_t n);
 
 uint8_t i2c_byte_read();
 
+void i2c_lock();
+
+void i2c_unlock();
+
+void i2c_use(uint8_t bus);
+
+uint8_t i2c_current_bus();
+
 /**
  *  SPI
  */
@@ -135,11 +205,91 @@ void spi_set_chip_select_polarity(uint8_t cs, uint8_t active);
 
 void spi_chip_select(uint8_t cs);
 
-void spi_data_transfer(char* wbuf, char* rbuf, uint8_t len);
+uint8_t spi_transfer(const char* wbuf, char* rbuf, uint32_t len);
+
+void spi_set_bulk_threshold(uint32_t len);
+
+/* spi_transfer_list() transfer descriptor */
+#define SPI_XFER_KEEP		0xff	// cs or mode, keep the current value
+#define SPI_XFER_CS_HOLD	0x01	// keep the chip select asserted into the next transfer
+
+typedef struct {
+	uint8_t cs;		// chip select 0 - 2
+	uint8_t mode;		// data mode 0 - 3
+	uint16_t div;		// clock divider (0 = keep)
+	uint32_t len;
+	const char *tx;		// NULL sends zeros
+	char *rx;		// NULL discards the received bytes
+	uint32_t flags;
+	uint32_t delay_us;	// delay after the transfer
+} spi_xfer_t;
+
+uint8_t spi_transfer_list(const spi_xfer_t *x, uint32_t n);
+
+/* Max. no. of spi device contexts */
+#define SPI_DEV_MAX		16
+
+int32_t spi_dev_open(uint8_t cs, uint8_t mode, uint8_t cs_high, uint16_t div);
+
+void spi_dev_close(int32_t id);
+
+uint8_t spi_dev_select(int32_t id);
+
+uint8_t spi_data_transfer(char* wbuf, char* rbuf, uint32_t len);
+
+uint8_t spi_write(char* wbuf, uint32_t len);
+
+uint8_t spi_read(char* rbuf, uint32_t len);
+
+void spi_lock();
+
+void spi_unlock();
+
+/**
+ *  AUX mini SPI, bus 1 (SPI1) or 2 (SPI2)
+ */
+uint8_t aux_spi_start(uint8_t bus);
+
+void aux_spi_stop(uint8_t bus);
+
+void aux_spi_set_clock_freq(uint8_t bus, uint16_t divider);
+
+void aux_spi_set_data_mode(uint8_t bus, uint8_t mode);
+
+void aux_spi_chip_select(uint8_t bus, uint8_t cs);
+
+uint8_t aux_spi_transfer(uint8_t bus, const char *wbuf, char *rbuf, uint32_t len);
+
+void aux_spi_lock(uint8_t bus);
+
+void aux_spi_unlock(uint8_t bus);
+
+/**
+ *  Software (bit-banged) SPI and I2C on gpio pins 0 ~ 27
+ */
+/* Max. no. of software buses */
+#define SOFT_BUS_MAX		8
+
+/* Unused pin */
+#define SOFT_PIN_NONE		0xff
+
+int32_t soft_spi_open(uint8_t sclk, uint8_t mosi, uint8_t miso, uint8_t cs, uint8_t mode, uint8_t lsb_first, uint8_t cs_high, uint32_t freq);
+
+void soft_spi_config(int32_t id, uint8_t mode, uint8_t lsb_first, uint32_t freq);
+
+uint8_t soft_spi_transfer(int32_t id, const char *wbuf, char *rbuf, uint32_t len);
+
+int32_t soft_i2c_open(uint8_t scl, uint8_t sda, uint32_t freq, uint32_t stretch_us);
+
+void soft_i2c_config(int32_t id, uint32_t freq, uint32_t stretch_us);
+
+uint8_t soft_i2c_write_read(int32_t id, uint8_t addr, const char *wbuf, uint32_t wlen, char *rbuf, uint32_t rlen);
+
+void soft_close(int32_t id);
 
-void spi_write(char* wbuf, uint8_t len);
+void soft_lock(int32_t id);
 
-void spi_read(char* rbuf, uint8_t len);
+void soft_unlock(int32_t id);
 
 #ifdef __cplusplus
 }
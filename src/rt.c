@@ -0,0 +1,231 @@
+/**
+ * rt.c
+ *
+ * Copyright (c) 2017 Ed Alegrid <ealegrid@gmail.com>
+ * GNU General Public License v3.0
+ *
+ */
+
+#define  _GNU_SOURCE	// for CPU_SET() and pthread_setaffinity_np()
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <alloca.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "rpi.h"
+#include "rt.h"
+
+static rt_profile_t rt_profile = { 0, -1, 0, 0, 0 };
+static rt_status_t rt_status = { 0, 0, -1, 0 };
+static pthread_mutex_t rt_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Set once mlockall() was called by this library, other code of the process may lock its own pages */
+static uint8_t rt_locked = 0;
+
+/* Stack bytes left untouched below the pre-faulted area for the rest of the thread */
+#define RT_STACK_MARGIN		(64 * 1024)
+
+/* Spin-only mode of the calling thread */
+static __thread uint8_t rt_spin = 0;
+
+/* Get the first cpu from /sys/devices/system/cpu/isolated (e.g. "3" or "2-3"), -1 if none */
+static int32_t rt_isolated_cpu(){
+	FILE *fp = NULL;
+	int cpu = -1;
+
+	if((fp = fopen("/sys/devices/system/cpu/isolated", "r")) == NULL){
+		return -1;
+	}
+	if(fscanf(fp, "%d", &cpu) != 1){
+		cpu = -1;
+	}
+	fclose(fp);
+
+	return cpu;
+}
+
+/* Clamp a pre-fault size to the stack left to the calling thread minus RT_STACK_MARGIN, 0 if none */
+static size_t rt_stack_avail(size_t len){
+	pthread_attr_t attr;
+	void *addr = NULL;
+	size_t size = 0, avail = 0;
+	char here;
+
+	if(pthread_getattr_np(pthread_self(), &attr) != 0){
+		return 0;
+	}
+	if(pthread_attr_getstack(&attr, &addr, &size) == 0){
+		/* the stack grows down from addr + size */
+		avail = (size_t)(&here - (char *)addr);
+		avail = avail > RT_STACK_MARGIN ? avail - RT_STACK_MARGIN : 0;
+	}
+	pthread_attr_destroy(&attr);
+
+	if(len > avail){
+		if(debug){
+			printf("rpi_rt_apply(): prefault clamped from %zu to %zu bytes\n", len, avail);
+		}
+		len = avail;
+	}
+
+	return len;
+}
+
+uint8_t rpi_rt_profile(const rt_profile_t *profile){
+	uint8_t flags = 0;
+
+	pthread_mutex_lock(&rt_lock);
+
+	rt_profile = *profile;
+
+	if(rt_profile.cpu == RT_CPU_ISOLATED){
+		rt_profile.cpu = rt_isolated_cpu();
+		if(rt_profile.cpu < 0 && debug){
+			puts("rpi_rt_profile(): no isolated cpu found.");
+		}
+	}
+
+	rt_status.flags = 0;
+	rt_status.priority = 0;
+	rt_status.cpu = -1;
+	rt_status.error = 0;
+
+	if(rt_profile.mlock){
+		if(mlockall(MCL_CURRENT|MCL_FUTURE) == 0){
+			rt_status.flags |= RT_MLOCK;
+			rt_locked = 1;
+		}
+		else{
+			rt_status.error = errno;
+			if(debug) perror("rpi_rt_profile mlockall");
+		}
+	}
+	else if(rt_locked){
+		munlockall();
+		rt_locked = 0;
+	}
+
+	flags = rt_status.flags;
+
+	pthread_mutex_unlock(&rt_lock);
+
+	return flags;
+}
+
+uint8_t rpi_rt_apply(){
+	rt_profile_t p;
+	uint8_t flags = 0;
+	int32_t priority = 0, cpu = -1, error = 0, affinity_error = 0, sched_error = 0;
+
+	pthread_mutex_lock(&rt_lock);
+	p = rt_profile;
+	pthread_mutex_unlock(&rt_lock);
+
+	if(p.cpu >= 0){
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		CPU_SET(p.cpu, &set);
+		if((affinity_error = pthread_setaffinity_np(pthread_self(), sizeof(set), &set)) == 0){
+			flags |= RT_AFFINITY;
+			cpu = p.cpu;
+		}
+		else if(debug){
+			printf("rpi_rt_apply(): cpu %d affinity error %d\n", p.cpu, affinity_error);
+		}
+	}
+
+	if(p.priority > 0){
+		struct sched_param param;
+		memset(&param, 0, sizeof(param));
+		param.sched_priority = p.priority;
+		/* EPERM w/o root or CAP_SYS_NICE, the thread keeps the default scheduler */
+		if((sched_error = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param)) == 0){
+			flags |= RT_SCHED_FIFO;
+			priority = p.priority;
+		}
+		else if(debug){
+			printf("rpi_rt_apply(): SCHED_FIFO priority %d error %d\n", p.priority, sched_error);
+		}
+	}
+
+	/* report the first setting that failed */
+	error = affinity_error ? affinity_error : sched_error;
+
+	if(p.prefault){
+		size_t len = rt_stack_avail(p.prefault);
+		if(len){
+			/* touch the stack pages now so the thread does not page fault later */
+			volatile char *stack = alloca(len);
+			size_t i;
+			for(i = 0; i < len; i += 4096){
+				stack[i] = 0;
+			}
+			stack[len - 1] = 0;
+			flags |= RT_PREFAULT;
+		}
+	}
+
+	rt_spin = p.spin;
+	if(p.spin){
+		flags |= RT_SPIN;
+	}
+
+	pthread_mutex_lock(&rt_lock);
+	rt_status.flags = (rt_status.flags & RT_MLOCK) | flags;
+	rt_status.priority = priority;
+	rt_status.cpu = cpu;
+	if(error){
+		rt_status.error = error;
+	}
+	flags = rt_status.flags;
+	pthread_mutex_unlock(&rt_lock);
+
+	return flags;
+}
+
+void rpi_rt_status(rt_status_t *status){
+	pthread_mutex_lock(&rt_lock);
+	*status = rt_status;
+	pthread_mutex_unlock(&rt_lock);
+}
+
+void rt_prefault(void *buf, size_t len){
+	volatile char *p = buf;
+	size_t i;
+
+	if(buf == NULL || len == 0){
+		return;
+	}
+
+	for(i = 0; i < len; i += 4096){
+		p[i] = p[i];
+	}
+
+	if(rt_profile.mlock){
+		mlock(buf, len);
+	}
+}
+
+uint8_t rt_spin_only(){
+	return rt_spin;
+}
+
+void rt_spin_ns(uint64_t ns){
+	struct timespec ts;
+	uint64_t end;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	end = (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec + ns;
+
+	do {
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+	} while((uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec < end);
+}
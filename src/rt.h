@@ -0,0 +1,71 @@
+/**
+ * rt.h
+ *
+ * Copyright (c) 2017 Ed Alegrid <ealegrid@gmail.com>
+ * GNU General Public License v3.0
+ *
+ */
+
+/* Real-time execution profile for native engine threads */
+#ifndef RT_H
+#define RT_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* cpu value to pick the first isolated core (isolcpus=) */
+#define RT_CPU_ISOLATED		-2
+
+/* Bit flags of the settings actually applied */
+#define RT_SCHED_FIFO		0x01
+#define RT_AFFINITY		0x02
+#define RT_MLOCK		0x04
+#define RT_PREFAULT		0x08
+#define RT_SPIN			0x10
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+	int32_t priority;	// SCHED_FIFO priority 1 ~ 99, 0 = default scheduler
+	int32_t cpu;		// cpu affinity, -1 = any cpu, RT_CPU_ISOLATED = first isolated cpu
+	uint8_t mlock;		// lock all current and future pages in memory
+	uint32_t prefault;	// no. of stack bytes to pre-fault in each engine thread
+	uint8_t spin;		// engine threads busy-wait instead of sleeping
+} rt_profile_t;
+
+typedef struct {
+	uint8_t flags;		// RT_xxx flags applied to the process and the last engine thread
+	int32_t priority;	// priority applied, 0 if not applied
+	int32_t cpu;		// cpu applied, -1 if not applied
+	int32_t error;		// errno of the last setting that could not be applied
+} rt_status_t;
+
+/* Set the profile used by all engine threads started after this call,
+ * mlock is applied to the whole process immediately. Returns the applied RT_xxx flags.
+ */
+uint8_t rpi_rt_profile(const rt_profile_t *profile);
+
+/* Apply the profile to the calling thread, engine threads call this on start.
+ * Missing privileges are skipped, returns the applied RT_xxx flags.
+ */
+uint8_t rpi_rt_apply();
+
+/* Get the settings actually applied */
+void rpi_rt_status(rt_status_t *status);
+
+/* Touch (and lock if mlock is set) each page of a buffer used by an engine thread */
+void rt_prefault(void *buf, size_t len);
+
+/* Non-zero if the calling thread uses the spin-only mode */
+uint8_t rt_spin_only();
+
+/* Busy-wait for ns nanoseconds */
+void rt_spin_ns(uint64_t ns);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* RT_H */
@@ -0,0 +1,196 @@
+/**
+ * sampler.c
+ *
+ * Copyright (c) 2017 Ed Alegrid <ealegrid@gmail.com>
+ * GNU General Public License v3.0
+ *
+ */
+
+#define  _DEFAULT_SOURCE	// for nanosleep()
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "rpi.h"
+#include "rt.h"
+#include "sampler.h"
+
+/* The thread sleeps until this long before a sample is due, then spins on the system timer */
+#define SAMPLER_SPIN_NS		100000
+
+static sampler_hdr_t *sampler_hdr = NULL;
+static sampler_rec_t *sampler_rec = NULL;
+static sampler_cfg_t sampler_cfg;
+static volatile uint8_t sampler_run = 0;
+
+static pthread_t sampler_thread;
+
+/* 64-bit system timer time in ns, extends the 32-bit counter on each wrap */
+static uint64_t sampler_now_ns(){
+	static uint32_t last = 0;
+	static uint64_t hi = 0;
+	uint32_t t = st_read();
+
+	if(t < last){
+		hi += 1ULL << 32;
+	}
+	last = t;
+	return (hi | t) * 1000;
+}
+
+/* Wait until the system timer reaches t (ns), returns the current time */
+static uint64_t sampler_wait(uint64_t t){
+	struct timespec ts;
+	uint64_t now = sampler_now_ns();
+
+	if(t > now + SAMPLER_SPIN_NS && !rt_spin_only()){
+		ts.tv_sec = (t - now - SAMPLER_SPIN_NS/2) / 1000000000ULL;
+		ts.tv_nsec = (t - now - SAMPLER_SPIN_NS/2) % 1000000000ULL;
+		nanosleep(&ts, NULL);
+	}
+	while((now = sampler_now_ns()) < t){
+		;
+	}
+	return now;
+}
+
+static void *sampler_worker(void *p){
+	sampler_cfg_t *c = &sampler_cfg;
+	sampler_rec_t *r;
+	char rx[SAMPLER_CMD_MAX];
+	uint64_t start, now, next, v, period = 1000000000ULL / c->rate;
+	uint32_t n = 0, i = 0, k, head = 0, missed, ts;
+
+	rpi_rt_apply();
+	rt_prefault(sampler_hdr, sizeof(sampler_hdr_t) + sampler_hdr->capacity * sizeof(sampler_rec_t));
+
+	/* sample n is due at start + n/rate s, start moves by 1 s every rate samples */
+	start = sampler_now_ns();
+
+	while(sampler_run){
+		next = start + (uint64_t)n * 1000000000ULL / c->rate;
+		now = sampler_wait(next);
+
+		/* skip the periods missed, the channel sequence continues where it was */
+		if(now - next >= period){
+			missed = (now - next) / period;
+			__atomic_store_n(&sampler_hdr->late, sampler_hdr->late + missed, __ATOMIC_RELAXED);
+			n += missed;
+		}
+
+		spi_lock();
+		if(spi_dev_select(c->dev) != 0){
+			spi_unlock();
+			__atomic_or_fetch(&sampler_hdr->flags, SAMPLER_ERROR, __ATOMIC_RELEASE);
+			break;
+		}
+		ts = st_read();
+		if(spi_transfer(c->cmd[i], rx, c->cmd_len) != 0){
+			spi_unlock();
+			__atomic_or_fetch(&sampler_hdr->flags, SAMPLER_ERROR, __ATOMIC_RELEASE);
+			break;
+		}
+		spi_unlock();
+
+		v = 0;
+		for(k = 0; k < c->cmd_len; k++){
+			v = (v << 8) | (uint8_t)rx[k];
+		}
+
+		/* the reader owns the tail, a full ring drops the sample */
+		if(head - __atomic_load_n(&sampler_hdr->tail, __ATOMIC_ACQUIRE) >= sampler_hdr->capacity){
+			__atomic_store_n(&sampler_hdr->overruns, sampler_hdr->overruns + 1, __ATOMIC_RELAXED);
+		}
+		else{
+			r = &sampler_rec[head & (sampler_hdr->capacity - 1)];
+			r->ts = ts;
+			r->value = (v >> c->shift) & c->mask;
+			r->ch = c->ch[i];
+			r->index = i;
+			head++;
+			__atomic_store_n(&sampler_hdr->head, head, __ATOMIC_RELEASE);
+		}
+		__atomic_store_n(&sampler_hdr->count, sampler_hdr->count + 1, __ATOMIC_RELAXED);
+
+		if(++i == c->nch){
+			i = 0;
+		}
+		for(n++; n >= c->rate; n -= c->rate){
+			start += 1000000000ULL;
+		}
+	}
+
+	__atomic_and_fetch(&sampler_hdr->flags, ~SAMPLER_RUNNING, __ATOMIC_RELEASE);
+
+	return NULL;
+}
+
+uint8_t rpi_sampler_start(void *mem, size_t size, uint32_t capacity, const sampler_cfg_t *cfg){
+	if(sampler_run){
+		printf("%s() error: ", __func__);
+		puts("sampler is already running");
+		return 1;
+	}
+
+	if(mem == NULL || ((uintptr_t)mem & 7) || capacity == 0 || (capacity & (capacity - 1)) ||
+		size < sizeof(sampler_hdr_t) + (size_t)capacity * sizeof(sampler_rec_t)){
+		printf("%s() error: ", __func__);
+		puts("invalid sampler memory size");
+		return 1;
+	}
+
+	if(cfg->nch == 0 || cfg->nch > SAMPLER_SEQ_MAX || cfg->cmd_len == 0 || cfg->cmd_len > SAMPLER_CMD_MAX ||
+		cfg->rate == 0 || cfg->rate > SAMPLER_RATE_MAX || cfg->shift > 63 || cfg->mask > 0xffff){
+		printf("%s() error: ", __func__);
+		puts("invalid sampler configuration");
+		return 1;
+	}
+
+	/* CLOCK_MONOTONIC is used w/o root access */
+	st_map();
+
+	sampler_cfg = *cfg;
+
+	memset(mem, 0, sizeof(sampler_hdr_t) + (size_t)capacity * sizeof(sampler_rec_t));
+	sampler_hdr = mem;
+	sampler_hdr->magic = SAMPLER_MAGIC;
+	sampler_hdr->version = SAMPLER_VERSION;
+	sampler_hdr->capacity = capacity;
+	sampler_hdr->nch = cfg->nch;
+	sampler_hdr->rate = cfg->rate;
+	sampler_hdr->flags = SAMPLER_RUNNING;
+	sampler_rec = (sampler_rec_t *)(sampler_hdr + 1);
+
+	sampler_run = 1;
+
+	if(pthread_create(&sampler_thread, NULL, sampler_worker, NULL) != 0){
+		perror("rpi_sampler_start pthread_create");
+		sampler_run = 0;
+		sampler_hdr->flags = 0;
+		sampler_hdr = NULL;
+		sampler_rec = NULL;
+		return 1;
+	}
+
+	return 0;
+}
+
+void rpi_sampler_stop(){
+	if(!sampler_run){
+		return;
+	}
+
+	sampler_run = 0;
+	pthread_join(sampler_thread, NULL);
+
+	sampler_hdr = NULL;
+	sampler_rec = NULL;
+}
+
+uint8_t rpi_sampler_running(){
+	return sampler_run;
+}
@@ -0,0 +1,86 @@
+/**
+ * sampler.h
+ *
+ * Copyright (c) 2017 Ed Alegrid <ealegrid@gmail.com>
+ * GNU General Public License v3.0
+ *
+ */
+
+/* Continuous spi adc sampling engine */
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define SAMPLER_MAGIC		0x53504741	// 'AGPS'
+#define SAMPLER_VERSION		1
+
+/* Max. no. of command bytes of a sample and max. length of the channel sequence */
+#define SAMPLER_CMD_MAX		8
+#define SAMPLER_SEQ_MAX		32
+
+/* Max. sample rate, limited by the 1 MHz system timer */
+#define SAMPLER_RATE_MAX	1000000
+
+/* Header flags */
+#define SAMPLER_RUNNING		0x01
+#define SAMPLER_ERROR		0x02		// the spi device was closed or a transfer timed out, sampling has stopped
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Shared memory layout: header | rec[capacity], a single-producer/single-consumer ring */
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t capacity;	// no. of records, power of 2
+	uint32_t nch;		// length of the channel sequence
+	uint32_t head;		// records written, written by the sampling thread
+	uint32_t tail;		// records consumed, written by the reader
+	uint32_t count;		// no. of samples taken (wraps)
+	uint32_t overruns;	// no. of samples dropped because the ring was full
+	uint32_t late;		// no. of sample periods missed because the thread was late
+	uint32_t rate;		// sample rate (samples per second)
+	uint32_t flags;
+	uint32_t reserved[5];
+} sampler_hdr_t;
+
+typedef struct {
+	uint32_t ts;		// system timer (us) at the start of the transfer
+	uint16_t value;
+	uint8_t ch;		// channel no. of the sequence entry
+	uint8_t index;		// index in the channel sequence
+} sampler_rec_t;
+
+typedef struct {
+	int32_t dev;				// spi device context (spi_dev_open())
+	uint8_t cmd_len;			// no. of bytes transferred per sample
+	uint8_t nch;				// length of the channel sequence
+	uint8_t ch[SAMPLER_SEQ_MAX];		// channel no. of each sequence entry
+	char cmd[SAMPLER_SEQ_MAX][SAMPLER_CMD_MAX];	// command bytes of each sequence entry
+	uint32_t mask;				// value = (received bytes as big-endian no. >> shift) & mask, max. 0xffff
+	uint8_t shift;
+	uint32_t rate;				// samples per second, 1 ~ SAMPLER_RATE_MAX
+} sampler_cfg_t;
+
+/* Start the sampling thread writing into a shared memory ring of capacity records after the header,
+ * the sequence entries are sampled round-robin, one every 1/rate s timed against the system timer.
+ * returns 0 on success, 1 on error
+ */
+uint8_t rpi_sampler_start(void *mem, size_t size, uint32_t capacity, const sampler_cfg_t *cfg);
+
+/* Stop and join the sampling thread, the ring keeps the samples not read yet */
+void rpi_sampler_stop();
+
+/* Non-zero while the sampling thread runs, spi_write()/spi_read() pairs are refused meanwhile
+ * since the sampler could run between them while the transfer is still active
+ */
+uint8_t rpi_sampler_running();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SAMPLER_H */
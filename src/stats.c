@@ -0,0 +1,184 @@
+/**
+ * stats.c
+ *
+ * Copyright (c) 2017 Ed Alegrid <ealegrid@gmail.com>
+ * GNU General Public License v3.0
+ *
+ */
+
+#define  _DEFAULT_SOURCE	// for syscall()
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "stats.h"
+
+/* Process local counter storage, used until rpi_stats_export() is called */
+static stats_region_t stats_local = { STATS_MAGIC, STATS_VERSION, STATS_MAX_THREADS, STAT_SUBSYS, STAT_COUNTERS, { 0 }, { { 0 } } };
+
+#if RPI_STATS
+
+/* Exported shared memory object name */
+static char stats_shm_name[64] = "";
+
+stats_region_t * volatile stats_region = &stats_local;
+
+/* Counter slot of the calling thread, -1 until its first count */
+__thread int stats_index = -1;
+
+/* Subsystem charged by the generic register helpers */
+__thread uint8_t stats_cur = STAT_GPIO;
+
+/* Releases the slot of an exiting thread, the engine threads come and go w/ each start and stop */
+static pthread_key_t stats_key;
+static pthread_once_t stats_key_once = PTHREAD_ONCE_INIT;
+
+static void stats_release(void *p){
+	int i = (int)(intptr_t)p - 1;
+
+	stats_index = -1;
+	if(i >= 0 && i < STATS_SHARED_SLOT){
+		__atomic_store_n(&stats_region->slot[i].tid, 0, __ATOMIC_RELEASE);
+	}
+}
+
+static void stats_key_create(){
+	pthread_key_create(&stats_key, stats_release);
+}
+
+/* Claim a free counter slot for the calling thread (internal use only).
+ * A reused slot keeps the counts of its previous owner, so the sums do not change.
+ */
+int stats_claim(){
+	uint32_t tid = (uint32_t)syscall(SYS_gettid);
+	uint32_t free;
+	int i;
+
+	pthread_once(&stats_key_once, stats_key_create);
+
+	for(i = 0; i < STATS_SHARED_SLOT; i++){
+		free = 0;
+		if(__atomic_compare_exchange_n(&stats_region->slot[i].tid, &free, tid, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)){
+			break;
+		}
+	}
+
+	/* out of slots, share the last one */
+	stats_region->slot[i].used = 1;
+	stats_index = i;
+	pthread_setspecific(stats_key, (void *)(intptr_t)(i + 1));
+
+	return i;
+}
+
+#endif /* RPI_STATS */
+
+static stats_region_t *stats_storage(){
+#if RPI_STATS
+	return stats_region;
+#else
+	return &stats_local;
+#endif
+}
+
+/* Sum all thread slots */
+uint32_t rpi_stats(uint64_t *out, uint32_t len){
+	stats_region_t *r = stats_storage();
+	uint32_t i, s, k, n = 0;
+
+	if(len > STAT_SUBSYS * STAT_COUNTERS){
+		len = STAT_SUBSYS * STAT_COUNTERS;
+	}
+
+	memset(out, 0, len * sizeof(uint64_t));
+
+	for(i = 0; i < STATS_MAX_THREADS; i++){
+		if(!r->slot[i].used){
+			continue;
+		}
+		for(s = 0, n = 0; s < STAT_SUBSYS; s++){
+			for(k = 0; k < STAT_COUNTERS && n < len; k++, n++){
+				out[n] += __atomic_load_n(&r->slot[i].c[s][k], __ATOMIC_RELAXED);
+			}
+		}
+	}
+
+	return len;
+}
+
+void rpi_stats_reset(){
+	stats_region_t *r = stats_storage();
+	uint32_t i;
+
+	for(i = 0; i < STATS_MAX_THREADS; i++){
+		memset(r->slot[i].c, 0, sizeof(r->slot[i].c));
+	}
+}
+
+/* Export the counters through a shared memory object
+ *
+ * The hot path is not changed, each thread keeps updating its own slot and an external sampler
+ * maps the object read-only (e.g. /dev/shm/array-gpio-stats) and sums the used slots.
+ */
+uint8_t rpi_stats_export(const char *name){
+#if RPI_STATS
+	stats_region_t *r = NULL;
+	int fd;
+
+	/* back to process memory */
+	if(name == NULL || name[0] == 0){
+		if(stats_region == &stats_local){
+			return 0;
+		}
+		r = stats_region;
+		memcpy(&stats_local, r, sizeof(stats_region_t));
+		__atomic_store_n(&stats_region, &stats_local, __ATOMIC_RELEASE);
+		/* other threads may still be counting into the old region, the mapping is
+		 * left in place (only the name is removed) so those late writes stay harmless */
+		shm_unlink(stats_shm_name);
+		stats_shm_name[0] = 0;
+		return 0;
+	}
+
+	if(stats_region != &stats_local){
+		printf("%s() error: ", __func__);
+		printf("Counters are already exported in %s\n", stats_shm_name);
+		return 1;
+	}
+
+	if((fd = shm_open(name, O_CREAT|O_RDWR, 0644)) < 0){
+		perror("rpi_stats_export shm_open");
+		return 1;
+	}
+
+	if(ftruncate(fd, sizeof(stats_region_t)) < 0){
+		perror("rpi_stats_export ftruncate");
+		close(fd);
+		return 1;
+	}
+
+	r = mmap(NULL, sizeof(stats_region_t), PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if(r == MAP_FAILED){
+		perror("rpi_stats_export mmap");
+		return 1;
+	}
+
+	memcpy(r, &stats_local, sizeof(stats_region_t));
+	strncpy(stats_shm_name, name, sizeof(stats_shm_name) - 1);
+	__atomic_store_n(&stats_region, r, __ATOMIC_RELEASE);
+
+	return 0;
+#else
+	printf("%s() error: ", __func__);
+	puts("array-gpio was built w/o RPI_STATS counters.");
+	return 1;
+#endif
+}
@@ -0,0 +1,143 @@
+/**
+ * stats.h
+ *
+ * Copyright (c) 2017 Ed Alegrid <ealegrid@gmail.com>
+ * GNU General Public License v3.0
+ *
+ */
+
+/* Hot-path instrumentation counters */
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+#include <time.h>
+
+/* Set RPI_STATS to 0 (e.g. node-gyp rebuild --rpi_stats=0) to compile out all counters */
+#ifndef RPI_STATS
+#define RPI_STATS 1
+#endif
+
+/* Max. number of counter slots, the last one is shared by the threads that find no free slot */
+#define STATS_MAX_THREADS	16
+#define STATS_SHARED_SLOT	(STATS_MAX_THREADS - 1)
+
+/* Shared memory region identification for external samplers */
+#define STATS_MAGIC		0x54534741	// 'AGST'
+#define STATS_VERSION		1
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Subsystems */
+enum {
+	STAT_GPIO = 0,
+	STAT_PWM,
+	STAT_I2C,
+	STAT_SPI,
+	STAT_TIMER,
+	STAT_SUBSYS		// number of subsystems
+};
+
+/* Counters for each subsystem */
+enum {
+	STAT_OPS = 0,		// api calls
+	STAT_REG_WRITES,	// register writes
+	STAT_REG_READS,		// register reads
+	STAT_POLLS,		// status polls inside busy-wait loops
+	STAT_ERRORS,		// transfer/parameter errors
+	STAT_BYTES,		// data bytes moved through a FIFO
+	STAT_SPIN_NS,		// time spent busy-waiting
+	STAT_WAIT_NS,		// time spent sleeping
+	STAT_COUNTERS		// number of counters
+};
+
+/* One counter block per thread, only the owner thread writes into it (except the shared slot).
+ * tid is 0 while the slot is free, a slot is released when its thread exits and keeps its counts.
+ */
+typedef struct {
+	uint32_t tid;
+	uint32_t used;
+	uint64_t c[STAT_SUBSYS][STAT_COUNTERS];
+} stats_slot_t;
+
+/* Counter storage, either process local or a shared memory object (see rpi_stats_export()) */
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t slots;
+	uint32_t subsys;
+	uint32_t counters;
+	uint32_t reserved[3];
+	stats_slot_t slot[STATS_MAX_THREADS];
+} stats_region_t;
+
+/* Copy the sum of all thread slots into out[STAT_SUBSYS * STAT_COUNTERS], returns no. of values */
+uint32_t rpi_stats(uint64_t *out, uint32_t len);
+
+/* Reset all counters to 0 */
+void rpi_stats_reset();
+
+/* Move the counters into a POSIX shared memory object (e.g. "/array-gpio-stats"),
+ * name = NULL moves them back to process memory and removes the object.
+ * returns 0 on success, 1 on failure
+ */
+uint8_t rpi_stats_export(const char *name);
+
+#if RPI_STATS
+
+extern stats_region_t * volatile stats_region;
+extern __thread int stats_index;
+extern __thread uint8_t stats_cur;
+
+int stats_claim();
+
+/* Monotonic time stamp in nanoseconds */
+static inline uint64_t stats_now_ns(){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Single writer per slot, a relaxed store is enough for an external reader.
+ * The shared overflow slot has several writers and needs an atomic add.
+ */
+static inline void stats_add(uint8_t s, uint8_t k, uint64_t n){
+	if(stats_index < 0){
+		stats_claim();
+	}
+	uint64_t *p = &stats_region->slot[stats_index].c[s][k];
+	if(stats_index == STATS_SHARED_SLOT){
+		__atomic_fetch_add(p, n, __ATOMIC_RELAXED);
+	}
+	else{
+		__atomic_store_n(p, *p + n, __ATOMIC_RELAXED);
+	}
+}
+
+/* Counts an api call and makes s the current subsystem of the calling thread */
+#define STAT_ENTER(s)		(stats_cur = (s), stats_add((s), STAT_OPS, 1))
+#define STAT_ADD(s, k, n)	stats_add((s), (k), (n))
+#define STAT_INC(s, k)		stats_add((s), (k), 1)
+/* Counts under the current subsystem, used by the generic register helpers */
+#define STAT_CUR(k)		stats_add(stats_cur, (k), 1)
+#define STAT_TIME_BEGIN(t)	uint64_t t = stats_now_ns()
+#define STAT_TIME_END(s, k, t)	stats_add((s), (k), stats_now_ns() - (t))
+
+#else
+
+#define STAT_ENTER(s)		((void)0)
+#define STAT_ADD(s, k, n)	((void)(n))
+#define STAT_INC(s, k)		((void)0)
+#define STAT_CUR(k)		((void)0)
+#define STAT_TIME_BEGIN(t)	((void)0)
+#define STAT_TIME_END(s, k, t)	((void)0)
+
+#endif /* RPI_STATS */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* STATS_H */
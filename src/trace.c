@@ -0,0 +1,324 @@
+/**
+ * trace.c
+ *
+ * Copyright (c) 2017 Ed Alegrid <ealegrid@gmail.com>
+ * GNU General Public License v3.0
+ *
+ */
+
+#define  _DEFAULT_SOURCE	// for syscall()
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+
+#include "trace.h"
+
+/* Mapped peripheral base pointers from rpi.c, used to decode register addresses */
+extern volatile uint32_t *base_pointer[10];
+
+#if RPI_TRACE
+
+/* Each thread owns one ring, only the owner thread writes into it (single producer).
+ * The ring of an exited thread is kept for the dump until a new thread reuses it.
+ */
+typedef struct {
+	uint32_t tid;
+	uint32_t owned;		// 0 after the owner thread has exited
+	uint32_t mask;		// size - 1
+	uint64_t head;		// total no. of records written
+	trace_rec_t rec[];
+} trace_ring_t;
+
+volatile uint8_t trace_on = 0;
+
+static trace_ring_t *trace_ring[TRACE_MAX_THREADS] = {};
+static uint32_t trace_size = TRACE_DEFAULT_SIZE;
+
+/* changes w/ each rpi_trace_start(), the threads then claim a ring of the new size */
+static uint32_t trace_gen = 1;
+
+/* no. of threads not traced because all rings were owned */
+static uint32_t trace_dropped = 0;
+
+/* Serializes claiming and freeing rings against the dump, the records are written w/o it */
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static pthread_key_t trace_key;
+static pthread_once_t trace_key_once = PTHREAD_ONCE_INIT;
+
+static __thread trace_ring_t *trace_self = NULL;
+static __thread uint32_t trace_self_gen = 0;
+
+/* Releases the ring of an exiting thread */
+static void trace_release(void *p){
+	trace_ring_t *r = p;
+
+	__atomic_store_n(&r->owned, 0, __ATOMIC_RELEASE);
+	trace_self = NULL;
+}
+
+static void trace_key_create(){
+	pthread_key_create(&trace_key, trace_release);
+}
+
+/* Get a ring of the current size for the calling thread, own is its current ring (or NULL).
+ * An unused index is taken first, else a released ring is reused. Returns NULL if all rings are owned or out of memory.
+ */
+static trace_ring_t *trace_claim(trace_ring_t *own){
+	uint32_t i, k = TRACE_MAX_THREADS, size;
+	trace_ring_t *r = NULL;
+
+	pthread_once(&trace_key_once, trace_key_create);
+	pthread_mutex_lock(&trace_lock);
+
+	size = trace_size;
+	if(own && own->mask + 1 == size){
+		pthread_mutex_unlock(&trace_lock);
+		return own;
+	}
+	if(own){
+		__atomic_store_n(&own->owned, 0, __ATOMIC_RELEASE);
+	}
+
+	for(i = 0; i < TRACE_MAX_THREADS; i++){
+		r = trace_ring[i];
+		if(r == NULL){
+			k = i;
+			break;
+		}
+		if(!__atomic_load_n(&r->owned, __ATOMIC_ACQUIRE) && k == TRACE_MAX_THREADS){
+			k = i;
+		}
+	}
+
+	r = NULL;
+	if(k == TRACE_MAX_THREADS){
+		/* once per thread and rpi_trace_start(), see trace_record() */
+		trace_dropped++;
+	}
+	else if(trace_ring[k] && trace_ring[k]->mask + 1 == size){
+		r = trace_ring[k];
+	}
+	else{
+		free(trace_ring[k]);
+		trace_ring[k] = NULL;
+		r = malloc(sizeof(trace_ring_t) + size * sizeof(trace_rec_t));
+		if(r){
+			r->mask = size - 1;
+		}
+	}
+
+	if(r){
+		r->tid = (uint32_t)syscall(SYS_gettid);
+		r->owned = 1;
+		r->head = 0;
+		__atomic_store_n(&trace_ring[k], r, __ATOMIC_RELEASE);
+	}
+
+	pthread_mutex_unlock(&trace_lock);
+	pthread_setspecific(trace_key, r);
+
+	return r;
+}
+
+void trace_record(uint8_t type, uint8_t cat, const char *name, volatile uint32_t *reg, uint32_t value, uint64_t ts, uint64_t dur){
+	trace_ring_t *r = trace_self;
+	trace_rec_t *p = NULL;
+	uint32_t gen = __atomic_load_n(&trace_gen, __ATOMIC_RELAXED);
+
+	if(r == NULL || trace_self_gen != gen){
+		/* a thread w/o a ring retries after the next rpi_trace_start() */
+		if(r == NULL && trace_self_gen == gen){
+			return;
+		}
+		r = trace_self = trace_claim(r);
+		trace_self_gen = gen;
+		if(r == NULL){
+			return;
+		}
+	}
+
+	/* oldest record is overwritten when the ring is full */
+	p = &r->rec[r->head & r->mask];
+	p->ts = ts;
+	p->name = name;
+	p->addr = (uintptr_t)reg;
+	p->value = value;
+	p->dur = dur > UINT32_MAX ? UINT32_MAX : (uint32_t)dur;
+	p->type = type;
+	p->cat = cat;
+
+	__atomic_store_n(&r->head, r->head + 1, __ATOMIC_RELEASE);
+}
+
+#endif /* RPI_TRACE */
+
+void rpi_trace_start(uint32_t size){
+#if RPI_TRACE
+	uint32_t n = 1;
+
+	if(size == 0){
+		size = TRACE_DEFAULT_SIZE;
+	}
+	while(n < size){
+		n <<= 1;
+	}
+
+	/* each thread moves to a ring of the new size w/ its next record */
+	pthread_mutex_lock(&trace_lock);
+	trace_size = n;
+	trace_dropped = 0;
+	__atomic_add_fetch(&trace_gen, 1, __ATOMIC_RELAXED);
+	pthread_mutex_unlock(&trace_lock);
+	trace_on = 1;
+#else
+	printf("%s() error: ", __func__);
+	puts("array-gpio was built w/o RPI_TRACE trace points.");
+#endif
+}
+
+void rpi_trace_stop(){
+#if RPI_TRACE
+	trace_on = 0;
+#endif
+}
+
+/* The rings of exited threads are freed */
+void rpi_trace_clear(){
+#if RPI_TRACE
+	uint32_t i;
+
+	pthread_mutex_lock(&trace_lock);
+	for(i = 0; i < TRACE_MAX_THREADS; i++){
+		trace_ring_t *r = trace_ring[i];
+		if(r && !__atomic_load_n(&r->owned, __ATOMIC_ACQUIRE)){
+			trace_ring[i] = NULL;
+			free(r);
+		}
+		else if(r){
+			__atomic_store_n(&r->head, 0, __ATOMIC_RELEASE);
+		}
+	}
+	trace_dropped = 0;
+	pthread_mutex_unlock(&trace_lock);
+#endif
+}
+
+#if RPI_TRACE
+
+static const char *trace_cat[] = { "gpio", "pwm", "i2c", "spi", "timer" };
+
+/* Peripheral names of each base_pointer[] index */
+static const char *trace_peri[] = { "st", "clk", "gpio", "pwm", "spi", "bsc1", "bsc0", "st", "aux", "p9" };
+
+/* Decode a register address into peripheral name + offset */
+static void trace_reg_name(uintptr_t addr, char *buf, size_t len){
+	uint8_t i;
+
+	for(i = 0; i < 10; i++){
+		uintptr_t base = (uintptr_t)base_pointer[i];
+		if(base && addr >= base && addr < base + 4096){
+			snprintf(buf, len, "%s+0x%02x", trace_peri[i], (unsigned)(addr - base));
+			return;
+		}
+	}
+	snprintf(buf, len, "0x%lx", (unsigned long)addr);
+}
+
+static void trace_write_rec(FILE *fp, int pid, uint32_t tid, trace_rec_t *p){
+	char reg[32];
+	double ts = p->ts / 1000.0;	// chrome trace time stamps are in microseconds
+
+	fputs(",\n", fp);
+
+	switch(p->type){
+		case TRACE_REG_WRITE:
+			trace_reg_name(p->addr, reg, sizeof(reg));
+			fprintf(fp, "{\"name\":\"%s\",\"cat\":\"reg\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f,\"pid\":%d,\"tid\":%u,"
+				"\"args\":{\"value\":\"0x%08x\"}}", reg, ts, pid, tid, p->value);
+			break;
+		case TRACE_POLL:
+			trace_reg_name(p->addr, reg, sizeof(reg));
+			fprintf(fp, "{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%u,"
+				"\"args\":{\"reg\":\"%s\",\"polls\":%u}}", p->name, trace_cat[p->cat], ts, p->dur / 1000.0, pid, tid, reg, p->value);
+			break;
+		case TRACE_WAIT:
+			fprintf(fp, "{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%u}",
+				p->name, trace_cat[p->cat], ts, p->dur / 1000.0, pid, tid);
+			break;
+		default:
+			fprintf(fp, "{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"%s\",\"ts\":%.3f,\"pid\":%d,\"tid\":%u}",
+				p->name, trace_cat[p->cat], p->type == TRACE_BEGIN ? "B" : "E", ts, pid, tid);
+			break;
+	}
+}
+
+#endif /* RPI_TRACE */
+
+/* Dump all thread rings using the Chrome trace event format
+ * (open the file with chrome://tracing or https://ui.perfetto.dev)
+ *
+ * Recording is paused during the dump so the rings are not overwritten.
+ * otherData.droppedThreads is the no. of threads not traced because all rings were owned.
+ */
+int32_t rpi_trace_dump(const char *path){
+#if RPI_TRACE
+	FILE *fp = NULL;
+	uint8_t on = trace_on;
+	int32_t n = 0;
+	int pid = getpid();
+	uint32_t i;
+	uint64_t j, head, start;
+
+	if((fp = fopen(path, "w")) == NULL){
+		perror("rpi_trace_dump fopen");
+		return -1;
+	}
+
+	trace_on = 0;
+	__sync_synchronize();
+	pthread_mutex_lock(&trace_lock);
+
+	fprintf(fp, "{\"displayTimeUnit\":\"ns\",\"otherData\":{\"droppedThreads\":%u},\"traceEvents\":[\n", trace_dropped);
+
+	for(i = 0; i < TRACE_MAX_THREADS; i++){
+		trace_ring_t *r = trace_ring[i];
+		if(r == NULL){
+			continue;
+		}
+
+		fprintf(fp, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%u,\"args\":{\"name\":\"array-gpio %u\"}}",
+			n ? ",\n" : "", pid, r->tid, r->tid);
+		n++;
+
+		head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+		start = head > (uint64_t)r->mask + 1 ? head - r->mask - 1 : 0;
+
+		for(j = start; j < head; j++){
+			trace_write_rec(fp, pid, r->tid, &r->rec[j & r->mask]);
+			n++;
+		}
+	}
+
+	fputs("\n]}\n", fp);
+
+	pthread_mutex_unlock(&trace_lock);
+	trace_on = on;
+
+	if(fclose(fp) != 0){
+		perror("rpi_trace_dump fclose");
+		return -1;
+	}
+
+	return n;
+#else
+	printf("%s() error: ", __func__);
+	puts("array-gpio was built w/o RPI_TRACE trace points.");
+	return -1;
+#endif
+}
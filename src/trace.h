@@ -0,0 +1,115 @@
+/**
+ * trace.h
+ *
+ * Copyright (c) 2017 Ed Alegrid <ealegrid@gmail.com>
+ * GNU General Public License v3.0
+ *
+ */
+
+/* Register-level trace ring buffer */
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include <time.h>
+
+/* Set RPI_TRACE to 0 (e.g. node-gyp rebuild --rpi_trace=0) to compile out all trace points */
+#ifndef RPI_TRACE
+#define RPI_TRACE 1
+#endif
+
+/* Max. number of trace rings, the ring of an exited thread is reused by a new thread */
+#define TRACE_MAX_THREADS	16
+
+/* Default no. of records per thread ring (rounded up to a power of 2) */
+#define TRACE_DEFAULT_SIZE	16384
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Record types */
+enum {
+	TRACE_REG_WRITE = 0,	// register write (instant event)
+	TRACE_POLL,		// busy-wait poll loop (complete event, value = no. of polls)
+	TRACE_WAIT,		// time delay (complete event)
+	TRACE_BEGIN,		// transaction begin
+	TRACE_END		// transaction end
+};
+
+/* Record categories */
+enum {
+	TRACE_GPIO = 0,
+	TRACE_PWM,
+	TRACE_I2C,
+	TRACE_SPI,
+	TRACE_TIMER
+};
+
+typedef struct {
+	uint64_t ts;		// start time stamp (ns)
+	const char *name;	// event name (static string)
+	uintptr_t addr;		// register address
+	uint32_t value;		// register value or no. of polls
+	uint32_t dur;		// duration (ns)
+	uint8_t type;
+	uint8_t cat;
+} trace_rec_t;
+
+/* Start recording, size = no. of records of each thread ring (0 = default size), also resizes the existing rings */
+void rpi_trace_start(uint32_t size);
+
+/* Stop recording, the recorded data is kept until rpi_trace_clear() */
+void rpi_trace_stop();
+
+/* Discard all recorded data and free the rings of exited threads */
+void rpi_trace_clear();
+
+/* Write all recorded data to a Chrome trace event (Perfetto compatible) json file,
+ * returns the no. of events written or -1 on error
+ */
+int32_t rpi_trace_dump(const char *path);
+
+#if RPI_TRACE
+
+extern volatile uint8_t trace_on;
+
+void trace_record(uint8_t type, uint8_t cat, const char *name, volatile uint32_t *reg, uint32_t value, uint64_t ts, uint64_t dur);
+
+static inline uint64_t trace_now(){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+#define TRACE_ON		__builtin_expect(trace_on, 0)
+
+#define TRACE_REG(reg, value) \
+	do { if(TRACE_ON) trace_record(TRACE_REG_WRITE, 0, NULL, (reg), (value), trace_now(), 0); } while(0)
+#define TRACE_BEGIN(cat, name) \
+	do { if(TRACE_ON) trace_record(TRACE_BEGIN, (cat), (name), NULL, 0, trace_now(), 0); } while(0)
+#define TRACE_END(cat, name) \
+	do { if(TRACE_ON) trace_record(TRACE_END, (cat), (name), NULL, 0, trace_now(), 0); } while(0)
+/* Start time of a poll loop or delay, 0 when not tracing */
+#define TRACE_SPAN(t)		uint64_t t = TRACE_ON ? trace_now() : 0
+#define TRACE_POLL(cat, name, reg, t, polls) \
+	do { if(t) trace_record(TRACE_POLL, (cat), (name), (reg), (polls), (t), trace_now() - (t)); } while(0)
+#define TRACE_WAIT(name, t) \
+	do { if(t) trace_record(TRACE_WAIT, TRACE_TIMER, (name), NULL, 0, (t), trace_now() - (t)); } while(0)
+
+#else
+
+#define TRACE_REG(reg, value)			((void)0)
+#define TRACE_BEGIN(cat, name)			((void)0)
+#define TRACE_END(cat, name)			((void)0)
+#define TRACE_SPAN(t)				((void)0)
+#define TRACE_POLL(cat, name, reg, t, polls)	((void)0)
+#define TRACE_WAIT(name, t)			((void)0)
+
+#endif /* RPI_TRACE */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TRACE_H */
@@ -0,0 +1,94 @@
+/**
+ * buffer-pool.test.js
+ *
+ * 2017 Ed Alegrid <ealegrid@gmail.com>
+ */
+const assert = require('assert');
+const sinon = require('sinon');
+
+const rpi = require('./native-stub.js');
+const BufferPool = require('../lib/buffer-pool.js');
+
+describe('\nBuffer pool ...', function () {
+	afterEach(() => {
+		sinon.restore();
+	});
+
+	describe('Register a buffer of size bytes', function () {
+		it('should return the native id and a buffer view of the same size', function (done) {
+			sinon.stub(rpi, 'buf_register').returns(3);
+			let pool = new BufferPool();
+
+			let id = pool.register(16);
+
+			assert.strictEqual(id, 3);
+			assert.ok(rpi.buf_register.firstCall.args[0] instanceof ArrayBuffer);
+			assert.strictEqual(Buffer.isBuffer(pool.buffer(3)), true);
+			assert.strictEqual(pool.buffer(3).length, 16);
+			done();
+		});
+	});
+	describe('Register a SharedArrayBuffer', function () {
+		it('should share the memory with the buffer view', function (done) {
+			sinon.stub(rpi, 'buf_register').returns(0);
+			let pool = new BufferPool();
+			let sab = new SharedArrayBuffer(4);
+
+			pool.register(sab);
+			new Uint8Array(sab)[1] = 0x5a;
+
+			assert.strictEqual(rpi.buf_register.firstCall.args[0], sab);
+			assert.strictEqual(pool.buffer(0)[1], 0x5a);
+			done();
+		});
+	});
+	describe('Register an invalid buffer', function () {
+		it('should throw a TypeError w/o registering it', function (done) {
+			sinon.stub(rpi, 'buf_register').returns(0);
+			let pool = new BufferPool();
+
+			assert.throws(() => pool.register('abc'), TypeError);
+			assert.throws(() => pool.register(Buffer.alloc(4)), { message:'ArrayBuffer, SharedArrayBuffer or size required' });
+			assert.strictEqual(rpi.buf_register.callCount, 0);
+			done();
+		});
+	});
+	describe('Register a buffer when the native pool is full', function () {
+		it('should throw an error', function (done) {
+			sinon.stub(rpi, 'buf_register').returns(-1);
+			let pool = new BufferPool();
+
+			assert.throws(() => pool.register(8), { message:'Buffer pool is full' });
+			done();
+		});
+	});
+	describe('Get the buffer of an unknown id', function () {
+		it('should throw an error', function (done) {
+			let pool = new BufferPool();
+
+			assert.throws(() => pool.buffer(5), { message:'Invalid buffer id 5' });
+			done();
+		});
+	});
+	describe('Unregister and close', function () {
+		it('should only release the buffers registered in this pool', function (done) {
+			let ids = [1, 2];
+			sinon.stub(rpi, 'buf_register').callsFake(() => ids.shift());
+			sinon.stub(rpi, 'buf_unregister');
+			let pool = new BufferPool();
+
+			pool.register(4);
+			pool.register(4);
+			pool.unregister(1);
+			pool.unregister(1);
+			pool.unregister(7);
+			assert.deepStrictEqual(rpi.buf_unregister.args, [[1]]);
+			assert.throws(() => pool.buffer(1), { message:'Invalid buffer id 1' });
+
+			pool.close();
+			assert.deepStrictEqual(rpi.buf_unregister.args, [[1], [2]]);
+			assert.throws(() => pool.buffer(2), { message:'Invalid buffer id 2' });
+			done();
+		});
+	});
+});
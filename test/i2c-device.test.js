@@ -0,0 +1,163 @@
+/**
+ * i2c-device.test.js
+ *
+ * 2017 Ed Alegrid <ealegrid@gmail.com>
+ */
+const assert = require('assert');
+const sinon = require('sinon');
+
+const rpi = require('./native-stub.js');
+const I2CDevice = require('../lib/i2c-device.js');
+
+/* buffers of the messages of each i2c_transfer() call */
+function sent () {
+	return rpi.i2c_transfer.args.map((a) => a[0].map((m) => [...m.buf]));
+}
+
+describe('\nI2C device handle ...', function () {
+	beforeEach(() => {
+		sinon.stub(rpi, 'i2c_use');
+		sinon.stub(rpi, 'i2c_set_slave_address');
+		sinon.stub(rpi, 'i2c_transfer').callsFake((msgs) => Buffer.alloc(msgs.length));
+		sinon.stub(rpi, 'i2c_write').returns(0);
+		sinon.stub(rpi, 'i2c_read').returns(0);
+	});
+
+	afterEach(() => {
+		sinon.restore();
+	});
+
+	describe('Create a device w/ an invalid address', function () {
+		it('should throw an error', function (done) {
+			assert.throws(() => new I2CDevice(1, 0x80), { message:'Invalid i2c slave address 128' });
+			assert.throws(() => new I2CDevice(1, -1), { message:'Invalid i2c slave address -1' });
+			assert.throws(() => new I2CDevice(1, 1.5), { message:'Invalid i2c slave address 1.5' });
+			done();
+		});
+	});
+	describe('Write to adjacent registers w/ combining', function () {
+		it('should merge the writes into one burst per run of registers, in order', function (done) {
+			let dev = new I2CDevice(1, 0x40, { combine:true });
+
+			assert.strictEqual(dev.write(Buffer.from([0x10, 1])), 0);
+			assert.strictEqual(dev.write(Buffer.from([0x11, 2, 3])), 0);
+			assert.strictEqual(dev.write(Buffer.from([0x13, 4])), 0);
+			assert.strictEqual(dev.write(Buffer.from([0x20, 5])), 0);
+			assert.strictEqual(dev.write(Buffer.from([0x14, 6])), 0);
+			assert.strictEqual(rpi.i2c_transfer.callCount, 0);
+
+			assert.strictEqual(dev.flush(), 0);
+			assert.deepStrictEqual(sent(), [[[0x10, 1, 2, 3, 4], [0x20, 5], [0x14, 6]]]);
+			assert.strictEqual(rpi.i2c_transfer.firstCall.args[1], 0x40);
+			done();
+		});
+	});
+	describe('Merge writes w/ an autoIncrement bit', function () {
+		it('should set the bit on merged writes only', function (done) {
+			let dev = new I2CDevice(1, 0x40, { combine:true, autoIncrement:0x80 });
+
+			dev.write(Buffer.from([0x02, 1]));
+			dev.write(Buffer.from([0x03, 2]));
+			dev.write(Buffer.from([0x08, 3]));
+			dev.flush();
+
+			assert.deepStrictEqual(sent(), [[[0x82, 1, 2], [0x08, 3]]]);
+			done();
+		});
+	});
+	describe('Write w/ combining and a length shorter than the buffer', function () {
+		it('should only queue len bytes and copy them', function (done) {
+			let dev = new I2CDevice(1, 0x40, { combine:true });
+			let buf = Buffer.from([0x01, 0xaa, 0xbb]);
+
+			dev.write(buf, 2);
+			buf[1] = 0;
+			dev.flush();
+
+			assert.deepStrictEqual(sent(), [[[0x01, 0xaa]]]);
+			done();
+		});
+	});
+	describe('Write a register address only w/ combining', function () {
+		it('should not be queued', function (done) {
+			let dev = new I2CDevice(1, 0x40, { combine:true });
+
+			dev.write(Buffer.from([0x05]));
+
+			assert.strictEqual(rpi.i2c_write.callCount, 1);
+			assert.strictEqual(rpi.i2c_transfer.callCount, 0);
+			done();
+		});
+	});
+	describe('Read after combined writes', function () {
+		it('should send the queued writes before the read', function (done) {
+			let dev = new I2CDevice(1, 0x40, { combine:true });
+
+			dev.write(Buffer.from([0x01, 1]));
+			dev.read(Buffer.alloc(2), 2);
+
+			assert.deepStrictEqual(sent(), [[[0x01, 1]]]);
+			assert.ok(rpi.i2c_transfer.calledBefore(rpi.i2c_read));
+			assert.strictEqual(rpi.i2c_set_slave_address.firstCall.args[0], 0x40);
+			done();
+		});
+	});
+	describe('Combined writes at the end of the tick', function () {
+		it('should be sent in one call', function (done) {
+			let dev = new I2CDevice(1, 0x40, { combine:true });
+
+			dev.write(Buffer.from([0x01, 1]));
+			dev.write(Buffer.from([0x02, 2]));
+
+			process.nextTick(() => {
+				assert.deepStrictEqual(sent(), [[[0x01, 1, 2]]]);
+				done();
+			});
+		});
+	});
+	describe('Write in a batch()', function () {
+		it('should merge the writes w/o combining and return the flush status', function (done) {
+			let dev = new I2CDevice(1, 0x40);
+			rpi.i2c_transfer.callsFake(() => Buffer.from([0, 4]));
+
+			let status = dev.batch((d) => {
+				d.write(Buffer.from([0x01, 1]));
+				d.write(Buffer.from([0x02, 2]));
+				d.write(Buffer.from([0x07, 3]));
+			});
+
+			assert.strictEqual(status, 4);
+			assert.deepStrictEqual(sent(), [[[0x01, 1, 2], [0x07, 3]]]);
+			assert.strictEqual(dev.status, 4);
+			dev.clearStatus();
+			assert.strictEqual(dev.status, 0);
+			done();
+		});
+	});
+	describe('Throw in a batch()', function () {
+		it('should still send the writes queued before the exception', function (done) {
+			let dev = new I2CDevice(1, 0x40);
+
+			assert.throws(() => dev.batch((d) => {
+				d.write(Buffer.from([0x01, 1]));
+				throw new Error('abort');
+			}), { message:'abort' });
+
+			assert.deepStrictEqual(sent(), [[[0x01, 1]]]);
+			done();
+		});
+	});
+	describe('Turn combining off', function () {
+		it('should send the queued writes and write directly afterwards', function (done) {
+			let dev = new I2CDevice(1, 0x40, { combine:true });
+
+			dev.write(Buffer.from([0x01, 1]));
+			dev.setCombining(false);
+			dev.write(Buffer.from([0x02, 2]));
+
+			assert.deepStrictEqual(sent(), [[[0x01, 1]]]);
+			assert.strictEqual(rpi.i2c_write.callCount, 1);
+			done();
+		});
+	});
+});
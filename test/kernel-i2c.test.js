@@ -0,0 +1,106 @@
+/**
+ * kernel-i2c.test.js
+ *
+ * 2017 Ed Alegrid <ealegrid@gmail.com>
+ */
+const assert = require('assert');
+const sinon = require('sinon');
+
+const rpi = require('./native-stub.js');
+const KernelI2C = require('../lib/kernel-i2c.js');
+
+describe('\nKernel i2c driver ...', function () {
+	let i2c = null;
+
+	beforeEach(() => {
+		sinon.stub(rpi, 'kdev_i2c_open').returns(3);
+		sinon.stub(rpi, 'kdev_i2c_transfer').callsFake((id, msgs) => Buffer.alloc(msgs.length));
+		sinon.stub(rpi, 'kdev_i2c_transfer_async').callsFake((id, msgs) => Promise.resolve(Buffer.alloc(msgs.length)));
+		sinon.stub(rpi, 'kdev_close');
+		i2c = new KernelI2C(1);
+		i2c.selectSlave(0x48);
+	});
+
+	afterEach(() => {
+		i2c.end();
+		sinon.restore();
+	});
+
+	describe('Open a bus w/o a driver', function () {
+		it('should throw an error', function (done) {
+			rpi.kdev_i2c_open.returns(-1);
+
+			assert.throws(() => new KernelI2C(7), { message:'Cannot open /dev/i2c-7' });
+			done();
+		});
+	});
+	describe('Write then read', function () {
+		it('should send a write w/ nostop followed by a read, to the selected slave', function (done) {
+			let wbuf = Buffer.from([0x05, 0x06]), rbuf = Buffer.alloc(4);
+
+			assert.strictEqual(i2c.writeRead(wbuf, 1, rbuf, 2), 0);
+			let [id, msgs, addr] = rpi.kdev_i2c_transfer.firstCall.args;
+
+			assert.strictEqual(id, 3);
+			assert.strictEqual(addr, 0x48);
+			assert.deepStrictEqual(msgs, [{ buf:wbuf, length:1, nostop:true }, { buf:rbuf, length:2, read:true }]);
+			done();
+		});
+	});
+	describe('Write and read w/o a length', function () {
+		it('should send one message of the whole buffer', function (done) {
+			let wbuf = Buffer.alloc(3), rbuf = Buffer.alloc(2);
+
+			i2c.write(wbuf);
+			i2c.read(rbuf);
+
+			assert.deepStrictEqual(rpi.kdev_i2c_transfer.firstCall.args[1], [{ buf:wbuf, length:3, nostop:false }]);
+			assert.deepStrictEqual(rpi.kdev_i2c_transfer.secondCall.args[1], [{ buf:rbuf, length:2, read:true }]);
+			done();
+		});
+	});
+	describe('Write then read w/ a failed message', function () {
+		it('should return the first failed status', function (done) {
+			rpi.kdev_i2c_transfer.returns(Buffer.from([0, 1]));
+			assert.strictEqual(i2c.writeRead(Buffer.alloc(1), 1, Buffer.alloc(1), 1), 1);
+
+			rpi.kdev_i2c_transfer.returns(Buffer.from([4, 1]));
+			assert.strictEqual(i2c.writeRead(Buffer.alloc(1), 1, Buffer.alloc(1), 1), 4);
+			done();
+		});
+	});
+	describe('Scan the bus', function () {
+		it('should probe each address w/ a quick write', function (done) {
+			rpi.kdev_i2c_transfer.callsFake((id, msgs) => Buffer.from([msgs[0].addr === 0x20 ? 0 : 1]));
+
+			assert.deepStrictEqual(i2c.scan({ first:0x1e, last:0x22 }), [0x20]);
+			assert.strictEqual(rpi.kdev_i2c_transfer.callCount, 5);
+			assert.strictEqual(rpi.kdev_i2c_transfer.firstCall.args[1][0].buf.length, 0);
+			done();
+		});
+	});
+	describe('Async write then read', function () {
+		it('should resolve w/ the first failed status', function (done) {
+			rpi.kdev_i2c_transfer_async.callsFake(() => Promise.resolve(Buffer.from([0, 2])));
+			let wbuf = Buffer.alloc(1), rbuf = Buffer.alloc(2);
+
+			i2c.writeReadAsync(wbuf, 1, rbuf, 2).then((status) => {
+				assert.strictEqual(status, 2);
+				assert.deepStrictEqual(rpi.kdev_i2c_transfer_async.firstCall.args[1], [{ buf:wbuf, length:1, nostop:true }, { buf:rbuf, length:2, read:true }]);
+				done();
+			}).catch(done);
+		});
+	});
+	describe('Transfer after end()', function () {
+		it('should throw or reject w/ an error', function (done) {
+			i2c.end();
+			assert.strictEqual(rpi.kdev_close.firstCall.args[0], 3);
+
+			assert.throws(() => i2c.read(Buffer.alloc(1)), { message:'I2C is not started' });
+			i2c.readAsync(Buffer.alloc(1)).then(() => done(new Error('resolved')), (e) => {
+				assert.strictEqual(e.message, 'I2C is not started');
+				done();
+			}).catch(done);
+		});
+	});
+});
@@ -0,0 +1,19 @@
+/**
+ * native-stub.js
+ *
+ * 2017 Ed Alegrid <ealegrid@gmail.com>
+ *
+ * Loads lib/rpi.js w/o the native addon, so the JS-only logic can be tested on any host.
+ * The node_rpi functions are no-ops returning 0, stub the rpi.js methods a test uses w/ sinon.
+ */
+const Module = require('module');
+const load = Module._load;
+
+Module._load = function (request, parent, isMain) {
+	if(request === 'bindings'){
+		return () => new Proxy({}, { get:() => () => 0 });
+	}
+	return load.call(this, request, parent, isMain);
+};
+
+module.exports = require('../lib/rpi.js');
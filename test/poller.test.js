@@ -0,0 +1,95 @@
+/**
+ * poller.test.js
+ *
+ * 2017 Ed Alegrid <ealegrid@gmail.com>
+ */
+const assert = require('assert');
+const sinon = require('sinon');
+
+const rpi = require('./native-stub.js');
+const Poller = require('../lib/poller.js');
+
+describe('\nI2C poller ...', function () {
+	let poller = null;
+
+	beforeEach(() => {
+		sinon.stub(rpi, 'i2c_use');
+		sinon.stub(rpi, 'poller_start').returns(0);
+		sinon.stub(rpi, 'poller_add').returns(0);
+		sinon.stub(rpi, 'poller_stop');
+		poller = new Poller({ slots:4, dataSize:8 });
+	});
+
+	afterEach(() => {
+		poller.stop();
+		sinon.restore();
+	});
+
+	describe('Start a poller', function () {
+		it('should pass the slot layout to the native scheduler', function (done) {
+			let [buf, slots, slotSize] = rpi.poller_start.firstCall.args;
+
+			assert.strictEqual(buf, poller.buffer);
+			assert.strictEqual(slots, 4);
+			assert.strictEqual(slotSize, 40);
+			assert.strictEqual(buf.byteLength, 32 + 4*40);
+			assert.strictEqual(rpi.i2c_use.firstCall.args[0], 1);
+			done();
+		});
+	});
+	describe('Start a second poller', function () {
+		it('should throw an error', function (done) {
+			assert.throws(() => new Poller(), { message:'I2C poller is already running' });
+			done();
+		});
+	});
+	describe('Start a poller when the native start fails', function () {
+		it('should throw an error and allow a new start', function (done) {
+			poller.stop();
+			rpi.poller_start.returns(1);
+			assert.throws(() => new Poller(), { message:'I2C poller start failed' });
+
+			rpi.poller_start.returns(0);
+			poller = new Poller({ bus:0 });
+			assert.strictEqual(rpi.i2c_use.lastCall.args[0], 0);
+			done();
+		});
+	});
+	describe('Add a valid job', function () {
+		it('should return the slot id, the period in us', function (done) {
+			rpi.poller_add.returns(2);
+
+			assert.strictEqual(poller.add(0x48, [0x00], 2, 10), 2);
+			let [addr, cmd, length, period] = rpi.poller_add.firstCall.args;
+			assert.strictEqual(addr, 0x48);
+			assert.deepStrictEqual([...cmd], [0x00]);
+			assert.strictEqual(length, 2);
+			assert.strictEqual(period, 10000);
+			done();
+		});
+	});
+	describe('Add an invalid job', function () {
+		it('should throw an error w/o calling the native side', function (done) {
+			let msg = { message:'Invalid i2c poller job' };
+
+			assert.throws(() => poller.add(0x80, [0], 2, 10), msg);
+			assert.throws(() => poller.add(-1, [0], 2, 10), msg);
+			assert.throws(() => poller.add(0x48, new Array(17).fill(0), 2, 10), msg);
+			assert.throws(() => poller.add(0x48, [0], 0, 10), msg);
+			assert.throws(() => poller.add(0x48, [0], 9, 10), msg);
+			assert.throws(() => poller.add(0x48, [0], 1.5, 10), msg);
+			assert.throws(() => poller.add(0x48, [0], 2, 0), msg);
+			assert.throws(() => poller.add(0x48, [0], 2), msg);
+			assert.strictEqual(rpi.poller_add.callCount, 0);
+			done();
+		});
+	});
+	describe('Add a job w/o a free slot', function () {
+		it('should throw an error', function (done) {
+			rpi.poller_add.returns(-1);
+
+			assert.throws(() => poller.add(0x48, [], 8, 1), { message:'Invalid i2c poller job or no free slot' });
+			done();
+		});
+	});
+});
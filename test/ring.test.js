@@ -0,0 +1,83 @@
+/**
+ * ring.test.js
+ *
+ * 2017 Ed Alegrid <ealegrid@gmail.com>
+ */
+const assert = require('assert');
+const sinon = require('sinon');
+
+const rpi = require('./native-stub.js');
+const Ring = require('../lib/ring.js');
+
+// header word index and descriptor sizes (see src/ring.h)
+const HDR_WORDS = 16, SQE_WORDS = 8, H_ENTRIES = 3, H_DATA_OFFSET = 4, H_DATA_SIZE = 5, H_SQ_TAIL = 7;
+
+/* ring_start() of the native side, fills in the header */
+function start (buf, bus, entries) {
+	let hdr = new Uint32Array(buf, 0, HDR_WORDS);
+	let offset = HDR_WORDS*4 + entries*(8 + 4)*4;
+	hdr[H_ENTRIES] = entries;
+	hdr[H_DATA_OFFSET] = offset;
+	hdr[H_DATA_SIZE] = buf.byteLength - offset;
+	return 0;
+}
+
+describe('\nTransaction ring ...', function () {
+	beforeEach(() => {
+		sinon.stub(rpi, 'ring_start').callsFake(start);
+		sinon.stub(rpi, 'ring_enter');
+		sinon.stub(rpi, 'ring_stop');
+	});
+
+	afterEach(() => {
+		sinon.restore();
+	});
+
+	describe('Create a ring on an invalid bus', function () {
+		it('should throw an error', function (done) {
+			assert.throws(() => new Ring('uart'), { message:'Invalid ring bus uart' });
+			assert.throws(() => new Ring(), { message:'Invalid ring bus undefined' });
+			assert.strictEqual(rpi.ring_start.callCount, 0);
+			done();
+		});
+	});
+	describe('Create a ring when the native start fails', function () {
+		it('should throw an error', function (done) {
+			rpi.ring_start.returns(-1);
+
+			assert.throws(() => new Ring('i2c'), { message:'Ring start failed' });
+			done();
+		});
+	});
+	describe('Create a ring', function () {
+		it('should round the entries up to a power of 2 and map the bus', function (done) {
+			let ring = new Ring('spi', { entries:5, dataSize:64 });
+			let [buf, bus, entries] = rpi.ring_start.firstCall.args;
+
+			assert.strictEqual(buf, ring.buffer);
+			assert.strictEqual(bus, 1);
+			assert.strictEqual(entries, 8);
+			assert.strictEqual(ring.data.length, 64);
+
+			new Ring('i2c0');
+			assert.strictEqual(rpi.ring_start.lastCall.args[1], 2);
+			done();
+		});
+	});
+	describe('Queue more transactions than entries', function () {
+		it('should return false when the ring is full', function (done) {
+			let ring = new Ring('i2c', { entries:2 });
+
+			assert.strictEqual(ring.queue({ addr:0x48, txOffset:0, txLength:1, rxOffset:4, rxLength:2, userData:7 }), true);
+			assert.strictEqual(ring.queue({ rxLength:1 }), true);
+			assert.strictEqual(ring.queue({ rxLength:1 }), false);
+			assert.strictEqual(ring.submit(), 2);
+			assert.strictEqual(new Uint32Array(ring.buffer)[H_SQ_TAIL], 2);
+
+			let sq = new Uint32Array(ring.buffer, HDR_WORDS*4, 2*SQE_WORDS);
+			assert.deepStrictEqual([...sq.subarray(0, 7)], [7, 0x48, 0, 1, 4, 2, 1]);
+			assert.deepStrictEqual([...sq.subarray(8, 15)], [0, 0, 0, 0, 0, 1, 0]);
+			done();
+		});
+	});
+});
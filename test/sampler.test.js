@@ -0,0 +1,101 @@
+/**
+ * sampler.test.js
+ *
+ * 2017 Ed Alegrid <ealegrid@gmail.com>
+ */
+const assert = require('assert');
+const sinon = require('sinon');
+
+const rpi = require('./native-stub.js');
+const Sampler = require('../lib/sampler.js');
+
+describe('\nSPI sampler ...', function () {
+	beforeEach(() => {
+		sinon.stub(rpi, 'spi_dev_open').returns(5);
+		sinon.stub(rpi, 'spi_dev_close');
+		sinon.stub(rpi, 'sampler_start').returns(0);
+		sinon.stub(rpi, 'sampler_stop');
+	});
+
+	afterEach(() => {
+		sinon.restore();
+	});
+
+	describe('Start a sampler w/ a mcp3008', function () {
+		it('should pass the command bytes of the channel sequence', function (done) {
+			let s = new Sampler({ channels:[0, 1, 7], rate:1000, capacity:1000 });
+			let [buf, capacity, dev, cmd, len, channels, mask, shift, rate] = rpi.sampler_start.firstCall.args;
+
+			assert.strictEqual(buf, s.buffer);
+			assert.strictEqual(capacity, 1024);
+			assert.strictEqual(dev, 5);
+			assert.deepStrictEqual([...cmd], [0x01, 0x80, 0x00, 0x01, 0x90, 0x00, 0x01, 0xf0, 0x00]);
+			assert.strictEqual(len, 3);
+			assert.deepStrictEqual([...channels], [0, 1, 7]);
+			assert.strictEqual(mask, 0x3ff);
+			assert.strictEqual(shift, 0);
+			assert.strictEqual(rate, 1000);
+			assert.deepStrictEqual(rpi.spi_dev_open.firstCall.args, [0, 0, undefined, 128]);
+
+			s.stop();
+			assert.strictEqual(rpi.sampler_stop.callCount, 1);
+			assert.strictEqual(rpi.spi_dev_close.callCount, 1);
+			done();
+		});
+	});
+	describe('Start a sampler w/ a custom adc', function () {
+		it('should use its command length, mask and shift', function (done) {
+			let s = new Sampler({ adc:{ length:2, mask:0xfff, shift:2, command:(ch) => [0x80 | ch, 0, 0xff] }, channels:[3] });
+			let [, capacity, , cmd, len, , mask, shift, rate] = rpi.sampler_start.firstCall.args;
+
+			assert.strictEqual(capacity, 65536);
+			assert.deepStrictEqual([...cmd], [0x83, 0x00]);
+			assert.strictEqual(len, 2);
+			assert.strictEqual(mask, 0xfff);
+			assert.strictEqual(shift, 2);
+			assert.strictEqual(rate, 10000);
+			s.stop();
+			done();
+		});
+	});
+	describe('Start a second sampler', function () {
+		it('should throw an error', function (done) {
+			let s = new Sampler();
+
+			assert.throws(() => new Sampler(), { message:'SPI sampler is already running' });
+			s.stop();
+			done();
+		});
+	});
+	describe('Start a sampler w/ invalid options', function () {
+		it('should throw an error w/o opening a device', function (done) {
+			assert.throws(() => new Sampler({ adc:'ads1115' }), { message:'Invalid adc ads1115' });
+			assert.throws(() => new Sampler({ adc:{ length:3 } }), { message:'Invalid adc [object Object]' });
+			assert.throws(() => new Sampler({ adc:{ mask:0x1ffff, command:() => [] } }), { message:'Invalid adc mask, max. 16 bits' });
+			assert.throws(() => new Sampler({ adc:{ mask:-1, command:() => [] } }), { message:'Invalid adc mask, max. 16 bits' });
+			assert.throws(() => new Sampler({ adc:{ length:0, command:() => [] } }), { message:'Invalid adc command length' });
+			assert.throws(() => new Sampler({ adc:{ length:9, command:() => [] } }), { message:'Invalid adc command length' });
+			assert.throws(() => new Sampler({ channels:[] }), { message:'Invalid channel sequence' });
+			assert.throws(() => new Sampler({ channels:3 }), { message:'Invalid channel sequence' });
+			assert.throws(() => new Sampler({ channels:new Array(33).fill(0) }), { message:'Invalid channel sequence' });
+			assert.throws(() => new Sampler({ rate:0 }), { message:'Invalid sample rate 0' });
+			assert.throws(() => new Sampler({ rate:2000000 }), { message:'Invalid sample rate 2000000' });
+			assert.strictEqual(rpi.spi_dev_open.callCount, 0);
+			assert.strictEqual(rpi.sampler_start.callCount, 0);
+			done();
+		});
+	});
+	describe('Start a sampler when the native start fails', function () {
+		it('should close its device and throw an error', function (done) {
+			rpi.sampler_start.returns(1);
+
+			assert.throws(() => new Sampler(), { message:'SPI sampler start failed' });
+			assert.strictEqual(rpi.spi_dev_close.callCount, 1);
+			assert.strictEqual(rpi.spi_dev_close.firstCall.args[0], 5);
+
+			rpi.sampler_start.returns(0);
+			new Sampler().stop();
+			done();
+		});
+	});
+});